@@ -0,0 +1,155 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+#include "nkgt/mapped_file.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem;
+struct EncodedGeometry;
+struct ImpostorAtlas;
+
+enum class AssetType : std::uint32_t {
+    Raw,
+    Mesh,
+    Texture,
+    Shader,
+    EncodedMesh,
+    Impostor,
+};
+
+// On disk layout: PackHeader, entry_count PackEntries sorted by name_hash,
+// chunk_count PackChunks, then the chunk data. Every asset is split into
+// chunk_size sized pieces compressed independently with LZ4, so a single
+// asset decompresses on all workers at once.
+struct PackHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t entry_count;
+    std::uint32_t chunk_count;
+    std::uint64_t chunk_size;
+};
+
+struct PackEntry {
+    std::uint64_t name_hash;
+    AssetType type;
+    std::uint32_t first_chunk;
+    std::uint32_t chunk_count;
+    std::uint32_t reserved;
+    std::uint64_t size;
+
+    // Only meaningful for meshes, which hold the vertices followed by the
+    // 16-bit indices exactly as Geometry expects them. Encoded meshes hold
+    // the words of an EncodedGeometry and describe its decoded form.
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    std::uint32_t vertex_stride;
+    std::uint32_t padding;
+};
+
+// A chunk with compressed_size equal to its size is stored uncompressed.
+struct PackChunk {
+    std::uint64_t offset;
+    std::uint32_t compressed_size;
+    std::uint32_t size;
+};
+
+constexpr std::uint32_t pack_magic = 0x4b41504d; // "MPAK"
+constexpr std::uint32_t pack_version = 1;
+constexpr std::uint64_t pack_chunk_size = 256 * 1024;
+
+constexpr auto asset_name_hash(std::string_view name) -> std::uint64_t {
+    return Hash::string(name);
+}
+
+// Read only view of a pack file mapped into memory. Only the pages of the
+// table of contents and of the chunks actually decompressed get read.
+class AssetPack {
+public:
+    auto open(const char* path) -> bool;
+    auto close() -> void;
+
+    auto find(std::uint64_t name_hash) const -> const PackEntry*;
+
+    auto find(std::string_view name) const -> const PackEntry* {
+        return find(asset_name_hash(name));
+    }
+
+    auto entries() const -> std::span<const PackEntry> {
+        return _entries;
+    }
+
+    // Decompresses every chunk of entry in parallel into destination, which
+    // must hold at least entry.size bytes. Destination may be mapped GPU
+    // memory, chunks are written straight into it.
+    auto decompress(
+        const PackEntry& entry,
+        std::span<unsigned char> destination,
+        JobSystem& jobs
+    ) const -> bool;
+
+    auto read(
+        const PackEntry& entry,
+        JobSystem& jobs
+    ) const -> std::optional<std::vector<unsigned char>>;
+
+private:
+    MappedFile _file;
+    const unsigned char* _data = nullptr;
+    std::uint64_t _size = 0;
+    std::uint64_t _chunk_size = 0;
+    std::span<const PackEntry> _entries;
+    std::span<const PackChunk> _chunks;
+};
+
+// Builds pack files. Compression runs in parallel on the job system.
+class PackWriter {
+public:
+    auto add(
+        std::string_view name,
+        AssetType type,
+        std::span<const unsigned char> data
+    ) -> void;
+
+    auto add_mesh(
+        std::string_view name,
+        std::span<const unsigned char> data,
+        std::uint32_t vertex_count,
+        std::uint32_t index_count,
+        std::uint32_t vertex_stride
+    ) -> void;
+
+    auto add_encoded_mesh(
+        std::string_view name,
+        const EncodedGeometry& geometry
+    ) -> void;
+
+    // Stored as ImpostorAtlas::serialize writes it.
+    auto add_impostor(
+        std::string_view name,
+        const ImpostorAtlas& atlas
+    ) -> void;
+
+    auto write(
+        const char* path,
+        JobSystem& jobs
+    ) const -> bool;
+
+private:
+    struct Asset {
+        PackEntry entry;
+        std::string name;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Asset> _assets;
+};
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+#include "nkgt/material.hpp"
+#include "nkgt/pipeline.hpp"
+#include "nkgt/render_server.hpp"
+#include "nkgt/task.hpp"
+#include "nkgt/timeline.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <latch>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Motorino {
+
+// Sessions a batch renders one size with at most. Each keeps
+// max_frames_in_flight frames going, which bounds the memory a batch holds.
+constexpr std::uint32_t max_batch_sessions = 4;
+
+struct RenderJob {
+    PipelineState pipeline;
+    Mesh mesh;
+    // Parameter block the shaders read the view from.
+    Material camera;
+    std::uint32_t width;
+    std::uint32_t height;
+    // Written as a PAM image with sRGB RGB_ALPHA tuples.
+    std::string output;
+};
+
+struct BatchStats {
+    std::uint32_t images;
+    std::uint32_t failed;
+    double seconds;
+
+    auto images_per_second() const -> double {
+        return seconds > 0.0 ? images / seconds : 0.0;
+    }
+};
+
+// Offline rendering of a queue of jobs on a RenderServer. Jobs of one size
+// are spread over a few sessions kept full with frames in flight, and every
+// finished frame is written to disk on the job system straight from its
+// readback buffer while later ones render. Sessions and pipelines are kept
+// between runs, so jobs of a size seen before reuse their attachments.
+class BatchRenderer {
+public:
+    explicit BatchRenderer(RenderServer& server);
+    ~BatchRenderer();
+
+    BatchRenderer(const BatchRenderer&) = delete;
+    auto operator=(const BatchRenderer&) -> BatchRenderer& = delete;
+
+    auto enqueue(RenderJob job) -> void;
+
+    // Renders every job queued so far and returns once all outputs are
+    // written. The throughput is logged as well.
+    auto run() -> BatchStats;
+
+private:
+    struct Progress {
+        std::latch done;
+        std::atomic<std::uint32_t> failed;
+    };
+
+    auto sessions(
+        std::uint32_t width,
+        std::uint32_t height,
+        std::uint32_t count
+    ) -> const std::vector<RenderSession*>&;
+
+    auto write(
+        RenderSession* session,
+        std::uint64_t frame,
+        TimelineAwaitable rendered,
+        const RenderJob* job,
+        Progress* progress
+    ) -> Task<void>;
+
+    RenderServer& _server;
+    std::mutex _mutex;
+    std::vector<RenderJob> _queue;
+    // Sessions by width in the high and height in the low half.
+    std::unordered_map<std::uint64_t, std::vector<RenderSession*>, Hash::Identity> _sessions;
+};
+
+}
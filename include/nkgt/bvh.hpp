@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Motorino {
+
+// Triangles a leaf holds at most. Larger ranges are split even when the
+// SAH would rather keep them, unless they reached max_bvh_depth.
+constexpr std::uint32_t max_bvh_leaf_size = 8;
+
+// Levels below the root at most, whatever the leaves hold then. Bounds the
+// traversal stack of shaders/ray_lighting.comp, which holds at most one
+// node more than this.
+constexpr std::uint32_t max_bvh_depth = 48;
+
+// Laid out as the GPU reads it. Interior nodes have a count of 0 and their
+// two children at first and first + 1, leaves hold count triangles from
+// first on.
+struct BvhNode {
+    float lower[3];
+    std::uint32_t first;
+    float upper[3];
+    std::uint32_t count;
+};
+
+// A vertex and the two edges leaving it, ready for the ray triangle test.
+struct BvhTriangle {
+    float vertex[3];
+    // Index of the triangle in the mesh the BVH was built from.
+    std::uint32_t index;
+    float edge1[3];
+    float padding0;
+    float edge2[3];
+    float padding1;
+};
+
+struct Bvh {
+    // The root first.
+    std::vector<BvhNode> nodes;
+    // In leaf order.
+    std::vector<BvhTriangle> triangles;
+};
+
+// Binned SAH build over an indexed triangle list, positions given as xyz
+// triplets. Returns an empty BVH for an empty mesh or out of range indices.
+auto build_bvh(
+    std::span<const float> positions,
+    std::span<const std::uint32_t> indices
+) -> Bvh;
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem;
+struct Geometry;
+
+// Limits of one cluster, the unit of culling and of level of detail.
+constexpr std::uint32_t cluster_max_triangles = 128;
+constexpr std::uint32_t cluster_max_vertices = 128;
+
+// Clusters simplified together, whose shared border is locked.
+constexpr std::uint32_t cluster_group_size = 4;
+
+// Bytes of a page, the unit of streaming. Pages hold whole groups.
+constexpr std::uint32_t cluster_page_size = 64 * 1024;
+
+// Groups of the whole mesh at most, and pages. Each keeps a table entry on
+// the GPU.
+constexpr std::uint32_t max_cluster_groups = 1u << 24;
+constexpr std::uint32_t max_cluster_pages = 1u << 20;
+
+// Marks a level 0 cluster, which wasn't simplified from any group.
+constexpr std::uint32_t no_cluster_group = UINT32_MAX;
+
+struct ClusterBuildSettings {
+    // Where every part keeps the float3 position and the float3 color of a
+    // vertex. Page vertices carry the color as sRGB RGBA8 next to the
+    // position, white for parts without one.
+    std::uint32_t position_offset = 0;
+    std::uint32_t color_offset = UINT32_MAX;
+};
+
+// Clusters a group was simplified into are drawn in place of the group's
+// own clusters once error, a world space distance, projects to few enough
+// pixels from anywhere in the sphere. The sphere of a group holds the
+// spheres of every group below it and its error is never smaller than
+// theirs, so the choice only ever goes one way along the hierarchy. Groups
+// of the last level are the roots, their error is FLT_MAX.
+struct ClusterGroup {
+    float center[3];
+    float radius;
+    float error;
+    std::uint32_t page;
+    std::uint32_t padding[2];
+};
+
+struct Cluster {
+    // Bounds of the cluster alone, for culling.
+    float center[3];
+    float radius;
+    // Group the cluster belongs to, and the group it was simplified from or
+    // no_cluster_group.
+    std::uint32_t group;
+    std::uint32_t source;
+    // In 4 byte words from the start of the page: vertex_count vertices of
+    // four words, xyz and the RGBA8 color, then one word per triangle
+    // holding its three 8-bit vertex indices.
+    std::uint32_t offset;
+    // Vertex count in the low 16 bits, triangle count in the high ones.
+    std::uint32_t counts;
+};
+
+// Pages holding the groups the clusters of this page were simplified
+// into. A page is only made resident after all of them, so wherever a
+// group is drawn the coarser ones above it are available.
+struct ClusterPage {
+    std::uint32_t first_dependency;
+    std::uint32_t dependency_count;
+};
+
+struct ClusterMesh {
+    std::vector<ClusterGroup> groups;
+    std::vector<Cluster> clusters;
+    std::vector<ClusterPage> pages;
+    std::vector<std::uint32_t> dependencies;
+    // cluster_page_size bytes per page.
+    std::vector<unsigned char> page_data;
+    // Pages of root groups only, the first ones. They never depend on
+    // another page and stay resident.
+    std::uint32_t root_pages = 0;
+};
+
+// On disk layout: ClusterFileHeader, group_count ClusterGroups,
+// cluster_count Clusters, page_count ClusterPages and dependency_count
+// page indices, then the pages from page_offset on, uncompressed so any
+// one of them is read alone.
+struct ClusterFileHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t group_count;
+    std::uint32_t cluster_count;
+    std::uint32_t page_count;
+    std::uint32_t root_pages;
+    std::uint32_t dependency_count;
+    std::uint32_t reserved;
+    std::uint64_t page_offset;
+};
+
+constexpr std::uint32_t cluster_file_magic = 0x554c434d; // "MCLU"
+constexpr std::uint32_t cluster_file_version = 1;
+
+// Splits the triangles of the parts into clusters, then repeatedly
+// simplifies groups of neighboring clusters to about half their triangles
+// and splits the result into clusters again, until a single cluster is
+// left. A group that no longer simplifies passes its clusters up as they
+// are. Vertices along the border of a group stay in place, so neighbors
+// simplified apart still meet without cracks.
+// The parts are welded into one mesh first, joining vertices at exactly the
+// same position with the color of the first, so part seams simplify like
+// any other edge.
+auto build_cluster_mesh(
+    std::span<const Geometry> parts,
+    const ClusterBuildSettings& settings,
+    JobSystem& jobs
+) -> std::optional<ClusterMesh>;
+
+auto write_cluster_mesh(
+    const ClusterMesh& mesh,
+    const char* path
+) -> bool;
+
+struct ClusterMeshSettings {
+    // Pages resident at once. The least recently used page no resident page
+    // depends on is evicted to make room for a new one.
+    std::uint32_t pool_pages = 512;
+    // Pixels the simplification error may project to on screen.
+    float max_error = 1.0f;
+};
+
+struct ClusterCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+    float position[3];
+    // Viewport height divided by the vertical field of view.
+    float pixels_per_radian;
+};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkDescriptorSetLayout_T* VkDescriptorSetLayout;
+typedef struct VkPipelineLayout_T* VkPipelineLayout;
+typedef struct VkPipeline_T* VkPipeline;
+
+namespace Motorino {
+
+// Values mirror VkDescriptorType.
+enum class DescriptorType : std::uint32_t {
+    CombinedImageSampler = 1,
+    StorageImage         = 3,
+    UniformBuffer        = 6,
+    StorageBuffer        = 7,
+};
+
+// A compute shader with a single descriptor set whose bindings are numbered
+// in the order of the types given at creation, plus optional push constants.
+struct ComputePipeline {
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+};
+
+auto create_compute_pipeline(
+    VkDevice device,
+    std::span<const std::uint32_t> code,
+    std::span<const DescriptorType> bindings,
+    std::uint32_t push_constant_size,
+    ComputePipeline& pipeline
+) -> bool;
+
+auto destroy_compute_pipeline(
+    VkDevice device,
+    ComputePipeline& pipeline
+) -> void;
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkPhysicalDevice_T* VkPhysicalDevice;
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkBuffer_T* VkBuffer;
+typedef struct VkDeviceMemory_T* VkDeviceMemory;
+
+namespace Motorino {
+
+// Index of the first memory type allowed by type_bits that has every flag
+// of properties.
+auto find_memory_type(
+    VkPhysicalDevice physical_device,
+    std::uint32_t type_bits,
+    std::uint32_t properties,
+    std::uint32_t& index
+) -> bool;
+
+auto allocate_memory(
+    VkDevice device,
+    VkPhysicalDevice physical_device,
+    std::uint64_t size,
+    std::uint32_t type_bits,
+    std::uint32_t properties,
+    VkDeviceMemory& memory
+) -> bool;
+
+// Creates a buffer with memory of its own bound. It is shared by the queue
+// families given, exclusive to one when fewer than two are. Nothing is left
+// behind on failure, so callers may retry with other properties.
+auto create_buffer(
+    VkDevice device,
+    VkPhysicalDevice physical_device,
+    std::span<const std::uint32_t> queue_families,
+    std::uint64_t size,
+    std::uint32_t usage,
+    std::uint32_t properties,
+    VkBuffer& buffer,
+    VkDeviceMemory& memory
+) -> bool;
+
+}
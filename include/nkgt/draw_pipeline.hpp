@@ -0,0 +1,59 @@
+#pragma once
+
+#include "nkgt/compute.hpp"
+
+#include <cstdint>
+#include <span>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkDescriptorSetLayout_T* VkDescriptorSetLayout;
+typedef struct VkPipelineLayout_T* VkPipelineLayout;
+typedef struct VkPipeline_T* VkPipeline;
+typedef struct VkRenderPass_T* VkRenderPass;
+
+namespace Motorino {
+
+enum class DrawBlend : std::uint32_t {
+    Opaque,
+    // Straight alpha, as antialiased edges write their coverage.
+    Alpha,
+    // Colors already multiplied by their alpha.
+    Premultiplied,
+};
+
+// The draws of engine features, shaders built in as SPIR-V. Like a
+// ComputePipeline they have a single descriptor set, bindings numbered in
+// order and seen by both stages, and push constants seen by both stages.
+// Nothing comes from vertex buffers, vertices are pulled from storage
+// buffers or made up from gl_VertexIndex.
+struct DrawPipelineInfo {
+    std::span<const std::uint32_t> vertex_code;
+    std::span<const std::uint32_t> fragment_code;
+    std::span<const DescriptorType> bindings;
+    std::uint32_t push_constant_size = 0;
+    DrawBlend blend = DrawBlend::Opaque;
+};
+
+struct DrawPipeline {
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+};
+
+// Builds an unculled triangle list against subpass 0 of the engine render
+// pass, with dynamic viewport and scissor. Feature draws can't be picked,
+// the object ID attachment is left as the geometry wrote it.
+auto create_draw_pipeline(
+    VkDevice device,
+    VkRenderPass render_pass,
+    const DrawPipelineInfo& info,
+    DrawPipeline& pipeline
+) -> bool;
+
+auto destroy_draw_pipeline(
+    VkDevice device,
+    DrawPipeline& pipeline
+) -> void;
+
+}
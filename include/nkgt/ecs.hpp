@@ -0,0 +1,417 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+#include "nkgt/jobs.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace Motorino {
+
+struct Entity {
+    std::uint32_t index;
+    std::uint32_t generation;
+
+    friend constexpr auto operator==(Entity, Entity) -> bool = default;
+};
+
+constexpr Entity null_entity{ UINT32_MAX, 0 };
+
+using ComponentId = std::uint32_t;
+using ComponentMask = std::uint64_t;
+
+constexpr std::uint32_t max_components = 64;
+constexpr std::uint32_t ecs_chunk_size = 16 * 1024;
+constexpr std::uint32_t ecs_chunk_alignment = 64;
+
+// Components are plain data. They are moved between chunks with memcpy and
+// never have their destructor run.
+template<class T>
+concept Component = std::is_trivially_copyable_v<std::remove_const_t<T>> &&
+                    std::is_trivially_destructible_v<std::remove_const_t<T>> &&
+                    alignof(T) <= ecs_chunk_alignment;
+
+namespace detail {
+
+auto register_component(
+    std::uint32_t size,
+    std::uint32_t alignment,
+    std::uint64_t hash
+) -> ComponentId;
+
+}
+
+// Ids are handed out on first use, so they are only stable within a run.
+template<Component T>
+auto component_id() -> ComponentId {
+    if constexpr (std::is_const_v<T>) {
+        return component_id<std::remove_const_t<T>>();
+    }
+    else {
+        static const ComponentId id = detail::register_component(sizeof(T), alignof(T), Hash::type<T>());
+        return id;
+    }
+}
+
+// Components must be registered before a serialized world using them is
+// loaded, ids are otherwise only handed out on first use.
+template<Component... Ts>
+auto register_components() -> void {
+    (component_id<Ts>(), ...);
+}
+
+template<Component... Ts>
+auto component_mask() -> ComponentMask {
+    return ((ComponentMask{ 1 } << component_id<Ts>()) | ... | ComponentMask{ 0 });
+}
+
+struct Column {
+    ComponentId id;
+    std::uint32_t size;
+    std::uint32_t offset;
+};
+
+// A 16 KB block holding capacity entities of one archetype, one array per
+// component one after the other. Every chunk but the last of an archetype is
+// full, so row r always lives in chunk r / capacity.
+struct Chunk {
+    unsigned char* data;
+    std::uint32_t count;
+
+    // Per column, the world version of the last write.
+    std::vector<std::uint64_t> versions;
+};
+
+// Every entity with exactly the same set of components lives in the same
+// archetype. Entities lead each chunk, followed by the component columns.
+struct Archetype {
+    ComponentMask mask;
+    std::vector<Column> columns;
+    std::uint8_t column_index[max_components];
+    std::uint32_t capacity;
+    std::uint32_t count;
+    std::vector<Chunk> chunks;
+
+    auto column(ComponentId id) const -> std::uint32_t {
+        return column_index[id];
+    }
+
+    auto entities(const Chunk& chunk) const -> Entity* {
+        return reinterpret_cast<Entity*>(chunk.data);
+    }
+};
+
+// The part of one chunk a query visits.
+class ChunkView {
+public:
+    ChunkView(
+        const Archetype& archetype,
+        const Chunk& chunk,
+        std::uint32_t first
+    ) : _archetype{ &archetype },
+        _chunk{ &chunk },
+        _first{ first }
+    {}
+
+    auto size() const -> std::uint32_t {
+        return _chunk->count;
+    }
+
+    // Row of the first entity within its archetype. Rows are dense, so
+    // extraction can write this chunk to a fixed range of a GPU buffer.
+    auto first() const -> std::uint32_t {
+        return _first;
+    }
+
+    auto archetype() const -> const Archetype& {
+        return *_archetype;
+    }
+
+    auto entities() const -> std::span<const Entity> {
+        return { _archetype->entities(*_chunk), _chunk->count };
+    }
+
+    template<Component T>
+    auto get() const -> std::span<T> {
+        const Column& column = _archetype->columns[_archetype->column(component_id<T>())];
+        return { reinterpret_cast<T*>(_chunk->data + column.offset), _chunk->count };
+    }
+
+private:
+    const Archetype* _archetype;
+    const Chunk* _chunk;
+    std::uint32_t _first;
+};
+
+template<Component... Ts>
+class Query;
+
+// Owns every entity and component. Not thread safe: structural changes and
+// queries must not overlap, but par_each spreads one query over the workers.
+//
+// Change tracking is per chunk and column. Writes stamp the current version
+// and Query::changed_since skips chunks untouched since a given version, so
+// an extraction step only rewrites the instances that changed:
+//
+//     world.query<const Transform, const Renderable>()
+//          .changed_since(extracted)
+//          .each_chunk([&](const ChunkView& chunk) { ... });
+//     extracted = world.advance();
+class World {
+public:
+    World();
+    ~World();
+
+    World(const World&) = delete;
+    auto operator=(const World&) -> World& = delete;
+
+    template<Component... Ts>
+    auto create(const Ts&... components) -> Entity {
+        const Entity entity = create_entity(component_mask<Ts...>());
+        (write(entity, component_id<Ts>(), &components), ...);
+        return entity;
+    }
+
+    auto destroy(Entity entity) -> bool;
+    auto alive(Entity entity) const -> bool;
+
+    template<Component T>
+    auto has(Entity entity) const -> bool {
+        return alive(entity) && (_records[entity.index].archetype->mask & component_mask<T>()) != 0;
+    }
+
+    template<Component T>
+    auto get(Entity entity) const -> const T* {
+        return static_cast<const T*>(component(entity, component_id<T>(), false));
+    }
+
+    // Marks the component changed.
+    template<Component T>
+    auto get_mut(Entity entity) -> T* {
+        return static_cast<T*>(component(entity, component_id<T>(), true));
+    }
+
+    // Adds the component or overwrites it if the entity already has one.
+    template<Component T>
+    auto set(Entity entity, const T& value) -> bool {
+        const ComponentId id = component_id<T>();
+
+        if (!alive(entity)) return false;
+
+        if (!has<T>(entity) && !change_archetype(entity, _records[entity.index].archetype->mask | (ComponentMask{ 1 } << id))) {
+            return false;
+        }
+
+        write(entity, id, &value);
+        return true;
+    }
+
+    template<Component T>
+    auto remove(Entity entity) -> bool {
+        if (!has<T>(entity)) return false;
+        return change_archetype(entity, _records[entity.index].archetype->mask & ~component_mask<T>());
+    }
+
+    template<Component... Ts>
+    auto query() -> Query<Ts...> {
+        return Query<Ts...>(*this);
+    }
+
+    auto version() const -> std::uint64_t {
+        return _version;
+    }
+
+    // Returns the current version and starts a new one. Everything written
+    // so far has a version no greater than the returned one.
+    auto advance() -> std::uint64_t {
+        return _version++;
+    }
+
+    auto size() const -> std::uint32_t {
+        return _count;
+    }
+
+    auto archetypes() const -> std::span<const std::unique_ptr<Archetype>> {
+        return _archetypes;
+    }
+
+    // Appends the whole world to out: entity generations, then every
+    // archetype as the type hashes of its components and one contiguous
+    // array per column. Loading copies those arrays back chunk by chunk.
+    auto serialize(std::vector<unsigned char>& out) const -> void;
+
+    // Replaces the contents of the world. Entities keep their handles.
+    auto deserialize(std::span<const unsigned char> data) -> bool;
+
+    auto clear() -> void;
+
+    // Exchanges the contents of both worlds, so one can be loaded aside and
+    // only swapped in once everything else it goes with succeeded.
+    auto swap(World& other) -> void;
+
+private:
+    template<Component... Ts>
+    friend class Query;
+
+    struct Record {
+        Archetype* archetype;
+        std::uint32_t row;
+        std::uint32_t generation;
+    };
+
+    auto create_entity(ComponentMask mask) -> Entity;
+
+    auto archetype(ComponentMask mask) -> Archetype*;
+
+    auto allocate_chunk(Archetype& archetype) -> Chunk&;
+
+    auto allocate_row(
+        Archetype& archetype,
+        Entity entity
+    ) -> std::uint32_t;
+
+    auto release_row(
+        Archetype& archetype,
+        std::uint32_t row
+    ) -> void;
+
+    auto change_archetype(
+        Entity entity,
+        ComponentMask mask
+    ) -> bool;
+
+    auto component(
+        Entity entity,
+        ComponentId id,
+        bool mark_changed
+    ) const -> void*;
+
+    auto write(
+        Entity entity,
+        ComponentId id,
+        const void* value
+    ) -> void;
+
+    std::vector<std::unique_ptr<Archetype>> _archetypes;
+    std::unordered_map<ComponentMask, Archetype*> _archetype_lookup;
+    std::vector<Record> _records;
+    std::vector<std::uint32_t> _free_indices;
+    std::uint32_t _count;
+    std::uint64_t _version;
+};
+
+// Visits every entity having at least the components Ts. Components asked for
+// as non-const are marked changed in every chunk the query visits.
+template<Component... Ts>
+class Query {
+    static_assert(sizeof...(Ts) > 0);
+
+public:
+    explicit Query(World& world)
+        : _world{ &world },
+          _since{ 0 },
+          _filter_changes{ false }
+    {}
+
+    // Only visits chunks where one of Ts was written after version.
+    auto changed_since(std::uint64_t version) -> Query& {
+        _since = version;
+        _filter_changes = true;
+        return *this;
+    }
+
+    template<class Fn>
+    auto each_chunk(Fn&& fn) -> void {
+        for (const ChunkView& chunk : collect()) {
+            fn(chunk);
+        }
+    }
+
+    // Calls fn(entity, components...) for every matching entity.
+    template<class Fn>
+    auto each(Fn&& fn) -> void {
+        for (const ChunkView& chunk : collect()) {
+            visit(chunk, fn);
+        }
+    }
+
+    // Like each, with the chunks spread over the job system. fn runs
+    // concurrently and must only touch the entity it is given.
+    template<class Fn>
+    auto par_each(
+        JobSystem& jobs,
+        Fn&& fn
+    ) -> void {
+        const std::vector<ChunkView> chunks = collect();
+
+        jobs.parallel_for(static_cast<std::uint32_t>(chunks.size()), 1, [&](std::uint32_t begin, std::uint32_t end) {
+            for (std::uint32_t i = begin; i < end; ++i) {
+                visit(chunks[i], fn);
+            }
+        });
+    }
+
+private:
+    auto collect() -> std::vector<ChunkView> {
+        const ComponentMask mask = component_mask<Ts...>();
+        const ComponentId ids[] = { component_id<Ts>()... };
+        constexpr bool writes[] = { !std::is_const_v<Ts>... };
+
+        std::vector<ChunkView> views;
+
+        for (const auto& archetype : _world->_archetypes) {
+            if ((archetype->mask & mask) != mask) continue;
+
+            std::uint32_t columns[sizeof...(Ts)];
+            for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+                columns[i] = archetype->column(ids[i]);
+            }
+
+            for (std::size_t c = 0; c < archetype->chunks.size(); ++c) {
+                Chunk& chunk = archetype->chunks[c];
+
+                if (_filter_changes) {
+                    bool changed = false;
+
+                    for (const auto column : columns) {
+                        changed |= chunk.versions[column] > _since;
+                    }
+
+                    if (!changed) continue;
+                }
+
+                for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+                    if (writes[i]) chunk.versions[columns[i]] = _world->_version;
+                }
+
+                views.emplace_back(*archetype, chunk, static_cast<std::uint32_t>(c * archetype->capacity));
+            }
+        }
+
+        return views;
+    }
+
+    template<class Fn>
+    static auto visit(
+        const ChunkView& chunk,
+        Fn& fn
+    ) -> void {
+        const auto entities = chunk.entities();
+        const auto columns = std::make_tuple(chunk.get<Ts>()...);
+
+        for (std::uint32_t i = 0; i < chunk.size(); ++i) {
+            std::apply([&](const auto&... column) { fn(entities[i], column[i]...); }, columns);
+        }
+    }
+
+    World* _world;
+    std::uint64_t _since;
+    bool _filter_changes;
+};
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkBuffer_T* VkBuffer;
+
+namespace Motorino {
+
+// Lights past this many are ignored, which bounds the cost of a froxel.
+constexpr std::uint32_t max_fog_lights = 32;
+
+struct FogLight {
+    float position[3];
+    // Light fades to nothing at this distance.
+    float range;
+    float color[3];
+    float padding;
+};
+
+// The froxel grid covers the view frustum: x and y split the screen evenly,
+// z splits the distance to the camera from depth_start to depth_end
+// exponentially, so slices near the camera are thin.
+struct FogSettings {
+    std::uint32_t grid[3] = { 160, 90, 64 };
+    float depth_start = 0.5f;
+    float depth_end = 200.0f;
+
+    // Extinction per world unit at height zero, falling off exponentially
+    // with height when height_falloff is set.
+    float density = 0.02f;
+    float height_falloff = 0.0f;
+    float albedo[3] = { 1.0f, 1.0f, 1.0f };
+
+    // Henyey-Greenstein g, positive scatters forward.
+    float anisotropy = 0.3f;
+
+    // Direction the sun light travels in, and its color. Black disables it.
+    float sun_direction[3] = { 0.0f, -1.0f, 0.0f };
+    float sun_color[3] = { 0.0f, 0.0f, 0.0f };
+    float ambient[3] = { 0.0f, 0.0f, 0.0f };
+
+    // Share of the previous frames kept in a froxel. Higher is smoother but
+    // lags behind moving lights.
+    float history_weight = 0.9f;
+};
+
+// Points and clusters are fogged at the depth they were rasterized at,
+// taken back to the world through this camera, so it should be theirs.
+struct FogCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+    float position[3];
+};
+
+// Light and transmittance integrated from the camera to the far side of
+// every froxel, one uvec2 of packHalf2x16 (r, g) and (b, transmittance) per
+// froxel, x fastest then y then z. A fragment at screen uv and distance d
+// from the camera reads froxel
+//   (uv * grid.xy, log(d / depth_start) / log(depth_end / depth_start) * grid.z)
+// and shades color * transmittance + rgb.
+struct FogVolume {
+    VkBuffer integrated;
+    std::uint32_t grid[3];
+    float depth_start;
+    float depth_end;
+};
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "nkgt/spsc_queue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <thread>
+
+namespace Motorino {
+
+constexpr std::uint32_t capture_slot_count = 4;
+
+// Layout of the 4:2:0 frames written. Values match the planar flag of the
+// conversion shader.
+enum class YuvLayout : std::uint32_t {
+    NV12 = 0,
+    I420 = 1,
+};
+
+enum class CaptureContainer : std::uint32_t {
+    // Frames back to back without any header.
+    Raw,
+    // YUV4MPEG2, readable by ffmpeg and most players. Needs I420.
+    Y4M,
+};
+
+struct CaptureSettings {
+    const char* path;
+    YuvLayout layout = YuvLayout::I420;
+    CaptureContainer container = CaptureContainer::Y4M;
+    std::uint32_t frame_rate = 60;
+};
+
+// Writes converted frames to disk from its own thread. Frames live in slots,
+// persistently mapped readback buffers the GPU converts into. The renderer
+// acquires a free slot per captured frame and submits it once the GPU is done
+// with it, the encoder writes the slot straight out of mapped memory and
+// frees it again. When every slot is still queued the frame is dropped, so a
+// slow disk never stalls rendering.
+class FrameEncoder {
+public:
+    FrameEncoder();
+    ~FrameEncoder();
+
+    FrameEncoder(const FrameEncoder&) = delete;
+    auto operator=(const FrameEncoder&) -> FrameEncoder& = delete;
+
+    // slots holds capture_slot_count mappings of at least frame_size bytes.
+    auto start(
+        const CaptureSettings& settings,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::span<const unsigned char* const> slots
+    ) -> bool;
+
+    // Writes every submitted frame, then closes the file.
+    auto stop() -> void;
+
+    auto running() const -> bool {
+        return _thread.joinable();
+    }
+
+    // Returns a free slot, or nullopt and counts the frame as dropped.
+    auto acquire() -> std::optional<std::uint32_t>;
+
+    // Queues an acquired slot for writing. Only one thread may submit.
+    auto submit(std::uint32_t slot) -> void;
+
+    auto frame_size() const -> std::uint64_t {
+        return static_cast<std::uint64_t>(_width) * _height * 3 / 2;
+    }
+
+private:
+    auto encode() -> void;
+
+    std::ofstream _file;
+    std::uint32_t _width;
+    std::uint32_t _height;
+    const unsigned char* _slots[capture_slot_count];
+    std::atomic<bool> _busy[capture_slot_count];
+    SpscQueue<std::uint32_t, capture_slot_count> _queue;
+    // Submitted slot count, waited on by the encoder thread.
+    std::atomic<std::uint32_t> _submitted;
+    std::atomic<bool> _stop;
+    std::uint64_t _written;
+    std::atomic<std::uint64_t> _dropped;
+    bool _y4m;
+    std::thread _thread;
+};
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace Motorino {
+
+// Left, right, bottom, top, near and far planes of a column major Vulkan
+// view projection, normalized so plane distances are in world units. A
+// point p is inside when dot(plane.xyz, p) + plane.w >= 0 for every plane.
+auto frustum_planes(
+    const float (&view_projection)[16],
+    float (&planes)[6][4]
+) -> void;
+
+auto sphere_in_frustum(
+    const float (&planes)[6][4],
+    const float (&center)[3],
+    float radius
+) -> bool;
+
+}
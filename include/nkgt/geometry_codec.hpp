@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Motorino {
+
+struct Geometry;
+
+// Bit packed, quantized geometry decoded on the GPU by a compute pass. Every
+// vertex component is a float quantized to its own bit count between the
+// component's minimum and maximum; indices use just enough bits to address
+// every vertex. Only vertex types made entirely of floats can be encoded.
+//
+// Word layout, mirrored by shaders/decode_geometry.comp:
+//   [0] vertex count          [4] index bits
+//   [1] index count           [5] vertex stream offset (words)
+//   [2] component count       [6] index stream offset (words)
+//   [3] bits per vertex       [7] decoded stride (words)
+//   [8 + 4c] per component: bits, bit offset in vertex, minimum, scale
+//   vertex stream, index stream, one padding word
+struct EncodedGeometry {
+    std::vector<std::uint32_t> words;
+
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    std::uint32_t vertex_stride;
+
+    // Size of the decoded vertices followed by the 16-bit indices, rounded up
+    // to whole words.
+    auto decoded_size() const -> std::uint64_t {
+        const std::uint64_t size = static_cast<std::uint64_t>(vertex_count) * vertex_stride +
+                                   index_count * sizeof(std::uint16_t);
+        return (size + 3) / 4 * 4;
+    }
+};
+
+constexpr std::uint32_t encoded_header_words = 8;
+constexpr std::uint32_t encoded_component_words = 4;
+constexpr std::uint32_t max_encoded_components = 16;
+
+// component_bits holds one bit count (0 to 16) per float of the vertex.
+auto encode_geometry(
+    const Geometry& geometry,
+    std::span<const std::uint8_t> component_bits
+) -> std::optional<EncodedGeometry>;
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace Motorino::Hash {
+
+// 64-bit FNV-1a. Every function is constexpr so hashes of static data can be
+// folded at compile time and reused as map keys without rehashing.
+constexpr std::uint64_t offset_basis = 0xcbf29ce484222325ull;
+constexpr std::uint64_t prime = 0x100000001b3ull;
+
+constexpr auto bytes(
+    std::span<const unsigned char> data,
+    std::uint64_t seed = offset_basis
+) -> std::uint64_t {
+    for (const auto byte : data) {
+        seed ^= byte;
+        seed *= prime;
+    }
+
+    return seed;
+}
+
+constexpr auto string(
+    std::string_view str,
+    std::uint64_t seed = offset_basis
+) -> std::uint64_t {
+    for (const auto c : str) {
+        seed ^= static_cast<unsigned char>(c);
+        seed *= prime;
+    }
+
+    // Terminate so that ("ab", "c") and ("a", "bc") hash differently.
+    seed ^= 0xff;
+    seed *= prime;
+    return seed;
+}
+
+constexpr auto integer(
+    std::uint64_t value,
+    std::uint64_t seed = offset_basis
+) -> std::uint64_t {
+    for (std::uint32_t i = 0; i < 8; ++i) {
+        seed ^= (value >> (i * 8)) & 0xff;
+        seed *= prime;
+    }
+
+    return seed;
+}
+
+// Hash of the compiler's spelling of T. Stable across runs of one build, which
+// is enough to find types again in data written by an earlier run.
+template<class T>
+constexpr auto type() -> std::uint64_t {
+#ifdef _MSC_VER
+    return string(__FUNCSIG__);
+#else
+    return string(__PRETTY_FUNCTION__);
+#endif
+}
+
+// For keys that already are hashes, so std containers do not hash them again.
+struct Identity {
+    constexpr auto operator()(std::uint64_t key) const noexcept -> std::size_t {
+        return static_cast<std::size_t>(key);
+    }
+};
+
+}
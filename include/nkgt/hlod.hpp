@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem;
+struct Geometry;
+
+// A static object of the scene, placed by its transform. Only its triangles
+// and vertex colors make it into the proxies.
+struct HlodObject {
+    const Geometry* geometry;
+    // Column major object to world transform.
+    float transform[16];
+};
+
+struct HlodSettings {
+    // Where every object keeps the float3 position and the float3 color of
+    // a vertex. Proxy vertices average the colors they merge, white without
+    // one.
+    std::uint32_t position_offset = 0;
+    std::uint32_t color_offset = UINT32_MAX;
+
+    // Clusters with at most this many objects are not split further.
+    std::uint32_t leaf_objects = 8;
+
+    // Size of the cells proxy vertices are merged in, relative to the
+    // diameter of the cluster. Smaller keeps more detail.
+    float proxy_detail = 1.0f / 32.0f;
+};
+
+// Vertex of every proxy mesh.
+struct ProxyVertex {
+    float position[3];
+    float color[3];
+};
+
+// A cluster of objects close to each other. Splitting a cluster gives up to
+// eight children; leaves list the objects they hold. Every cluster has a
+// proxy, one merged and simplified mesh standing for all its objects.
+struct HlodNode {
+    float center[3];
+    float radius;
+
+    // World space deviation of the proxy from the objects, never smaller
+    // than the error of a child.
+    float error;
+
+    std::uint32_t first_child;
+    std::uint32_t child_count;
+    std::uint32_t first_object;
+    std::uint32_t object_count;
+    std::uint32_t proxy;
+};
+
+// Proxy meshes in the layout Geometry expects: ProxyVertex vertices followed
+// by 16-bit indices, in world space.
+struct HlodProxy {
+    std::vector<unsigned char> data;
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+};
+
+// Nodes are stored breadth first, the root first. objects lists object
+// indices, leaves refer to ranges of it.
+struct HlodTree {
+    std::vector<HlodNode> nodes;
+    std::vector<std::uint32_t> objects;
+    std::vector<HlodProxy> proxies;
+};
+
+// Clusters the objects and builds the proxy of every cluster on the job
+// system.
+auto build_hlod(
+    std::span<const HlodObject> objects,
+    const HlodSettings& settings,
+    JobSystem& jobs
+) -> std::optional<HlodTree>;
+
+// Walks the tree from the root and stops at the first cluster whose proxy
+// error projects to at most max_error pixels, appending its proxy to
+// proxies. Leaves close enough to need more detail append their objects.
+// pixels_per_radian is the viewport height divided by the vertical field of
+// view.
+auto select_hlod(
+    const HlodTree& tree,
+    const std::array<float, 3>& camera,
+    float pixels_per_radian,
+    float max_error,
+    std::vector<std::uint32_t>& objects,
+    std::vector<std::uint32_t>& proxies
+) -> void;
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkBuffer_T* VkBuffer;
+
+namespace Motorino {
+
+constexpr std::uint32_t sh_coefficient_count = 9;
+
+struct IblSettings {
+    // Equirectangular RGBA32F radiance, rows from +y down to -y. Direction
+    // (sin t cos p, cos t, sin t sin p) sits at u = p / 2pi + 1/2, v = t / pi.
+    std::span<const float> environment;
+    std::uint32_t width;
+    std::uint32_t height;
+
+    // Face size of the first specular mip, a power of two. Mip m holds
+    // roughness m / (mip_count - 1).
+    std::uint32_t cube_size = 128;
+    std::uint32_t mip_count = 6;
+    std::uint32_t specular_samples = 256;
+
+    std::uint32_t lut_size = 128;
+    std::uint32_t lut_samples = 512;
+
+    // Baked results are stored here, keyed by a hash of everything above.
+    const char* cache_directory = "ibl_cache";
+};
+
+// Byte offsets of the three results in the IBL buffer.
+//
+// irradiance: sh_coefficient_count vec4, RGB in xyz, in the order
+//   1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2 of the real SH basis. They
+//   are already convolved with the cosine lobe and divided by pi, so their
+//   sum weighted by the basis at n is the diffuse light for albedo one.
+// brdf: lut_size^2 uints, packHalf2x16(scale, bias) of the split sum
+//   approximation, columns by NdotV and rows by roughness.
+// specular: mip by mip, the +x, -x, +y, -y, +z and -z faces of
+//   cube_size >> mip texels per side, each texel RGBA16F as two
+//   packHalf2x16 uints.
+struct IblLayout {
+    std::uint64_t irradiance;
+    std::uint64_t brdf;
+    std::uint64_t specular;
+    std::uint64_t size;
+
+    std::uint32_t cube_size;
+    std::uint32_t mip_count;
+    std::uint32_t lut_size;
+};
+
+auto ibl_layout(
+    std::uint32_t cube_size,
+    std::uint32_t mip_count,
+    std::uint32_t lut_size
+) -> IblLayout;
+
+// The storage buffer a pipeline reads the IBL results from.
+struct IblMaps {
+    VkBuffer buffer;
+    IblLayout layout;
+};
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem;
+struct Geometry;
+
+// Views per side of an impostor atlas at most, so a cell index fits the 10
+// bits ImpostorInstance stores it in.
+constexpr std::uint32_t max_impostor_grid = 32;
+
+struct ImpostorSettings {
+    // The atlas holds grid * grid views of cell_size * cell_size pixels.
+    std::uint32_t grid = 8;
+    std::uint32_t cell_size = 64;
+
+    // Where the bake reads the float3 position and the float3 color of a
+    // vertex. The color becomes the albedo of the views, white without one.
+    std::uint32_t position_offset = 0;
+    std::uint32_t color_offset = UINT32_MAX;
+};
+
+// A mesh seen from a hemisphere of directions around +y. Cell (x, y) holds
+// the view from the direction hemi_octahedral_direction maps the cell center
+// to, so neighbouring cells hold neighbouring views and a shader can blend
+// the three closest ones. Every view is an orthographic projection of the
+// bounding sphere, with right = normalize(cross(up, d)) and up = +y, or -z
+// when looking straight down.
+//
+// Planes are grid * cell_size texels per side, rows top to bottom:
+//   albedo  RGBA8, alpha 0 where the view misses the mesh
+//   normal  RGBA8, the object space normal * 0.5 + 0.5
+struct ImpostorAtlas {
+    std::uint32_t grid;
+    std::uint32_t cell_size;
+    float center[3];
+    float radius;
+
+    std::vector<std::uint8_t> albedo;
+    std::vector<std::uint8_t> normal;
+
+    auto size() const -> std::uint32_t {
+        return grid * cell_size;
+    }
+
+    auto serialize(std::vector<unsigned char>& out) const -> void;
+    auto deserialize(std::span<const unsigned char> data) -> bool;
+};
+
+// Maps a point of [-1, 1]^2 to a unit direction with y >= 0 and back.
+auto hemi_octahedral_direction(
+    float u,
+    float v
+) -> std::array<float, 3>;
+
+auto hemi_octahedral_point(const std::array<float, 3>& direction) -> std::array<float, 2>;
+
+// Rasterizes every view on the CPU, one cell per job, so atlases bake
+// offline without a device. Takes the interleaved indexed triangle list the
+// engine draws.
+auto bake_impostor(
+    const Geometry& geometry,
+    const ImpostorSettings& settings,
+    JobSystem& jobs
+) -> std::optional<ImpostorAtlas>;
+
+// The three cells closest to a view direction and their blend weights,
+// which add up to one.
+struct ImpostorFrames {
+    std::uint32_t cells[3];
+    float weights[3];
+};
+
+auto impostor_frames(
+    std::uint32_t grid,
+    const std::array<float, 3>& direction
+) -> ImpostorFrames;
+
+// Per instance data of the impostor draw, see Engine::create_impostors: one
+// quad drawn once per instance, turned towards the camera in the vertex
+// shader and blending the three views in the fragment shader.
+struct ImpostorInstance {
+    // Center of the bounding sphere in world space.
+    float position[3];
+    float radius;
+    float weights[3];
+    // Cell indices y * grid + x, 10 bits each from the lowest.
+    std::uint32_t cells;
+};
+
+static_assert(sizeof(ImpostorInstance) == 32);
+
+struct ImpostorCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+    float position[3];
+    // Direction the light travels in.
+    float light[3];
+};
+
+// Splits instances by distance to the camera. Instances are only
+// translated, positions being their origins. Those closer than
+// switch_distance go to meshes as indices into positions and keep drawing
+// the full mesh, the rest are appended to impostors, far to near as the
+// impostor draw wants them.
+auto select_impostors(
+    const ImpostorAtlas& atlas,
+    std::span<const std::array<float, 3>> positions,
+    const std::array<float, 3>& camera,
+    float switch_distance,
+    std::vector<std::uint32_t>& meshes,
+    std::vector<ImpostorInstance>& impostors
+) -> void;
+
+}
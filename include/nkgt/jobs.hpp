@@ -0,0 +1,75 @@
+#pragma once
+
+#include "nkgt/task.hpp"
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem {
+public:
+    // A thread_count of 0 uses one worker per hardware thread minus one.
+    explicit JobSystem(std::uint32_t thread_count = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    auto operator=(const JobSystem&) -> JobSystem& = delete;
+
+    auto submit(std::function<void()> job) -> void;
+
+    // Runs the task to completion on the workers without waiting for it.
+    auto spawn(Task<void> task) -> void;
+
+    // Calls fn(begin, end) over [0, count) in batches of at most batch_size,
+    // using the calling thread as well. Returns once every batch is done.
+    auto parallel_for(
+        std::uint32_t count,
+        std::uint32_t batch_size,
+        const std::function<void(std::uint32_t, std::uint32_t)>& fn
+    ) -> void;
+
+    // Blocks until the queue is empty and no worker runs a job, including
+    // jobs submitted while waiting. Returns whether there was any.
+    auto wait_idle() -> bool;
+
+    auto thread_count() const -> std::uint32_t {
+        return static_cast<std::uint32_t>(_threads.size());
+    }
+
+    struct ScheduleAwaitable {
+        JobSystem* jobs;
+
+        auto await_ready() const noexcept -> bool { return false; }
+
+        auto await_suspend(std::coroutine_handle<> handle) -> void {
+            jobs->submit([handle] { handle.resume(); });
+        }
+
+        auto await_resume() const noexcept -> void {}
+    };
+
+    // co_await jobs.schedule() continues the coroutine on a worker thread.
+    auto schedule() -> ScheduleAwaitable {
+        return { this };
+    }
+
+private:
+    auto worker() -> void;
+
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void()>> _queue;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::condition_variable _idle;
+    std::uint32_t _running;
+    bool _stop;
+};
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace Motorino {
+
+// Read only view of a whole file mapped into memory. Pages are only read
+// from disk once touched.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+    auto open(const char* path) -> bool;
+    auto close() -> void;
+
+    auto data() const -> std::span<const unsigned char> {
+        return { _data, _size };
+    }
+
+private:
+    void* _file;
+    void* _mapping;
+    const unsigned char* _data;
+    std::uint64_t _size;
+};
+
+}
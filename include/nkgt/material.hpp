@@ -0,0 +1,123 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace Motorino {
+
+constexpr std::uint32_t material_alignment = 16;
+constexpr std::uint64_t material_buffer_size = 4 * 1024 * 1024;
+
+// Offset of a parameter block in units of material_alignment. This is the
+// index a draw pushes for its shaders to find their parameters with.
+struct Material {
+    std::uint32_t index;
+
+    friend constexpr auto operator==(Material, Material) -> bool = default;
+};
+
+constexpr Material null_material{ UINT32_MAX };
+
+struct MaterialRange {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// CPU copy of the material buffer. Every material is a parameter block of a
+// plain struct packed into one storage buffer that all pipelines share, so
+// adding a material never touches descriptors. Writes only record dirty
+// ranges, which the engine copies to the GPU in one batch before the next
+// frame that follows a change.
+class MaterialSystem {
+public:
+    explicit MaterialSystem(std::uint64_t capacity = material_buffer_size);
+
+    MaterialSystem(const MaterialSystem&) = delete;
+    auto operator=(const MaterialSystem&) -> MaterialSystem& = delete;
+
+    // pipeline is the PipelineState hash the material is drawn with.
+    template<class T>
+    requires std::is_trivially_copyable_v<T>
+    auto create(
+        std::uint64_t pipeline,
+        const T& parameters
+    ) -> Material {
+        return allocate(pipeline, &parameters, sizeof(T));
+    }
+
+    // Fails if the size of T differs from the one the material was created
+    // with.
+    template<class T>
+    requires std::is_trivially_copyable_v<T>
+    auto update(
+        Material material,
+        const T& parameters
+    ) -> bool {
+        return write(material, &parameters, sizeof(T));
+    }
+
+    auto destroy(Material material) -> void;
+
+    auto contains(Material material) const -> bool;
+
+    // Materials drawn with pipeline, so draws can be sorted to bind each
+    // pipeline once.
+    auto materials(std::uint64_t pipeline) const -> std::vector<Material>;
+
+    auto capacity() const -> std::uint64_t {
+        return _data.size();
+    }
+
+    // Packs the bytes of every range written since the last flush into
+    // bytes, ranges coalesced and sorted by offset. Returns false if nothing
+    // changed.
+    auto flush(
+        std::vector<MaterialRange>& ranges,
+        std::vector<unsigned char>& bytes
+    ) -> bool;
+
+    // Appends every material and the used part of the buffer to out.
+    auto serialize(std::vector<unsigned char>& out) const -> void;
+
+    // Replaces every material. The whole used range is dirty afterwards.
+    auto deserialize(std::span<const unsigned char> data) -> bool;
+
+    // Exchanges every material and dirty range with other, whose capacity
+    // must match.
+    auto swap(MaterialSystem& other) -> void;
+
+private:
+    struct Record {
+        std::uint64_t pipeline;
+        std::uint32_t size;
+    };
+
+    auto allocate(
+        std::uint64_t pipeline,
+        const void* parameters,
+        std::uint32_t size
+    ) -> Material;
+
+    auto write(
+        Material material,
+        const void* parameters,
+        std::uint32_t size
+    ) -> bool;
+
+    mutable std::mutex _mutex;
+    std::vector<unsigned char> _data;
+    std::uint64_t _end;
+    std::unordered_map<std::uint32_t, Record> _records;
+    // Freed blocks by aligned size, reused before growing _end.
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> _free;
+    std::unordered_map<std::uint64_t, std::vector<Material>, Hash::Identity> _groups;
+    std::vector<MaterialRange> _dirty;
+};
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace Motorino {
+
+// General 4x4 inverse by cofactors, column major like the input. Returns
+// false for a singular matrix.
+auto invert(
+    const float (&m)[16],
+    float (&out)[16]
+) -> bool;
+
+}
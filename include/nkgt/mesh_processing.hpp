@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Motorino {
+
+class JobSystem;
+struct Geometry;
+
+// Byte offsets in a vertex of the attributes the kernels below read and
+// write. UINT32_MAX marks an attribute the vertex doesn't have.
+struct MeshAttributes {
+    // float3
+    std::uint32_t position_offset = 0;
+    // float3
+    std::uint32_t normal_offset = UINT32_MAX;
+    // float2
+    std::uint32_t uv_offset = UINT32_MAX;
+    // float4, w being the handedness of the bitangent.
+    std::uint32_t tangent_offset = UINT32_MAX;
+};
+
+struct MeshBounds {
+    float lower[3];
+    float upper[3];
+    // Bounding sphere around the center of the box.
+    float center[3];
+    float radius;
+};
+
+// The kernels below run on the job system, in batches of vertices or
+// triangles, and take geometry holding 16-bit indices after its vertices,
+// as everywhere else. They fail on geometry that isn't an indexed triangle
+// list, whose attributes lie outside the vertex or whose vertices are
+// already split in two streams.
+
+// Writes area weighted vertex normals. Vertices no triangle uses get +y.
+auto compute_normals(
+    Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> bool;
+
+// Writes tangents the way MikkTSpace builds them from the normals and uvs:
+// per triangle tangents projected onto the tangent plane of each vertex,
+// weighted by the corner angle. Vertices are never split, so a vertex whose
+// triangles disagree on handedness takes the sign of the sum.
+auto compute_tangents(
+    Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> bool;
+
+auto compute_bounds(
+    const Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> std::optional<MeshBounds>;
+
+// Merges vertices with identical bytes in place, keeping the first of each
+// in order, and rewrites the indices after the remaining vertices. Returns
+// the new index of every old vertex, to remap data kept alongside.
+auto deduplicate_vertices(
+    Geometry& geometry,
+    JobSystem& jobs
+) -> std::optional<std::vector<std::uint32_t>>;
+
+// Moves position_size bytes at position_offset of every vertex into a
+// tightly packed position stream ahead of what remains of the vertices, in
+// place, and sets Geometry::position_stride. Depth only pipelines then
+// fetch positions alone. Run it after the kernels above.
+auto split_vertex_streams(
+    Geometry& geometry,
+    std::uint32_t position_offset,
+    std::uint32_t position_size,
+    JobSystem& jobs
+) -> bool;
+
+}
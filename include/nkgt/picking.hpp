@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace Motorino {
+
+// Side of the square of object ids read around a picked pixel, so thin
+// lines and small objects can be picked without hitting them exactly.
+constexpr std::uint32_t pick_region_size = 9;
+
+// Picks waiting for their frame at most. More are refused until one
+// resolves.
+constexpr std::uint32_t pick_slot_count = 8;
+
+struct PickResult {
+    // 0 when nothing with an object id was drawn in the region.
+    std::uint32_t object;
+    // Pixel the object was found at, the closest one to the requested
+    // pixel.
+    std::uint32_t x;
+    std::uint32_t y;
+};
+
+using PickCallback = std::function<void(const PickResult&)>;
+
+}
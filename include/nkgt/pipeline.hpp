@@ -0,0 +1,157 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+#include "nkgt/vertex_layout.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkPipelineLayout_T* VkPipelineLayout;
+typedef struct VkRenderPass_T* VkRenderPass;
+typedef struct VkPipeline_T* VkPipeline;
+
+namespace Motorino {
+
+class ShaderCompiler;
+
+enum class ShaderStage {
+    Vertex   = 0x00000001,
+    Fragment = 0x00000010,
+};
+
+struct ShaderDefine {
+    const char* name;
+    const char* value;
+};
+
+// path is either a SPIR-V binary (.spv) or, with runtime shader compilation
+// enabled, a GLSL or HLSL (.hlsl) source compiled with the given defines.
+struct ShaderInfo {
+    ShaderStage type;
+    const char* path;
+    std::span<const ShaderDefine> defines = {};
+};
+
+// Values mirror the matching Vulkan enums.
+enum class PrimitiveTopology : std::uint32_t {
+    PointList     = 0,
+    LineList      = 1,
+    LineStrip     = 2,
+    TriangleList  = 3,
+    TriangleStrip = 4,
+};
+
+enum class PolygonMode : std::uint32_t {
+    Fill  = 0,
+    Line  = 1,
+    Point = 2,
+};
+
+enum class CullMode : std::uint32_t {
+    None         = 0,
+    Front        = 1,
+    Back         = 2,
+    FrontAndBack = 3,
+};
+
+enum class FrontFace : std::uint32_t {
+    CounterClockwise = 0,
+    Clockwise        = 1,
+};
+
+enum class BlendMode : std::uint32_t {
+    Opaque,
+    Alpha,
+    Additive,
+};
+
+constexpr std::uint32_t max_shader_stages = 2;
+
+// Everything needed to build a graphics pipeline. Meant to be declared as a
+// constexpr value next to the code that draws with it, so its hash is folded
+// at compile time and identical states share one pipeline.
+struct PipelineState {
+    std::array<ShaderInfo, max_shader_stages> shaders;
+    std::uint32_t shader_count = max_shader_stages;
+    VertexInput vertex_input = Motorino::vertex_input<Vertex>;
+    // Attribute stream of split geometry at binding 1, for instance
+    // vertex_input<VertexAttributes, 1, 1> next to vertex_input<VertexPosition>.
+    // Left empty by interleaved pipelines and by depth only ones, which then
+    // fetch nothing but positions.
+    VertexInput attribute_input = {};
+    PrimitiveTopology topology = PrimitiveTopology::TriangleList;
+    PolygonMode polygon_mode = PolygonMode::Fill;
+    CullMode cull_mode = CullMode::Back;
+    FrontFace front_face = FrontFace::Clockwise;
+    BlendMode blend = BlendMode::Opaque;
+    // The fragment shader writes a uint object id to location 1, read back
+    // by Engine::pick. Without it nothing drawn can be picked.
+    bool object_id = false;
+
+    constexpr auto hash() const -> std::uint64_t {
+        std::uint64_t seed = Hash::integer(shader_count);
+
+        for (std::uint32_t i = 0; i < shader_count; ++i) {
+            seed = Hash::integer(static_cast<std::uint64_t>(shaders[i].type), seed);
+            seed = Hash::string(shaders[i].path, seed);
+            seed = Hash::integer(shaders[i].defines.size(), seed);
+
+            for (const auto& define : shaders[i].defines) {
+                seed = Hash::string(define.name, seed);
+                seed = Hash::string(define.value, seed);
+            }
+        }
+
+        seed = Hash::integer(vertex_input.binding.binding, seed);
+        seed = Hash::integer(vertex_input.binding.stride, seed);
+        seed = Hash::integer(vertex_input.binding.input_rate, seed);
+        seed = Hash::integer(vertex_input.attributes.size(), seed);
+
+        for (const auto& attribute : vertex_input.attributes) {
+            seed = Hash::integer(attribute.location, seed);
+            seed = Hash::integer(attribute.binding, seed);
+            seed = Hash::integer(static_cast<std::uint64_t>(attribute.format), seed);
+            seed = Hash::integer(attribute.offset, seed);
+        }
+
+        seed = Hash::integer(attribute_input.binding.binding, seed);
+        seed = Hash::integer(attribute_input.binding.stride, seed);
+        seed = Hash::integer(attribute_input.binding.input_rate, seed);
+        seed = Hash::integer(attribute_input.attributes.size(), seed);
+
+        for (const auto& attribute : attribute_input.attributes) {
+            seed = Hash::integer(attribute.location, seed);
+            seed = Hash::integer(attribute.binding, seed);
+            seed = Hash::integer(static_cast<std::uint64_t>(attribute.format), seed);
+            seed = Hash::integer(attribute.offset, seed);
+        }
+
+        seed = Hash::integer(static_cast<std::uint64_t>(topology), seed);
+        seed = Hash::integer(static_cast<std::uint64_t>(polygon_mode), seed);
+        seed = Hash::integer(static_cast<std::uint64_t>(cull_mode), seed);
+        seed = Hash::integer(static_cast<std::uint64_t>(front_face), seed);
+        seed = Hash::integer(static_cast<std::uint64_t>(blend), seed);
+        seed = Hash::integer(object_id, seed);
+
+        return seed;
+    }
+};
+
+// Builds the graphics pipeline for state against subpass 0 of render_pass,
+// loading its shaders through shader_compiler. With id_attachment the subpass
+// has the object ID attachment after its color attachment. Returns
+// VK_NULL_HANDLE on failure. Callers keep their own cache keyed by
+// PipelineState::hash.
+auto create_graphics_pipeline(
+    VkDevice device,
+    ShaderCompiler& shader_compiler,
+    const PipelineState& state,
+    VkPipelineLayout layout,
+    VkRenderPass render_pass,
+    bool id_attachment
+) -> VkPipeline;
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Motorino {
+
+// Batches a frame draws at most, the rest of the visible ones are skipped.
+constexpr std::uint32_t max_point_batches = 8192;
+
+// Points of one batch at most. Batches are culled and refined as a whole,
+// so a few hundred thousand points of a small area work best.
+constexpr std::uint32_t max_point_batch_size = 1u << 20;
+
+// Handle of a batch added to the point cloud, valid until it is removed or
+// the point cloud destroyed.
+struct PointBatchId {
+    std::uint32_t index;
+
+    friend constexpr auto operator==(PointBatchId, PointBatchId) -> bool = default;
+};
+
+constexpr PointBatchId null_point_batch{ UINT32_MAX };
+
+struct PointCloudPoint {
+    float position[3];
+    // RGBA8, sRGB.
+    std::uint32_t color;
+};
+
+struct PointCloudSettings {
+    // Points the device buffer holds across every batch, 16 bytes each. At
+    // most UINT32_MAX, and the buffer must fit the maxStorageBufferRange of
+    // the device.
+    std::uint64_t capacity = 64ull * 1024 * 1024;
+
+    // Points drawn per pixel a batch covers on screen. Batches further away
+    // draw fewer of their points.
+    float points_per_pixel = 1.5f;
+
+    // Points drawn per frame at most, shared by every batch in proportion to
+    // what it would draw.
+    std::uint64_t point_budget = 32ull * 1024 * 1024;
+};
+
+struct PointCloudCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+    float position[3];
+    // Viewport height divided by the vertical field of view.
+    float pixels_per_radian;
+};
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Motorino {
+
+// Segments culled together. Consecutive segments of a batch share a chunk,
+// so lines drawn in order cull well.
+constexpr std::uint32_t polyline_chunk_size = 4096;
+
+enum class LineJoin : std::uint32_t {
+    // Falls back to Round past the miter limit.
+    Miter = 0,
+    Round = 1,
+};
+
+enum class LineCap : std::uint32_t {
+    Butt   = 0,
+    Square = 1,
+    Round  = 2,
+};
+
+// Shared by every polyline of a batch, as a layer of GIS or CAD data would.
+struct PolylineStyle {
+    // In pixels, whatever the distance to the camera.
+    float width = 1.0f;
+    LineJoin join = LineJoin::Miter;
+    LineCap cap = LineCap::Butt;
+    // Longest miter, in line widths.
+    float miter_limit = 4.0f;
+};
+
+struct PolylineVertex {
+    float position[3];
+    // RGBA8, sRGB, blended along the segment.
+    std::uint32_t color;
+};
+
+struct PolylineSettings {
+    // Bytes of the device buffer holding every batch: 16 per vertex and 4
+    // per segment. Draws address segments by signed vertex index, six per
+    // segment, which caps it at about 1.43 GB, and the buffer must fit the
+    // maxStorageBufferRange of the device.
+    std::uint64_t capacity = 256ull * 1024 * 1024;
+};
+
+struct PolylineCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+};
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkBuffer_T* VkBuffer;
+
+namespace Motorino {
+
+// Ray traced sun shadows and ambient occlusion, traced in a compute shader
+// against a BVH so no ray tracing hardware or extension is needed.
+struct RayLightingSettings {
+    // Receivers traced per frame, the others keep what they accumulated.
+    // Bounds the cost of a frame to receivers_per_frame * (1 + ao_rays)
+    // rays whatever the scene.
+    std::uint32_t receivers_per_frame = 16384;
+    std::uint32_t ao_rays = 2;
+    // Occluders further away than this don't darken a receiver.
+    float ao_radius = 1.0f;
+    // Half angle of the sun disc in radians, which softens shadows.
+    float sun_angle = 0.00465f;
+    // Frames averaged at most, so changes fade in rather than never.
+    std::uint32_t max_history = 64;
+    // Rays start this far along the normal, against self intersection.
+    float bias = 1e-3f;
+};
+
+// A point lighting is traced for, such as a vertex or a lightmap texel.
+struct RayReceiver {
+    float position[3];
+    float padding0;
+    float normal[3];
+    float padding1;
+};
+
+// One vec4 per receiver: sun visibility in x, ambient visibility in y, both
+// from 0 for occluded to 1, and the frames averaged so far in z.
+struct RayLighting {
+    VkBuffer buffer;
+    std::uint32_t count;
+};
+
+}
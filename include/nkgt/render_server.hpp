@@ -0,0 +1,287 @@
+#pragma once
+
+#include "nkgt/hash.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/material.hpp"
+#include "nkgt/pipeline.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/shader_compiler.hpp"
+#include "nkgt/timeline.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Motorino {
+
+// Sessions submitted to the GPU in one scheduling round at most. Sessions
+// past the limit go first in the next round.
+constexpr std::uint32_t max_sessions_per_round = 32;
+
+// Geometry uploaded to a render server, drawable from every session.
+struct Mesh {
+    std::uint32_t index;
+
+    friend constexpr auto operator==(Mesh, Mesh) -> bool = default;
+};
+
+constexpr Mesh null_mesh{ UINT32_MAX };
+
+class RenderServer;
+
+// One independent offscreen renderer of a RenderServer. Every session owns
+// its color targets, readback buffers, command buffers and frame timeline,
+// so sessions never share frame indices. Frames are RGBA8 sRGB and read
+// back to host memory as part of the frame.
+class RenderSession {
+public:
+    RenderSession(
+        RenderServer& server,
+        std::uint32_t width,
+        std::uint32_t height,
+        bool retain_frames
+    );
+    ~RenderSession();
+
+    RenderSession(const RenderSession&) = delete;
+    auto operator=(const RenderSession&) -> RenderSession& = delete;
+
+    auto width() const -> std::uint32_t {
+        return _width;
+    }
+
+    auto height() const -> std::uint32_t {
+        return _height;
+    }
+
+    // key is the PipelineState hash of a pipeline created on the server.
+    // The state is captured by request_frame, so changing it does not affect
+    // frames already requested.
+    auto set_pipeline(std::uint64_t key) -> void;
+    auto set_mesh(Mesh mesh) -> void;
+    auto set_material(Material material) -> void;
+
+    // Queues a frame with the current state. The awaitable completes once
+    // the server rendered it and its pixels are readable, or once it gave
+    // up on it, which failed(frame) tells.
+    auto request_frame() -> TimelineAwaitable;
+
+    // Same, also returning the number of the frame for pixels(frame).
+    auto request_frame(std::uint64_t& frame) -> TimelineAwaitable;
+
+    // Rows of the most recently completed frame, tightly packed. They stay
+    // valid until max_frames_in_flight more frames of this session started
+    // rendering.
+    auto pixels() const -> std::span<const unsigned char>;
+
+    // Rows of a completed frame. With retain_frames its slot is not reused
+    // before release(frame), otherwise the same limits as pixels() apply.
+    // Empty for failed frames.
+    auto pixels(std::uint64_t frame) const -> std::span<const unsigned char>;
+
+    // Whether the frame completed without being rendered, because recording
+    // or submitting it failed. Every frame requested by then fails with it.
+    auto failed(std::uint64_t frame) const -> bool;
+
+    // Hands the slot of the frame back to the server, failed frames
+    // included. Only needed with retain_frames. Frames may be released in
+    // any order, slots are reused once every earlier frame was released.
+    auto release(std::uint64_t frame) -> void;
+
+private:
+    friend class RenderServer;
+
+    auto init() -> bool;
+
+    // True when a frame was requested and the slot it renders into is free.
+    auto ready() const -> bool;
+
+    auto record() -> bool;
+
+    // Completes every frame requested but not submitted as failed. The
+    // timeline is signaled past them once the frames before completed.
+    auto fail_pending() -> void;
+
+    RenderServer& _server;
+    std::uint32_t _width;
+    std::uint32_t _height;
+
+    VkCommandPool _command_pool;
+    VkCommandBuffer _command_buffers[max_frames_in_flight];
+    VkImage _images[max_frames_in_flight];
+    VkDeviceMemory _image_memory[max_frames_in_flight];
+    VkImageView _image_views[max_frames_in_flight];
+    VkFramebuffer _framebuffers[max_frames_in_flight];
+    VkBuffer _readback_buffers[max_frames_in_flight];
+    VkDeviceMemory _readback_memory[max_frames_in_flight];
+    const unsigned char* _readback_data[max_frames_in_flight];
+
+    // Signaled with the number of the frame once it is read back.
+    VkSemaphore _timeline;
+    // Frames requested, and frames handed to the GPU. Only the scheduler
+    // touches _submitted.
+    std::atomic<std::uint64_t> _requested;
+    std::uint64_t _submitted;
+    bool _retain_frames;
+    // Every frame up to _released was released, frames released past it
+    // wait in _release_pending for the ones before.
+    std::atomic<std::uint64_t> _released;
+    std::mutex _release_mutex;
+    std::vector<std::uint64_t> _release_pending;
+    // Set from a failure until the timeline was signaled past the failed
+    // frames, nothing is submitted meanwhile so the GPU never signals a
+    // value below the host.
+    std::atomic<bool> _failing;
+
+    // First and last frame of every failed run.
+    struct FailedFrames {
+        std::uint64_t first;
+        std::uint64_t last;
+    };
+
+    mutable std::mutex _failed_mutex;
+    std::vector<FailedFrames> _failed;
+
+    struct FrameState {
+        std::uint64_t pipeline_key;
+        Mesh mesh;
+        Material material;
+    };
+
+    // Guards the current state and the state of every requested frame not
+    // recorded yet, oldest first.
+    std::mutex _state_mutex;
+    FrameState _state;
+    std::deque<FrameState> _queued;
+};
+
+// Headless renderer hosting many sessions on one VkInstance and VkDevice.
+// Sessions share the pipeline cache, the meshes and the materials. A
+// scheduler thread renders in rounds: every session with a pending frame
+// records its command buffer on the job system, and the whole round is one
+// queue submission. A session gets at most one frame per round, so a busy
+// session can't starve the others.
+class RenderServer {
+public:
+    RenderServer();
+    ~RenderServer();
+
+    RenderServer(const RenderServer&) = delete;
+    auto operator=(const RenderServer&) -> RenderServer& = delete;
+
+    auto init() -> bool;
+
+    // Owned by the server until destroy_session. Returns nullptr on failure.
+    // With retain_frames, frames stay readable until the caller releases
+    // them, which holds back rendering into their slots.
+    auto create_session(
+        std::uint32_t width,
+        std::uint32_t height,
+        bool retain_frames = false
+    ) -> RenderSession*;
+
+    // Waits for the frames of the session still in flight. Frames requested
+    // but not rendered yet complete without being rendered.
+    auto destroy_session(RenderSession* session) -> void;
+
+    // Sessions draw the pipeline by passing state.hash() to set_pipeline.
+    auto create_pipeline(const PipelineState& state) -> bool;
+
+    // Copies the geometry to the GPU. The returned mesh can be drawn right
+    // away, frames are ordered after the copy on the queue. Meshes live as
+    // long as the server.
+    auto upload(const Geometry& geometry) -> Mesh;
+
+    auto materials() -> MaterialSystem& {
+        return _materials;
+    }
+
+    auto jobs() -> JobSystem& {
+        return _jobs;
+    }
+
+    // Renders one round and returns the number of frames submitted. The
+    // scheduler thread calls this; it is public for callers driving the
+    // server themselves instead.
+    auto render() -> std::uint32_t;
+
+private:
+    friend class RenderSession;
+
+    struct MeshRecord {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        std::uint32_t vertex_count;
+        std::uint32_t index_count;
+        std::uint32_t vertex_stride;
+        std::uint32_t position_stride;
+    };
+
+    auto schedule() -> void;
+    auto wake() -> void;
+
+    // Copies bytes into destination, range by range, ahead of every later
+    // submission. Returns false if nothing was submitted.
+    auto submit_copy(
+        VkBuffer destination,
+        std::span<const MaterialRange> ranges,
+        std::span<const unsigned char> bytes
+    ) -> bool;
+
+    auto find_pipeline(std::uint64_t key) -> VkPipeline;
+    auto find_mesh(Mesh mesh) -> std::optional<MeshRecord>;
+
+    VkInstance _instance;
+    VkPhysicalDevice _physical_device;
+    VkDevice _device;
+    std::uint32_t _queue_family;
+    VkQueue _queue;
+    // Every submission goes to the one queue.
+    std::mutex _queue_mutex;
+
+    VkRenderPass _render_pass;
+    VkDescriptorSetLayout _material_set_layout;
+    VkPipelineLayout _pipeline_layout;
+    VkDescriptorPool _descriptor_pool;
+    VkDescriptorSet _material_set;
+    VkBuffer _material_buffer;
+    VkDeviceMemory _material_buffer_memory;
+    MaterialSystem _materials;
+    std::vector<MaterialRange> _material_ranges;
+    std::vector<unsigned char> _material_bytes;
+
+    // Copies, signaled once per submit_copy.
+    VkCommandPool _copy_pool;
+    VkSemaphore _copy_timeline;
+    std::uint64_t _copy_value;
+
+    std::unordered_map<std::uint64_t, VkPipeline, Hash::Identity> _pipelines;
+    std::mutex _pipeline_mutex;
+
+    std::vector<MeshRecord> _meshes;
+    std::mutex _mesh_mutex;
+
+    std::vector<std::unique_ptr<RenderSession>> _sessions;
+    // Index in _sessions the next round starts at.
+    std::size_t _next_session;
+    std::mutex _session_mutex;
+
+    std::mutex _schedule_mutex;
+    std::condition_variable _schedule_condition;
+    bool _work;
+    bool _stop;
+    std::thread _scheduler;
+
+    JobSystem _jobs;
+    TimelineWaiter _waiter;
+    ShaderCompiler _shader_compiler;
+};
+
+}
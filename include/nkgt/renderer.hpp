@@ -1,7 +1,38 @@
 #pragma once
 
+#include "nkgt/asset_pack.hpp"
+#include "nkgt/bvh.hpp"
+#include "nkgt/cluster_mesh.hpp"
+#include "nkgt/compute.hpp"
+#include "nkgt/draw_pipeline.hpp"
+#include "nkgt/fog.hpp"
+#include "nkgt/frame_encoder.hpp"
+#include "nkgt/geometry_codec.hpp"
+#include "nkgt/hash.hpp"
+#include "nkgt/ibl.hpp"
+#include "nkgt/impostor.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/mapped_file.hpp"
+#include "nkgt/material.hpp"
+#include "nkgt/picking.hpp"
+#include "nkgt/pipeline.hpp"
+#include "nkgt/point_cloud.hpp"
+#include "nkgt/polyline.hpp"
+#include "nkgt/ray_lighting.hpp"
+#include "nkgt/scatter.hpp"
+#include "nkgt/shader_compiler.hpp"
+#include "nkgt/staging_ring.hpp"
+#include "nkgt/task.hpp"
+#include "nkgt/timeline.hpp"
+#include "nkgt/volume.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <optional>
-#include <span>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 // Forward declare GLFW types to avoid public include
@@ -27,42 +58,42 @@ typedef struct VkSemaphore_T* VkSemaphore;
 typedef struct VkFence_T* VkFence;
 typedef struct VkBuffer_T* VkBuffer;
 typedef struct VkDeviceMemory_T* VkDeviceMemory;
+typedef struct VkDescriptorPool_T* VkDescriptorPool;
+typedef struct VkDescriptorSet_T* VkDescriptorSet;
+typedef struct VkSampler_T* VkSampler;
 
 namespace Motorino {
 
+class World;
+
 constexpr std::uint32_t max_frames_in_flight = 2;
+constexpr std::uint64_t staging_ring_size = 64 * 1024 * 1024;
+// Largest piece of a chunked upload, so uploads bigger than the ring still
+// stage through it a piece at a time.
+constexpr std::uint64_t staging_chunk_size = staging_ring_size / 4;
 
 enum class Error {
     vulkan,
     shader_compilation
 };
 
-enum class ShaderStage {
-    Vertex   = 0x00000001,
-    Fragment = 0x00000010,
-};
-
-struct ShaderInfo {
-    ShaderStage type;
-    const char* path;
-};
-
 struct queue_indices {
     std::optional<std::uint32_t> graphics;
     std::optional<std::uint32_t> present;
     std::optional<std::uint32_t> transfer;
 };
 
-struct Vertex {
-    float pos[2];
-    float color[3];
-};
-
 struct Geometry {
     unsigned char* data;
 
     std::uint32_t vertex_count;
     std::uint32_t index_count;
+    std::uint32_t vertex_stride = sizeof(Vertex);
+    // 0 for interleaved vertices. Otherwise vertices are split in two
+    // streams: position_stride bytes of position for every vertex, then the
+    // remaining vertex_stride - position_stride bytes of every vertex. The
+    // indices follow at the same offset either way.
+    std::uint32_t position_stride = 0;
 };
 
 class Engine {
@@ -83,14 +114,331 @@ public:
         std::uint32_t height
     ) -> void;
 
+    // Makes the pipeline described by state the one used for drawing,
+    // creating it only if no identical state was requested before. Geometry
+    // its vertex input can't read isn't drawn, and later uploads have to
+    // match it.
+    auto create_pipeline(
+        const PipelineState& state
+    ) -> bool;
+
     auto create_pipeline(
-        std::span<ShaderInfo> shaders
+        const PipelineState& state,
+        std::uint64_t key
     ) -> bool;
 
+    template<const PipelineState& State>
+    auto create_pipeline() -> bool {
+        constexpr std::uint64_t key = State.hash();
+        return create_pipeline(State, key);
+    }
+
+    // Builds the pipeline on a worker without making it current. A later
+    // create_pipeline with the same state then only hits the cache.
+    auto compile_pipeline(
+        PipelineState state
+    ) -> Task<bool>;
+
     auto submit_vertex_data(
         const Geometry* geometry
     ) -> bool;
 
+    // Starts copying the geometry to the GPU and returns right away. The
+    // geometry data has to stay alive until the returned awaitable completes,
+    // at which point the geometry is the one drawn. It yields false when the
+    // pipeline changed meanwhile to one that can't read the geometry, which
+    // is then dropped.
+    auto upload(
+        const Geometry* geometry
+    ) -> TimelineAwaitable;
+
+    // Uploads the encoded geometry as is and decodes it on the GPU with a
+    // compute pass, so only the compressed size crosses the bus. The encoded
+    // data is copied out before this returns.
+    auto upload(
+        const EncodedGeometry& geometry
+    ) -> TimelineAwaitable;
+
+    // Uploads a mesh straight out of a pack, decompressing it into staging
+    // memory on the job system. Encoded meshes are decoded on the GPU.
+    auto upload(
+        const AssetPack& pack,
+        std::string_view name
+    ) -> TimelineAwaitable;
+
+    // Completes when the next frame submitted to the GPU finished rendering.
+    auto next_frame() -> TimelineAwaitable;
+
+    auto jobs() -> JobSystem& {
+        return _jobs;
+    }
+
+    auto shader_compiler() -> ShaderCompiler& {
+        return _shader_compiler;
+    }
+
+    // Parameter blocks shared by every pipeline. Shaders read them from the
+    // storage buffer at set 0, binding 0, indexed by the uint push constant
+    // holding the current material.
+    auto materials() -> MaterialSystem& {
+        return _materials;
+    }
+
+    auto set_material(Material material) -> void;
+
+    // Writes the drawn geometry, the materials and, if given, the world to
+    // path. The geometry is read back from the GPU, blocking the render loop
+    // until the copy finished.
+    auto save_snapshot(
+        const char* path,
+        const World* world = nullptr
+    ) -> bool;
+
+    // Replaces the world right away and uploads geometry and materials in a
+    // single transfer submission, complete when the awaitable is. It yields
+    // false when the current pipeline can't read the geometry, as upload.
+    auto load_snapshot(
+        const char* path,
+        World* world = nullptr
+    ) -> TimelineAwaitable;
+
+    // Converts every presented frame to YUV 4:2:0 on the GPU and streams it
+    // to settings.path from the encoder thread. The read back is half the
+    // size of RGB24 and frames are dropped while the encoder falls behind.
+    auto start_capture(
+        const CaptureSettings& settings
+    ) -> bool;
+
+    // Waits for the frames already captured to be written.
+    auto stop_capture() -> void;
+
+    // Uploads the maps of a scatter pass, which from then on regenerates the
+    // instances on the GPU at the start of every frame following a camera
+    // change. Instances never go through host memory: the pass writes them
+    // and the instance counts of the indirect draws the frame then records
+    // for every layer. One pass at a time, destroy_scatter before creating
+    // another.
+    auto create_scatter(
+        const ScatterSettings& settings
+    ) -> TimelineAwaitable;
+
+    auto set_scatter_camera(
+        const ScatterCamera& camera
+    ) -> void;
+
+    // Waits for the frames that may still read the instances.
+    auto destroy_scatter() -> void;
+
+    // Reads the object ids around pixel x, y of the next frame drawn. The
+    // frame copies them out after its render pass and callback runs on the
+    // waiter thread once it completed, so neither the frame nor the caller
+    // waits. Returns false while pick_slot_count picks are pending.
+    auto pick(
+        std::uint32_t x,
+        std::uint32_t y,
+        PickCallback callback
+    ) -> bool;
+
+    // Creates the point cloud, drawn behind everything else from then on.
+    // Points are rasterized in compute, one 64-bit atomic per point keeping
+    // the closest one of each pixel. Needs 64-bit buffer atomics. One point
+    // cloud at a time, destroy_point_cloud before creating another.
+    auto create_point_cloud(
+        const PointCloudSettings& settings
+    ) -> bool;
+
+    // Streams a batch of points in, drawn once uploaded. Batches are culled
+    // as a whole and draw fewer of their points as they get smaller on
+    // screen.
+    auto add_point_batch(
+        std::span<const PointCloudPoint> points
+    ) -> TimelineAwaitable;
+
+    // Same, also returning the handle remove_point_batch takes.
+    auto add_point_batch(
+        std::span<const PointCloudPoint> points,
+        PointBatchId& batch
+    ) -> TimelineAwaitable;
+
+    // Stops drawing the batch. Its points go back to the buffer once the
+    // frames that may still draw them, or its upload, completed.
+    auto remove_point_batch(
+        PointBatchId batch
+    ) -> bool;
+
+    auto set_point_cloud_camera(
+        const PointCloudCamera& camera
+    ) -> void;
+
+    // Waits for the uploads and the frames that may still use the points.
+    auto destroy_point_cloud() -> void;
+
+    // Creates the froxel grid of the volumetric fog, which from then on is
+    // lit and integrated at the start of every frame and laid over the
+    // cleared background, and over the points and clusters at their depth.
+    // The render pass keeps no depth, so geometry fogs itself by reading
+    // fog_volume(). Its cost only depends on the grid size, with lights
+    // capped at max_fog_lights. One fog at a time, destroy_fog before
+    // creating another.
+    auto create_fog(
+        const FogSettings& settings
+    ) -> bool;
+
+    auto set_fog_camera(
+        const FogCamera& camera
+    ) -> void;
+
+    // Lights past max_fog_lights are ignored.
+    auto set_fog_lights(
+        std::span<const FogLight> lights
+    ) -> void;
+
+    // Null buffer while no fog is created, or once destroy_fog started.
+    auto fog_volume() -> FogVolume;
+
+    // Waits for the frames that may still read the grid.
+    auto destroy_fog() -> void;
+
+    // Precomputes the diffuse SH irradiance, the split sum BRDF table and the
+    // prefiltered specular mips of an environment on the GPU. Results are
+    // stored in the cache directory and later loads of the same environment
+    // and settings only upload them. Replaces the maps of an earlier load.
+    auto load_ibl(
+        const IblSettings& settings
+    ) -> TimelineAwaitable;
+
+    // Null buffer until a load completes. Geometry shaders read the same
+    // maps from the storage buffer at set 2, binding 0, bound once a load
+    // completed.
+    auto ibl() -> IblMaps;
+
+    // Uploads an impostor atlas, whose instances are drawn over the cluster
+    // mesh and behind the geometry from then on: one camera facing quad per
+    // instance, blending the three views select_impostors picked for it.
+    // Instances go through host memory every frame, at most max_instances
+    // of them. One atlas at a time, destroy_impostors before creating
+    // another.
+    auto create_impostors(
+        const ImpostorAtlas& atlas,
+        std::uint32_t max_instances
+    ) -> TimelineAwaitable;
+
+    // Replaces the instances drawn, in order, so far to near as
+    // select_impostors leaves them.
+    auto set_impostors(
+        std::span<const ImpostorInstance> instances
+    ) -> void;
+
+    auto set_impostor_camera(
+        const ImpostorCamera& camera
+    ) -> void;
+
+    // Waits for the upload and the frames that may still draw the atlas.
+    auto destroy_impostors() -> void;
+
+    // Creates the polyline buffer, drawn over the geometry from then on.
+    // Lines are never tessellated on the CPU: the vertex shader expands
+    // every segment into a quad with its joins and caps. One polyline
+    // buffer at a time, destroy_polylines before creating another.
+    auto create_polylines(
+        const PolylineSettings& settings
+    ) -> bool;
+
+    // Uploads a batch of polylines sharing a style, drawn once uploaded.
+    // counts holds the vertices of each polyline, at least two each and
+    // adding up to vertices.size(). Batches are culled in chunks of
+    // polyline_chunk_size segments.
+    auto add_polylines(
+        std::span<const PolylineVertex> vertices,
+        std::span<const std::uint32_t> counts,
+        const PolylineStyle& style
+    ) -> TimelineAwaitable;
+
+    auto set_polyline_camera(
+        const PolylineCamera& camera
+    ) -> void;
+
+    // Waits for the uploads and the frames that may still draw the lines.
+    auto destroy_polylines() -> void;
+
+    // Creates the volume, ray marched over the geometry from then on. Only
+    // the bricks rays reach are loaded, through loader, and the least
+    // recently used ones make room for them once the pool is full, so the
+    // volume may be far larger than device memory. Needs storage writes in
+    // fragment shaders. One volume at a time, destroy_volume before
+    // creating another.
+    auto create_volume(
+        const VolumeSettings& settings,
+        VolumeLoader loader
+    ) -> bool;
+
+    // RGBA8 colors by voxel value, sRGB, alpha being the opacity of one
+    // voxel. Every voxel is transparent until set.
+    auto set_volume_transfer_function(
+        std::span<const std::uint32_t, volume_transfer_size> colors
+    ) -> void;
+
+    auto set_volume_camera(
+        const VolumeCamera& camera
+    ) -> void;
+
+    // Waits for the bricks being loaded and the frames that may still
+    // sample the volume.
+    auto destroy_volume() -> void;
+
+    // Creates the ray tracing of sun shadows and ambient occlusion, which
+    // from then on traces receivers_per_frame receivers of the scene at the
+    // start of every frame and averages the results over frames. One at a
+    // time, destroy_ray_lighting before creating another.
+    auto create_ray_lighting(
+        const RayLightingSettings& settings
+    ) -> bool;
+
+    // Uploads the BVH rays are traced against and the receivers they are
+    // traced from, replacing the previous scene and its results once the
+    // upload completed. The upload goes through staging in pieces, so the
+    // scene may be larger than the staging ring.
+    auto set_ray_scene(
+        const Bvh& bvh,
+        std::span<const RayReceiver> receivers
+    ) -> TimelineAwaitable;
+
+    // Direction the sun light travels in. Results fade over to a new
+    // direction within max_history samples.
+    auto set_ray_sun(
+        const float (&direction)[3]
+    ) -> void;
+
+    // Null buffer until a scene is uploaded. Valid until the next scene
+    // replaces it. Geometry shaders read the same results from the storage
+    // buffer at set 1, binding 0, bound while a scene is.
+    auto ray_lighting() -> RayLighting;
+
+    // Waits for the frames that may still trace the scene.
+    auto destroy_ray_lighting() -> void;
+
+    // Opens the cluster mesh write_cluster_mesh wrote to path, depth tested
+    // against the point cloud and behind the geometry from then on. Every frame a
+    // compute pass picks, among the resident pages, the clusters whose
+    // simplification error projects to at most max_error pixels, and
+    // requests the pages finer ones need. Pages are read from the mapped
+    // file as requested and the least recently used ones make room for
+    // them. Clusters are rasterized in compute like the point cloud, so
+    // this needs 64-bit buffer atomics. One at a time, destroy_cluster_mesh
+    // before opening another.
+    auto create_cluster_mesh(
+        const char* path,
+        const ClusterMeshSettings& settings
+    ) -> bool;
+
+    auto set_cluster_camera(
+        const ClusterCamera& camera
+    ) -> void;
+
+    // Waits for the pages being loaded and the frames that may still draw
+    // the mesh.
+    auto destroy_cluster_mesh() -> void;
+
 private:
     auto create_swapchain() -> bool;
     auto cleanup_swapchain() -> void;
@@ -103,6 +451,286 @@ private:
         std::uint32_t image_index
     ) -> void;
 
+    // Records the conversion of the presented image into a free capture
+    // slot after the render pass. Returns the slot to hand to the encoder
+    // once the frame completed.
+    auto record_capture(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t image_index
+    ) -> std::optional<std::uint32_t>;
+
+    auto destroy_capture() -> void;
+
+    // Records the copies of the queued picks out of the frame's ID
+    // attachment after the render pass.
+    auto record_picks(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t image_index
+    ) -> void;
+
+    auto resolve_pick(
+        std::uint32_t slot_index
+    ) -> void;
+
+    // Dispatches the scatter pass ahead of the render pass if the camera
+    // moved since the last one.
+    auto record_scatter(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Culls the point batches and rasterizes the visible ones ahead of the
+    // render pass.
+    auto record_point_cloud(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Binds the visibility frame the points are rasterized into. Only
+    // called with the device idle.
+    auto resize_point_cloud() -> bool;
+
+    // First fit out of the free ranges. Both with _draw_mutex held.
+    auto reserve_points(
+        std::uint32_t count,
+        std::uint32_t& first
+    ) -> bool;
+
+    auto release_points(
+        std::uint32_t first,
+        std::uint32_t count
+    ) -> void;
+
+    // Lights and integrates the fog grid ahead of the render pass.
+    auto record_fog(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Fogs the cleared background and the resolved points and clusters,
+    // ahead of the other draws of the render pass.
+    auto draw_fog(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Binds the visibility frame the composite reads depth from. Only
+    // called with the device idle.
+    auto resize_fog() -> void;
+
+    // Draws every layer of the scatter pass into the render pass, with the
+    // instance counts the pass wrote.
+    auto draw_scatter(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Copies the instances into the buffer of current_frame and draws them
+    // into the render pass.
+    auto draw_impostors(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t current_frame
+    ) -> void;
+
+    // Culls the polyline chunks and draws the visible ones into the render
+    // pass.
+    auto draw_polylines(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Streams in the bricks listed by the frame last recorded with
+    // current_frame, which completed, clears the request bits and uploads
+    // the brick table changes ahead of the render pass.
+    auto record_volume(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t current_frame
+    ) -> void;
+
+    auto draw_volume(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t current_frame
+    ) -> void;
+
+    // Makes the brick lists of the frame visible to the host, after the
+    // render pass.
+    auto finish_volume(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t current_frame
+    ) -> void;
+
+    // Traces the next range of receivers ahead of the render pass.
+    auto record_ray_lighting(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Streams in the pages requested by the frame last recorded with
+    // current_frame, then selects and rasterizes the clusters ahead of the
+    // render pass.
+    auto record_cluster_mesh(
+        VkCommandBuffer cmd_buffer,
+        std::uint32_t current_frame
+    ) -> void;
+
+    // Binds the visibility frame the clusters are rasterized into. Only
+    // called with the device idle.
+    auto resize_cluster_mesh() -> bool;
+
+    // Creates the visibility frame points and clusters are rasterized into
+    // and the pass resolving it. Needs 64-bit buffer atomics.
+    auto create_visibility() -> bool;
+
+    // Sizes the visibility frame to the window. Only called with the device
+    // idle.
+    auto resize_visibility() -> bool;
+
+    auto destroy_visibility() -> void;
+
+    // Clears the visibility frame for the first pass of the frame being
+    // recorded that rasterizes into it. Later passes wait for the one
+    // before and depth test against what it kept.
+    auto begin_visibility(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Draws the points and clusters the frame kept into the render pass.
+    auto draw_visibility(
+        VkCommandBuffer cmd_buffer
+    ) -> void;
+
+    // Loads brick into slot once frame free_after, which evicted the brick
+    // the slot held, completed.
+    auto stream_brick(
+        std::uint32_t brick,
+        std::uint32_t slot,
+        std::uint64_t free_after,
+        std::uint64_t generation
+    ) -> Task<void>;
+
+    // Copies page out of the mapped file into slot once frame free_after,
+    // which evicted the page the slot held, completed.
+    auto stream_cluster_page(
+        std::uint32_t page,
+        std::uint32_t slot,
+        std::uint64_t free_after,
+        std::uint64_t generation
+    ) -> Task<void>;
+
+    auto build_pipeline(
+        const PipelineState& state,
+        std::uint64_t key
+    ) -> VkPipeline;
+
+    auto release_retired_buffers() -> void;
+
+    // Copies the materials written since the last frame in one transfer
+    // submission that waits for the frames still reading them. Returns the
+    // transfer value the frame must wait for, or 0 if nothing changed.
+    auto flush_materials(
+        std::uint64_t frame_value
+    ) -> std::uint64_t;
+
+    // Either a slice of the staging ring or, when memory is set, a dedicated
+    // buffer for uploads too large for the ring or made while it is full of
+    // allocations still being written.
+    struct StagingBlock {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        std::uint64_t offset;
+        unsigned char* data;
+        StagingAllocation allocation;
+    };
+
+    auto acquire_staging(
+        std::uint64_t size
+    ) -> std::optional<StagingBlock>;
+
+    auto release_staging(
+        const StagingBlock& block,
+        std::uint64_t transfer_value
+    ) -> void;
+
+    // Copies size bytes of staging into destination, from destination_offset
+    // on, on the transfer queue and returns the transfer timeline value
+    // signaled once done, or 0 on failure. The staging block is released
+    // either way.
+    auto submit_transfer(
+        const StagingBlock& staging,
+        VkBuffer destination,
+        std::uint64_t size,
+        std::uint64_t destination_offset = 0
+    ) -> std::uint64_t;
+
+    // Copies size bytes into destination in pieces of at most
+    // staging_chunk_size, fill writing the bytes from offset on of each
+    // piece into its staging. Returns the transfer value of the last piece,
+    // reached once every piece is copied. On failure returns 0 after
+    // waiting for the pieces already submitted, so destination can go right
+    // away.
+    auto submit_chunked_transfer(
+        VkBuffer destination,
+        std::uint64_t size,
+        const std::function<bool(unsigned char* data, std::uint64_t offset, std::uint64_t size)>& fill
+    ) -> std::uint64_t;
+
+    auto submit_geometry(
+        const StagingBlock& staging,
+        std::uint64_t size,
+        std::uint32_t vertex_count,
+        std::uint32_t index_count,
+        std::uint32_t vertex_stride,
+        std::uint32_t position_stride
+    ) -> TimelineAwaitable;
+
+    auto submit_encoded_geometry(
+        const StagingBlock& staging,
+        std::uint64_t size,
+        std::uint32_t vertex_count,
+        std::uint32_t index_count,
+        std::uint32_t vertex_stride
+    ) -> TimelineAwaitable;
+
+    // Whether the current pipeline, if any, reads vertices laid out with
+    // these strides. Logs the mismatch.
+    auto fits_pipeline(
+        std::uint32_t vertex_stride,
+        std::uint32_t position_stride
+    ) -> bool;
+
+    // Makes the buffer the one drawn, retiring the previous one. Geometry
+    // the current pipeline can't read is dropped instead, returning false.
+    auto replace_geometry(
+        VkBuffer buffer,
+        VkDeviceMemory memory,
+        std::uint32_t vertex_count,
+        std::uint32_t index_count,
+        std::uint32_t vertex_stride,
+        std::uint32_t position_stride
+    ) -> bool;
+
+    // Makes the buffer the one IBL maps are read from, retiring the previous
+    // one.
+    auto replace_ibl(
+        VkBuffer buffer,
+        VkDeviceMemory memory,
+        const IblLayout& layout
+    ) -> void;
+
+    struct Readback {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkCommandBuffer cmd_buffer;
+        std::uint64_t size;
+        std::uint64_t transfer_value;
+    };
+
+    // Submits a copy of the first size bytes of buffer into a host visible
+    // one. The source must stay alive until the transfer value is reached.
+    auto submit_readback(
+        VkBuffer buffer,
+        std::uint64_t size
+    ) -> std::optional<Readback>;
+
+    // Waits for the copy and moves its bytes into out.
+    auto finish_readback(
+        const Readback& readback,
+        std::vector<unsigned char>& out
+    ) -> bool;
+
     auto create_buffer(
         std::uint64_t size,
         std::uint32_t usage,
@@ -121,6 +749,9 @@ private:
     VkInstance _instance;
     VkSurfaceKHR _surface;
     VkPhysicalDevice _physical_device;
+    // Largest range of a storage buffer binding, which bounds the buffers
+    // engine shaders index through one binding.
+    std::uint32_t _max_storage_buffer_range;
     VkDevice _device;
     VkQueue _graphics_queue;
     VkQueue _present_queue;
@@ -129,19 +760,429 @@ private:
     VkRenderPass _render_pass;
     VkCommandPool _graphics_command_pool;
     VkCommandPool _transfer_command_pool;
+    VkCommandPool _compute_command_pool;
+    VkDescriptorPool _descriptor_pool;
     VkCommandBuffer _graphics_command_buffers[max_frames_in_flight];
+    VkDescriptorSetLayout _material_set_layout;
+    VkDescriptorSet _material_set;
+    // Set 1 of geometry pipelines, the results of the ray lighting scene.
+    VkDescriptorSetLayout _ray_shading_set_layout;
+    // Set 2 of geometry pipelines, the IBL maps.
+    VkDescriptorSetLayout _ibl_set_layout;
     VkPipelineLayout _pipeline_layout;
     VkPipeline _pipeline;
+    // Vertex input strides of _pipeline, checked against the geometry: the
+    // stride of binding 0 and of the attribute stream, 0 without one.
+    std::uint32_t _pipeline_binding_stride;
+    std::uint32_t _pipeline_attribute_stride;
+    std::unordered_map<std::uint64_t, VkPipeline, Hash::Identity> _pipelines;
+    std::mutex _pipeline_mutex;
     VkSemaphore _image_available_semaphores[max_frames_in_flight];
     VkSemaphore _render_finished_semaphores[max_frames_in_flight];
     VkFence _inflight_fences[max_frames_in_flight];
+    // Per engine, several engines may render in one process.
+    std::uint32_t _current_frame;
+    VkSemaphore _frame_timeline;
+    VkSemaphore _transfer_timeline;
+    std::atomic<std::uint64_t> _frame_value;
+    std::uint64_t _transfer_value;
+    std::mutex _transfer_mutex;
+    VkSemaphore _compute_timeline;
+    std::uint64_t _compute_value;
+    // Guards the compute pool, the descriptor pool and _compute_value.
+    std::mutex _compute_mutex;
+    // The graphics queue is submitted to from the render loop and from
+    // uploads decoding geometry.
+    std::mutex _graphics_queue_mutex;
+    ComputePipeline _decode_pipeline;
+    StagingRing _staging_ring;
+    // Guards everything read while recording a frame.
+    std::mutex _draw_mutex;
     VkBuffer _vertex_buffer;
     VkDeviceMemory _vertex_buffer_memory;
+    // Transfer value of the last readback of _vertex_buffer, which retiring
+    // it waits for as well.
+    std::uint64_t _vertex_readback;
     std::uint32_t _index_count;
     std::uint32_t _vertex_count;
+    std::uint32_t _vertex_stride;
+    std::uint32_t _position_stride;
+    Material _material;
+    MaterialSystem _materials;
+    VkBuffer _material_buffer;
+    VkDeviceMemory _material_buffer_memory;
+    // Reused by flush_materials, which only runs on the render thread.
+    std::vector<MaterialRange> _material_ranges;
+    std::vector<unsigned char> _material_bytes;
+    // Transfer value of the last snapshot that uploaded materials, which
+    // frames wait for along with their own flush.
+    std::atomic<std::uint64_t> _material_upload;
     std::vector<VkImage> _images;
     std::vector<VkImageView> _image_views;
     std::vector<VkFramebuffer> _framebuffers;
+    // One object ID attachment per swapchain image.
+    std::vector<VkImage> _id_images;
+    std::vector<VkDeviceMemory> _id_image_memory;
+    std::vector<VkImageView> _id_image_views;
+    // Set when the swapchain images allow SAMPLED usage.
+    bool _capture_supported;
+
+    // Readback buffers frames are converted into, see FrameEncoder.
+    struct CaptureSlot {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkDescriptorSet set;
+    };
+
+    CaptureSlot _capture_slots[capture_slot_count];
+    ComputePipeline _capture_pipeline;
+    VkSampler _capture_sampler;
+    YuvLayout _capture_layout;
+    std::uint32_t _capture_width;
+    std::uint32_t _capture_height;
+    bool _capturing;
+    // Slot the frame being recorded converts into.
+    std::optional<std::uint32_t> _capture_slot;
+    FrameEncoder _encoder;
+
+    enum class PickState {
+        Free,
+        // Waiting for the next frame to copy its region.
+        Queued,
+        // Copied by a frame that hasn't completed yet.
+        Recorded,
+    };
+
+    struct PickSlot {
+        PickState state;
+        std::uint32_t x;
+        std::uint32_t y;
+        // Part of the region that was on screen.
+        std::uint32_t origin[2];
+        std::uint32_t extent[2];
+        PickCallback callback;
+    };
+
+    // Slot i reads back into the ith region of the buffer.
+    PickSlot _pick_slots[pick_slot_count];
+    VkBuffer _pick_buffer;
+    VkDeviceMemory _pick_memory;
+    const std::uint32_t* _pick_data;
+    // Slots the frame being recorded copies.
+    std::vector<std::uint32_t> _picks_recorded;
+
+    ComputePipeline _scatter_pipeline;
+    VkDescriptorSet _scatter_set;
+    VkBuffer _scatter_data;
+    VkDeviceMemory _scatter_data_memory;
+    VkBuffer _scatter_instances;
+    VkDeviceMemory _scatter_instances_memory;
+    VkBuffer _scatter_commands;
+    VkDeviceMemory _scatter_commands_memory;
+    DrawPipeline _scatter_draw_pipeline;
+    VkDescriptorSet _scatter_draw_set;
+    // Vertices of the layer meshes, then their 16-bit indices from
+    // _scatter_index_offset.
+    VkBuffer _scatter_mesh;
+    VkDeviceMemory _scatter_mesh_memory;
+    std::uint64_t _scatter_index_offset;
+    // Indirect commands with no instances, copied over the commands before
+    // every dispatch.
+    ScatterCommand _scatter_commands_reset[max_scatter_layers];
+    std::uint32_t _scatter_tiles[2];
+    std::uint32_t _scatter_layer_count;
+    std::uint64_t _scatter_upload;
+    ScatterCamera _scatter_camera;
+    // Set once the maps are uploaded, and when the camera changed.
+    bool _scatter_ready;
+    bool _scatter_dirty;
+
+    // Set when the device has 64-bit buffer atomics.
+    bool _point_cloud_supported;
+    DrawPipeline _visibility_resolve_pipeline;
+    VkDescriptorSet _visibility_set;
+    // One 64-bit depth and color value per pixel, shared by the points and
+    // the clusters so they depth test against each other.
+    VkBuffer _visibility_frame;
+    VkDeviceMemory _visibility_frame_memory;
+    // Set once a pass of the frame being recorded rasterized into it.
+    bool _visibility_drawn;
+
+    ComputePipeline _point_pipeline;
+    VkDescriptorSet _point_set;
+    VkBuffer _points;
+    VkDeviceMemory _points_memory;
+    VkBuffer _point_draws;
+    VkDeviceMemory _point_draws_memory;
+    PointCloudSettings _point_settings;
+    PointCloudCamera _point_camera;
+
+    struct PointBatch {
+        float center[3];
+        float radius;
+        std::uint32_t first;
+        std::uint32_t count;
+        std::uint32_t id;
+        // Set once the upload completed, frames draw the batch from then on.
+        bool uploaded;
+        // Transfer value of the upload.
+        std::uint64_t upload;
+    };
+
+    struct PointRange {
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    // Mirrors the DrawList entries of shaders/point_cloud.comp.
+    struct PointDraw {
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    // Batches added and not removed, uploaded or not.
+    std::vector<PointBatch> _point_batches;
+    // Batches the frame being recorded draws.
+    std::vector<PointDraw> _point_draw_list;
+    // Ranges of the buffer no batch holds, sorted by first point and never
+    // adjacent.
+    std::vector<PointRange> _point_free;
+    std::uint32_t _point_next_batch;
+    // Counts the point clouds destroyed, so ranges a removal gives back late
+    // don't land in the free list of the next one.
+    std::uint64_t _point_generation;
+    // Transfer value of the last upload.
+    std::uint64_t _point_upload;
+    bool _point_ready;
+
+    ComputePipeline _fog_pipeline;
+    // Set i writes froxels i, the other holds the previous frame.
+    VkDescriptorSet _fog_sets[2];
+    DrawPipeline _fog_composite_pipeline;
+    VkDescriptorSet _fog_composite_set;
+    VkBuffer _fog_data;
+    VkDeviceMemory _fog_data_memory;
+    VkBuffer _fog_froxels[2];
+    VkDeviceMemory _fog_froxels_memory[2];
+    VkBuffer _fog_integrated;
+    VkDeviceMemory _fog_integrated_memory;
+    FogSettings _fog_settings;
+    FogCamera _fog_camera;
+    // Camera of the last frame recorded.
+    FogCamera _fog_previous;
+    FogLight _fog_lights[max_fog_lights];
+    std::uint32_t _fog_light_count;
+    std::uint32_t _fog_frame;
+    bool _fog_history;
+    bool _fog_ready;
+
+    ComputePipeline _ibl_pipeline;
+    // Guards the creation of _ibl_pipeline by the first bake.
+    std::mutex _ibl_mutex;
+    VkBuffer _ibl_buffer;
+    VkDeviceMemory _ibl_memory;
+    IblLayout _ibl_layout;
+    // Binds _ibl_buffer as set 2 of geometry pipelines, null until a load
+    // completes.
+    VkDescriptorSet _ibl_set;
+    // Set once a frame bound _ibl_set, which then outlives the frames in
+    // flight when replaced.
+    bool _ibl_set_used;
+
+    DrawPipeline _impostor_pipeline;
+    // One set per frame in flight, each with its own instances.
+    VkDescriptorSet _impostor_sets[max_frames_in_flight];
+    // Albedo, then normal texels.
+    VkBuffer _impostor_atlas;
+    VkDeviceMemory _impostor_atlas_memory;
+    // Host visible and mapped, written while recording the frame drawing
+    // them.
+    VkBuffer _impostor_instances[max_frames_in_flight];
+    VkDeviceMemory _impostor_instances_memory[max_frames_in_flight];
+    ImpostorInstance* _impostor_instance_data[max_frames_in_flight];
+    std::vector<ImpostorInstance> _impostor_list;
+    ImpostorCamera _impostor_camera;
+    std::uint32_t _impostor_grid;
+    std::uint32_t _impostor_cell_size;
+    std::uint32_t _impostor_capacity;
+    // Transfer value of the atlas upload.
+    std::uint64_t _impostor_upload;
+    // Set once the atlas is uploaded.
+    bool _impostor_ready;
+
+    DrawPipeline _polyline_pipeline;
+    VkDescriptorSet _polyline_set;
+    // Vertices and segments of every batch, one after the other.
+    VkBuffer _polylines;
+    VkDeviceMemory _polylines_memory;
+    PolylineSettings _polyline_settings;
+    PolylineCamera _polyline_camera;
+
+    struct PolylineChunk {
+        float center[3];
+        float radius;
+        // Segment index in the buffer, counted in 4 byte words.
+        std::uint64_t first;
+        std::uint32_t count;
+        std::uint32_t style;
+    };
+
+    // Chunks whose upload completed, with the styles of their batches.
+    std::vector<PolylineChunk> _polyline_chunks;
+    std::vector<PolylineStyle> _polyline_styles;
+    // Bytes of the buffer given to batches, uploaded or not.
+    std::uint64_t _polyline_reserved;
+    // Transfer value of the last upload.
+    std::uint64_t _polyline_upload;
+    bool _polyline_ready;
+
+    // Set when fragment shaders may write storage buffers.
+    bool _volume_supported;
+    DrawPipeline _volume_pipeline;
+    // One set per frame in flight, each with its own brick lists.
+    VkDescriptorSet _volume_sets[max_frames_in_flight];
+    VkBuffer _volume_pool;
+    VkDeviceMemory _volume_pool_memory;
+    VkBuffer _volume_bricks;
+    VkDeviceMemory _volume_bricks_memory;
+    VkBuffer _volume_transfer;
+    VkDeviceMemory _volume_transfer_memory;
+    // Bit per brick, so each is listed once a frame. Cleared on the GPU
+    // before every frame.
+    VkBuffer _volume_requests;
+    VkDeviceMemory _volume_requests_memory;
+    // Lists of the bricks a frame needs, host visible and mapped, read once
+    // the frame writing them completed.
+    VkBuffer _volume_used[max_frames_in_flight];
+    VkDeviceMemory _volume_used_memory[max_frames_in_flight];
+    std::uint32_t* _volume_used_lists[max_frames_in_flight];
+    VolumeSettings _volume_settings;
+    VolumeLoader _volume_loader;
+    VolumeCamera _volume_camera;
+
+    // Mirrors the Bricks entries of shaders/volume.frag.
+    struct VolumeBrick {
+        std::uint32_t slot;
+        std::uint32_t range;
+    };
+
+    struct VolumeSlot {
+        std::uint32_t brick;
+        // Frame value of the last frame known to sample the brick.
+        std::uint64_t last_used;
+    };
+
+    std::vector<VolumeBrick> _volume_brick_table;
+    std::vector<bool> _volume_loading;
+    std::vector<VolumeSlot> _volume_slots;
+    std::vector<std::uint32_t> _volume_free_slots;
+    // Bricks whose table entry changed since the last frame.
+    std::vector<std::uint32_t> _volume_dirty;
+    std::uint32_t _volume_colors[volume_transfer_size];
+    // Bricks being loaded, destroy_volume waits for none to be left.
+    std::uint32_t _volume_streams;
+    std::condition_variable _volume_idle;
+    // Tells bricks loaded for a destroyed volume apart.
+    std::uint64_t _volume_generation;
+    bool _volume_colors_dirty;
+    bool _volume_reset;
+    bool _volume_ready;
+
+    ComputePipeline _ray_pipeline;
+    VkDescriptorSet _ray_set;
+    // The results for geometry shaders, replaced along with _ray_set.
+    VkDescriptorSet _ray_shading_set;
+    // Nodes, triangles and receivers of the scene.
+    VkBuffer _ray_scene;
+    VkDeviceMemory _ray_scene_memory;
+    VkBuffer _ray_results;
+    VkDeviceMemory _ray_results_memory;
+    RayLightingSettings _ray_settings;
+    float _ray_sun[3];
+    std::uint32_t _ray_receiver_count;
+    // First receiver the next frame traces.
+    std::uint32_t _ray_cursor;
+    std::uint32_t _ray_frame;
+    // Set once a frame traced the scene, which then keeps its sets until
+    // that frame completed.
+    bool _ray_set_used;
+    // Set when a new scene needs its results cleared.
+    bool _ray_reset;
+    bool _ray_ready;
+
+    ComputePipeline _cluster_select_pipeline;
+    ComputePipeline _cluster_raster_pipeline;
+    // Selection sets of every frame in flight, each with its own request
+    // bits, then the rasterization set.
+    VkDescriptorSet _cluster_sets[max_frames_in_flight + 1];
+    // Groups, then clusters.
+    VkBuffer _cluster_tables;
+    VkDeviceMemory _cluster_tables_memory;
+    VkBuffer _cluster_page_slots;
+    VkDeviceMemory _cluster_page_slots_memory;
+    VkBuffer _cluster_pool;
+    VkDeviceMemory _cluster_pool_memory;
+    // Indirect dispatch size, then the clusters drawn and their slots.
+    VkBuffer _cluster_draws;
+    VkDeviceMemory _cluster_draws_memory;
+    // Indirect dispatch size, then the large triangles binned into tiles.
+    VkBuffer _cluster_large;
+    VkDeviceMemory _cluster_large_memory;
+    // Host visible and mapped, read once the frame writing them completed.
+    VkBuffer _cluster_requests[max_frames_in_flight];
+    VkDeviceMemory _cluster_requests_memory[max_frames_in_flight];
+    std::uint32_t* _cluster_request_bits[max_frames_in_flight];
+    MappedFile _cluster_file;
+    ClusterMeshSettings _cluster_settings;
+    ClusterCamera _cluster_camera;
+
+    struct ClusterSlot {
+        std::uint32_t page;
+        // Frame value of the last frame known to draw from the page.
+        std::uint64_t last_used;
+    };
+
+    std::vector<ClusterPage> _cluster_pages;
+    std::vector<std::uint32_t> _cluster_dependencies;
+    // Slot of each page, mirrored by _cluster_page_slots.
+    std::vector<std::uint32_t> _cluster_page_table;
+    std::vector<bool> _cluster_loading;
+    // Resident or loading pages depending on each page, which is only
+    // evicted without any.
+    std::vector<std::uint32_t> _cluster_dependents;
+    std::vector<ClusterSlot> _cluster_slots;
+    std::vector<std::uint32_t> _cluster_free_slots;
+    // Pages whose slot changed since the last frame.
+    std::vector<std::uint32_t> _cluster_dirty;
+    std::uint64_t _cluster_page_offset;
+    std::uint32_t _cluster_count;
+    std::uint32_t _cluster_root_pages;
+    // Pages being loaded, destroy_cluster_mesh waits for none to be left.
+    std::uint32_t _cluster_streams;
+    std::condition_variable _cluster_idle;
+    // Tells pages loaded for a destroyed mesh apart.
+    std::uint64_t _cluster_generation;
+    // Transfer value of the table upload.
+    std::uint64_t _cluster_upload;
+    bool _cluster_reset;
+    // Set once the tables are uploaded.
+    bool _cluster_ready;
+
+    // Buffers replaced while frames up to and including frame_value may
+    // still read them.
+    struct RetiredBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        std::uint64_t frame_value;
+        // Transfer value of a readback still copying out of the buffer.
+        std::uint64_t transfer_value;
+    };
+
+    std::vector<RetiredBuffer> _retired_buffers;
+
+    JobSystem _jobs;
+    TimelineWaiter _waiter;
+    ShaderCompiler _shader_compiler;
 #ifndef NDEBUG
     VkDebugUtilsMessengerEXT _dbg_messenger;
 #endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace Motorino {
+
+struct Geometry;
+
+// One per channel of the density map.
+constexpr std::uint32_t max_scatter_layers = 4;
+
+// Candidates are generated by groups of this many invocations.
+constexpr std::uint32_t scatter_group_size = 64;
+
+// One kind of instance, say grass, rocks or trees, drawn with a range of
+// the indices of ScatterSettings::mesh. Its density is the matching channel
+// of the density map.
+struct ScatterLayer {
+    // Random positions tried per tile, rounded up to scatter_group_size.
+    std::uint32_t candidates_per_tile = 256;
+
+    // Instances the layer holds at most. Accepted candidates past it are
+    // dropped.
+    std::uint32_t capacity = 64 * 1024;
+
+    // Bounding sphere of the mesh at scale one, for culling.
+    float radius = 1.0f;
+    float min_scale = 1.0f;
+    float max_scale = 1.0f;
+
+    // Nothing further from the camera is generated, whole tiles past it
+    // are skipped before trying any candidate.
+    float max_distance = 200.0f;
+
+    // Copied into the indirect command of the layer. Every index of the
+    // range plus vertex_offset must name a vertex of the mesh.
+    std::uint32_t index_count;
+    std::uint32_t first_index = 0;
+    std::int32_t vertex_offset = 0;
+};
+
+// A terrain on the xz plane, split in tiles of the same size. The density
+// and height maps span the whole terrain and are sampled bilinearly.
+struct ScatterSettings {
+    float origin[2];
+    float size[2];
+    std::uint32_t tiles[2];
+
+    std::uint32_t map_width;
+    std::uint32_t map_height;
+
+    // RGBA8 texels, channel l the probability a candidate of layer l is
+    // kept.
+    std::span<const std::uint32_t> density;
+
+    // One per texel, between 0 and 1, mapped to [height_min, height_max].
+    std::span<const float> heights;
+    float height_min = 0.0f;
+    float height_max = 0.0f;
+
+    ScatterLayer layers[max_scatter_layers];
+    std::uint32_t layer_count = 1;
+
+    // Indexed triangle list holding the meshes of every layer, read like
+    // ImpostorSettings reads its geometry: the float3 position at
+    // position_offset and, unless color_offset is UINT32_MAX, the float3
+    // color at color_offset. Instances are drawn unlit in that color.
+    const Geometry* mesh = nullptr;
+    std::uint32_t position_offset = 0;
+    std::uint32_t color_offset = UINT32_MAX;
+
+    std::uint32_t seed = 0;
+};
+
+struct ScatterCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+    float position[3];
+};
+
+// Written by the scatter pass, 16 bytes each. Layer l owns the instances
+// from the sum of the capacities of the layers before it, which is also
+// the firstInstance of its draw, so gl_InstanceIndex indexes the buffer.
+struct ScatterInstance {
+    float position[3];
+    float scale;
+};
+
+// Same layout as VkDrawIndexedIndirectCommand.
+struct ScatterCommand {
+    std::uint32_t index_count;
+    std::uint32_t instance_count;
+    std::uint32_t first_index;
+    std::int32_t vertex_offset;
+    std::uint32_t first_instance;
+};
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "nkgt/pipeline.hpp"
+#include "nkgt/task.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Forward declare shaderc types to avoid public include
+typedef struct shaderc_compiler* shaderc_compiler_t;
+
+namespace Motorino {
+
+class JobSystem;
+
+using SpirV = std::vector<std::uint32_t>;
+
+// Turns ShaderInfos into SPIR-V. Binaries are read as is; sources are compiled
+// with shaderc when the library is built with MOTORINO_RUNTIME_SHADERS and the
+// result is cached on disk, keyed by the source, every file it includes, the
+// defines, the stage and the compiler version.
+class ShaderCompiler {
+public:
+    ShaderCompiler(
+        JobSystem& jobs,
+        std::filesystem::path cache_directory
+    );
+    ~ShaderCompiler();
+
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    auto operator=(const ShaderCompiler&) -> ShaderCompiler& = delete;
+
+    auto load(
+        const ShaderInfo& shader
+    ) -> std::optional<SpirV>;
+
+    // Loads every shader in parallel on the job system.
+    auto load_all(
+        std::span<const ShaderInfo> shaders
+    ) -> std::vector<std::optional<SpirV>>;
+
+    auto load_async(
+        ShaderInfo shader
+    ) -> Task<std::optional<SpirV>>;
+
+private:
+    auto compile(
+        const ShaderInfo& shader,
+        const std::filesystem::path& source_path,
+        std::uint64_t key
+    ) -> std::optional<SpirV>;
+
+    JobSystem& _jobs;
+    std::filesystem::path _cache_directory;
+    std::uint64_t _compiler_version;
+    shaderc_compiler_t _compiler;
+};
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "nkgt/material.hpp"
+
+#include <cstdint>
+
+namespace Motorino {
+
+enum class SnapshotSection : std::uint32_t {
+    Geometry,
+    Materials,
+    World,
+};
+
+// On disk layout: SnapshotHeader, section_count SnapshotEntries, then the
+// sections. Offsets are relative to the start of the file, so a mapped
+// snapshot is used in place: loading is a lookup per section and one copy of
+// each into staging memory, nothing is parsed per object.
+struct SnapshotHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t section_count;
+    std::uint32_t reserved;
+};
+
+struct SnapshotEntry {
+    SnapshotSection type;
+    std::uint32_t reserved;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// Leads the geometry section, followed by size bytes of vertices and 16-bit
+// indices exactly as they are in the vertex buffer.
+struct SnapshotGeometry {
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    std::uint32_t vertex_stride;
+    // As in Geometry, 0 for interleaved vertices.
+    std::uint32_t position_stride;
+    Material material;
+    std::uint32_t reserved;
+    std::uint64_t size;
+};
+
+constexpr std::uint32_t snapshot_magic = 0x504e534d; // "MSNP"
+constexpr std::uint32_t snapshot_version = 2;
+constexpr std::uint64_t snapshot_alignment = 16;
+
+}
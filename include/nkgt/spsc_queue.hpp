@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace Motorino {
+
+// Bounded queue between exactly one producer and one consumer thread. Neither
+// side locks or blocks, a full queue makes push fail instead.
+template<class T, std::size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+public:
+    auto push(const T& value) -> bool {
+        const std::size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail - _head.load(std::memory_order_acquire) == Capacity) return false;
+
+        _items[tail & (Capacity - 1)] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    auto pop() -> std::optional<T> {
+        const std::size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail.load(std::memory_order_acquire)) return std::nullopt;
+
+        T value = _items[head & (Capacity - 1)];
+        _head.store(head + 1, std::memory_order_release);
+
+        return value;
+    }
+
+private:
+    std::array<T, Capacity> _items{};
+
+    // Each side writes one index only, kept on separate cache lines.
+    alignas(64) std::atomic<std::size_t> _head{ 0 };
+    alignas(64) std::atomic<std::size_t> _tail{ 0 };
+};
+
+}
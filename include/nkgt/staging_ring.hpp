@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkBuffer_T* VkBuffer;
+typedef struct VkDeviceMemory_T* VkDeviceMemory;
+typedef struct VkSemaphore_T* VkSemaphore;
+
+namespace Motorino {
+
+struct StagingAllocation {
+    unsigned char* data;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint64_t id;
+};
+
+// Persistently mapped host visible buffer handed out front to back. Space is
+// reused once the transfer timeline passed the value an allocation was
+// released with, so uploads never create staging buffers of their own.
+class StagingRing {
+public:
+    StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    auto operator=(const StagingRing&) -> StagingRing& = delete;
+
+    // Takes ownership of buffer and memory, which must be host visible and
+    // coherent and at least size bytes large.
+    auto init(
+        VkDevice device,
+        VkBuffer buffer,
+        VkDeviceMemory memory,
+        std::uint64_t size,
+        VkSemaphore timeline
+    ) -> bool;
+
+    auto destroy() -> void;
+
+    // Blocks while the space needed is held by allocations released to
+    // transfers still in flight. Returns nullopt if size can never fit, or
+    // if the oldest allocation in the way was not released yet: it may be
+    // held by the caller itself, or by a job the caller waits for, so
+    // waiting could deadlock. Callers then stage through a buffer of their
+    // own.
+    auto allocate(
+        std::uint64_t size,
+        std::uint64_t alignment = 16
+    ) -> std::optional<StagingAllocation>;
+
+    // Marks the allocation reusable once the timeline reaches value.
+    auto release(
+        const StagingAllocation& allocation,
+        std::uint64_t value
+    ) -> void;
+
+    auto buffer() const -> VkBuffer {
+        return _buffer;
+    }
+
+    auto size() const -> std::uint64_t {
+        return _size;
+    }
+
+private:
+    struct Block {
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::uint64_t value;
+        bool released;
+    };
+
+    auto try_allocate(
+        std::uint64_t size,
+        std::uint64_t alignment
+    ) -> std::optional<StagingAllocation>;
+
+    auto reclaim() -> void;
+
+    VkDevice _device;
+    VkBuffer _buffer;
+    VkDeviceMemory _memory;
+    VkSemaphore _timeline;
+    unsigned char* _data;
+    std::uint64_t _size;
+    std::uint64_t _head;
+    std::uint64_t _first_id;
+    std::deque<Block> _blocks;
+    std::mutex _mutex;
+};
+
+}
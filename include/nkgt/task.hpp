@@ -0,0 +1,114 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace Motorino {
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    struct FinalAwaiter {
+        auto await_ready() const noexcept -> bool { return false; }
+
+        template<typename Promise>
+        auto await_suspend(std::coroutine_handle<Promise> handle) noexcept -> std::coroutine_handle<> {
+            return handle.promise().continuation;
+        }
+
+        auto await_resume() const noexcept -> void {}
+    };
+
+    auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+    auto final_suspend() noexcept -> FinalAwaiter { return {}; }
+    auto unhandled_exception() noexcept -> void { std::terminate(); }
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    auto get_return_object() -> Task<T>;
+
+    auto return_value(T result) -> void {
+        value.emplace(std::move(result));
+    }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    auto get_return_object() -> Task<void>;
+    auto return_void() noexcept -> void {}
+};
+
+}
+
+// Lazily started coroutine. Awaiting it starts the body on the awaiting thread
+// and resumes the awaiter on whichever thread the body finishes on.
+template<typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : _handle{ handle }
+    {}
+
+    Task(Task&& other) noexcept
+        : _handle{ std::exchange(other._handle, nullptr) }
+    {}
+
+    auto operator=(Task&& other) noexcept -> Task& {
+        if (this != &other) {
+            if (_handle) _handle.destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    auto operator=(const Task&) -> Task& = delete;
+
+    ~Task() {
+        if (_handle) _handle.destroy();
+    }
+
+    auto await_ready() const noexcept -> bool {
+        return !_handle || _handle.done();
+    }
+
+    auto await_suspend(std::coroutine_handle<> awaiter) noexcept -> std::coroutine_handle<> {
+        _handle.promise().continuation = awaiter;
+        return _handle;
+    }
+
+    auto await_resume() -> T {
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*_handle.promise().value);
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+template<typename T>
+inline auto detail::TaskPromise<T>::get_return_object() -> Task<T> {
+    return Task<T>{ std::coroutine_handle<TaskPromise<T>>::from_promise(*this) };
+}
+
+inline auto detail::TaskPromise<void>::get_return_object() -> Task<void> {
+    return Task<void>{ std::coroutine_handle<TaskPromise<void>>::from_promise(*this) };
+}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Forward declare Vulkan types to avoid public include
+typedef struct VkDevice_T* VkDevice;
+typedef struct VkSemaphore_T* VkSemaphore;
+
+namespace Motorino {
+
+class JobSystem;
+
+// Watches timeline semaphores from a dedicated thread and runs callbacks once
+// they reach the requested value. Callbacks run in registration order on the
+// watcher thread, so they must stay short and hand real work to the jobs.
+class TimelineWaiter {
+public:
+    TimelineWaiter();
+    ~TimelineWaiter();
+
+    TimelineWaiter(const TimelineWaiter&) = delete;
+    auto operator=(const TimelineWaiter&) -> TimelineWaiter& = delete;
+
+    auto start(VkDevice device) -> bool;
+    auto stop() -> void;
+
+    // False if semaphore is sealed below value, the callback never runs.
+    auto add(
+        VkSemaphore semaphore,
+        std::uint64_t value,
+        std::function<void()> callback
+    ) -> bool;
+
+    // Nothing signals semaphore past last_value anymore. Callbacks waiting
+    // for later values are dropped, and adding more of them fails.
+    auto seal(
+        VkSemaphore semaphore,
+        std::uint64_t last_value
+    ) -> void;
+
+    auto reached(
+        VkSemaphore semaphore,
+        std::uint64_t value
+    ) const -> bool;
+
+    // Blocks until every callback added so far, and any added by them, ran.
+    // Only for values submitted work will signal. Returns whether there
+    // was any.
+    auto wait_idle() -> bool;
+
+private:
+    struct Entry {
+        VkSemaphore semaphore;
+        std::uint64_t value;
+        std::function<void()> callback;
+    };
+
+    struct Seal {
+        VkSemaphore semaphore;
+        std::uint64_t last_value;
+    };
+
+    auto watch() -> void;
+    auto wake() -> void;
+
+    VkDevice _device;
+    VkSemaphore _wake_semaphore;
+    std::uint64_t _wake_value;
+    std::vector<Entry> _entries;
+    std::vector<Seal> _seals;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::condition_variable _idle;
+    std::thread _thread;
+    // Set while the watcher runs callbacks it took out of _entries.
+    bool _running;
+    bool _stop;
+};
+
+// Result of an asynchronous GPU operation. co_await resumes on the job system
+// once the semaphore reaches value and yields whether the operation was
+// submitted at all, or false right away if the semaphore was sealed below
+// value. wait() blocks the calling thread instead.
+class TimelineAwaitable {
+public:
+    TimelineAwaitable(
+        TimelineWaiter* waiter,
+        JobSystem* jobs,
+        VkSemaphore semaphore,
+        std::uint64_t value
+    );
+
+    // Same, also yielding false once failed is set. Only set by a callback
+    // added for the same value before the awaitable is, which then ran by
+    // the time it resumes.
+    TimelineAwaitable(
+        TimelineWaiter* waiter,
+        JobSystem* jobs,
+        VkSemaphore semaphore,
+        std::uint64_t value,
+        std::shared_ptr<const std::atomic<bool>> failed
+    );
+
+    auto await_ready() const -> bool;
+    auto await_suspend(std::coroutine_handle<> handle) -> bool;
+
+    auto await_resume() const noexcept -> bool {
+        return _semaphore != nullptr && !(_failed && _failed->load());
+    }
+
+    auto wait() -> bool;
+
+private:
+    TimelineWaiter* _waiter;
+    JobSystem* _jobs;
+    VkSemaphore _semaphore;
+    std::uint64_t _value;
+    std::shared_ptr<const std::atomic<bool>> _failed;
+};
+
+}
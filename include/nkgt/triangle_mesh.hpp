@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace Motorino {
+
+struct Geometry;
+
+// float3 math of the CPU mesh builders, which work on copies of the
+// vertices read out of a Geometry.
+using Vec3 = std::array<float, 3>;
+
+inline auto operator+(const Vec3& a, const Vec3& b) -> Vec3 {
+    return { a[0] + b[0], a[1] + b[1], a[2] + b[2] };
+}
+
+inline auto operator-(const Vec3& a, const Vec3& b) -> Vec3 {
+    return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+inline auto operator*(const Vec3& v, float s) -> Vec3 {
+    return { v[0] * s, v[1] * s, v[2] * s };
+}
+
+inline auto dot(const Vec3& a, const Vec3& b) -> float {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline auto cross(const Vec3& a, const Vec3& b) -> Vec3 {
+    return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+inline auto length(const Vec3& v) -> float {
+    return std::sqrt(dot(v, v));
+}
+
+inline auto distance(
+    const Vec3& a,
+    const Vec3& b
+) -> float {
+    return length(a - b);
+}
+
+// The zero vector has no direction, it maps to fallback.
+inline auto normalize(
+    const Vec3& v,
+    const Vec3& fallback = { 0.0f, 1.0f, 0.0f }
+) -> Vec3 {
+    const float l = length(v);
+    if (l == 0.0f) return fallback;
+    return { v[0] / l, v[1] / l, v[2] / l };
+}
+
+// Corners of the box around points, of which there is at least one.
+inline auto bounds(
+    std::span<const Vec3> points,
+    Vec3& lower,
+    Vec3& upper
+) -> void {
+    lower = points[0];
+    upper = points[0];
+
+    for (const Vec3& point : points) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], point[c]);
+            upper[c] = std::max(upper[c], point[c]);
+        }
+    }
+}
+
+// Copy of the positions, colors and triangles of a Geometry.
+struct TriangleMesh {
+    std::vector<Vec3> positions;
+    // White where the geometry has no color.
+    std::vector<Vec3> colors;
+    std::vector<std::uint16_t> indices;
+};
+
+// Reads the float3 position at position_offset of every vertex and, unless
+// color_offset is UINT32_MAX, the float3 color at color_offset, along with
+// the 16-bit indices after the vertices. Fails on geometry that isn't an
+// indexed triangle list, whose vertices are split in two streams or whose
+// attributes lie outside the vertex; user names the caller in the errors.
+auto read_triangle_mesh(
+    const Geometry& geometry,
+    std::uint32_t position_offset,
+    std::uint32_t color_offset,
+    std::string_view user,
+    TriangleMesh& mesh
+) -> bool;
+
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace Motorino {
+
+// Values mirror VkFormat so they can be cast directly on the Vulkan side.
+enum class VertexFormat : std::uint32_t {
+    R8G8B8A8_UNORM      = 37,
+    R8G8B8A8_SNORM      = 38,
+    R8G8B8A8_UINT       = 41,
+    R16G16_UNORM        = 77,
+    R16G16_SNORM        = 78,
+    R16G16_UINT         = 81,
+    R16G16_SFLOAT       = 83,
+    R16G16B16A16_UNORM  = 91,
+    R16G16B16A16_SNORM  = 92,
+    R16G16B16A16_UINT   = 95,
+    R16G16B16A16_SFLOAT = 97,
+    R32_UINT            = 98,
+    R32_SINT            = 99,
+    R32_SFLOAT          = 100,
+    R32G32_UINT         = 101,
+    R32G32_SINT         = 102,
+    R32G32_SFLOAT       = 103,
+    R32G32B32_UINT      = 104,
+    R32G32B32_SINT      = 105,
+    R32G32B32_SFLOAT    = 106,
+    R32G32B32A32_UINT   = 107,
+    R32G32B32A32_SINT   = 108,
+    R32G32B32A32_SFLOAT = 109,
+};
+
+struct Vertex {
+    float pos[2];
+    float color[3];
+};
+
+// Vertex split in two streams, see Geometry::position_stride. Locations match
+// those of Vertex, so the same shaders read either layout.
+struct VertexPosition {
+    float pos[2];
+};
+
+struct VertexAttributes {
+    float color[3];
+};
+
+// Same layout as VkVertexInputBindingDescription (input rate is always per vertex).
+struct VertexBinding {
+    std::uint32_t binding;
+    std::uint32_t stride;
+    std::uint32_t input_rate;
+};
+
+// Same layout as VkVertexInputAttributeDescription.
+struct VertexAttribute {
+    std::uint32_t location;
+    std::uint32_t binding;
+    VertexFormat format;
+    std::uint32_t offset;
+};
+
+struct VertexInput {
+    VertexBinding binding;
+    std::span<const VertexAttribute> attributes;
+};
+
+// Compact attribute types. Wrapping the storage in a struct keeps each one a
+// single member of the vertex, so the format can be picked from the type.
+struct unorm8x4  { std::uint8_t  value[4]; };
+struct snorm8x4  { std::int8_t   value[4]; };
+struct unorm16x2 { std::uint16_t value[2]; };
+struct snorm16x2 { std::int16_t  value[2]; };
+struct unorm16x4 { std::uint16_t value[4]; };
+struct snorm16x4 { std::int16_t  value[4]; };
+struct half2     { std::uint16_t bits[2]; };
+struct half4     { std::uint16_t bits[4]; };
+
+// Maps a vertex member type to its attribute format. Specialize it to support
+// additional member types.
+template<typename T>
+struct vertex_format;
+
+template<VertexFormat F>
+struct vertex_format_constant {
+    static constexpr VertexFormat value = F;
+};
+
+template<> struct vertex_format<float>            : vertex_format_constant<VertexFormat::R32_SFLOAT> {};
+template<> struct vertex_format<float[2]>         : vertex_format_constant<VertexFormat::R32G32_SFLOAT> {};
+template<> struct vertex_format<float[3]>         : vertex_format_constant<VertexFormat::R32G32B32_SFLOAT> {};
+template<> struct vertex_format<float[4]>         : vertex_format_constant<VertexFormat::R32G32B32A32_SFLOAT> {};
+template<> struct vertex_format<std::uint32_t>    : vertex_format_constant<VertexFormat::R32_UINT> {};
+template<> struct vertex_format<std::uint32_t[2]> : vertex_format_constant<VertexFormat::R32G32_UINT> {};
+template<> struct vertex_format<std::uint32_t[3]> : vertex_format_constant<VertexFormat::R32G32B32_UINT> {};
+template<> struct vertex_format<std::uint32_t[4]> : vertex_format_constant<VertexFormat::R32G32B32A32_UINT> {};
+template<> struct vertex_format<std::int32_t>     : vertex_format_constant<VertexFormat::R32_SINT> {};
+template<> struct vertex_format<std::int32_t[2]>  : vertex_format_constant<VertexFormat::R32G32_SINT> {};
+template<> struct vertex_format<std::int32_t[3]>  : vertex_format_constant<VertexFormat::R32G32B32_SINT> {};
+template<> struct vertex_format<std::int32_t[4]>  : vertex_format_constant<VertexFormat::R32G32B32A32_SINT> {};
+template<> struct vertex_format<std::uint16_t[2]> : vertex_format_constant<VertexFormat::R16G16_UINT> {};
+template<> struct vertex_format<std::uint16_t[4]> : vertex_format_constant<VertexFormat::R16G16B16A16_UINT> {};
+template<> struct vertex_format<std::uint8_t[4]>  : vertex_format_constant<VertexFormat::R8G8B8A8_UINT> {};
+template<> struct vertex_format<unorm8x4>         : vertex_format_constant<VertexFormat::R8G8B8A8_UNORM> {};
+template<> struct vertex_format<snorm8x4>         : vertex_format_constant<VertexFormat::R8G8B8A8_SNORM> {};
+template<> struct vertex_format<unorm16x2>        : vertex_format_constant<VertexFormat::R16G16_UNORM> {};
+template<> struct vertex_format<snorm16x2>        : vertex_format_constant<VertexFormat::R16G16_SNORM> {};
+template<> struct vertex_format<unorm16x4>        : vertex_format_constant<VertexFormat::R16G16B16A16_UNORM> {};
+template<> struct vertex_format<snorm16x4>        : vertex_format_constant<VertexFormat::R16G16B16A16_SNORM> {};
+template<> struct vertex_format<half2>            : vertex_format_constant<VertexFormat::R16G16_SFLOAT> {};
+template<> struct vertex_format<half4>            : vertex_format_constant<VertexFormat::R16G16B16A16_SFLOAT> {};
+
+template<typename T>
+concept VertexMember = requires { vertex_format<T>::value; };
+
+namespace detail {
+
+struct any_member {
+    template<typename T>
+    constexpr operator T() const noexcept;
+};
+
+// Every member is initialized from its own braced list, which disables brace
+// elision: array members count as one member instead of one per element.
+template<typename T, std::size_t... I>
+constexpr auto is_braces_constructible(std::index_sequence<I...>) -> bool {
+    return requires { T{ { (static_cast<void>(I), any_member{}) }... }; };
+}
+
+template<typename T, std::size_t N = 0>
+constexpr auto member_count() -> std::size_t {
+    if constexpr (is_braces_constructible<T>(std::make_index_sequence<N + 1>{})) {
+        return member_count<T, N + 1>();
+    }
+    else {
+        return N;
+    }
+}
+
+template<typename... Ts>
+struct type_list {};
+
+// Only ever used for return type deduction, the body is never evaluated.
+template<typename T>
+constexpr auto member_types() {
+    constexpr std::size_t count = member_count<T>();
+    T* v = nullptr;
+
+    if constexpr (count == 1) {
+        auto& [a] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>>{};
+    }
+    else if constexpr (count == 2) {
+        auto& [a, b] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>>{};
+    }
+    else if constexpr (count == 3) {
+        auto& [a, b, c] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>>{};
+    }
+    else if constexpr (count == 4) {
+        auto& [a, b, c, d] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>,
+                         std::remove_cvref_t<decltype(d)>>{};
+    }
+    else if constexpr (count == 5) {
+        auto& [a, b, c, d, e] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>,
+                         std::remove_cvref_t<decltype(d)>,
+                         std::remove_cvref_t<decltype(e)>>{};
+    }
+    else if constexpr (count == 6) {
+        auto& [a, b, c, d, e, f] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>,
+                         std::remove_cvref_t<decltype(d)>,
+                         std::remove_cvref_t<decltype(e)>,
+                         std::remove_cvref_t<decltype(f)>>{};
+    }
+    else if constexpr (count == 7) {
+        auto& [a, b, c, d, e, f, g] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>,
+                         std::remove_cvref_t<decltype(d)>,
+                         std::remove_cvref_t<decltype(e)>,
+                         std::remove_cvref_t<decltype(f)>,
+                         std::remove_cvref_t<decltype(g)>>{};
+    }
+    else if constexpr (count == 8) {
+        auto& [a, b, c, d, e, f, g, h] = *v;
+        return type_list<std::remove_cvref_t<decltype(a)>,
+                         std::remove_cvref_t<decltype(b)>,
+                         std::remove_cvref_t<decltype(c)>,
+                         std::remove_cvref_t<decltype(d)>,
+                         std::remove_cvref_t<decltype(e)>,
+                         std::remove_cvref_t<decltype(f)>,
+                         std::remove_cvref_t<decltype(g)>,
+                         std::remove_cvref_t<decltype(h)>>{};
+    }
+    else {
+        static_assert(count >= 1 && count <= 8, "Vertex types must have between 1 and 8 members.");
+        return type_list<>{};
+    }
+}
+
+template<typename... Ts>
+constexpr auto make_attributes(
+    std::uint32_t binding,
+    std::uint32_t first_location,
+    type_list<Ts...>
+) -> std::array<VertexAttribute, sizeof...(Ts)> {
+    static_assert((VertexMember<Ts> && ...), "Vertex member type has no vertex_format specialization.");
+
+    constexpr std::size_t sizes[] = { sizeof(Ts)... };
+    constexpr std::size_t alignments[] = { alignof(Ts)... };
+    constexpr VertexFormat formats[] = { vertex_format<Ts>::value... };
+
+    // Standard layout aggregates place each member at the next offset
+    // satisfying its alignment, which is what offsetof would report.
+    std::array<VertexAttribute, sizeof...(Ts)> attributes{};
+    std::size_t offset = 0;
+
+    for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+        offset = (offset + alignments[i] - 1) / alignments[i] * alignments[i];
+
+        attributes[i] = {
+            .location = first_location + static_cast<std::uint32_t>(i),
+            .binding = binding,
+            .format = formats[i],
+            .offset = static_cast<std::uint32_t>(offset),
+        };
+
+        offset += sizes[i];
+    }
+
+    return attributes;
+}
+
+}
+
+template<typename T>
+concept VertexType = std::is_aggregate_v<T> &&
+                     std::is_standard_layout_v<T> &&
+                     std::is_trivially_copyable_v<T>;
+
+// Members get consecutive locations from FirstLocation on, so a second
+// stream can continue where the first one ends.
+template<VertexType T, std::uint32_t Binding = 0, std::uint32_t FirstLocation = 0>
+inline constexpr auto vertex_attributes = detail::make_attributes(
+    Binding,
+    FirstLocation,
+    decltype(detail::member_types<T>()){}
+);
+
+template<VertexType T, std::uint32_t Binding = 0, std::uint32_t FirstLocation = 0>
+inline constexpr VertexInput vertex_input{
+    .binding = {
+        .binding = Binding,
+        .stride = sizeof(T),
+        .input_rate = 0,
+    },
+    .attributes = vertex_attributes<T, Binding, FirstLocation>,
+};
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+
+namespace Motorino {
+
+// Voxels along each side of a brick, the unit of streaming and of empty
+// space skipping.
+constexpr std::uint32_t volume_brick_size = 32;
+
+// Bricks are stored with a one voxel apron on every side, so trilinear
+// samples never read a neighbor brick.
+constexpr std::uint32_t volume_brick_stride = volume_brick_size + 2;
+
+// Bricks of the whole volume at most, each keeps a table entry on the GPU.
+constexpr std::uint32_t max_volume_bricks = 1u << 24;
+
+// Entries of the transfer function, one per 8-bit voxel value.
+constexpr std::uint32_t volume_transfer_size = 256;
+
+// Fills the voxels of the box starting at origin, x fastest then y then z.
+// Called from the job system, several bricks at a time. Returning false
+// leaves the brick empty.
+using VolumeLoader = std::function<bool(
+    const std::uint32_t (&origin)[3],
+    const std::uint32_t (&extent)[3],
+    std::span<std::uint8_t> voxels
+)>;
+
+struct VolumeSettings {
+    // In voxels, any size but zero: only the bricks rays reach are ever
+    // loaded.
+    std::uint32_t size[3] = { 0, 0, 0 };
+    // World position of the corner of voxel 0, 0, 0.
+    float origin[3] = { 0.0f, 0.0f, 0.0f };
+    float voxel_size[3] = { 1.0f, 1.0f, 1.0f };
+    // Bricks resident at once, 39 KB each. The least recently used brick
+    // is evicted to make room for a new one.
+    std::uint32_t pool_bricks = 4096;
+    // Ray marching step, in voxels.
+    float step = 0.5f;
+};
+
+struct VolumeCamera {
+    // Column major, clip space depth from 0 to 1 as in Vulkan.
+    float view_projection[16];
+};
+
+}
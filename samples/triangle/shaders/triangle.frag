@@ -1,8 +1,94 @@
 #version 450
 
+// Lit by the IBL maps the engine binds at set 2, see Motorino::IblLayout.
+// The offsets follow the default IblSettings the sample bakes with.
+
+layout(std430, set = 2, binding = 0) readonly buffer Ibl {
+    uint words[];
+} ibl;
+
+const uint cube_size = 128;
+const uint mip_count = 6;
+const uint lut_size = 128;
+
+// In words.
+const uint brdf_offset = 9 * 4;
+const uint specular_offset = brdf_offset + lut_size * lut_size;
+
+const float roughness = 0.4;
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragPosition;
+
 layout(location = 0) out vec4 outColor;
 
+vec3 irradiance(vec3 n) {
+    float basis[9] = float[](
+        0.282095,
+        0.488603 * n.y,
+        0.488603 * n.z,
+        0.488603 * n.x,
+        1.092548 * n.x * n.y,
+        1.092548 * n.y * n.z,
+        0.315392 * (3.0 * n.z * n.z - 1.0),
+        1.092548 * n.x * n.z,
+        0.546274 * (n.x * n.x - n.y * n.y)
+    );
+
+    vec3 sum = vec3(0.0);
+
+    for (uint i = 0; i < 9; ++i) {
+        sum += uintBitsToFloat(uvec3(ibl.words[i * 4], ibl.words[i * 4 + 1], ibl.words[i * 4 + 2])) * basis[i];
+    }
+
+    return max(sum, vec3(0.0));
+}
+
+// Nearest texel of the prefiltered mip in direction d.
+vec3 prefiltered(vec3 d, uint mip) {
+    uint offset = specular_offset;
+
+    for (uint m = 0; m < mip; ++m) {
+        uint face_size = cube_size >> m;
+        offset += 6 * face_size * face_size * 2;
+    }
+
+    uint size = cube_size >> mip;
+    vec3 a = abs(d);
+    uint face;
+    vec2 uv;
+
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x > 0.0 ? 0 : 1;
+        uv = vec2(d.x > 0.0 ? -d.z : d.z, -d.y) / a.x;
+    }
+    else if (a.y >= a.z) {
+        face = d.y > 0.0 ? 2 : 3;
+        uv = vec2(d.x, d.y > 0.0 ? d.z : -d.z) / a.y;
+    }
+    else {
+        face = d.z > 0.0 ? 4 : 5;
+        uv = vec2(d.z > 0.0 ? d.x : -d.x, -d.y) / a.z;
+    }
+
+    uvec2 p = uvec2(clamp((uv * 0.5 + 0.5) * float(size), vec2(0.0), vec2(size - 1)));
+    uint word = offset + ((face * size + p.y) * size + p.x) * 2;
+
+    return vec3(unpackHalf2x16(ibl.words[word]), unpackHalf2x16(ibl.words[word + 1]).x);
+}
+
+vec2 brdf(float n_dot_v) {
+    uvec2 p = uvec2(min(vec2(n_dot_v, roughness) * float(lut_size), vec2(lut_size - 1)));
+    return unpackHalf2x16(ibl.words[brdf_offset + p.y * lut_size + p.x]);
+}
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    // A dome bulging towards the viewer, who looks down +z.
+    vec3 n = normalize(vec3(fragPosition, -1.0));
+    vec3 v = vec3(0.0, 0.0, -1.0);
+
+    vec2 split = brdf(max(dot(n, v), 0.0));
+    vec3 specular = prefiltered(reflect(-v, n), uint(roughness * float(mip_count - 1) + 0.5)) * (0.04 * split.x + split.y);
+
+    outColor = vec4(fragColor * irradiance(n) + specular, 1.0);
+}
@@ -1,23 +1,81 @@
+#include <nkgt/logger.hpp>
 #include <nkgt/renderer.hpp>
 
-int main() {
-    Motorino::Engine vroom(800, 600, "Triangle");
-    if (!vroom.init_vulkan()) {
-        return EXIT_FAILURE;
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+constexpr Motorino::PipelineState triangle_pipeline{
+    .shaders = {{
+        { Motorino::ShaderStage::Fragment, "shaders/frag.spv" },
+        { Motorino::ShaderStage::Vertex, "shaders/vert.spv" },
+    }},
+};
+
+// Equirectangular sky for the IBL bake: blue above the horizon, brown
+// below, with a bright sun up and to the right.
+static auto sky(
+    std::uint32_t width,
+    std::uint32_t height
+) -> std::vector<float> {
+    constexpr float pi = 3.14159265f;
+    std::vector<float> texels;
+
+    for (std::uint32_t y = 0; y < height; ++y) {
+        for (std::uint32_t x = 0; x < width; ++x) {
+            const float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * pi;
+            const float theta = (y + 0.5f) / height * pi;
+            const float up = std::cos(theta);
+            const float sun = std::pow(std::max(std::sin(theta) * std::cos(phi) * 0.6f + up * 0.8f, 0.0f), 64.0f) * 20.0f;
+
+            const float color[3] = {
+                up > 0.0f ? 0.3f + sun : 0.25f,
+                up > 0.0f ? 0.5f + sun : 0.18f,
+                up > 0.0f ? 0.9f + sun : 0.1f,
+            };
+
+            texels.insert(texels.end(), { color[0], color[1], color[2], 1.0f });
+        }
     }
 
-    std::vector<Motorino::ShaderInfo> shaders = {
-        {
-            Motorino::ShaderStage::Fragment,
-            "shaders/frag.spv"
-        },
-        {
-            Motorino::ShaderStage::Vertex,
-            "shaders/vert.spv"
-        },
-    };
+    return texels;
+}
+
+static auto load(
+    Motorino::Engine& engine,
+    const Motorino::Geometry* geometry,
+    const std::vector<float>* environment
+) -> Motorino::Task<void> {
+    // The upload and the IBL bake run on the GPU while the pipeline
+    // compiles.
+    auto upload = engine.upload(geometry);
+    auto ibl = engine.load_ibl({ .environment = *environment, .width = 64, .height = 32 });
+
+    if (!co_await engine.compile_pipeline(triangle_pipeline)) {
+        Motorino::Logger::error("Failed to compile triangle pipeline.\n");
+        co_return;
+    }
+
+    // The fragment shader reads the maps, which are only bound once baked.
+    if (!co_await ibl) {
+        Motorino::Logger::error("Failed to load the IBL maps.\n");
+        co_return;
+    }
+
+    engine.create_pipeline<triangle_pipeline>();
+
+    if (!co_await upload) {
+        Motorino::Logger::error("Failed to upload triangle geometry.\n");
+        co_return;
+    }
 
-    if (!vroom.create_pipeline(shaders)) {
+    co_await engine.next_frame();
+    Motorino::Logger::info("First frame with the triangle rendered.\n");
+}
+
+int main() {
+    Motorino::Engine vroom(800, 600, "Triangle");
+    if (!vroom.init_vulkan()) {
         return EXIT_FAILURE;
     }
 
@@ -45,10 +103,9 @@ int main() {
     std::memcpy(geometry.data, vertices, vertex_bytes);
     std::memcpy(geometry.data + vertex_bytes, indices, index_bytes);
 
-    if (!vroom.submit_vertex_data(&geometry)) {
-        return EXIT_FAILURE;
-    }
+    const std::vector<float> environment = sky(64, 32);
 
+    vroom.jobs().spawn(load(vroom, &geometry, &environment));
     vroom.run();
 
     delete[] geometry.data;
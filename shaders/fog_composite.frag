@@ -0,0 +1,97 @@
+#version 450
+
+// Lays the fog in front of everything behind the render pass, see
+// Motorino::FogVolume. Pixels the points or clusters kept in the
+// visibility frame read the integrated light and transmittance at their
+// depth, the others the last slice of the froxel column. Blended
+// premultiplied, so the color behind ends up as color * transmittance +
+// light.
+
+// packHalf2x16 (r, g) and (b, transmittance) per froxel.
+layout(std430, set = 0, binding = 0) readonly buffer Integrated {
+    uvec2 froxels[];
+} integrated;
+
+// The start of the Data block of shaders/fog.comp.
+layout(std430, set = 0, binding = 1) readonly buffer Data {
+    mat4 inverse_view_projection;
+    mat4 previous_view_projection;
+    vec4 position;
+    vec4 previous_position;
+    vec4 sun_direction;
+    vec4 sun_color;
+    vec4 ambient;
+    vec4 albedo;
+    uvec4 grid;
+    vec2 depth;
+} data;
+
+// The 64-bit pixels as two words, color first. A depth word of all ones is
+// a pixel nothing reached.
+layout(std430, set = 0, binding = 2) readonly buffer Frame {
+    uvec2 pixels[];
+} frame;
+
+layout(push_constant) uniform Constants {
+    uvec3 grid;
+    uint width;
+    uint height;
+    // One when the visibility frame was rasterized into this frame.
+    uint visibility;
+} constants;
+
+layout(location = 0) out vec4 out_color;
+
+// From the camera to the far side of the slice before, nothing at the
+// camera.
+vec4 boundary(ivec2 column, uint slice) {
+    if (slice == 0) return vec4(0.0, 0.0, 0.0, 1.0);
+
+    uvec2 clamped = uvec2(clamp(column, ivec2(0), ivec2(constants.grid.xy) - 1));
+    uint index = ((slice - 1) * constants.grid.y + clamped.y) * constants.grid.x + clamped.x;
+    uvec2 value = integrated.froxels[index];
+    return vec4(unpackHalf2x16(value.x), unpackHalf2x16(value.y));
+}
+
+// Depth in slices, grid.z being the far end of the column.
+vec4 froxel(ivec2 column, float slice) {
+    float s = clamp(slice, 0.0, float(constants.grid.z));
+    uint lower = min(uint(s), constants.grid.z - 1);
+    return mix(boundary(column, lower), boundary(column, lower + 1), s - float(lower));
+}
+
+// Depth in slices of what the visibility frame kept, or the far end of the
+// column.
+float pixel_slice(vec2 uv) {
+    float far_end = float(constants.grid.z);
+
+    if (constants.visibility == 0) return far_end;
+
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    uint depth = frame.pixels[pixel.y * constants.width + pixel.x].y;
+
+    if (depth == 0xffffffffu) return far_end;
+
+    vec4 point = data.inverse_view_projection * vec4(uv * 2.0 - 1.0, uintBitsToFloat(depth), 1.0);
+    float d = max(distance(point.xyz / point.w, data.position.xyz), data.depth.x);
+
+    return log(d / data.depth.x) / log(data.depth.y / data.depth.x) * far_end;
+}
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / vec2(constants.width, constants.height);
+    float slice = pixel_slice(uv);
+
+    // Bilinear between columns, so the grid doesn't show as blocks.
+    vec2 coord = uv * vec2(constants.grid.xy) - 0.5;
+    ivec2 base = ivec2(floor(coord));
+    vec2 f = coord - vec2(base);
+
+    vec4 value = mix(
+        mix(froxel(base, slice), froxel(base + ivec2(1, 0), slice), f.x),
+        mix(froxel(base + ivec2(0, 1), slice), froxel(base + ivec2(1, 1), slice), f.x),
+        f.y
+    );
+
+    out_color = vec4(value.rgb, 1.0 - value.a);
+}
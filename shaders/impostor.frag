@@ -0,0 +1,57 @@
+#version 450
+
+// Blends the three views of shaders/impostor.vert by their weights. Where
+// the blend mostly misses the mesh the quad is cut, the rest is lit by one
+// directional light through the baked normals.
+
+// Albedo, then normal texels of the atlas, RGBA8 each.
+layout(std430, set = 0, binding = 1) readonly buffer Atlas {
+    uint texels[];
+} atlas;
+
+layout(push_constant) uniform Constants {
+    mat4 view_projection;
+    vec3 camera;
+    uint grid;
+    // Direction the light travels in.
+    vec3 light;
+    uint cell_size;
+} constants;
+
+layout(location = 0) in vec2 in_cell_uvs[3];
+layout(location = 3) flat in vec3 in_weights;
+layout(location = 4) flat in uint in_cells;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    uint side = constants.grid * constants.cell_size;
+    uint normals = side * side;
+    float last = float(constants.cell_size - 1);
+
+    vec4 albedo = vec4(0.0);
+    vec3 normal = vec3(0.0);
+
+    for (uint i = 0; i < 3; ++i) {
+        vec2 uv = in_cell_uvs[i];
+
+        // The view saw nothing past the sphere.
+        if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) continue;
+
+        uint cell = (in_cells >> (i * 10)) & 0x3ffu;
+        uvec2 origin = uvec2(cell % constants.grid, cell / constants.grid) * constants.cell_size;
+        uvec2 local = uvec2(min(uv * float(constants.cell_size), vec2(last)));
+        uint texel = (origin.y + local.y) * side + origin.x + local.x;
+
+        vec4 color = unpackUnorm4x8(atlas.texels[texel]);
+        float weight = in_weights[i] * color.a;
+
+        albedo += vec4(color.rgb, 1.0) * weight;
+        normal += (unpackUnorm4x8(atlas.texels[normals + texel]).xyz * 2.0 - 1.0) * weight;
+    }
+
+    if (albedo.a < 0.5) discard;
+
+    float lit = 0.25 + 0.75 * max(dot(normalize(normal), -constants.light), 0.0);
+    out_color = vec4(albedo.rgb / albedo.a * lit, 1.0);
+}
@@ -0,0 +1,82 @@
+#version 450
+
+// Camera facing quads of the impostors Motorino::select_impostors picked,
+// see Motorino::ImpostorAtlas. Nothing comes from vertex buffers: every six
+// vertices are one quad spanning the bounding sphere of the instance
+// gl_InstanceIndex points at. Each of the three views blended gets the quad
+// position in its own projection, so shaders/impostor.frag reads every view
+// where it saw that point.
+
+struct Instance {
+    vec3 position;
+    float radius;
+    vec3 weights;
+    // Cell indices y * grid + x, 10 bits each from the lowest.
+    uint cells;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance data[];
+} instances;
+
+layout(push_constant) uniform Constants {
+    mat4 view_projection;
+    vec3 camera;
+    uint grid;
+    vec3 light;
+    uint cell_size;
+} constants;
+
+// Position in every cell, 0 to 1 across it and rows top to bottom.
+layout(location = 0) out vec2 out_cell_uvs[3];
+layout(location = 3) flat out vec3 out_weights;
+layout(location = 4) flat out uint out_cells;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0),
+    vec2(-1.0, 1.0), vec2(1.0, -1.0), vec2(1.0, 1.0)
+);
+
+// Same as Motorino::hemi_octahedral_direction.
+vec3 hemi_octahedral_direction(vec2 p) {
+    float x = (p.x + p.y) * 0.5;
+    float z = (p.x - p.y) * 0.5;
+    return normalize(vec3(x, 1.0 - abs(x) - abs(z), z));
+}
+
+vec3 cell_view(uint cell) {
+    vec2 center = vec2(cell % constants.grid, cell / constants.grid) + 0.5;
+    return hemi_octahedral_direction(center / float(constants.grid) * 2.0 - 1.0);
+}
+
+// The axes the atlas is baked with, -z up when looking straight down. The
+// quads use them from below as well.
+void view_axes(vec3 view, out vec3 right, out vec3 up) {
+    vec3 up_axis = abs(view.y) > 0.999 ? vec3(0.0, 0.0, -1.0) : vec3(0.0, 1.0, 0.0);
+    right = normalize(cross(up_axis, view));
+    up = cross(view, right);
+}
+
+void main() {
+    Instance instance = instances.data[gl_InstanceIndex];
+    vec2 corner = corners[gl_VertexIndex];
+
+    vec3 right;
+    vec3 up;
+    view_axes(normalize(constants.camera - instance.position), right, up);
+
+    // In radii, from the center of the sphere.
+    vec3 offset = right * corner.x + up * corner.y;
+    gl_Position = constants.view_projection * vec4(instance.position + offset * instance.radius, 1.0);
+
+    for (uint i = 0; i < 3; ++i) {
+        vec3 cell_right;
+        vec3 cell_up;
+        view_axes(cell_view((instance.cells >> (i * 10)) & 0x3ffu), cell_right, cell_up);
+
+        out_cell_uvs[i] = vec2(dot(offset, cell_right), -dot(offset, cell_up)) * 0.5 + 0.5;
+    }
+
+    out_weights = instance.weights;
+    out_cells = instance.cells;
+}
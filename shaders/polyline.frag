@@ -0,0 +1,35 @@
+#version 450
+
+// Antialiased edges of the quads shaders/polyline.vert expands, cut round
+// past round ends.
+
+layout(push_constant) uniform Constants {
+    mat4 view_projection;
+    vec2 viewport;
+    float half_width;
+    float miter_limit;
+    uint style;
+} constants;
+
+layout(location = 0) noperspective in vec2 in_local;
+layout(location = 1) noperspective in vec4 in_color;
+layout(location = 2) flat in float in_length;
+layout(location = 3) flat in uint in_round;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    float distance_to_line = abs(in_local.y);
+
+    if (in_local.x < 0.0 && (in_round & 1u) != 0) {
+        distance_to_line = length(in_local);
+    }
+    else if (in_local.x > in_length && (in_round & 2u) != 0) {
+        distance_to_line = length(in_local - vec2(in_length, 0.0));
+    }
+
+    float coverage = clamp(constants.half_width + 0.5 - distance_to_line, 0.0, 1.0);
+    if (coverage <= 0.0) discard;
+
+    out_color = vec4(in_color.rgb, in_color.a * coverage);
+}
@@ -0,0 +1,156 @@
+#version 450
+
+// Expands polyline segments into screen space quads, see Motorino::
+// PolylineStyle. Nothing comes from vertex buffers: every six vertices are
+// one segment, whose endpoints and neighbors are pulled from storage
+// buffers. Interior ends meet their neighbor on the miter line, round joins
+// and caps extend the quad by half a width and are cut round by
+// shaders/polyline.frag.
+
+// xyz the position, w the RGBA8 color bits.
+layout(std430, set = 0, binding = 0) readonly buffer Vertices {
+    vec4 data[];
+} vertices;
+
+// Index of the first vertex in the low 30 bits, bit 30 set when it starts
+// its polyline and bit 31 when the second vertex ends it.
+layout(std430, set = 0, binding = 1) readonly buffer Segments {
+    uint words[];
+} segments;
+
+layout(push_constant) uniform Constants {
+    mat4 view_projection;
+    vec2 viewport;
+    float half_width;
+    float miter_limit;
+    // Join in bit 0, cap in bits 1 and 2.
+    uint style;
+} constants;
+
+// Distance to the start along the segment and to its axis, in pixels.
+layout(location = 0) noperspective out vec2 out_local;
+layout(location = 1) noperspective out vec4 out_color;
+layout(location = 2) flat out float out_length;
+// Bit 0 when the start is round, bit 1 the end.
+layout(location = 3) flat out uint out_round;
+
+const uint corners[6] = uint[](0, 1, 2, 2, 1, 3);
+const float near_w = 1e-5;
+
+vec2 to_screen(vec4 clip) {
+    return (clip.xy / clip.w * 0.5 + 0.5) * constants.viewport;
+}
+
+vec4 project(uint index) {
+    return constants.view_projection * vec4(vertices.data[index].xyz, 1.0);
+}
+
+vec2 perpendicular(vec2 v) {
+    return vec2(-v.y, v.x);
+}
+
+vec4 decode_color(uint bits) {
+    vec4 color = unpackUnorm4x8(bits);
+    vec3 linear = mix(color.rgb / 12.92, pow((color.rgb + 0.055) / 1.055, vec3(2.4)), greaterThan(color.rgb, vec3(0.04045)));
+    return vec4(linear, color.a);
+}
+
+void main() {
+    uint word = segments.words[gl_VertexIndex / 6];
+    uint corner = corners[gl_VertexIndex % 6];
+    uint index = word & 0x3fffffffu;
+    bool starts = (word & 0x40000000u) != 0;
+    bool ends = (word & 0x80000000u) != 0;
+
+    vec4 c0 = project(index);
+    vec4 c1 = project(index + 1);
+
+    // Behind the camera: the whole segment goes, half of it is cut at the
+    // near plane.
+    if (c0.w < near_w && c1.w < near_w) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    if (c0.w < near_w) c0 = mix(c0, c1, (near_w - c0.w) / (c1.w - c0.w));
+    if (c1.w < near_w) c1 = mix(c1, c0, (near_w - c1.w) / (c0.w - c1.w));
+
+    vec2 a = to_screen(c0);
+    vec2 b = to_screen(c1);
+    float segment_length = length(b - a);
+    vec2 direction = segment_length > 0.0 ? (b - a) / segment_length : vec2(1.0, 0.0);
+    vec2 normal = perpendicular(direction);
+
+    float half_width = constants.half_width;
+    // One more pixel for antialiasing.
+    float expand = half_width + 1.0;
+
+    bool round_join = (constants.style & 1u) != 0;
+    uint cap = (constants.style >> 1) & 3u;
+
+    // Both ends, since every vertex must agree on the flat outputs.
+    vec2 miters[2];
+    float miter_lengths[2];
+    uint round_ends = 0;
+
+    for (uint end = 0; end < 2; ++end) {
+        bool interior = end == 0 ? !starts : !ends;
+        miters[end] = normal;
+        miter_lengths[end] = 0.0;
+
+        if (!interior) {
+            if (cap == 2u) round_ends |= 1u << end;
+            continue;
+        }
+
+        vec4 neighbor = end == 0 ? project(index - 1) : project(index + 2);
+
+        if (round_join || neighbor.w < near_w) {
+            round_ends |= 1u << end;
+            continue;
+        }
+
+        vec2 other = end == 0 ? a - to_screen(neighbor) : to_screen(neighbor) - b;
+        vec2 other_normal = length(other) > 0.0 ? perpendicular(normalize(other)) : normal;
+        vec2 miter = normal + other_normal;
+
+        float cosine = length(miter) > 0.0 ? dot(normalize(miter), normal) : 0.0;
+
+        if (cosine < 1.0 / constants.miter_limit) {
+            round_ends |= 1u << end;
+            continue;
+        }
+
+        miters[end] = normalize(miter);
+        miter_lengths[end] = 1.0 / cosine;
+    }
+
+    uint end = corner & 1u;
+    float side = corner < 2u ? -1.0 : 1.0;
+    vec2 origin = end == 0 ? a : b;
+    float outward = end == 0 ? -1.0 : 1.0;
+    bool interior = end == 0 ? !starts : !ends;
+
+    vec2 position;
+
+    if ((round_ends & (1u << end)) != 0) {
+        position = origin + normal * side * expand + direction * outward * expand;
+    }
+    else if (interior) {
+        position = origin + miters[end] * side * expand * miter_lengths[end];
+    }
+    else if (cap == 1u) {
+        position = origin + normal * side * expand + direction * outward * half_width;
+    }
+    else {
+        position = origin + normal * side * expand;
+    }
+
+    float depth = end == 0 ? c0.z / c0.w : c1.z / c1.w;
+    gl_Position = vec4(position / constants.viewport * 2.0 - 1.0, depth, 1.0);
+
+    out_local = vec2(dot(position - a, direction), dot(position - a, normal));
+    out_color = decode_color(floatBitsToUint(vertices.data[index + end].w));
+    out_length = segment_length;
+    out_round = round_ends;
+}
@@ -0,0 +1,11 @@
+#version 450
+
+// Unlit color of the scatter mesh, see shaders/scatter_draw.vert.
+
+layout(location = 0) in vec3 in_color;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+    out_color = vec4(in_color, 1.0);
+}
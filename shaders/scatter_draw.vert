@@ -0,0 +1,31 @@
+#version 450
+
+// Instances of the scatter pass, see Motorino::ScatterSettings. Drawn
+// indexed and indirect, one draw per layer: the indices pick the vertex of
+// the layer mesh and gl_InstanceIndex, starting at the first instance of
+// the layer, the instance shaders/scatter.comp wrote. Nothing comes from
+// vertex buffers, both are pulled from storage buffers.
+
+// xyz the position, w the scale.
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    vec4 data[];
+} instances;
+
+// xyz the position, w the RGBA8 color bits.
+layout(std430, set = 0, binding = 1) readonly buffer Vertices {
+    vec4 data[];
+} vertices;
+
+layout(push_constant) uniform Constants {
+    mat4 view_projection;
+} constants;
+
+layout(location = 0) out vec3 out_color;
+
+void main() {
+    vec4 instance = instances.data[gl_InstanceIndex];
+    vec4 vertex = vertices.data[gl_VertexIndex];
+
+    gl_Position = constants.view_projection * vec4(instance.xyz + vertex.xyz * instance.w, 1.0);
+    out_color = unpackUnorm4x8(floatBitsToUint(vertex.w)).rgb;
+}
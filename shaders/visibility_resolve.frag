@@ -0,0 +1,33 @@
+#version 450
+
+// Draws the points shaders/point_cloud.comp and the triangles
+// shaders/cluster_raster.comp kept in the visibility frame, whichever was
+// closest, leaving every other pixel as it was.
+
+// The 64-bit pixels as two words, color first. A depth word of all ones is
+// a pixel nothing reached.
+layout(std430, set = 0, binding = 0) readonly buffer Frame {
+    uvec2 pixels[];
+} frame;
+
+layout(push_constant) uniform Constants {
+    uint width;
+} constants;
+
+layout(location = 0) out vec4 out_color;
+
+vec3 srgb_to_linear(vec3 c) {
+    return mix(c / 12.92, pow((c + 0.055) / 1.055, vec3(2.4)), greaterThan(c, vec3(0.04045)));
+}
+
+void main() {
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    uvec2 value = frame.pixels[pixel.y * constants.width + pixel.x];
+
+    if (value.y == 0xffffffffu) discard;
+
+    // The attachment is sRGB, so colors are decoded before they are
+    // encoded again on write. The exact curve keeps them unchanged.
+    vec4 color = unpackUnorm4x8(value.x);
+    out_color = vec4(srgb_to_linear(color.rgb), 1.0);
+}
@@ -0,0 +1,192 @@
+#version 450
+
+// Ray marches the bricked volume of Motorino::Engine::create_volume behind
+// shaders/fullscreen.vert. Rays walk the brick grid, skipping every brick
+// whose value range the transfer function maps to nothing, and stop once
+// nearly opaque. The first ray to need a brick in a frame appends it to the
+// list of resident or of missing bricks, which is how the engine knows what
+// is still in use and what to stream in.
+
+const uint brick_size = 32;
+const uint brick_stride = brick_size + 2;
+const uint brick_words = brick_stride * brick_stride * brick_stride / 4;
+const uint not_resident = 0xffffffffu;
+const float opaque = 0.99;
+const uint max_misses = 256;
+
+// 8-bit voxels of the resident bricks, apron included.
+layout(std430, set = 0, binding = 0) readonly buffer Pool {
+    uint words[];
+} pool;
+
+// Slot of each brick, then its value range with 255 - min in the low byte
+// and max in the next one. A cleared entry is a full range, so bricks
+// never loaded are assumed visible.
+layout(std430, set = 0, binding = 1) readonly buffer Bricks {
+    uvec2 entries[];
+} bricks;
+
+// RGBA8 colors, then how many entries below each value have any opacity.
+layout(std430, set = 0, binding = 2) readonly buffer Transfer {
+    uint colors[256];
+    uint visible[257];
+} transfer;
+
+// One bit per brick, set once the brick is listed. Cleared every frame.
+layout(std430, set = 0, binding = 3) buffer Requests {
+    uint bits[];
+} requests;
+
+// Bricks the frame needs, read by the host once it completed. Lists past
+// their capacity keep counting but drop the bricks.
+layout(std430, set = 0, binding = 4) buffer Used {
+    uint missing_count;
+    uint resident_count;
+    uint missing[max_misses];
+    uint resident[];
+} used;
+
+layout(push_constant) uniform Constants {
+    mat4 inverse_view_projection;
+    vec3 origin;
+    float step;
+    vec3 voxel_size;
+    float width;
+    uvec3 size;
+    float height;
+} constants;
+
+layout(location = 0) out vec4 out_color;
+
+bool visible(uint range) {
+    uint low = 255u - (range & 0xffu);
+    uint high = (range >> 8) & 0xffu;
+    return transfer.visible[high + 1] != transfer.visible[low];
+}
+
+uint fetch(uint base, ivec3 p) {
+    uint index = uint((p.z * int(brick_stride) + p.y) * int(brick_stride) + p.x);
+    uint word = pool.words[base + (index >> 2)];
+    return (word >> ((index & 3u) * 8u)) & 0xffu;
+}
+
+// Trilinear, q in voxels from the corner of the apron shifted by half a
+// voxel, so integer positions are voxel centers.
+float sample_brick(uint base, vec3 q) {
+    q = clamp(q, vec3(0.0), vec3(float(brick_stride - 1) - 1e-3));
+    ivec3 i = ivec3(floor(q));
+    vec3 f = q - vec3(i);
+
+    float c000 = float(fetch(base, i));
+    float c100 = float(fetch(base, i + ivec3(1, 0, 0)));
+    float c010 = float(fetch(base, i + ivec3(0, 1, 0)));
+    float c110 = float(fetch(base, i + ivec3(1, 1, 0)));
+    float c001 = float(fetch(base, i + ivec3(0, 0, 1)));
+    float c101 = float(fetch(base, i + ivec3(1, 0, 1)));
+    float c011 = float(fetch(base, i + ivec3(0, 1, 1)));
+    float c111 = float(fetch(base, i + ivec3(1, 1, 1)));
+
+    float c00 = mix(c000, c100, f.x);
+    float c10 = mix(c010, c110, f.x);
+    float c01 = mix(c001, c101, f.x);
+    float c11 = mix(c011, c111, f.x);
+
+    return mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);
+}
+
+vec4 transfer_color(float value) {
+    uint low = min(uint(value), 254u);
+    vec4 a = unpackUnorm4x8(transfer.colors[low]);
+    vec4 b = unpackUnorm4x8(transfer.colors[low + 1]);
+    vec4 color = mix(a, b, value - float(low));
+    vec3 linear = mix(color.rgb / 12.92, pow((color.rgb + 0.055) / 1.055, vec3(2.4)), greaterThan(color.rgb, vec3(0.04045)));
+    return vec4(linear, color.a);
+}
+
+void main() {
+    vec2 ndc = gl_FragCoord.xy / vec2(constants.width, constants.height) * 2.0 - 1.0;
+    vec4 near_point = constants.inverse_view_projection * vec4(ndc, 0.0, 1.0);
+    vec4 far_point = constants.inverse_view_projection * vec4(ndc, 1.0, 1.0);
+
+    // In voxels, t going from the near plane at 0 to the far plane at 1.
+    vec3 origin = (near_point.xyz / near_point.w - constants.origin) / constants.voxel_size;
+    vec3 direction = (far_point.xyz / far_point.w - constants.origin) / constants.voxel_size - origin;
+
+    vec3 safe = mix(direction, vec3(1e-20), lessThan(abs(direction), vec3(1e-20)));
+    vec3 inverse = 1.0 / safe;
+    vec3 size = vec3(constants.size);
+
+    vec3 t_low = -origin * inverse;
+    vec3 t_high = (size - origin) * inverse;
+    vec3 t_min = min(t_low, t_high);
+    vec3 t_max = max(t_low, t_high);
+
+    float t_enter = max(max(t_min.x, t_min.y), max(t_min.z, 0.0));
+    float t_exit = min(min(t_max.x, t_max.y), min(t_max.z, 1.0));
+
+    if (t_enter >= t_exit) discard;
+
+    float dt = constants.step / length(direction);
+    float epsilon = dt * 1e-3;
+
+    // Per pixel offset of the samples, trading banding for noise.
+    float jitter = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+
+    uvec3 grid = (constants.size + brick_size - 1) / brick_size;
+    vec4 color = vec4(0.0);
+    float t = t_enter;
+
+    while (t < t_exit && color.a < opaque) {
+        vec3 p = origin + direction * (t + epsilon);
+        uvec3 brick = uvec3(clamp(ivec3(floor(p / float(brick_size))), ivec3(0), ivec3(grid) - 1));
+
+        vec3 corner = vec3(brick * brick_size);
+        vec3 exits = max((corner - origin) * inverse, (corner + float(brick_size) - origin) * inverse);
+        float brick_exit = min(min(min(exits.x, exits.y), exits.z), t_exit);
+
+        uint index = (brick.z * grid.y + brick.y) * grid.x + brick.x;
+        uvec2 entry = bricks.entries[index];
+
+        if (visible(entry.y)) {
+            uint bit = 1u << (index & 31u);
+
+            if ((requests.bits[index >> 5] & bit) == 0 && (atomicOr(requests.bits[index >> 5], bit) & bit) == 0) {
+                if (entry.x != not_resident) {
+                    uint i = atomicAdd(used.resident_count, 1u);
+                    if (i < uint(used.resident.length())) used.resident[i] = index;
+                }
+                else {
+                    uint i = atomicAdd(used.missing_count, 1u);
+                    if (i < max_misses) used.missing[i] = index;
+                }
+            }
+
+            // Bricks still streaming in are seen through.
+            if (entry.x != not_resident) {
+                uint base = entry.x * brick_words;
+                vec3 apron = corner - 0.5;
+
+                // Samples stay on one grid along the ray whatever the brick,
+                // so brick borders don't show.
+                float s = t_enter + (ceil((t - t_enter) / dt - jitter) + jitter) * dt;
+
+                for (; s < brick_exit && color.a < opaque; s += dt) {
+                    vec3 q = origin + direction * s - apron;
+                    vec4 sample_color = transfer_color(sample_brick(base, q));
+
+                    // Opacities are given per voxel, corrected for the step.
+                    float alpha = 1.0 - pow(1.0 - sample_color.a, constants.step);
+                    color.rgb += (1.0 - color.a) * alpha * sample_color.rgb;
+                    color.a += (1.0 - color.a) * alpha;
+                }
+            }
+        }
+
+        t = max(brick_exit, t + epsilon);
+    }
+
+    if (color.a <= 0.0) discard;
+
+    // Premultiplied, blended over what the render pass drew so far.
+    out_color = color;
+}
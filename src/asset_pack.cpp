@@ -0,0 +1,328 @@
+#include "nkgt/asset_pack.hpp"
+#include "nkgt/geometry_codec.hpp"
+#include "nkgt/impostor.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+static_assert(sizeof(Motorino::PackHeader) == 24);
+static_assert(sizeof(Motorino::PackEntry) == 48);
+static_assert(sizeof(Motorino::PackChunk) == 16);
+
+auto Motorino::AssetPack::open(const char* path) -> bool {
+    close();
+
+    if (!_file.open(path)) return false;
+
+    _data = _file.data().data();
+    _size = _file.data().size();
+
+    if (_size < sizeof(PackHeader)) {
+        Logger::error("Asset pack too small. Path: {}\n", path);
+        close();
+        return false;
+    }
+
+    PackHeader header;
+    std::memcpy(&header, _data, sizeof(PackHeader));
+
+    if (header.magic != pack_magic || header.version != pack_version) {
+        Logger::error("Unsupported asset pack format. Path: {}\n", path);
+        close();
+        return false;
+    }
+
+    const std::uint64_t toc_size = sizeof(PackHeader) +
+                                   header.entry_count * sizeof(PackEntry) +
+                                   header.chunk_count * sizeof(PackChunk);
+
+    if (toc_size > _size) {
+        Logger::error("Truncated asset pack. Path: {}\n", path);
+        close();
+        return false;
+    }
+
+    _chunk_size = header.chunk_size;
+    _entries = {
+        reinterpret_cast<const PackEntry*>(_data + sizeof(PackHeader)),
+        header.entry_count
+    };
+    _chunks = {
+        reinterpret_cast<const PackChunk*>(_data + sizeof(PackHeader) + header.entry_count * sizeof(PackEntry)),
+        header.chunk_count
+    };
+
+    Logger::info("Opened asset pack {} ({} assets).\n", path, header.entry_count);
+    return true;
+}
+
+auto Motorino::AssetPack::close() -> void {
+    _file.close();
+
+    _data = nullptr;
+    _size = 0;
+    _entries = {};
+    _chunks = {};
+}
+
+auto Motorino::AssetPack::find(std::uint64_t name_hash) const -> const PackEntry* {
+    const auto it = std::lower_bound(
+        _entries.begin(),
+        _entries.end(),
+        name_hash,
+        [](const PackEntry& entry, std::uint64_t hash) { return entry.name_hash < hash; }
+    );
+
+    if (it == _entries.end() || it->name_hash != name_hash) return nullptr;
+    return &*it;
+}
+
+auto Motorino::AssetPack::decompress(
+    const PackEntry& entry,
+    std::span<unsigned char> destination,
+    JobSystem& jobs
+) const -> bool {
+    if (destination.size() < entry.size) {
+        Logger::error("Destination too small for asset {:016x}.\n", entry.name_hash);
+        return false;
+    }
+
+    if (static_cast<std::uint64_t>(entry.first_chunk) + entry.chunk_count > _chunks.size()) {
+        Logger::error("Corrupt chunk range for asset {:016x}.\n", entry.name_hash);
+        return false;
+    }
+
+    std::atomic<bool> failed{ false };
+
+    jobs.parallel_for(entry.chunk_count, 1, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; ++i) {
+            const PackChunk& chunk = _chunks[entry.first_chunk + i];
+            const std::uint64_t offset = i * _chunk_size;
+
+            if (chunk.offset + chunk.compressed_size > _size || offset + chunk.size > entry.size) {
+                failed = true;
+                continue;
+            }
+
+            const auto* source = _data + chunk.offset;
+            auto* target = destination.data() + offset;
+
+            if (chunk.compressed_size == chunk.size) {
+                std::memcpy(target, source, chunk.size);
+                continue;
+            }
+
+            const int written = LZ4_decompress_safe(
+                reinterpret_cast<const char*>(source),
+                reinterpret_cast<char*>(target),
+                static_cast<int>(chunk.compressed_size),
+                static_cast<int>(chunk.size)
+            );
+
+            if (written != static_cast<int>(chunk.size)) failed = true;
+        }
+    });
+
+    if (failed) {
+        Logger::error("Failed to decompress asset {:016x}.\n", entry.name_hash);
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::AssetPack::read(
+    const PackEntry& entry,
+    JobSystem& jobs
+) const -> std::optional<std::vector<unsigned char>> {
+    std::vector<unsigned char> data(entry.size);
+    if (!decompress(entry, data, jobs)) return std::nullopt;
+
+    return data;
+}
+
+auto Motorino::PackWriter::add(
+    std::string_view name,
+    AssetType type,
+    std::span<const unsigned char> data
+) -> void {
+    _assets.push_back({
+        .entry = {
+            .name_hash = asset_name_hash(name),
+            .type = type,
+            .size = data.size(),
+        },
+        .name = std::string(name),
+        .data = { data.begin(), data.end() },
+    });
+}
+
+auto Motorino::PackWriter::add_mesh(
+    std::string_view name,
+    std::span<const unsigned char> data,
+    std::uint32_t vertex_count,
+    std::uint32_t index_count,
+    std::uint32_t vertex_stride
+) -> void {
+    add(name, AssetType::Mesh, data);
+
+    PackEntry& entry = _assets.back().entry;
+    entry.vertex_count = vertex_count;
+    entry.index_count = index_count;
+    entry.vertex_stride = vertex_stride;
+}
+
+auto Motorino::PackWriter::add_encoded_mesh(
+    std::string_view name,
+    const EncodedGeometry& geometry
+) -> void {
+    const std::span<const unsigned char> data{
+        reinterpret_cast<const unsigned char*>(geometry.words.data()),
+        geometry.words.size() * sizeof(std::uint32_t)
+    };
+
+    add(name, AssetType::EncodedMesh, data);
+
+    PackEntry& entry = _assets.back().entry;
+    entry.vertex_count = geometry.vertex_count;
+    entry.index_count = geometry.index_count;
+    entry.vertex_stride = geometry.vertex_stride;
+}
+
+auto Motorino::PackWriter::add_impostor(
+    std::string_view name,
+    const ImpostorAtlas& atlas
+) -> void {
+    std::vector<unsigned char> data;
+    atlas.serialize(data);
+
+    add(name, AssetType::Impostor, data);
+}
+
+auto Motorino::PackWriter::write(
+    const char* path,
+    JobSystem& jobs
+) const -> bool {
+    std::vector<const Asset*> assets;
+    assets.reserve(_assets.size());
+
+    for (const auto& asset : _assets) {
+        assets.push_back(&asset);
+    }
+
+    std::sort(assets.begin(), assets.end(), [](const Asset* a, const Asset* b) {
+        return a->entry.name_hash < b->entry.name_hash;
+    });
+
+    for (std::size_t i = 1; i < assets.size(); ++i) {
+        if (assets[i]->entry.name_hash == assets[i - 1]->entry.name_hash) {
+            Logger::error("Asset names {} and {} collide.\n", assets[i - 1]->name, assets[i]->name);
+            return false;
+        }
+    }
+
+    struct Source {
+        const unsigned char* data;
+        std::uint32_t size;
+    };
+
+    std::vector<PackEntry> entries;
+    std::vector<Source> sources;
+    entries.reserve(assets.size());
+
+    for (const Asset* asset : assets) {
+        PackEntry entry = asset->entry;
+        entry.first_chunk = static_cast<std::uint32_t>(sources.size());
+
+        for (std::uint64_t offset = 0; offset < asset->data.size(); offset += pack_chunk_size) {
+            const auto size = std::min<std::uint64_t>(pack_chunk_size, asset->data.size() - offset);
+            sources.push_back({ asset->data.data() + offset, static_cast<std::uint32_t>(size) });
+        }
+
+        entry.chunk_count = static_cast<std::uint32_t>(sources.size()) - entry.first_chunk;
+        entries.push_back(entry);
+    }
+
+    std::vector<std::vector<char>> compressed(sources.size());
+
+    jobs.parallel_for(static_cast<std::uint32_t>(sources.size()), 1, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; ++i) {
+            const Source& source = sources[i];
+            auto& output = compressed[i];
+
+            output.resize(LZ4_compressBound(static_cast<int>(source.size)));
+
+            const int size = LZ4_compress_HC(
+                reinterpret_cast<const char*>(source.data),
+                output.data(),
+                static_cast<int>(source.size),
+                static_cast<int>(output.size()),
+                LZ4HC_CLEVEL_MAX
+            );
+
+            // Store incompressible chunks raw, marked by equal sizes.
+            if (size <= 0 || static_cast<std::uint32_t>(size) >= source.size) {
+                output.assign(
+                    reinterpret_cast<const char*>(source.data),
+                    reinterpret_cast<const char*>(source.data) + source.size
+                );
+            }
+            else {
+                output.resize(size);
+            }
+        }
+    });
+
+    const PackHeader header{
+        .magic = pack_magic,
+        .version = pack_version,
+        .entry_count = static_cast<std::uint32_t>(entries.size()),
+        .chunk_count = static_cast<std::uint32_t>(sources.size()),
+        .chunk_size = pack_chunk_size,
+    };
+
+    std::vector<PackChunk> chunks(sources.size());
+    std::uint64_t offset = sizeof(PackHeader) +
+                           entries.size() * sizeof(PackEntry) +
+                           chunks.size() * sizeof(PackChunk);
+
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i] = {
+            .offset = offset,
+            .compressed_size = static_cast<std::uint32_t>(compressed[i].size()),
+            .size = sources[i].size,
+        };
+
+        offset += compressed[i].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    if (!file) {
+        Logger::error("Failed to create asset pack. Path: {}\n", path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(PackEntry));
+    file.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(PackChunk));
+
+    for (const auto& chunk : compressed) {
+        file.write(chunk.data(), chunk.size());
+    }
+
+    if (!file) {
+        Logger::error("Failed to write asset pack. Path: {}\n", path);
+        return false;
+    }
+
+    Logger::info("Wrote asset pack {} ({} assets, {}B).\n", path, entries.size(), offset);
+    return true;
+}
@@ -0,0 +1,182 @@
+#include "nkgt/batch_renderer.hpp"
+#include "nkgt/logger.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <unordered_set>
+
+static auto size_key(
+    std::uint32_t width,
+    std::uint32_t height
+) -> std::uint64_t {
+    return (static_cast<std::uint64_t>(width) << 32) | height;
+}
+
+Motorino::BatchRenderer::BatchRenderer(RenderServer& server)
+    : _server{ server }
+{}
+
+Motorino::BatchRenderer::~BatchRenderer() {
+    for (const auto& [key, sessions] : _sessions) {
+        for (RenderSession* session : sessions) {
+            _server.destroy_session(session);
+        }
+    }
+}
+
+auto Motorino::BatchRenderer::enqueue(RenderJob job) -> void {
+    std::scoped_lock lock(_mutex);
+    _queue.push_back(std::move(job));
+}
+
+auto Motorino::BatchRenderer::sessions(
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint32_t count
+) -> const std::vector<RenderSession*>& {
+    auto& sessions = _sessions[size_key(width, height)];
+
+    while (sessions.size() < count) {
+        // Retained, so a frame stays readable until its output is written.
+        RenderSession* session = _server.create_session(width, height, true);
+        if (session == nullptr) break;
+
+        sessions.push_back(session);
+    }
+
+    return sessions;
+}
+
+auto Motorino::BatchRenderer::run() -> BatchStats {
+    std::vector<RenderJob> jobs;
+
+    {
+        std::scoped_lock lock(_mutex);
+        jobs.swap(_queue);
+    }
+
+    if (jobs.empty()) return {};
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Jobs of one size next to each other share their sessions.
+    std::stable_sort(jobs.begin(), jobs.end(), [](const RenderJob& a, const RenderJob& b) {
+        return size_key(a.width, a.height) < size_key(b.width, b.height);
+    });
+
+    std::unordered_set<std::uint64_t> failed_pipelines;
+    std::unordered_set<std::uint64_t> ready_pipelines;
+
+    Progress progress{
+        .done = std::latch(static_cast<std::ptrdiff_t>(jobs.size())),
+        .failed = 0,
+    };
+
+    std::size_t first = 0;
+
+    while (first < jobs.size()) {
+        const std::uint32_t width = jobs[first].width;
+        const std::uint32_t height = jobs[first].height;
+
+        std::size_t last = first;
+        while (last < jobs.size() && jobs[last].width == width && jobs[last].height == height) ++last;
+
+        const auto count = static_cast<std::uint32_t>(std::min<std::size_t>(last - first, max_batch_sessions));
+        const auto& group = sessions(width, height, count);
+
+        for (std::size_t i = first; i < last; ++i) {
+            const RenderJob& job = jobs[i];
+            const std::uint64_t pipeline = job.pipeline.hash();
+
+            if (!ready_pipelines.contains(pipeline) && !failed_pipelines.contains(pipeline)) {
+                if (_server.create_pipeline(job.pipeline)) {
+                    ready_pipelines.insert(pipeline);
+                }
+                else {
+                    failed_pipelines.insert(pipeline);
+                }
+            }
+
+            if (group.empty() || failed_pipelines.contains(pipeline)) {
+                Logger::error("Skipping render job for {}.\n", job.output);
+                progress.failed.fetch_add(1);
+                progress.done.count_down();
+                continue;
+            }
+
+            // Frames only queue up here, sessions render them as their
+            // slots free up.
+            RenderSession* session = group[(i - first) % group.size()];
+            session->set_pipeline(pipeline);
+            session->set_mesh(job.mesh);
+            session->set_material(job.camera);
+
+            std::uint64_t frame;
+            TimelineAwaitable rendered = session->request_frame(frame);
+
+            _server.jobs().spawn(write(session, frame, rendered, &job, &progress));
+        }
+
+        first = last;
+    }
+
+    progress.done.wait();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const BatchStats stats{
+        .images = static_cast<std::uint32_t>(jobs.size()) - progress.failed.load(),
+        .failed = progress.failed.load(),
+        .seconds = elapsed.count(),
+    };
+
+    Logger::info(
+        "Rendered {} images in {:.2f}s ({:.1f} images/s), {} failed.\n",
+        stats.images,
+        stats.seconds,
+        stats.images_per_second(),
+        stats.failed
+    );
+
+    return stats;
+}
+
+auto Motorino::BatchRenderer::write(
+    RenderSession* session,
+    std::uint64_t frame,
+    TimelineAwaitable rendered,
+    const RenderJob* job,
+    Progress* progress
+) -> Task<void> {
+    bool written = false;
+
+    // Frames the server gave up on complete too, without pixels.
+    if (co_await rendered && !session->failed(frame)) {
+        const auto pixels = session->pixels(frame);
+
+        std::ofstream file(job->output, std::ios::binary | std::ios::trunc);
+
+        const std::string header = fmt::format(
+            "P7\nWIDTH {}\nHEIGHT {}\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+            job->width,
+            job->height
+        );
+
+        file.write(header.data(), header.size());
+        file.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+
+        written = file.good();
+    }
+
+    session->release(frame);
+
+    if (!written) {
+        Logger::error("Failed to write {}.\n", job->output);
+        progress->failed.fetch_add(1);
+    }
+
+    progress->done.count_down();
+}
@@ -0,0 +1,247 @@
+#include "nkgt/bvh.hpp"
+#include "nkgt/logger.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+constexpr std::uint32_t bin_count = 12;
+
+namespace {
+
+struct Bounds {
+    float lower[3] = {
+        std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max(),
+    };
+
+    float upper[3] = {
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+    };
+
+    auto grow(const float (&point)[3]) -> void {
+        for (std::uint32_t i = 0; i < 3; ++i) {
+            lower[i] = std::min(lower[i], point[i]);
+            upper[i] = std::max(upper[i], point[i]);
+        }
+    }
+
+    auto grow(const Bounds& other) -> void {
+        grow(other.lower);
+        grow(other.upper);
+    }
+
+    // Half the surface area, which is all the SAH compares.
+    auto area() const -> float {
+        if (lower[0] > upper[0]) return 0.0f;
+
+        const float dx = upper[0] - lower[0];
+        const float dy = upper[1] - lower[1];
+        const float dz = upper[2] - lower[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+struct BuildItem {
+    Bounds bounds;
+    float centroid[3];
+};
+
+struct Bin {
+    Bounds bounds;
+    std::uint32_t count = 0;
+};
+
+}
+
+static auto bin_of(
+    const BuildItem& item,
+    std::uint32_t axis,
+    float start,
+    float scale
+) -> std::uint32_t {
+    const auto bin = static_cast<std::uint32_t>((item.centroid[axis] - start) * scale);
+    return std::min(bin, bin_count - 1);
+}
+
+auto Motorino::build_bvh(
+    std::span<const float> positions,
+    std::span<const std::uint32_t> indices
+) -> Bvh {
+    Bvh bvh;
+
+    const std::uint64_t vertex_count = positions.size() / 3;
+    const auto triangle_count = static_cast<std::uint32_t>(indices.size() / 3);
+
+    if (triangle_count == 0) return bvh;
+
+    std::vector<BuildItem> items(triangle_count);
+
+    for (std::uint32_t t = 0; t < triangle_count; ++t) {
+        BuildItem& item = items[t];
+
+        for (std::uint32_t v = 0; v < 3; ++v) {
+            const std::uint32_t index = indices[t * 3 + v];
+
+            if (index >= vertex_count) {
+                Logger::error("BVH triangle {} indexes vertex {} of {}.\n", t, index, vertex_count);
+                return bvh;
+            }
+
+            const float point[3] = { positions[index * 3], positions[index * 3 + 1], positions[index * 3 + 2] };
+            item.bounds.grow(point);
+        }
+
+        for (std::uint32_t i = 0; i < 3; ++i) {
+            item.centroid[i] = (item.bounds.lower[i] + item.bounds.upper[i]) * 0.5f;
+        }
+    }
+
+    std::vector<std::uint32_t> order(triangle_count);
+    std::iota(order.begin(), order.end(), 0u);
+
+    bvh.nodes.reserve(triangle_count * 2);
+    bvh.nodes.push_back({ .lower = {}, .first = 0, .upper = {}, .count = triangle_count });
+
+    // Nodes to split and their depth.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pending{ { 0, 0 } };
+
+    while (!pending.empty()) {
+        const auto [node_index, depth] = pending.back();
+        pending.pop_back();
+
+        const std::uint32_t first = bvh.nodes[node_index].first;
+        const std::uint32_t count = bvh.nodes[node_index].count;
+
+        Bounds bounds;
+        Bounds centroids;
+
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            bounds.grow(items[order[i]].bounds);
+            centroids.grow(items[order[i]].centroid);
+        }
+
+        std::copy(std::begin(bounds.lower), std::end(bounds.lower), bvh.nodes[node_index].lower);
+        std::copy(std::begin(bounds.upper), std::end(bounds.upper), bvh.nodes[node_index].upper);
+
+        if (count == 1 || depth == max_bvh_depth) continue;
+
+        // Cost of a split relative to keeping a leaf, both in triangle
+        // tests times area.
+        float best_cost = static_cast<float>(count) * bounds.area();
+        std::uint32_t best_axis = 3;
+        std::uint32_t best_split = 0;
+
+        for (std::uint32_t axis = 0; axis < 3; ++axis) {
+            const float extent = centroids.upper[axis] - centroids.lower[axis];
+            if (extent <= 0.0f) continue;
+
+            const float scale = static_cast<float>(bin_count) / extent;
+            Bin bins[bin_count];
+
+            for (std::uint32_t i = first; i < first + count; ++i) {
+                Bin& bin = bins[bin_of(items[order[i]], axis, centroids.lower[axis], scale)];
+                bin.bounds.grow(items[order[i]].bounds);
+                ++bin.count;
+            }
+
+            // Left sides swept forward, right sides backward. Split s puts
+            // bins up to s on the left.
+            float right_costs[bin_count - 1];
+            Bounds right;
+            std::uint32_t right_count = 0;
+
+            for (std::uint32_t s = bin_count - 1; s > 0; --s) {
+                right.grow(bins[s].bounds);
+                right_count += bins[s].count;
+                right_costs[s - 1] = static_cast<float>(right_count) * right.area();
+            }
+
+            Bounds left;
+            std::uint32_t left_count = 0;
+
+            for (std::uint32_t s = 0; s < bin_count - 1; ++s) {
+                left.grow(bins[s].bounds);
+                left_count += bins[s].count;
+
+                if (left_count == 0 || left_count == count) continue;
+
+                const float cost = static_cast<float>(left_count) * left.area() + right_costs[s];
+
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = s;
+                }
+            }
+        }
+
+        if (best_axis == 3 && count <= max_bvh_leaf_size) continue;
+
+        std::uint32_t middle;
+
+        if (best_axis != 3) {
+            const float scale = static_cast<float>(bin_count) / (centroids.upper[best_axis] - centroids.lower[best_axis]);
+
+            const auto split = std::partition(order.begin() + first, order.begin() + first + count, [&](std::uint32_t t) {
+                return bin_of(items[t], best_axis, centroids.lower[best_axis], scale) <= best_split;
+            });
+
+            middle = static_cast<std::uint32_t>(split - order.begin());
+        }
+        else {
+            // Centroids all coincide, or no split pays off in a range too
+            // large for a leaf: halve it along its longest axis.
+            std::uint32_t axis = 0;
+
+            for (std::uint32_t i = 1; i < 3; ++i) {
+                if (bounds.upper[i] - bounds.lower[i] > bounds.upper[axis] - bounds.lower[axis]) axis = i;
+            }
+
+            middle = first + count / 2;
+
+            std::nth_element(
+                order.begin() + first,
+                order.begin() + middle,
+                order.begin() + first + count,
+                [&](std::uint32_t a, std::uint32_t b) { return items[a].centroid[axis] < items[b].centroid[axis]; }
+            );
+        }
+
+        const auto children = static_cast<std::uint32_t>(bvh.nodes.size());
+        bvh.nodes.push_back({ .lower = {}, .first = first, .upper = {}, .count = middle - first });
+        bvh.nodes.push_back({ .lower = {}, .first = middle, .upper = {}, .count = first + count - middle });
+
+        bvh.nodes[node_index].first = children;
+        bvh.nodes[node_index].count = 0;
+
+        pending.push_back({ children, depth + 1 });
+        pending.push_back({ children + 1, depth + 1 });
+    }
+
+    bvh.triangles.resize(triangle_count);
+
+    for (std::uint32_t i = 0; i < triangle_count; ++i) {
+        const std::uint32_t t = order[i];
+        const float* p[3];
+
+        for (std::uint32_t v = 0; v < 3; ++v) p[v] = &positions[indices[t * 3 + v] * 3];
+
+        BvhTriangle& triangle = bvh.triangles[i];
+        triangle.index = t;
+        triangle.padding0 = 0.0f;
+        triangle.padding1 = 0.0f;
+
+        for (std::uint32_t axis = 0; axis < 3; ++axis) {
+            triangle.vertex[axis] = p[0][axis];
+            triangle.edge1[axis] = p[1][axis] - p[0][axis];
+            triangle.edge2[axis] = p[2][axis] - p[0][axis];
+        }
+    }
+
+    return bvh;
+}
@@ -0,0 +1,873 @@
+#include "nkgt/cluster_mesh.hpp"
+#include "nkgt/hash.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/triangle_mesh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <unordered_map>
+
+// Bits per axis of a vertex clustering cell coordinate.
+constexpr std::uint32_t cell_bits = 21;
+
+// Finest cells tried, relative to the diameter of the group. Cells double
+// from there until the group is simplified enough.
+constexpr float first_cell = 1.0f / 1024.0f;
+
+// Groups that don't get below this share of their triangles become roots,
+// further levels would barely draw less.
+constexpr float min_reduction = 0.75f;
+
+// Levels of simplification at most, far more than halving ever needs.
+constexpr std::uint32_t max_cluster_levels = 32;
+
+constexpr std::uint32_t page_words = Motorino::cluster_page_size / sizeof(std::uint32_t);
+
+// Pages are read with one copy each, aligned for the mapping.
+constexpr std::uint64_t cluster_page_alignment = 4096;
+
+static_assert(sizeof(Motorino::ClusterGroup) == 32);
+static_assert(sizeof(Motorino::Cluster) == 32);
+static_assert(sizeof(Motorino::ClusterPage) == 8);
+static_assert(sizeof(Motorino::ClusterFileHeader) == 40);
+
+// Local vertex indices are 8 bits, and a group always fits one page.
+static_assert(Motorino::cluster_max_vertices <= 256);
+static_assert(
+    Motorino::cluster_group_size * (Motorino::cluster_max_vertices * 4 + Motorino::cluster_max_triangles) <= page_words
+);
+
+namespace {
+
+using Motorino::Vec3;
+using Motorino::operator+;
+using Motorino::operator*;
+
+// Three vertex indices, or the bits of a position.
+struct Triple {
+    std::uint32_t values[3];
+
+    auto operator==(const Triple&) const -> bool = default;
+};
+
+struct TripleHash {
+    auto operator()(const Triple& triple) const noexcept -> std::size_t {
+        const std::uint64_t low = triple.values[0] | std::uint64_t{ triple.values[1] } << 32;
+        return static_cast<std::size_t>(Motorino::Hash::integer(triple.values[2], Motorino::Hash::integer(low)));
+    }
+};
+
+struct Sphere {
+    Vec3 center;
+    float radius;
+};
+
+struct WeldedMesh {
+    std::vector<Vec3> positions;
+    std::vector<std::uint32_t> colors;
+    // Three vertices per triangle.
+    std::vector<std::uint32_t> indices;
+};
+
+struct BuildCluster {
+    // Mesh vertices the cluster uses, in the order of its local indices.
+    std::vector<std::uint32_t> vertices;
+    // Three 8-bit local indices per triangle.
+    std::vector<std::uint32_t> triangles;
+    Sphere bounds;
+    std::uint32_t group;
+    std::uint32_t source;
+};
+
+struct BuildGroup {
+    std::vector<std::uint32_t> members;
+    Sphere bounds;
+    float error;
+    bool root;
+};
+
+auto pack_color(const Vec3& color) -> std::uint32_t {
+    std::uint32_t bits = 0xff000000u;
+
+    for (std::uint32_t c = 0; c < 3; ++c) {
+        const float value = std::clamp(color[c], 0.0f, 1.0f);
+        bits |= static_cast<std::uint32_t>(value * 255.0f + 0.5f) << (c * 8);
+    }
+
+    return bits;
+}
+
+auto load_parts(
+    std::span<const Motorino::Geometry> parts,
+    const Motorino::ClusterBuildSettings& settings,
+    WeldedMesh& mesh
+) -> bool {
+    std::unordered_map<Triple, std::uint32_t, TripleHash> welded;
+    Motorino::TriangleMesh part_mesh;
+
+    for (const Motorino::Geometry& part : parts) {
+        if (!Motorino::read_triangle_mesh(part, settings.position_offset, settings.color_offset, "Cluster mesh", part_mesh)) {
+            return false;
+        }
+
+        std::vector<std::uint32_t> remap(part_mesh.positions.size());
+
+        for (std::size_t v = 0; v < part_mesh.positions.size(); ++v) {
+            const Vec3& position = part_mesh.positions[v];
+
+            Triple key;
+            std::memcpy(key.values, position.data(), sizeof(Vec3));
+
+            const auto [it, inserted] = welded.try_emplace(key, static_cast<std::uint32_t>(mesh.positions.size()));
+
+            if (inserted) {
+                mesh.positions.push_back(position);
+                mesh.colors.push_back(pack_color(part_mesh.colors[v]));
+            }
+
+            remap[v] = it->second;
+        }
+
+        for (std::size_t t = 0; t < part_mesh.indices.size(); t += 3) {
+            const std::uint32_t a = remap[part_mesh.indices[t]];
+            const std::uint32_t b = remap[part_mesh.indices[t + 1]];
+            const std::uint32_t c = remap[part_mesh.indices[t + 2]];
+
+            // Welding may leave triangles without area.
+            if (a == b || b == c || a == c) continue;
+
+            mesh.indices.insert(mesh.indices.end(), { a, b, c });
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        Motorino::Logger::error("Cluster mesh has no triangles.\n");
+        return false;
+    }
+
+    return true;
+}
+
+auto spread_bits(std::uint32_t x) -> std::uint32_t {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Indices of points sorted along a Z curve over their bounds, so runs of
+// the order are spatially compact.
+auto morton_order(std::span<const Vec3> points) -> std::vector<std::uint32_t> {
+    Vec3 lower;
+    Vec3 upper;
+    Motorino::bounds(points, lower, upper);
+
+    const float extent = std::max({ upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2], 1e-20f });
+    const float scale = 1023.0f / extent;
+
+    std::vector<std::uint32_t> codes(points.size());
+
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        std::uint32_t code = 0;
+
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            const float cell = std::clamp((points[i][c] - lower[c]) * scale, 0.0f, 1023.0f);
+            code |= spread_bits(static_cast<std::uint32_t>(cell)) << c;
+        }
+
+        codes[i] = code;
+    }
+
+    std::vector<std::uint32_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return codes[a] < codes[b]; });
+
+    return order;
+}
+
+// Box center, and the distance to the farthest sphere.
+auto enclose(std::span<const Sphere> spheres) -> Sphere {
+    Vec3 lower = spheres[0].center;
+    Vec3 upper = lower;
+
+    for (const Sphere& sphere : spheres) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], sphere.center[c] - sphere.radius);
+            upper[c] = std::max(upper[c], sphere.center[c] + sphere.radius);
+        }
+    }
+
+    Sphere result{
+        .center = (lower + upper) * 0.5f,
+        .radius = 0.0f,
+    };
+
+    for (const Sphere& sphere : spheres) {
+        result.radius = std::max(result.radius, Motorino::distance(result.center, sphere.center) + sphere.radius);
+    }
+
+    return result;
+}
+
+auto cluster_indices(
+    const BuildCluster& cluster,
+    std::vector<std::uint32_t>& indices
+) -> void {
+    for (const std::uint32_t triangle : cluster.triangles) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            indices.push_back(cluster.vertices[(triangle >> (c * 8)) & 0xff]);
+        }
+    }
+}
+
+// Cuts the triangles in Z curve order of their centroids into runs that fit
+// a cluster.
+auto split_clusters(
+    const WeldedMesh& mesh,
+    std::span<const std::uint32_t> indices,
+    std::uint32_t source,
+    std::vector<BuildCluster>& out
+) -> void {
+    const std::size_t triangle_count = indices.size() / 3;
+    std::vector<Vec3> centroids(triangle_count);
+
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+        const Vec3 sum = mesh.positions[indices[t * 3]] + mesh.positions[indices[t * 3 + 1]] + mesh.positions[indices[t * 3 + 2]];
+        centroids[t] = sum * (1.0f / 3.0f);
+    }
+
+    const BuildCluster empty{ {}, {}, {}, UINT32_MAX, source };
+    BuildCluster cluster = empty;
+    std::unordered_map<std::uint32_t, std::uint32_t> local;
+
+    const auto flush = [&] {
+        if (cluster.triangles.empty()) return;
+
+        std::vector<Sphere> points(cluster.vertices.size());
+
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            points[i] = { mesh.positions[cluster.vertices[i]], 0.0f };
+        }
+
+        cluster.bounds = enclose(points);
+        out.push_back(std::move(cluster));
+
+        cluster = empty;
+        local.clear();
+    };
+
+    for (const std::uint32_t t : morton_order(centroids)) {
+        const std::uint32_t* corners = &indices[t * 3];
+        std::uint32_t new_vertices = 0;
+
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            if (!local.contains(corners[c])) ++new_vertices;
+        }
+
+        if (cluster.triangles.size() == Motorino::cluster_max_triangles ||
+            cluster.vertices.size() + new_vertices > Motorino::cluster_max_vertices) {
+            flush();
+        }
+
+        std::uint32_t word = 0;
+
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            const auto [it, inserted] = local.try_emplace(corners[c], static_cast<std::uint32_t>(cluster.vertices.size()));
+            if (inserted) cluster.vertices.push_back(corners[c]);
+
+            word |= it->second << (c * 8);
+        }
+
+        cluster.triangles.push_back(word);
+    }
+
+    flush();
+}
+
+// Grows groups from seeds in Z curve order, adding the ungrouped neighbor
+// sharing the most vertices with the group until it holds
+// cluster_group_size clusters. Locked borders keep all their vertices, so
+// groups tend to form across the borders of the level before, which then
+// get simplified.
+auto group_level(
+    const std::vector<BuildCluster>& clusters,
+    std::span<const std::uint32_t> level
+) -> std::vector<std::vector<std::uint32_t>> {
+    const auto count = static_cast<std::uint32_t>(level.size());
+
+    // Clusters of the level using each vertex, by sorting the pairs.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> uses;
+
+    for (std::uint32_t i = 0; i < count; ++i) {
+        for (const std::uint32_t v : clusters[level[i]].vertices) uses.push_back({ v, i });
+    }
+
+    std::sort(uses.begin(), uses.end());
+
+    // Vertices shared by every pair of neighbors.
+    std::vector<std::unordered_map<std::uint32_t, std::uint32_t>> shared(count);
+
+    for (std::size_t first = 0; first < uses.size();) {
+        std::size_t last = first;
+        while (last < uses.size() && uses[last].first == uses[first].first) ++last;
+
+        for (std::size_t a = first; a < last; ++a) {
+            for (std::size_t b = a + 1; b < last; ++b) {
+                ++shared[uses[a].second][uses[b].second];
+                ++shared[uses[b].second][uses[a].second];
+            }
+        }
+
+        first = last;
+    }
+
+    std::vector<Vec3> centers(count);
+
+    for (std::uint32_t i = 0; i < count; ++i) {
+        centers[i] = clusters[level[i]].bounds.center;
+    }
+
+    const auto order = morton_order(centers);
+    std::vector<std::uint32_t> rank(count);
+
+    for (std::uint32_t r = 0; r < count; ++r) rank[order[r]] = r;
+
+    std::vector<std::uint8_t> grouped(count, 0);
+    std::vector<std::vector<std::uint32_t>> groups;
+    std::unordered_map<std::uint32_t, std::uint32_t> candidates;
+
+    // Next cluster in Z curve order that may still be ungrouped.
+    std::size_t cursor = 0;
+
+    for (const std::uint32_t seed : order) {
+        if (grouped[seed]) continue;
+
+        std::vector<std::uint32_t> group{ level[seed] };
+        grouped[seed] = 1;
+        candidates = shared[seed];
+
+        while (group.size() < Motorino::cluster_group_size) {
+            std::uint32_t best = UINT32_MAX;
+
+            for (const auto& [neighbor, weight] : candidates) {
+                if (grouped[neighbor]) continue;
+
+                if (best == UINT32_MAX || weight > candidates[best] ||
+                    (weight == candidates[best] && rank[neighbor] < rank[best])) {
+                    best = neighbor;
+                }
+            }
+
+            // Without ungrouped neighbors, the nearest ungrouped cluster
+            // along the curve, so separate pieces merge as well.
+            if (best == UINT32_MAX) {
+                while (cursor < count && grouped[order[cursor]]) ++cursor;
+                if (cursor == count) break;
+
+                best = order[cursor];
+            }
+
+            group.push_back(level[best]);
+            grouped[best] = 1;
+
+            for (const auto& [neighbor, weight] : shared[best]) candidates[neighbor] += weight;
+        }
+
+        groups.push_back(std::move(group));
+    }
+
+    return groups;
+}
+
+// Collapses the free vertices of the group in every cell into the one
+// closest to their average, with cells doubling until at most half the
+// triangles are left, dropping triangles left degenerate or folded.
+// Locked vertices never move. Returns false if the group can't get below
+// min_reduction of its triangles, otherwise the triangles left and how far
+// a vertex moved at most.
+auto simplify_group(
+    const WeldedMesh& mesh,
+    const std::vector<BuildCluster>& clusters,
+    std::span<const std::uint32_t> members,
+    const std::vector<std::uint8_t>& locked,
+    std::vector<std::uint32_t>& simplified,
+    float& displacement
+) -> bool {
+    std::vector<std::uint32_t> indices;
+
+    for (const std::uint32_t member : members) {
+        cluster_indices(clusters[member], indices);
+    }
+
+    const std::size_t triangle_count = indices.size() / 3;
+
+    std::vector<std::uint32_t> vertices(indices);
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    Vec3 lower = mesh.positions[vertices[0]];
+    Vec3 upper = lower;
+
+    for (const std::uint32_t v : vertices) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], mesh.positions[v][c]);
+            upper[c] = std::max(upper[c], mesh.positions[v][c]);
+        }
+    }
+
+    const float diameter = std::max(Motorino::distance(lower, upper), 1e-6f);
+    const std::uint64_t cell_mask = (std::uint64_t{ 1 } << cell_bits) - 1;
+
+    struct Cell {
+        Vec3 sum;
+        std::uint32_t count;
+        std::uint32_t vertex;
+        float distance;
+    };
+
+    std::unordered_map<std::uint64_t, Cell> cells;
+    std::unordered_map<std::uint32_t, std::uint32_t> remap;
+    struct Fin {
+        std::vector<std::uint32_t> triangles;
+        bool odd;
+    };
+
+    std::unordered_map<Triple, Fin, TripleHash> fins;
+    std::vector<std::uint8_t> dropped;
+    std::vector<std::uint32_t> result;
+    bool fallback = false;
+
+    for (float cell = diameter * first_cell; cell <= diameter * 2.0f; cell *= 2.0f) {
+        const auto key_of = [&](const Vec3& position) {
+            std::uint64_t key = 0;
+
+            for (std::uint32_t c = 0; c < 3; ++c) {
+                const auto coordinate = static_cast<std::uint64_t>(std::max((position[c] - lower[c]) / cell, 0.0f));
+                key |= std::min(coordinate, cell_mask) << (c * cell_bits);
+            }
+
+            return key;
+        };
+
+        cells.clear();
+
+        for (const std::uint32_t v : vertices) {
+            if (locked[v]) continue;
+
+            Cell& entry = cells.try_emplace(key_of(mesh.positions[v]), Cell{ {}, 0, UINT32_MAX, FLT_MAX }).first->second;
+
+            entry.sum = entry.sum + mesh.positions[v];
+            ++entry.count;
+        }
+
+        for (const std::uint32_t v : vertices) {
+            if (locked[v]) continue;
+
+            Cell& entry = cells[key_of(mesh.positions[v])];
+            const Vec3 average = entry.sum * (1.0f / static_cast<float>(entry.count));
+            const float offset = Motorino::distance(mesh.positions[v], average);
+
+            if (offset < entry.distance) {
+                entry.vertex = v;
+                entry.distance = offset;
+            }
+        }
+
+        float moved = 0.0f;
+        remap.clear();
+
+        for (const std::uint32_t v : vertices) {
+            const std::uint32_t target = locked[v] ? v : cells[key_of(mesh.positions[v])].vertex;
+            moved = std::max(moved, Motorino::distance(mesh.positions[v], mesh.positions[target]));
+            remap[v] = target;
+        }
+
+        result.clear();
+        fins.clear();
+        dropped.assign(triangle_count, 0);
+
+        for (std::size_t t = 0; t < triangle_count; ++t) {
+            const std::uint32_t corners[3] = {
+                remap[indices[t * 3]],
+                remap[indices[t * 3 + 1]],
+                remap[indices[t * 3 + 2]],
+            };
+
+            if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) {
+                dropped[t] = 1;
+                continue;
+            }
+
+            // Two triangles over the same corners facing apart are a fin
+            // with no area, both go. Either on its own keeps the edges of
+            // the surface paired, so the other duplicates stay.
+            Triple key{ { corners[0], corners[1], corners[2] } };
+            std::sort(std::begin(key.values), std::end(key.values));
+
+            const std::uint32_t first = static_cast<std::uint32_t>(std::min_element(corners, corners + 3) - corners);
+            const bool odd = corners[(first + 1) % 3] > corners[(first + 2) % 3];
+
+            Fin& fin = fins[key];
+
+            if (!fin.triangles.empty() && fin.odd != odd) {
+                dropped[fin.triangles.back()] = 1;
+                dropped[t] = 1;
+                fin.triangles.pop_back();
+                continue;
+            }
+
+            fin.triangles.push_back(static_cast<std::uint32_t>(t));
+            fin.odd = odd;
+        }
+
+        for (std::size_t t = 0; t < triangle_count; ++t) {
+            if (dropped[t]) continue;
+
+            for (std::uint32_t c = 0; c < 3; ++c) result.push_back(remap[indices[t * 3 + c]]);
+        }
+
+        const std::size_t left = result.size() / 3;
+
+        if (left * 2 <= triangle_count) {
+            simplified = std::move(result);
+            displacement = moved;
+            return true;
+        }
+
+        // The least error that gets below min_reduction, in case half is
+        // out of reach.
+        if (!fallback && static_cast<float>(left) <= static_cast<float>(triangle_count) * min_reduction) {
+            simplified = result;
+            displacement = moved;
+            fallback = true;
+        }
+    }
+
+    return fallback;
+}
+
+}
+
+auto Motorino::build_cluster_mesh(
+    std::span<const Geometry> parts,
+    const ClusterBuildSettings& settings,
+    JobSystem& jobs
+) -> std::optional<ClusterMesh> {
+    if (parts.empty()) {
+        Logger::error("Cluster meshes need at least one part.\n");
+        return std::nullopt;
+    }
+
+    WeldedMesh mesh;
+    if (!load_parts(parts, settings, mesh)) return std::nullopt;
+
+    std::vector<BuildCluster> clusters;
+    split_clusters(mesh, mesh.indices, no_cluster_group, clusters);
+
+    std::vector<BuildGroup> groups;
+    std::vector<std::uint32_t> level(clusters.size());
+    std::iota(level.begin(), level.end(), 0u);
+
+    // Group of the level that first used each vertex.
+    std::vector<std::uint32_t> owner(mesh.positions.size(), UINT32_MAX);
+    std::vector<std::uint8_t> locked(mesh.positions.size(), 0);
+    std::vector<std::uint32_t> touched;
+
+    for (std::uint32_t depth = 0; !level.empty(); ++depth) {
+        const auto runs = group_level(clusters, level);
+        const auto first_group = static_cast<std::uint32_t>(groups.size());
+        const auto group_count = static_cast<std::uint32_t>(runs.size());
+
+        // The top simplifies no further, every group of it is a root.
+        const bool top = level.size() == 1 || depth + 1 == max_cluster_levels;
+
+        for (const auto& run : runs) {
+            for (const std::uint32_t member : run) {
+                clusters[member].group = static_cast<std::uint32_t>(groups.size());
+            }
+
+            groups.push_back({ .members = run, .bounds = {}, .error = 0.0f, .root = top });
+        }
+
+        // A vertex used by two groups is on their border.
+        touched.clear();
+
+        for (std::uint32_t g = first_group; g < first_group + group_count; ++g) {
+            for (const std::uint32_t member : groups[g].members) {
+                for (const std::uint32_t v : clusters[member].vertices) {
+                    if (owner[v] == UINT32_MAX) {
+                        owner[v] = g;
+                        touched.push_back(v);
+                    }
+                    else if (owner[v] != g) {
+                        locked[v] = 1;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<BuildCluster>> outputs(group_count);
+        std::vector<float> displacements(group_count, 0.0f);
+
+        if (!top) {
+            jobs.parallel_for(group_count, 1, [&](std::uint32_t begin, std::uint32_t end) {
+                std::vector<std::uint32_t> indices;
+
+                for (std::uint32_t i = begin; i < end; ++i) {
+                    const auto& members = groups[first_group + i].members;
+
+                    if (simplify_group(mesh, clusters, members, locked, indices, displacements[i])) {
+                        split_clusters(mesh, indices, first_group + i, outputs[i]);
+                        continue;
+                    }
+
+                    // Mostly leftovers too small or too locked to simplify.
+                    // Their clusters move up as they are and get grouped
+                    // with other neighbors at the next level.
+                    for (const std::uint32_t member : members) {
+                        BuildCluster copy = clusters[member];
+                        copy.group = UINT32_MAX;
+                        copy.source = first_group + i;
+                        outputs[i].push_back(std::move(copy));
+                    }
+                }
+            });
+        }
+
+        for (const std::uint32_t v : touched) {
+            owner[v] = UINT32_MAX;
+            locked[v] = 0;
+        }
+
+        std::vector<std::uint32_t> next;
+
+        for (std::uint32_t i = 0; i < group_count; ++i) {
+            BuildGroup& group = groups[first_group + i];
+
+            // Around the clusters and the groups they came from, so the
+            // spheres nest along the hierarchy.
+            std::vector<Sphere> spheres;
+            float child_error = 0.0f;
+
+            for (const std::uint32_t member : group.members) {
+                const BuildCluster& cluster = clusters[member];
+                spheres.push_back(cluster.bounds);
+
+                if (cluster.source != no_cluster_group) {
+                    spheres.push_back(groups[cluster.source].bounds);
+                    child_error = std::max(child_error, groups[cluster.source].error);
+                }
+            }
+
+            group.bounds = enclose(spheres);
+
+            if (top) {
+                group.error = FLT_MAX;
+                continue;
+            }
+
+            group.error = child_error + displacements[i];
+
+            for (BuildCluster& cluster : outputs[i]) {
+                next.push_back(static_cast<std::uint32_t>(clusters.size()));
+                clusters.push_back(std::move(cluster));
+            }
+        }
+
+        level = std::move(next);
+    }
+
+    if (groups.size() > max_cluster_groups) {
+        Logger::error("Cluster mesh of {} groups, at most {} are supported.\n", groups.size(), max_cluster_groups);
+        return std::nullopt;
+    }
+
+    // Roots first and alone in their pages, then the rest level by level.
+    std::vector<std::uint32_t> order;
+    order.reserve(groups.size());
+
+    for (std::uint32_t g = 0; g < groups.size(); ++g) {
+        if (groups[g].root) order.push_back(g);
+    }
+
+    const std::size_t root_count = order.size();
+
+    for (std::uint32_t g = 0; g < groups.size(); ++g) {
+        if (!groups[g].root) order.push_back(g);
+    }
+
+    ClusterMesh result;
+    result.groups.resize(groups.size());
+    result.clusters.resize(clusters.size());
+
+    std::uint32_t page = 0;
+    std::uint32_t used = 0;
+
+    for (std::size_t k = 0; k < order.size(); ++k) {
+        const BuildGroup& group = groups[order[k]];
+        std::uint32_t words = 0;
+
+        for (const std::uint32_t member : group.members) {
+            words += static_cast<std::uint32_t>(clusters[member].vertices.size() * 4 + clusters[member].triangles.size());
+        }
+
+        if (k == root_count) result.root_pages = page + 1;
+
+        if (used > 0 && (used + words > page_words || k == root_count)) {
+            ++page;
+            used = 0;
+        }
+
+        result.groups[order[k]] = {
+            .center = { group.bounds.center[0], group.bounds.center[1], group.bounds.center[2] },
+            .radius = group.bounds.radius,
+            .error = group.error,
+            .page = page,
+            .padding = {},
+        };
+
+        for (const std::uint32_t member : group.members) {
+            const BuildCluster& cluster = clusters[member];
+
+            result.clusters[member] = {
+                .center = { cluster.bounds.center[0], cluster.bounds.center[1], cluster.bounds.center[2] },
+                .radius = cluster.bounds.radius,
+                .group = cluster.group,
+                .source = cluster.source,
+                .offset = used,
+                .counts = static_cast<std::uint32_t>(cluster.vertices.size() | cluster.triangles.size() << 16),
+            };
+
+            used += static_cast<std::uint32_t>(cluster.vertices.size() * 4 + cluster.triangles.size());
+        }
+    }
+
+    if (root_count == order.size()) result.root_pages = page + 1;
+
+    const std::uint32_t page_count = page + 1;
+
+    if (page_count > max_cluster_pages) {
+        Logger::error("Cluster mesh of {} pages, at most {} are supported.\n", page_count, max_cluster_pages);
+        return std::nullopt;
+    }
+
+    result.page_data.assign(static_cast<std::size_t>(page_count) * cluster_page_size, 0);
+
+    jobs.parallel_for(static_cast<std::uint32_t>(clusters.size()), 256, [&](std::uint32_t begin, std::uint32_t end) {
+        std::vector<std::uint32_t> words;
+
+        for (std::uint32_t i = begin; i < end; ++i) {
+            const BuildCluster& cluster = clusters[i];
+            words.clear();
+
+            for (const std::uint32_t v : cluster.vertices) {
+                std::uint32_t position[3];
+                std::memcpy(position, mesh.positions[v].data(), sizeof(position));
+                words.insert(words.end(), { position[0], position[1], position[2], mesh.colors[v] });
+            }
+
+            words.insert(words.end(), cluster.triangles.begin(), cluster.triangles.end());
+
+            const std::uint64_t offset =
+                static_cast<std::uint64_t>(result.groups[cluster.group].page) * cluster_page_size +
+                result.clusters[i].offset * sizeof(std::uint32_t);
+
+            std::memcpy(result.page_data.data() + offset, words.data(), words.size() * sizeof(std::uint32_t));
+        }
+    });
+
+    // A group's page depends on the pages of the clusters simplified from
+    // it. Levels are laid out upwards, so dependencies never form a cycle.
+    std::vector<std::vector<std::uint32_t>> dependencies(page_count);
+
+    for (const Cluster& cluster : result.clusters) {
+        if (cluster.source == no_cluster_group) continue;
+
+        const std::uint32_t from = result.groups[cluster.source].page;
+        const std::uint32_t to = result.groups[cluster.group].page;
+
+        if (from != to) dependencies[from].push_back(to);
+    }
+
+    result.pages.resize(page_count);
+
+    for (std::uint32_t p = 0; p < page_count; ++p) {
+        auto& list = dependencies[p];
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+
+        result.pages[p] = {
+            .first_dependency = static_cast<std::uint32_t>(result.dependencies.size()),
+            .dependency_count = static_cast<std::uint32_t>(list.size()),
+        };
+
+        result.dependencies.insert(result.dependencies.end(), list.begin(), list.end());
+    }
+
+    Logger::info(
+        "Built {} clusters in {} groups and {} pages from {} triangles.\n",
+        result.clusters.size(),
+        result.groups.size(),
+        page_count,
+        mesh.indices.size() / 3
+    );
+
+    return result;
+}
+
+auto Motorino::write_cluster_mesh(
+    const ClusterMesh& mesh,
+    const char* path
+) -> bool {
+    const std::uint64_t table_size = sizeof(ClusterFileHeader) +
+                                     mesh.groups.size() * sizeof(ClusterGroup) +
+                                     mesh.clusters.size() * sizeof(Cluster) +
+                                     mesh.pages.size() * sizeof(ClusterPage) +
+                                     mesh.dependencies.size() * sizeof(std::uint32_t);
+
+    const std::uint64_t page_offset = (table_size + cluster_page_alignment - 1) / cluster_page_alignment * cluster_page_alignment;
+
+    const ClusterFileHeader header{
+        .magic = cluster_file_magic,
+        .version = cluster_file_version,
+        .group_count = static_cast<std::uint32_t>(mesh.groups.size()),
+        .cluster_count = static_cast<std::uint32_t>(mesh.clusters.size()),
+        .page_count = static_cast<std::uint32_t>(mesh.pages.size()),
+        .root_pages = mesh.root_pages,
+        .dependency_count = static_cast<std::uint32_t>(mesh.dependencies.size()),
+        .reserved = 0,
+        .page_offset = page_offset,
+    };
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    if (!file) {
+        Logger::error("Failed to create cluster mesh. Path: {}\n", path);
+        return false;
+    }
+
+    const std::vector<char> padding(page_offset - table_size, 0);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(mesh.groups.data()), mesh.groups.size() * sizeof(ClusterGroup));
+    file.write(reinterpret_cast<const char*>(mesh.clusters.data()), mesh.clusters.size() * sizeof(Cluster));
+    file.write(reinterpret_cast<const char*>(mesh.pages.data()), mesh.pages.size() * sizeof(ClusterPage));
+    file.write(reinterpret_cast<const char*>(mesh.dependencies.data()), mesh.dependencies.size() * sizeof(std::uint32_t));
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char*>(mesh.page_data.data()), mesh.page_data.size());
+
+    if (!file) {
+        Logger::error("Failed to write cluster mesh. Path: {}\n", path);
+        return false;
+    }
+
+    Logger::info("Wrote cluster mesh {} ({} pages, {}B).\n", path, mesh.pages.size(), page_offset + mesh.page_data.size());
+    return true;
+}
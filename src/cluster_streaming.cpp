@@ -0,0 +1,992 @@
+#include "nkgt/cluster_mesh.hpp"
+#include "nkgt/frustum.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+static constexpr std::uint32_t cluster_select_spv[] = {
+#include "cluster_select.comp.spv.h"
+};
+
+static constexpr std::uint32_t cluster_raster_spv[] = {
+#include "cluster_raster.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType cluster_select_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+static constexpr Motorino::DescriptorType cluster_raster_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t not_resident = UINT32_MAX;
+
+constexpr std::uint32_t cluster_select_group_size = 64;
+
+// Groups the selection dispatches at most, larger meshes loop over their
+// clusters.
+constexpr std::uint32_t max_cluster_select_groups = 1024;
+
+// Clusters drawn in one frame at most, the x size of the indirect dispatch
+// rasterizing them. Mirrors max_draws of shaders/cluster_select.comp.
+constexpr std::uint32_t max_cluster_draws = 65535;
+
+// The count and indirect dispatch size ahead of the draw list entries.
+constexpr std::uint64_t cluster_draw_header_size = 4 * sizeof(std::uint32_t);
+
+// Binned large triangles and their tiles at most, the latter the x size of
+// the indirect dispatch rasterizing them. Mirror the constants of
+// shaders/cluster_raster.comp.
+constexpr std::uint32_t max_large_triangles = 16384;
+constexpr std::uint32_t max_large_tiles = 65535;
+
+// The tile count and indirect dispatch size, then three corners of four
+// words per triangle and two words per tile.
+constexpr std::uint64_t cluster_large_size = 4 * sizeof(std::uint32_t) +
+    max_large_triangles * 3 * 4 * sizeof(std::uint32_t) +
+    max_large_tiles * 2 * sizeof(std::uint32_t);
+
+// Pages being loaded at once. Requests past it wait for later frames.
+constexpr std::uint32_t max_cluster_streams = 32;
+
+// Groups and clusters share one buffer, each range starting at the largest
+// minStorageBufferOffsetAlignment a device may ask for.
+constexpr std::uint64_t cluster_table_alignment = 256;
+
+namespace {
+
+// Mirrors the Constants block of shaders/cluster_select.comp.
+struct ClusterSelectConstants {
+    float planes[6][4];
+    float position[3];
+    float pixels_per_radian;
+    float max_error;
+    std::uint32_t cluster_count;
+};
+
+// Mirrors the Constants block of shaders/cluster_raster.comp.
+struct ClusterRasterConstants {
+    float view_projection[16];
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t pass;
+};
+
+enum class ClusterRasterPass : std::uint32_t {
+    Clusters = 0,
+    Tiles = 1,
+};
+
+static_assert(sizeof(ClusterSelectConstants) == 120);
+static_assert(sizeof(ClusterRasterConstants) == 76);
+static_assert(sizeof(Motorino::ClusterGroup) == 32);
+static_assert(sizeof(Motorino::Cluster) == 32);
+static_assert(sizeof(Motorino::ClusterFileHeader) == 40);
+
+}
+
+static auto align_table(std::uint64_t offset) -> std::uint64_t {
+    return (offset + cluster_table_alignment - 1) & ~(cluster_table_alignment - 1);
+}
+
+template<typename T>
+static auto read_table(
+    std::span<const unsigned char> file,
+    std::uint64_t& offset,
+    std::uint32_t count,
+    std::vector<T>& out
+) -> void {
+    out.resize(count);
+    if (count > 0) std::memcpy(out.data(), file.data() + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+}
+
+// Checks every index the shaders and the streaming follow, so a broken
+// file can't make them read outside of the buffers.
+static auto validate_cluster_file(
+    std::span<const unsigned char> file,
+    Motorino::ClusterFileHeader& header,
+    std::vector<Motorino::ClusterGroup>& groups,
+    std::vector<Motorino::Cluster>& clusters,
+    std::vector<Motorino::ClusterPage>& pages,
+    std::vector<std::uint32_t>& dependencies
+) -> bool {
+    using namespace Motorino;
+
+    if (file.size() < sizeof(header)) return false;
+
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != cluster_file_magic || header.version != cluster_file_version) return false;
+
+    if (header.group_count == 0 || header.group_count > max_cluster_groups ||
+        header.page_count == 0 || header.page_count > max_cluster_pages ||
+        header.cluster_count == 0 ||
+        header.root_pages == 0 || header.root_pages > header.page_count) {
+        return false;
+    }
+
+    const std::uint64_t table_size =
+        sizeof(header) +
+        static_cast<std::uint64_t>(header.group_count) * sizeof(ClusterGroup) +
+        static_cast<std::uint64_t>(header.cluster_count) * sizeof(Cluster) +
+        static_cast<std::uint64_t>(header.page_count) * sizeof(ClusterPage) +
+        static_cast<std::uint64_t>(header.dependency_count) * sizeof(std::uint32_t);
+
+    const std::uint64_t page_bytes = static_cast<std::uint64_t>(header.page_count) * cluster_page_size;
+
+    if (header.page_offset < table_size || header.page_offset % sizeof(std::uint32_t) != 0 ||
+        header.page_offset > file.size() || page_bytes > file.size() - header.page_offset) {
+        return false;
+    }
+
+    std::uint64_t offset = sizeof(header);
+    read_table(file, offset, header.group_count, groups);
+    read_table(file, offset, header.cluster_count, clusters);
+    read_table(file, offset, header.page_count, pages);
+    read_table(file, offset, header.dependency_count, dependencies);
+
+    for (const ClusterGroup& group : groups) {
+        if (group.page >= header.page_count) return false;
+    }
+
+    constexpr std::uint32_t page_words = cluster_page_size / sizeof(std::uint32_t);
+
+    for (const Cluster& cluster : clusters) {
+        if (cluster.group >= header.group_count) return false;
+        if (cluster.source != no_cluster_group && cluster.source >= header.group_count) return false;
+
+        const std::uint32_t vertex_count = cluster.counts & 0xffffu;
+        const std::uint32_t triangle_count = cluster.counts >> 16;
+
+        if (vertex_count == 0 || vertex_count > cluster_max_vertices) return false;
+        if (triangle_count == 0 || triangle_count > cluster_max_triangles) return false;
+
+        if (cluster.offset > page_words || vertex_count * 4 + triangle_count > page_words - cluster.offset) {
+            return false;
+        }
+    }
+
+    for (std::uint32_t i = 0; i < header.page_count; ++i) {
+        const ClusterPage& page = pages[i];
+
+        if (page.first_dependency > header.dependency_count ||
+            page.dependency_count > header.dependency_count - page.first_dependency) {
+            return false;
+        }
+
+        // Root pages are loaded first and never wait for another.
+        if (i < header.root_pages && page.dependency_count != 0) return false;
+    }
+
+    for (const std::uint32_t dependency : dependencies) {
+        if (dependency >= header.page_count) return false;
+    }
+
+    return true;
+}
+
+auto Motorino::Engine::create_cluster_mesh(
+    const char* path,
+    const ClusterMeshSettings& settings
+) -> bool {
+    if (!_point_cloud_supported) {
+        Logger::error("Device lacks 64-bit buffer atomics, cluster meshes are unavailable.\n");
+        return false;
+    }
+
+    if (_cluster_select_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Cluster mesh already created.\n");
+        return false;
+    }
+
+    if (!(settings.max_error > 0.0f)) {
+        Logger::error("Cluster mesh error must be positive.\n");
+        return false;
+    }
+
+    if (!_cluster_file.open(path)) {
+        Logger::error("Failed to open cluster mesh {}.\n", path);
+        return false;
+    }
+
+    ClusterFileHeader header;
+    std::vector<ClusterGroup> groups;
+    std::vector<Cluster> clusters;
+    std::vector<ClusterPage> pages;
+    std::vector<std::uint32_t> dependencies;
+
+    if (!validate_cluster_file(_cluster_file.data(), header, groups, clusters, pages, dependencies)) {
+        Logger::error("{} is not a valid cluster mesh.\n", path);
+        _cluster_file.close();
+        return false;
+    }
+
+    if (settings.pool_pages <= header.root_pages ||
+        settings.pool_pages > UINT32_MAX / cluster_page_size) {
+        Logger::error(
+            "Cluster pools of this mesh hold {} to {} pages.\n",
+            header.root_pages + 1,
+            UINT32_MAX / cluster_page_size
+        );
+        _cluster_file.close();
+        return false;
+    }
+
+    const std::uint64_t groups_size = groups.size() * sizeof(ClusterGroup);
+    const std::uint64_t clusters_size = clusters.size() * sizeof(Cluster);
+    const std::uint64_t clusters_offset = align_table(groups_size);
+    const std::uint64_t tables_size = clusters_offset + clusters_size;
+    const std::uint64_t request_size = (header.page_count + 31) / 32 * sizeof(std::uint32_t);
+
+    bool result = create_compute_pipeline(
+        _device,
+        cluster_select_spv,
+        cluster_select_bindings,
+        sizeof(ClusterSelectConstants),
+        _cluster_select_pipeline
+    ) && create_compute_pipeline(
+        _device,
+        cluster_raster_spv,
+        cluster_raster_bindings,
+        sizeof(ClusterRasterConstants),
+        _cluster_raster_pipeline
+    ) && create_buffer(
+        tables_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _cluster_tables,
+        _cluster_tables_memory
+    ) && create_buffer(
+        header.page_count * sizeof(std::uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _cluster_page_slots,
+        _cluster_page_slots_memory
+    ) && create_buffer(
+        static_cast<std::uint64_t>(settings.pool_pages) * cluster_page_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _cluster_pool,
+        _cluster_pool_memory
+    ) && create_buffer(
+        cluster_draw_header_size + max_cluster_draws * 2 * sizeof(std::uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _cluster_draws,
+        _cluster_draws_memory
+    ) && create_buffer(
+        cluster_large_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _cluster_large,
+        _cluster_large_memory
+    );
+
+    for (std::uint32_t i = 0; result && i < max_frames_in_flight; ++i) {
+        result = create_buffer(
+            request_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _cluster_requests[i],
+            _cluster_requests_memory[i]
+        );
+
+        void* data = nullptr;
+
+        if (result && vkMapMemory(_device, _cluster_requests_memory[i], 0, request_size, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map cluster request buffer.\n");
+            result = false;
+        }
+
+        if (result) {
+            _cluster_request_bits[i] = static_cast<std::uint32_t*>(data);
+            std::memset(data, 0, request_size);
+        }
+    }
+
+    if (!result) {
+        destroy_cluster_mesh();
+        return false;
+    }
+
+    // Selection sets of every frame in flight, then the rasterization set.
+    VkDescriptorSetLayout set_layouts[max_frames_in_flight + 1];
+    std::fill(std::begin(set_layouts), std::end(set_layouts), _cluster_select_pipeline.set_layout);
+    set_layouts[max_frames_in_flight] = _cluster_raster_pipeline.set_layout;
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = max_frames_in_flight + 1,
+        .pSetLayouts = set_layouts,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, _cluster_sets) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate cluster mesh descriptor sets.\n");
+        std::fill(std::begin(_cluster_sets), std::end(_cluster_sets), VK_NULL_HANDLE);
+        destroy_cluster_mesh();
+        return false;
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { .buffer = _cluster_tables, .offset = 0, .range = groups_size },
+            { .buffer = _cluster_tables, .offset = clusters_offset, .range = clusters_size },
+            { .buffer = _cluster_page_slots, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _cluster_draws, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _cluster_requests[i], .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _cluster_sets[i],
+            .dstBinding = 0,
+            .descriptorCount = 5,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+
+    // The visibility frame the rasterization writes is bound on resize.
+    const VkDescriptorBufferInfo raster_infos[] = {
+        { .buffer = _cluster_tables, .offset = clusters_offset, .range = clusters_size },
+        { .buffer = _cluster_draws, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _cluster_pool, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _cluster_large, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+
+    const VkWriteDescriptorSet raster_writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _cluster_sets[max_frames_in_flight],
+            .dstBinding = 0,
+            .descriptorCount = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = raster_infos,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _cluster_sets[max_frames_in_flight],
+            .dstBinding = 4,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &raster_infos[3],
+        },
+    };
+
+    vkUpdateDescriptorSets(_device, 2, raster_writes, 0, nullptr);
+
+    if (!resize_cluster_mesh()) {
+        destroy_cluster_mesh();
+        return false;
+    }
+
+    const auto staging = acquire_staging(tables_size);
+
+    if (!staging) {
+        destroy_cluster_mesh();
+        return false;
+    }
+
+    std::memcpy(staging->data, groups.data(), groups_size);
+    std::memcpy(staging->data + clusters_offset, clusters.data(), clusters_size);
+
+    const std::uint64_t transfer_value = submit_transfer(*staging, _cluster_tables, tables_size);
+
+    if (transfer_value == 0) {
+        destroy_cluster_mesh();
+        return false;
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+    _cluster_settings = settings;
+    _cluster_count = header.cluster_count;
+    _cluster_root_pages = header.root_pages;
+    _cluster_page_offset = header.page_offset;
+    _cluster_pages = std::move(pages);
+    _cluster_dependencies = std::move(dependencies);
+    _cluster_page_table.assign(header.page_count, not_resident);
+    _cluster_loading.assign(header.page_count, false);
+    _cluster_dependents.assign(header.page_count, 0);
+    _cluster_slots.assign(settings.pool_pages, { not_resident, 0 });
+    _cluster_free_slots.resize(settings.pool_pages);
+    _cluster_dirty.clear();
+
+    // Popped from the back, so slots fill from the start of the pool.
+    for (std::uint32_t i = 0; i < settings.pool_pages; ++i) {
+        _cluster_free_slots[i] = settings.pool_pages - 1 - i;
+    }
+
+    _cluster_upload = transfer_value;
+    _cluster_reset = true;
+
+    // Frames only select clusters once the tables are on the GPU.
+    _waiter.add(_transfer_timeline, transfer_value, [this, generation = _cluster_generation] {
+        std::scoped_lock lock(_draw_mutex);
+        if (generation == _cluster_generation) _cluster_ready = true;
+    });
+
+    Logger::info(
+        "Opened cluster mesh {}: {} clusters in {} groups, {} pages.\n",
+        path,
+        header.cluster_count,
+        header.group_count,
+        header.page_count
+    );
+
+    return true;
+}
+
+auto Motorino::Engine::set_cluster_camera(const ClusterCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _cluster_camera = camera;
+}
+
+auto Motorino::Engine::destroy_cluster_mesh() -> void {
+    std::uint64_t last_frame;
+    std::uint64_t upload;
+
+    {
+        // Pages being loaded still read the file and write the pool, their
+        // results are dropped once the generation changed.
+        std::unique_lock lock(_draw_mutex);
+        _cluster_ready = false;
+        ++_cluster_generation;
+        _cluster_idle.wait(lock, [this] { return _cluster_streams == 0; });
+
+        _cluster_pages.clear();
+        _cluster_dependencies.clear();
+        _cluster_page_table.clear();
+        _cluster_loading.clear();
+        _cluster_dependents.clear();
+        _cluster_slots.clear();
+        _cluster_free_slots.clear();
+        _cluster_dirty.clear();
+        last_frame = _frame_value.load();
+        upload = std::exchange(_cluster_upload, 0);
+    }
+
+    if (upload > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, upload).wait();
+    }
+
+    if (last_frame > 0 && _cluster_select_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_cluster_sets[0] != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, max_frames_in_flight + 1, _cluster_sets);
+        std::fill(std::begin(_cluster_sets), std::end(_cluster_sets), VK_NULL_HANDLE);
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        vkDestroyBuffer(_device, _cluster_requests[i], nullptr);
+        vkFreeMemory(_device, _cluster_requests_memory[i], nullptr);
+
+        _cluster_requests[i] = VK_NULL_HANDLE;
+        _cluster_requests_memory[i] = VK_NULL_HANDLE;
+        _cluster_request_bits[i] = nullptr;
+    }
+
+    vkDestroyBuffer(_device, _cluster_tables, nullptr);
+    vkFreeMemory(_device, _cluster_tables_memory, nullptr);
+    vkDestroyBuffer(_device, _cluster_page_slots, nullptr);
+    vkFreeMemory(_device, _cluster_page_slots_memory, nullptr);
+    vkDestroyBuffer(_device, _cluster_pool, nullptr);
+    vkFreeMemory(_device, _cluster_pool_memory, nullptr);
+    vkDestroyBuffer(_device, _cluster_draws, nullptr);
+    vkFreeMemory(_device, _cluster_draws_memory, nullptr);
+    vkDestroyBuffer(_device, _cluster_large, nullptr);
+    vkFreeMemory(_device, _cluster_large_memory, nullptr);
+
+    _cluster_tables = VK_NULL_HANDLE;
+    _cluster_tables_memory = VK_NULL_HANDLE;
+    _cluster_page_slots = VK_NULL_HANDLE;
+    _cluster_page_slots_memory = VK_NULL_HANDLE;
+    _cluster_pool = VK_NULL_HANDLE;
+    _cluster_pool_memory = VK_NULL_HANDLE;
+    _cluster_draws = VK_NULL_HANDLE;
+    _cluster_draws_memory = VK_NULL_HANDLE;
+    _cluster_large = VK_NULL_HANDLE;
+    _cluster_large_memory = VK_NULL_HANDLE;
+
+    destroy_compute_pipeline(_device, _cluster_raster_pipeline);
+    destroy_compute_pipeline(_device, _cluster_select_pipeline);
+
+    _cluster_file.close();
+}
+
+auto Motorino::Engine::resize_cluster_mesh() -> bool {
+    if (_cluster_sets[0] == VK_NULL_HANDLE) return true;
+
+    if (_visibility_frame == VK_NULL_HANDLE) {
+        std::scoped_lock lock(_draw_mutex);
+        _cluster_ready = false;
+        return false;
+    }
+
+    const VkDescriptorBufferInfo frame_info{
+        .buffer = _visibility_frame,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _cluster_sets[max_frames_in_flight],
+        .dstBinding = 3,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &frame_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return true;
+}
+
+auto Motorino::Engine::stream_cluster_page(
+    std::uint32_t page,
+    std::uint32_t slot,
+    std::uint64_t free_after,
+    std::uint64_t generation
+) -> Task<void> {
+    // Evicted slots are only written once the frames drawing them are done.
+    if (free_after > 0) {
+        co_await TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, free_after);
+    }
+
+    std::uint64_t page_offset = 0;
+    bool current;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        current = generation == _cluster_generation;
+        if (current) page_offset = _cluster_page_offset;
+    }
+
+    std::uint64_t transfer_value = 0;
+
+    // The mapping outlives every stream, destroy_cluster_mesh waits for
+    // them. Copying out of it is what reads the page from disk, here on a
+    // worker.
+    if (current) {
+        if (const auto staging = acquire_staging(cluster_page_size)) {
+            const unsigned char* data = _cluster_file.data().data() +
+                page_offset + static_cast<std::uint64_t>(page) * cluster_page_size;
+
+            std::memcpy(staging->data, data, cluster_page_size);
+
+            transfer_value = submit_transfer(
+                *staging,
+                _cluster_pool,
+                cluster_page_size,
+                static_cast<std::uint64_t>(slot) * cluster_page_size
+            );
+        }
+    }
+
+    // Published once on the GPU, the next frame uploads the table entry.
+    if (transfer_value != 0) {
+        co_await TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+
+    if (generation == _cluster_generation) {
+        _cluster_loading[page] = false;
+
+        if (transfer_value != 0) {
+            _cluster_page_table[page] = slot;
+            _cluster_slots[slot].last_used = _frame_value.load();
+            _cluster_dirty.push_back(page);
+        }
+        else {
+            Logger::warn("Failed to load cluster page {}.\n", page);
+
+            const ClusterPage& entry = _cluster_pages[page];
+
+            for (std::uint32_t i = 0; i < entry.dependency_count; ++i) {
+                --_cluster_dependents[_cluster_dependencies[entry.first_dependency + i]];
+            }
+
+            _cluster_slots[slot].page = not_resident;
+            _cluster_free_slots.push_back(slot);
+        }
+    }
+
+    --_cluster_streams;
+    _cluster_idle.notify_all();
+}
+
+auto Motorino::Engine::record_cluster_mesh(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t current_frame
+) -> void {
+    if (!_cluster_ready) return;
+
+    // The frame value reserved for the frame being recorded.
+    const std::uint64_t frame = _frame_value.load();
+
+    // Root pages are always wanted. The frame last recorded with
+    // current_frame completed, so its requests are final: resident pages
+    // it asked for are in use, the others are streamed in.
+    std::vector<std::uint32_t> wanted;
+
+    for (std::uint32_t page = 0; page < _cluster_root_pages; ++page) {
+        if (_cluster_page_table[page] == not_resident && !_cluster_loading[page]) wanted.push_back(page);
+    }
+
+    std::uint32_t* bits = _cluster_request_bits[current_frame];
+    const std::uint32_t word_count = static_cast<std::uint32_t>((_cluster_page_table.size() + 31) / 32);
+
+    for (std::uint32_t w = 0; w < word_count; ++w) {
+        std::uint32_t word = bits[w];
+        if (word == 0) continue;
+
+        bits[w] = 0;
+
+        while (word != 0) {
+            const std::uint32_t page = w * 32 + static_cast<std::uint32_t>(std::countr_zero(word));
+            word &= word - 1;
+
+            const std::uint32_t slot = _cluster_page_table[page];
+
+            if (slot != not_resident) {
+                _cluster_slots[slot].last_used = frame;
+            }
+            else if (!_cluster_loading[page]) {
+                wanted.push_back(page);
+            }
+        }
+    }
+
+    // Grows while walked: pages whose dependencies aren't resident queue
+    // those first and load in a later frame.
+    for (std::size_t i = 0; i < wanted.size(); ++i) {
+        if (_cluster_streams == max_cluster_streams) break;
+
+        const std::uint32_t page = wanted[i];
+
+        if (_cluster_page_table[page] != not_resident || _cluster_loading[page]) continue;
+
+        const ClusterPage& entry = _cluster_pages[page];
+        const std::uint32_t* dependencies = _cluster_dependencies.data() + entry.first_dependency;
+        bool dependencies_resident = true;
+
+        for (std::uint32_t d = 0; d < entry.dependency_count; ++d) {
+            if (_cluster_page_table[dependencies[d]] != not_resident) continue;
+
+            dependencies_resident = false;
+            if (!_cluster_loading[dependencies[d]]) wanted.push_back(dependencies[d]);
+        }
+
+        if (!dependencies_resident) continue;
+
+        // Pinned before looking for a slot, so the search can't evict a
+        // page this one needs.
+        for (std::uint32_t d = 0; d < entry.dependency_count; ++d) {
+            ++_cluster_dependents[dependencies[d]];
+        }
+
+        std::uint32_t slot = not_resident;
+        std::uint64_t free_after = 0;
+
+        if (!_cluster_free_slots.empty()) {
+            slot = _cluster_free_slots.back();
+            _cluster_free_slots.pop_back();
+        }
+        else {
+            // The least recently used resident page no other resident page
+            // depends on, as long as the frame read back didn't need it.
+            // Root pages stay.
+            std::uint64_t oldest = frame;
+
+            for (std::uint32_t s = 0; s < _cluster_slots.size(); ++s) {
+                const ClusterSlot& candidate = _cluster_slots[s];
+
+                if (candidate.page == not_resident || candidate.last_used >= oldest) continue;
+                if (candidate.page < _cluster_root_pages || _cluster_dependents[candidate.page] != 0) continue;
+                if (_cluster_page_table[candidate.page] != s) continue;
+
+                slot = s;
+                oldest = candidate.last_used;
+            }
+
+            // Every page is in use, the pool is too small for the view.
+            if (slot == not_resident) {
+                for (std::uint32_t d = 0; d < entry.dependency_count; ++d) {
+                    --_cluster_dependents[dependencies[d]];
+                }
+
+                break;
+            }
+
+            const std::uint32_t evicted = _cluster_slots[slot].page;
+            const ClusterPage& evicted_entry = _cluster_pages[evicted];
+
+            for (std::uint32_t d = 0; d < evicted_entry.dependency_count; ++d) {
+                --_cluster_dependents[_cluster_dependencies[evicted_entry.first_dependency + d]];
+            }
+
+            _cluster_page_table[evicted] = not_resident;
+            _cluster_dirty.push_back(evicted);
+
+            // This frame no longer draws from the slot, earlier ones may.
+            free_after = frame;
+        }
+
+        _cluster_slots[slot] = { page, frame };
+        _cluster_loading[page] = true;
+        ++_cluster_streams;
+
+        _jobs.spawn(stream_cluster_page(page, slot, free_after, _cluster_generation));
+    }
+
+    // Frames before may still read the page table and the draw and tile
+    // lists.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        0, nullptr
+    );
+
+    if (_cluster_reset) {
+        vkCmdFillBuffer(cmd_buffer, _cluster_page_slots, 0, VK_WHOLE_SIZE, 0xffffffffu);
+        _cluster_reset = false;
+
+        VkMemoryBarrier fill_barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            1, &fill_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+    }
+
+    std::sort(_cluster_dirty.begin(), _cluster_dirty.end());
+    _cluster_dirty.erase(std::unique(_cluster_dirty.begin(), _cluster_dirty.end()), _cluster_dirty.end());
+
+    for (const std::uint32_t page : _cluster_dirty) {
+        vkCmdUpdateBuffer(
+            cmd_buffer,
+            _cluster_page_slots,
+            page * sizeof(std::uint32_t),
+            sizeof(std::uint32_t),
+            &_cluster_page_table[page]
+        );
+    }
+
+    _cluster_dirty.clear();
+
+    constexpr std::uint32_t draw_header[4] = { 0, 1, 1, 0 };
+    vkCmdUpdateBuffer(cmd_buffer, _cluster_draws, 0, sizeof(draw_header), draw_header);
+    vkCmdUpdateBuffer(cmd_buffer, _cluster_large, 0, sizeof(draw_header), draw_header);
+
+    VkMemoryBarrier to_compute{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &to_compute,
+        0, nullptr,
+        0, nullptr
+    );
+
+    const ClusterCamera& camera = _cluster_camera;
+
+    ClusterSelectConstants select_constants{
+        .planes = {},
+        .position = { camera.position[0], camera.position[1], camera.position[2] },
+        .pixels_per_radian = camera.pixels_per_radian,
+        .max_error = _cluster_settings.max_error,
+        .cluster_count = _cluster_count,
+    };
+
+    frustum_planes(camera.view_projection, select_constants.planes);
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cluster_select_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _cluster_select_pipeline.layout,
+        0,
+        1,
+        &_cluster_sets[current_frame],
+        0,
+        nullptr
+    );
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _cluster_select_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(select_constants),
+        &select_constants
+    );
+
+    const std::uint32_t select_groups = std::min(
+        max_cluster_select_groups,
+        (_cluster_count + cluster_select_group_size - 1) / cluster_select_group_size
+    );
+
+    vkCmdDispatch(cmd_buffer, select_groups, 1, 1);
+
+    VkMemoryBarrier to_raster{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &to_raster,
+        0, nullptr,
+        0, nullptr
+    );
+
+    begin_visibility(cmd_buffer);
+
+    ClusterRasterConstants raster_constants{
+        .view_projection = {},
+        .width = _width,
+        .height = _height,
+        .pass = static_cast<std::uint32_t>(ClusterRasterPass::Clusters),
+    };
+
+    std::memcpy(raster_constants.view_projection, camera.view_projection, sizeof(raster_constants.view_projection));
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cluster_raster_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _cluster_raster_pipeline.layout,
+        0,
+        1,
+        &_cluster_sets[max_frames_in_flight],
+        0,
+        nullptr
+    );
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _cluster_raster_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(raster_constants),
+        &raster_constants
+    );
+
+    vkCmdDispatchIndirect(cmd_buffer, _cluster_draws, 0);
+
+    VkMemoryBarrier to_tiles{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &to_tiles,
+        0, nullptr,
+        0, nullptr
+    );
+
+    // The large triangles pass 0 binned, a group per tile.
+    raster_constants.pass = static_cast<std::uint32_t>(ClusterRasterPass::Tiles);
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _cluster_raster_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(raster_constants),
+        &raster_constants
+    );
+
+    vkCmdDispatchIndirect(cmd_buffer, _cluster_large, 0);
+
+    const VkBufferMemoryBarrier to_consumers[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = _visibility_frame,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = _cluster_requests[current_frame],
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        },
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        2, to_consumers,
+        0, nullptr
+    );
+}
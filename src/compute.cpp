@@ -0,0 +1,110 @@
+#include "nkgt/compute.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+static_assert(static_cast<VkDescriptorType>(Motorino::DescriptorType::CombinedImageSampler) == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+static_assert(static_cast<VkDescriptorType>(Motorino::DescriptorType::StorageImage) == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+static_assert(static_cast<VkDescriptorType>(Motorino::DescriptorType::UniformBuffer) == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+static_assert(static_cast<VkDescriptorType>(Motorino::DescriptorType::StorageBuffer) == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+auto Motorino::create_compute_pipeline(
+    VkDevice device,
+    std::span<const std::uint32_t> code,
+    std::span<const DescriptorType> bindings,
+    std::uint32_t push_constant_size,
+    ComputePipeline& pipeline
+) -> bool {
+    pipeline = {};
+
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings(bindings.size());
+
+    for (std::uint32_t i = 0; i < bindings.size(); ++i) {
+        layout_bindings[i] = {
+            .binding = i,
+            .descriptorType = static_cast<VkDescriptorType>(bindings[i]),
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<std::uint32_t>(layout_bindings.size()),
+        .pBindings = layout_bindings.data(),
+    };
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &pipeline.set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create compute descriptor set layout.\n");
+        return false;
+    }
+
+    VkPushConstantRange push_constants{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = push_constant_size,
+    };
+
+    VkPipelineLayoutCreateInfo layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &pipeline.set_layout,
+        .pushConstantRangeCount = push_constant_size > 0 ? 1u : 0u,
+        .pPushConstantRanges = &push_constants,
+    };
+
+    if (vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline.layout) != VK_SUCCESS) {
+        Logger::error("Failed to create compute pipeline layout.\n");
+        destroy_compute_pipeline(device, pipeline);
+        return false;
+    }
+
+    VkShaderModuleCreateInfo module_info{
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = code.size_bytes(),
+        .pCode = code.data(),
+    };
+
+    VkShaderModule shader_module;
+
+    if (vkCreateShaderModule(device, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+        Logger::error("Failed to create compute shader module.\n");
+        destroy_compute_pipeline(device, pipeline);
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName = "main",
+        },
+        .layout = pipeline.layout,
+    };
+
+    const auto result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline.pipeline);
+    vkDestroyShaderModule(device, shader_module, nullptr);
+
+    if (result != VK_SUCCESS) {
+        Logger::error("Failed to create compute pipeline.\n");
+        destroy_compute_pipeline(device, pipeline);
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::destroy_compute_pipeline(
+    VkDevice device,
+    ComputePipeline& pipeline
+) -> void {
+    vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, pipeline.set_layout, nullptr);
+
+    pipeline = {};
+}
@@ -0,0 +1,99 @@
+#include "nkgt/device_memory.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+auto Motorino::find_memory_type(
+    VkPhysicalDevice physical_device,
+    std::uint32_t type_bits,
+    std::uint32_t properties,
+    std::uint32_t& index
+) -> bool {
+    VkPhysicalDeviceMemoryProperties mem_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+
+    for (std::uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
+        const bool correct_type = type_bits & (1 << i);
+        const bool has_property = (mem_properties.memoryTypes[i].propertyFlags & properties) == properties;
+
+        if (correct_type && has_property) {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+auto Motorino::allocate_memory(
+    VkDevice device,
+    VkPhysicalDevice physical_device,
+    std::uint64_t size,
+    std::uint32_t type_bits,
+    std::uint32_t properties,
+    VkDeviceMemory& memory
+) -> bool {
+    VkMemoryAllocateInfo allocate_info{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+    };
+
+    if (!find_memory_type(physical_device, type_bits, properties, allocate_info.memoryTypeIndex)) {
+        return false;
+    }
+
+    if (vkAllocateMemory(device, &allocate_info, nullptr, &memory) != VK_SUCCESS) {
+        Logger::error("Failed to allocate memory.\n");
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::create_buffer(
+    VkDevice device,
+    VkPhysicalDevice physical_device,
+    std::span<const std::uint32_t> queue_families,
+    std::uint64_t size,
+    std::uint32_t usage,
+    std::uint32_t properties,
+    VkBuffer& buffer,
+    VkDeviceMemory& memory
+) -> bool {
+    const bool shared = queue_families.size() > 1;
+
+    VkBufferCreateInfo buffer_info{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = shared ? static_cast<std::uint32_t>(queue_families.size()) : 0,
+        .pQueueFamilyIndices = shared ? queue_families.data() : nullptr,
+    };
+
+    if (vkCreateBuffer(device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+        Logger::error("Failed to create buffer.\n");
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    const bool result = allocate_memory(
+        device,
+        physical_device,
+        requirements.size,
+        requirements.memoryTypeBits,
+        properties,
+        memory
+    );
+
+    if (!result) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    vkBindBufferMemory(device, buffer, memory, 0);
+    return true;
+}
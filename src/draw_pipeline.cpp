@@ -0,0 +1,213 @@
+#include "nkgt/draw_pipeline.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+auto Motorino::create_draw_pipeline(
+    VkDevice device,
+    VkRenderPass render_pass,
+    const DrawPipelineInfo& info,
+    DrawPipeline& pipeline
+) -> bool {
+    pipeline = {};
+
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings(info.bindings.size());
+
+    for (std::uint32_t i = 0; i < info.bindings.size(); ++i) {
+        layout_bindings[i] = {
+            .binding = i,
+            .descriptorType = static_cast<VkDescriptorType>(info.bindings[i]),
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        };
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<std::uint32_t>(layout_bindings.size()),
+        .pBindings = layout_bindings.data(),
+    };
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &pipeline.set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create draw descriptor set layout.\n");
+        return false;
+    }
+
+    VkPushConstantRange push_constants{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = info.push_constant_size,
+    };
+
+    VkPipelineLayoutCreateInfo layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &pipeline.set_layout,
+        .pushConstantRangeCount = info.push_constant_size > 0 ? 1u : 0u,
+        .pPushConstantRanges = &push_constants,
+    };
+
+    if (vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline.layout) != VK_SUCCESS) {
+        Logger::error("Failed to create draw pipeline layout.\n");
+        destroy_draw_pipeline(device, pipeline);
+        return false;
+    }
+
+    const VkShaderModuleCreateInfo module_infos[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = info.vertex_code.size_bytes(),
+            .pCode = info.vertex_code.data(),
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = info.fragment_code.size_bytes(),
+            .pCode = info.fragment_code.data(),
+        },
+    };
+
+    VkShaderModule modules[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+
+    const auto destroy_modules = [&] {
+        for (auto mod : modules) vkDestroyShaderModule(device, mod, nullptr);
+    };
+
+    for (std::uint32_t i = 0; i < 2; ++i) {
+        if (vkCreateShaderModule(device, &module_infos[i], nullptr, &modules[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create draw shader module.\n");
+            destroy_modules();
+            destroy_draw_pipeline(device, pipeline);
+            return false;
+        }
+    }
+
+    const VkPipelineShaderStageCreateInfo stages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = modules[0],
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = modules[1],
+            .pName = "main",
+        },
+    };
+
+    constexpr VkPipelineVertexInputStateCreateInfo vertex_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    };
+
+    constexpr VkPipelineInputAssemblyStateCreateInfo assembly_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+    };
+
+    constexpr VkDynamicState dynamic_states[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamic_states
+    };
+
+    constexpr VkPipelineViewportStateCreateInfo viewport_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+
+    // Full screen triangles and camera facing quads wind either way.
+    constexpr VkPipelineRasterizationStateCreateInfo rasterizer{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .lineWidth = 1.0f,
+    };
+
+    constexpr VkPipelineMultisampleStateCreateInfo multisampling{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{
+        .blendEnable = VK_FALSE,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+                          VK_COLOR_COMPONENT_G_BIT |
+                          VK_COLOR_COMPONENT_B_BIT |
+                          VK_COLOR_COMPONENT_A_BIT,
+    };
+
+    if (info.blend != DrawBlend::Opaque) {
+        color_blend_attachment.blendEnable = VK_TRUE;
+        color_blend_attachment.srcColorBlendFactor = info.blend == DrawBlend::Alpha ?
+                                                     VK_BLEND_FACTOR_SRC_ALPHA :
+                                                     VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
+
+    const VkPipelineColorBlendAttachmentState blend_attachments[] = {
+        color_blend_attachment,
+        {
+            .blendEnable = VK_FALSE,
+            .colorWriteMask = 0,
+        },
+    };
+
+    VkPipelineColorBlendStateCreateInfo color_blend_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount = 2,
+        .pAttachments = blend_attachments,
+    };
+
+    VkGraphicsPipelineCreateInfo pipeline_info{
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = stages,
+        .pVertexInputState = &vertex_info,
+        .pInputAssemblyState = &assembly_info,
+        .pViewportState = &viewport_state,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pColorBlendState = &color_blend_state,
+        .pDynamicState = &dynamic_state,
+        .layout = pipeline.layout,
+        .renderPass = render_pass,
+        .subpass = 0,
+    };
+
+    const auto result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline.pipeline);
+    destroy_modules();
+
+    if (result != VK_SUCCESS) {
+        Logger::error("Failed to create draw pipeline.\n");
+        pipeline.pipeline = VK_NULL_HANDLE;
+        destroy_draw_pipeline(device, pipeline);
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::destroy_draw_pipeline(
+    VkDevice device,
+    DrawPipeline& pipeline
+) -> void {
+    vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
+    vkDestroyDescriptorSetLayout(device, pipeline.set_layout, nullptr);
+
+    pipeline = {};
+}
@@ -0,0 +1,537 @@
+#include "nkgt/ecs.hpp"
+#include "nkgt/logger.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace {
+
+struct ComponentInfo {
+    std::uint32_t size;
+    std::uint32_t alignment;
+    std::uint64_t hash;
+};
+
+std::mutex component_mutex;
+std::vector<ComponentInfo> components;
+
+auto component_info(Motorino::ComponentId id) -> ComponentInfo {
+    std::scoped_lock lock(component_mutex);
+    return components[id];
+}
+
+auto find_component(
+    std::uint64_t hash,
+    std::uint32_t size
+) -> std::optional<Motorino::ComponentId> {
+    std::scoped_lock lock(component_mutex);
+
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        if (components[i].hash == hash && components[i].size == size) {
+            return static_cast<Motorino::ComponentId>(i);
+        }
+    }
+
+    return std::nullopt;
+}
+
+auto row_data(
+    const Motorino::Archetype& archetype,
+    std::uint32_t row,
+    std::uint32_t column
+) -> unsigned char* {
+    const Motorino::Chunk& chunk = archetype.chunks[row / archetype.capacity];
+    const Motorino::Column& info = archetype.columns[column];
+
+    return chunk.data + info.offset + (row % archetype.capacity) * info.size;
+}
+
+constexpr std::uint8_t no_column = 0xff;
+
+// Serialized world layout: WorldHeader, record_count generations,
+// free_count free indices, then per archetype an ArchetypeHeader,
+// column_count hashes, column_count sizes, count entities and one array of
+// count values per column.
+struct WorldHeader {
+    std::uint64_t version;
+    std::uint32_t record_count;
+    std::uint32_t free_count;
+    std::uint32_t archetype_count;
+    std::uint32_t entity_count;
+};
+
+struct ArchetypeHeader {
+    std::uint32_t column_count;
+    std::uint32_t count;
+};
+
+auto append(
+    std::vector<unsigned char>& out,
+    const void* data,
+    std::uint64_t size
+) -> void {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+class Reader {
+public:
+    explicit Reader(std::span<const unsigned char> data)
+        : _data{ data },
+          _position{ 0 }
+    {}
+
+    // Returns the next size bytes or nullptr if the data ends before.
+    auto take(std::uint64_t size) -> const unsigned char* {
+        if (size > _data.size() - _position) return nullptr;
+
+        const unsigned char* result = _data.data() + _position;
+        _position += size;
+        return result;
+    }
+
+    auto read(
+        void* destination,
+        std::uint64_t size
+    ) -> bool {
+        const unsigned char* source = take(size);
+        if (source == nullptr) return false;
+
+        std::memcpy(destination, source, size);
+        return true;
+    }
+
+private:
+    std::span<const unsigned char> _data;
+    std::uint64_t _position;
+};
+
+}
+
+auto Motorino::detail::register_component(
+    std::uint32_t size,
+    std::uint32_t alignment,
+    std::uint64_t hash
+) -> ComponentId {
+    std::scoped_lock lock(component_mutex);
+
+    const auto id = static_cast<ComponentId>(components.size());
+
+    if (id == max_components) {
+        Logger::error("More than {} component types registered.\n", max_components);
+        std::terminate();
+    }
+
+    components.push_back({ size, alignment, hash });
+    return id;
+}
+
+Motorino::World::World()
+    : _count{ 0 },
+      _version{ 1 }
+{}
+
+Motorino::World::~World() {
+    clear();
+}
+
+auto Motorino::World::clear() -> void {
+    for (const auto& archetype : _archetypes) {
+        for (const Chunk& chunk : archetype->chunks) {
+            ::operator delete(chunk.data, std::align_val_t{ ecs_chunk_alignment });
+        }
+    }
+
+    _archetypes.clear();
+    _archetype_lookup.clear();
+    _records.clear();
+    _free_indices.clear();
+    _count = 0;
+}
+
+auto Motorino::World::swap(World& other) -> void {
+    std::swap(_archetypes, other._archetypes);
+    std::swap(_archetype_lookup, other._archetype_lookup);
+    std::swap(_records, other._records);
+    std::swap(_free_indices, other._free_indices);
+    std::swap(_count, other._count);
+    std::swap(_version, other._version);
+}
+
+auto Motorino::World::create_entity(ComponentMask mask) -> Entity {
+    Archetype* target = archetype(mask);
+    if (target == nullptr) return null_entity;
+
+    std::uint32_t index;
+
+    if (!_free_indices.empty()) {
+        index = _free_indices.back();
+        _free_indices.pop_back();
+    }
+    else {
+        index = static_cast<std::uint32_t>(_records.size());
+        _records.push_back({ nullptr, 0, 0 });
+    }
+
+    const Entity entity{ index, _records[index].generation };
+
+    _records[index].archetype = target;
+    _records[index].row = allocate_row(*target, entity);
+    ++_count;
+
+    return entity;
+}
+
+auto Motorino::World::destroy(Entity entity) -> bool {
+    if (!alive(entity)) return false;
+
+    Record& record = _records[entity.index];
+    release_row(*record.archetype, record.row);
+
+    record.archetype = nullptr;
+    ++record.generation;
+    _free_indices.push_back(entity.index);
+    --_count;
+
+    return true;
+}
+
+auto Motorino::World::alive(Entity entity) const -> bool {
+    return entity.index < _records.size() &&
+           _records[entity.index].archetype != nullptr &&
+           _records[entity.index].generation == entity.generation;
+}
+
+auto Motorino::World::archetype(ComponentMask mask) -> Archetype* {
+    if (const auto it = _archetype_lookup.find(mask); it != _archetype_lookup.end()) {
+        return it->second;
+    }
+
+    auto archetype = std::make_unique<Archetype>();
+    archetype->mask = mask;
+    archetype->count = 0;
+    std::fill(std::begin(archetype->column_index), std::end(archetype->column_index), no_column);
+
+    std::vector<std::uint32_t> alignments;
+    std::uint32_t entity_size = sizeof(Entity);
+
+    for (ComponentMask bits = mask; bits != 0; bits &= bits - 1) {
+        const auto id = static_cast<ComponentId>(std::countr_zero(bits));
+        const ComponentInfo info = component_info(id);
+
+        archetype->column_index[id] = static_cast<std::uint8_t>(archetype->columns.size());
+        archetype->columns.push_back({ id, info.size, 0 });
+        alignments.push_back(info.alignment);
+        entity_size += info.size;
+    }
+
+    // Start from the capacity ignoring padding and shrink until the aligned
+    // columns fit.
+    for (archetype->capacity = ecs_chunk_size / entity_size; archetype->capacity > 0; --archetype->capacity) {
+        std::uint64_t offset = sizeof(Entity) * archetype->capacity;
+
+        for (std::size_t i = 0; i < archetype->columns.size(); ++i) {
+            offset = (offset + alignments[i] - 1) / alignments[i] * alignments[i];
+            archetype->columns[i].offset = static_cast<std::uint32_t>(offset);
+            offset += static_cast<std::uint64_t>(archetype->columns[i].size) * archetype->capacity;
+        }
+
+        if (offset <= ecs_chunk_size) break;
+    }
+
+    if (archetype->capacity == 0) {
+        Logger::error("Components of archetype {:016x} exceed a chunk.\n", mask);
+        return nullptr;
+    }
+
+    Archetype* result = archetype.get();
+    _archetypes.push_back(std::move(archetype));
+    _archetype_lookup.emplace(mask, result);
+
+    return result;
+}
+
+auto Motorino::World::allocate_row(
+    Archetype& archetype,
+    Entity entity
+) -> std::uint32_t {
+    const std::uint32_t row = archetype.count;
+
+    if (row / archetype.capacity == archetype.chunks.size()) {
+        allocate_chunk(archetype);
+    }
+
+    Chunk& chunk = archetype.chunks.back();
+    archetype.entities(chunk)[chunk.count++] = entity;
+    std::fill(chunk.versions.begin(), chunk.versions.end(), _version);
+
+    ++archetype.count;
+    return row;
+}
+
+auto Motorino::World::allocate_chunk(Archetype& archetype) -> Chunk& {
+    auto* data = static_cast<unsigned char*>(::operator new(ecs_chunk_size, std::align_val_t{ ecs_chunk_alignment }));
+    return archetype.chunks.emplace_back(data, 0u, std::vector<std::uint64_t>(archetype.columns.size(), _version));
+}
+
+// Keeps rows dense by moving the archetype's last entity into the hole.
+auto Motorino::World::release_row(
+    Archetype& archetype,
+    std::uint32_t row
+) -> void {
+    const std::uint32_t last = archetype.count - 1;
+
+    Chunk& chunk = archetype.chunks[row / archetype.capacity];
+    Chunk& last_chunk = archetype.chunks.back();
+
+    if (row != last) {
+        const Entity moved = archetype.entities(last_chunk)[last % archetype.capacity];
+        archetype.entities(chunk)[row % archetype.capacity] = moved;
+
+        for (std::uint32_t c = 0; c < archetype.columns.size(); ++c) {
+            std::memcpy(row_data(archetype, row, c), row_data(archetype, last, c), archetype.columns[c].size);
+        }
+
+        _records[moved.index].row = row;
+        std::fill(chunk.versions.begin(), chunk.versions.end(), _version);
+    }
+
+    --archetype.count;
+
+    if (--last_chunk.count == 0) {
+        ::operator delete(last_chunk.data, std::align_val_t{ ecs_chunk_alignment });
+        archetype.chunks.pop_back();
+    }
+    else {
+        // A shorter chunk is a change as well, extraction has fewer
+        // instances to write.
+        std::fill(last_chunk.versions.begin(), last_chunk.versions.end(), _version);
+    }
+}
+
+auto Motorino::World::change_archetype(
+    Entity entity,
+    ComponentMask mask
+) -> bool {
+    Archetype* target = archetype(mask);
+    if (target == nullptr) return false;
+
+    Record& record = _records[entity.index];
+    Archetype& source = *record.archetype;
+
+    const std::uint32_t row = allocate_row(*target, entity);
+
+    for (std::uint32_t c = 0; c < target->columns.size(); ++c) {
+        const std::uint32_t column = source.column(target->columns[c].id);
+        if (column == no_column) continue;
+
+        std::memcpy(row_data(*target, row, c), row_data(source, record.row, column), target->columns[c].size);
+    }
+
+    release_row(source, record.row);
+
+    record.archetype = target;
+    record.row = row;
+
+    return true;
+}
+
+auto Motorino::World::component(
+    Entity entity,
+    ComponentId id,
+    bool mark_changed
+) const -> void* {
+    if (!alive(entity)) return nullptr;
+
+    const Record& record = _records[entity.index];
+    const std::uint32_t column = record.archetype->column(id);
+
+    if (column == no_column) return nullptr;
+
+    if (mark_changed) {
+        record.archetype->chunks[record.row / record.archetype->capacity].versions[column] = _version;
+    }
+
+    return row_data(*record.archetype, record.row, column);
+}
+
+auto Motorino::World::write(
+    Entity entity,
+    ComponentId id,
+    const void* value
+) -> void {
+    void* target = component(entity, id, true);
+    if (target == nullptr) return;
+
+    std::memcpy(target, value, component_info(id).size);
+}
+
+auto Motorino::World::serialize(std::vector<unsigned char>& out) const -> void {
+    const WorldHeader header{
+        .version = _version,
+        .record_count = static_cast<std::uint32_t>(_records.size()),
+        .free_count = static_cast<std::uint32_t>(_free_indices.size()),
+        .archetype_count = static_cast<std::uint32_t>(_archetypes.size()),
+        .entity_count = _count,
+    };
+
+    append(out, &header, sizeof(header));
+
+    for (const Record& record : _records) {
+        append(out, &record.generation, sizeof(record.generation));
+    }
+
+    append(out, _free_indices.data(), _free_indices.size() * sizeof(std::uint32_t));
+
+    for (const auto& archetype : _archetypes) {
+        const ArchetypeHeader archetype_header{
+            .column_count = static_cast<std::uint32_t>(archetype->columns.size()),
+            .count = archetype->count,
+        };
+
+        append(out, &archetype_header, sizeof(archetype_header));
+
+        for (const Column& column : archetype->columns) {
+            const std::uint64_t hash = component_info(column.id).hash;
+            append(out, &hash, sizeof(hash));
+        }
+
+        for (const Column& column : archetype->columns) {
+            append(out, &column.size, sizeof(column.size));
+        }
+
+        for (const Chunk& chunk : archetype->chunks) {
+            append(out, chunk.data, chunk.count * sizeof(Entity));
+        }
+
+        for (const Column& column : archetype->columns) {
+            for (const Chunk& chunk : archetype->chunks) {
+                append(out, chunk.data + column.offset, static_cast<std::uint64_t>(chunk.count) * column.size);
+            }
+        }
+    }
+}
+
+auto Motorino::World::deserialize(std::span<const unsigned char> data) -> bool {
+    clear();
+
+    const auto fail = [this] {
+        Logger::error("Corrupt or incompatible serialized world.\n");
+        clear();
+        return false;
+    };
+
+    Reader reader(data);
+    WorldHeader header;
+
+    if (!reader.read(&header, sizeof(header))) return fail();
+
+    _version = header.version;
+
+    // Taken before anything is sized by the counts, so a corrupt header
+    // can't allocate more than the data holds.
+    const unsigned char* generations = reader.take(static_cast<std::uint64_t>(header.record_count) * sizeof(std::uint32_t));
+    const unsigned char* free_indices = reader.take(static_cast<std::uint64_t>(header.free_count) * sizeof(std::uint32_t));
+
+    if (generations == nullptr || free_indices == nullptr) return fail();
+
+    _free_indices.resize(header.free_count);
+    std::memcpy(_free_indices.data(), free_indices, _free_indices.size() * sizeof(std::uint32_t));
+
+    if (std::any_of(_free_indices.begin(), _free_indices.end(), [&](std::uint32_t index) { return index >= header.record_count; })) {
+        return fail();
+    }
+
+    _records.resize(header.record_count);
+
+    for (std::uint32_t i = 0; i < header.record_count; ++i) {
+        std::uint32_t generation;
+        std::memcpy(&generation, generations + i * sizeof(std::uint32_t), sizeof(generation));
+        _records[i] = { nullptr, 0, generation };
+    }
+
+    for (std::uint32_t a = 0; a < header.archetype_count; ++a) {
+        ArchetypeHeader archetype_header;
+        if (!reader.read(&archetype_header, sizeof(archetype_header))) return fail();
+
+        const std::uint32_t column_count = archetype_header.column_count;
+        const std::uint32_t count = archetype_header.count;
+
+        if (column_count > max_components) return fail();
+
+        std::vector<std::uint64_t> hashes(column_count);
+        std::vector<std::uint32_t> sizes(column_count);
+
+        if (!reader.read(hashes.data(), hashes.size() * sizeof(std::uint64_t)) ||
+            !reader.read(sizes.data(), sizes.size() * sizeof(std::uint32_t))) {
+            return fail();
+        }
+
+        std::vector<ComponentId> ids(column_count);
+        ComponentMask mask = 0;
+
+        for (std::uint32_t c = 0; c < column_count; ++c) {
+            const auto id = find_component(hashes[c], sizes[c]);
+
+            if (!id) {
+                Logger::error("Serialized world uses unregistered component {:016x}.\n", hashes[c]);
+                clear();
+                return false;
+            }
+
+            ids[c] = *id;
+            mask |= ComponentMask{ 1 } << *id;
+        }
+
+        Archetype* target = archetype(mask);
+        if (target == nullptr) return fail();
+
+        const unsigned char* entities = reader.take(static_cast<std::uint64_t>(count) * sizeof(Entity));
+        if (entities == nullptr) return fail();
+
+        std::vector<const unsigned char*> columns(column_count);
+
+        for (std::uint32_t c = 0; c < column_count; ++c) {
+            columns[c] = reader.take(static_cast<std::uint64_t>(count) * sizes[c]);
+            if (columns[c] == nullptr) return fail();
+        }
+
+        for (std::uint32_t row = 0; row < count; row += target->capacity) {
+            const std::uint32_t n = std::min(target->capacity, count - row);
+            Chunk& chunk = allocate_chunk(*target);
+
+            std::memcpy(chunk.data, entities + row * sizeof(Entity), n * sizeof(Entity));
+
+            for (std::uint32_t c = 0; c < column_count; ++c) {
+                const Column& column = target->columns[target->column(ids[c])];
+                std::memcpy(chunk.data + column.offset, columns[c] + static_cast<std::uint64_t>(row) * sizes[c], static_cast<std::uint64_t>(n) * sizes[c]);
+            }
+
+            chunk.count = n;
+        }
+
+        target->count = count;
+
+        for (std::uint32_t row = 0; row < count; ++row) {
+            Entity entity;
+            std::memcpy(&entity, entities + row * sizeof(Entity), sizeof(Entity));
+
+            if (entity.index >= _records.size()) return fail();
+
+            _records[entity.index] = { target, row, entity.generation };
+        }
+
+        _count += count;
+    }
+
+    if (_count != header.entity_count) return fail();
+
+    Logger::info("Loaded world with {} entities.\n", _count);
+    return true;
+}
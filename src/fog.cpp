@@ -0,0 +1,559 @@
+#include "nkgt/fog.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/matrix.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+static constexpr std::uint32_t fog_spv[] = {
+#include "fog.comp.spv.h"
+};
+
+static constexpr std::uint32_t fullscreen_vert_spv[] = {
+#include "fullscreen.vert.spv.h"
+};
+
+static constexpr std::uint32_t fog_composite_spv[] = {
+#include "fog_composite.frag.spv.h"
+};
+
+static constexpr Motorino::DescriptorType fog_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+static constexpr Motorino::DescriptorType fog_composite_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t fog_group_size = 8;
+
+// Froxels keep scattering and extinction as four halves.
+constexpr std::uint64_t fog_froxel_size = 2 * sizeof(std::uint32_t);
+
+namespace {
+
+// Mirrors the Data block of shaders/fog.comp.
+struct FogData {
+    float inverse_view_projection[16];
+    float previous_view_projection[16];
+    float position[4];
+    float previous_position[4];
+    float sun_direction[4];
+    float sun_color[4];
+    float ambient[4];
+    float albedo[4];
+    std::uint32_t grid[4];
+    float depth[2];
+    float padding[2];
+    Motorino::FogLight lights[Motorino::max_fog_lights];
+};
+
+// Mirrors the push constants of shaders/fog_composite.frag.
+struct FogCompositeConstants {
+    std::uint32_t grid[3];
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t visibility;
+};
+
+static_assert(sizeof(Motorino::FogLight) == 32);
+static_assert(sizeof(FogData) == 256 + Motorino::max_fog_lights * 32);
+
+enum class FogPass : std::uint32_t {
+    Inject = 0,
+    Integrate = 1,
+};
+
+}
+
+// Van der Corput sequence in base 2, so jittered depths of consecutive frames
+// spread evenly over the slice.
+static auto depth_jitter(std::uint32_t frame) -> float {
+    std::uint32_t bits = frame;
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+    bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+    bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+auto Motorino::Engine::create_fog(const FogSettings& settings) -> bool {
+    if (_fog_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Fog already created.\n");
+        return false;
+    }
+
+    if (settings.grid[0] == 0 || settings.grid[1] == 0 || settings.grid[2] == 0) {
+        Logger::error("Fog grid must hold at least one froxel.\n");
+        return false;
+    }
+
+    if (!(settings.depth_start > 0.0f) || !(settings.depth_end > settings.depth_start)) {
+        Logger::error("Fog depth range must be positive and not empty.\n");
+        return false;
+    }
+
+    bool result = create_compute_pipeline(
+        _device,
+        fog_spv,
+        fog_bindings,
+        sizeof(FogPass),
+        _fog_pipeline
+    );
+
+    result = result && create_draw_pipeline(
+        _device,
+        _render_pass,
+        {
+            .vertex_code = fullscreen_vert_spv,
+            .fragment_code = fog_composite_spv,
+            .bindings = fog_composite_bindings,
+            .push_constant_size = sizeof(FogCompositeConstants),
+            .blend = DrawBlend::Premultiplied,
+        },
+        _fog_composite_pipeline
+    );
+
+    if (!result) {
+        destroy_fog();
+        return false;
+    }
+
+    const std::uint64_t grid_size = static_cast<std::uint64_t>(settings.grid[0]) * settings.grid[1] *
+        settings.grid[2] * fog_froxel_size;
+
+    result = create_buffer(
+        sizeof(FogData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _fog_data,
+        _fog_data_memory
+    ) && create_buffer(
+        grid_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _fog_froxels[0],
+        _fog_froxels_memory[0]
+    ) && create_buffer(
+        grid_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _fog_froxels[1],
+        _fog_froxels_memory[1]
+    ) && create_buffer(
+        grid_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _fog_integrated,
+        _fog_integrated_memory
+    );
+
+    if (!result) {
+        destroy_fog();
+        return false;
+    }
+
+    const VkDescriptorSetLayout set_layouts[] = {
+        _fog_pipeline.set_layout,
+        _fog_pipeline.set_layout,
+    };
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 2,
+        .pSetLayouts = set_layouts,
+    };
+
+    VkDescriptorSetAllocateInfo composite_set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_fog_composite_pipeline.set_layout,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+
+        if (vkAllocateDescriptorSets(_device, &set_info, _fog_sets) != VK_SUCCESS) {
+            _fog_sets[0] = VK_NULL_HANDLE;
+            _fog_sets[1] = VK_NULL_HANDLE;
+            result = false;
+        }
+
+        if (result && vkAllocateDescriptorSets(_device, &composite_set_info, &_fog_composite_set) != VK_SUCCESS) {
+            _fog_composite_set = VK_NULL_HANDLE;
+            result = false;
+        }
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate fog descriptor sets.\n");
+        destroy_fog();
+        return false;
+    }
+
+    // Set i writes froxels i and reads the history from the other one.
+    for (std::uint32_t i = 0; i < 2; ++i) {
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { .buffer = _fog_data, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _fog_froxels[1 - i], .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _fog_froxels[i], .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _fog_integrated, .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _fog_sets[i],
+            .dstBinding = 0,
+            .descriptorCount = 4,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+
+    // The visibility frame the composite reads depth from is bound on
+    // resize.
+    const VkDescriptorBufferInfo composite_infos[] = {
+        { .buffer = _fog_integrated, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _fog_data, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+
+    VkWriteDescriptorSet composite_write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _fog_composite_set,
+        .dstBinding = 0,
+        .descriptorCount = 2,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = composite_infos,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &composite_write, 0, nullptr);
+    resize_fog();
+
+    std::scoped_lock lock(_draw_mutex);
+    _fog_settings = settings;
+    _fog_frame = 0;
+    _fog_history = false;
+    _fog_ready = true;
+
+    return true;
+}
+
+auto Motorino::Engine::set_fog_camera(const FogCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _fog_camera = camera;
+}
+
+auto Motorino::Engine::set_fog_lights(std::span<const FogLight> lights) -> void {
+    std::scoped_lock lock(_draw_mutex);
+
+    _fog_light_count = static_cast<std::uint32_t>(std::min<std::size_t>(lights.size(), max_fog_lights));
+    std::copy_n(lights.begin(), _fog_light_count, _fog_lights);
+}
+
+auto Motorino::Engine::fog_volume() -> FogVolume {
+    std::scoped_lock lock(_draw_mutex);
+
+    return {
+        .integrated = _fog_ready ? _fog_integrated : VK_NULL_HANDLE,
+        .grid = { _fog_settings.grid[0], _fog_settings.grid[1], _fog_settings.grid[2] },
+        .depth_start = _fog_settings.depth_start,
+        .depth_end = _fog_settings.depth_end,
+    };
+}
+
+auto Motorino::Engine::destroy_fog() -> void {
+    std::uint64_t last_frame;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _fog_ready = false;
+        last_frame = _frame_value.load();
+    }
+
+    if (last_frame > 0 && _fog_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_fog_sets[0] != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 2, _fog_sets);
+        _fog_sets[0] = VK_NULL_HANDLE;
+        _fog_sets[1] = VK_NULL_HANDLE;
+    }
+
+    if (_fog_composite_set != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 1, &_fog_composite_set);
+        _fog_composite_set = VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(_device, _fog_data, nullptr);
+    vkFreeMemory(_device, _fog_data_memory, nullptr);
+    vkDestroyBuffer(_device, _fog_integrated, nullptr);
+    vkFreeMemory(_device, _fog_integrated_memory, nullptr);
+
+    _fog_data = VK_NULL_HANDLE;
+    _fog_data_memory = VK_NULL_HANDLE;
+    _fog_integrated = VK_NULL_HANDLE;
+    _fog_integrated_memory = VK_NULL_HANDLE;
+
+    for (std::uint32_t i = 0; i < 2; ++i) {
+        vkDestroyBuffer(_device, _fog_froxels[i], nullptr);
+        vkFreeMemory(_device, _fog_froxels_memory[i], nullptr);
+        _fog_froxels[i] = VK_NULL_HANDLE;
+        _fog_froxels_memory[i] = VK_NULL_HANDLE;
+    }
+
+    destroy_compute_pipeline(_device, _fog_pipeline);
+    destroy_draw_pipeline(_device, _fog_composite_pipeline);
+}
+
+auto Motorino::Engine::resize_fog() -> void {
+    if (_fog_composite_set == VK_NULL_HANDLE) return;
+
+    // Without a visibility frame the composite never reads the binding, so
+    // any buffer fills it.
+    const VkDescriptorBufferInfo frame_info{
+        .buffer = _visibility_frame != VK_NULL_HANDLE ? _visibility_frame : _fog_integrated,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _fog_composite_set,
+        .dstBinding = 2,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &frame_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+}
+
+auto Motorino::Engine::record_fog(VkCommandBuffer cmd_buffer) -> void {
+    if (!_fog_ready) return;
+
+    FogData data{};
+
+    if (!invert(_fog_camera.view_projection, data.inverse_view_projection)) return;
+
+    const FogSettings& settings = _fog_settings;
+    const std::uint32_t current = _fog_frame & 1;
+
+    std::memcpy(data.previous_view_projection, _fog_previous.view_projection, sizeof(data.previous_view_projection));
+
+    for (std::uint32_t i = 0; i < 3; ++i) {
+        data.position[i] = _fog_camera.position[i];
+        data.previous_position[i] = _fog_previous.position[i];
+        data.sun_direction[i] = settings.sun_direction[i];
+        data.sun_color[i] = settings.sun_color[i];
+        data.ambient[i] = settings.ambient[i];
+        data.albedo[i] = settings.albedo[i];
+        data.grid[i] = settings.grid[i];
+    }
+
+    const float sun_length = std::sqrt(
+        data.sun_direction[0] * data.sun_direction[0] +
+        data.sun_direction[1] * data.sun_direction[1] +
+        data.sun_direction[2] * data.sun_direction[2]
+    );
+
+    if (sun_length > 0.0f) {
+        for (std::uint32_t i = 0; i < 3; ++i) data.sun_direction[i] /= sun_length;
+    }
+
+    data.position[3] = depth_jitter(_fog_frame);
+    data.previous_position[3] = _fog_history ? 1.0f : 0.0f;
+    data.sun_direction[3] = std::clamp(settings.anisotropy, -0.99f, 0.99f);
+    data.sun_color[3] = settings.density;
+    data.ambient[3] = settings.height_falloff;
+    data.albedo[3] = std::clamp(settings.history_weight, 0.0f, 1.0f);
+    data.grid[3] = _fog_light_count;
+    data.depth[0] = settings.depth_start;
+    data.depth[1] = settings.depth_end;
+    std::copy_n(_fog_lights, _fog_light_count, data.lights);
+
+    // Earlier frames may still read the data, the froxels this frame
+    // overwrites and the integrated grid, and the previous one wrote the
+    // history read here.
+    VkMemoryBarrier history{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &history,
+        0, nullptr,
+        0, nullptr
+    );
+
+    const VkDeviceSize data_size = offsetof(FogData, lights) + _fog_light_count * sizeof(FogLight);
+    vkCmdUpdateBuffer(cmd_buffer, _fog_data, 0, data_size, &data);
+
+    VkBufferMemoryBarrier to_compute{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _fog_data,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    // The composite reads the camera too.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &to_compute,
+        0, nullptr
+    );
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _fog_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _fog_pipeline.layout,
+        0,
+        1,
+        &_fog_sets[current],
+        0,
+        nullptr
+    );
+
+    const std::uint32_t groups_x = (settings.grid[0] + fog_group_size - 1) / fog_group_size;
+    const std::uint32_t groups_y = (settings.grid[1] + fog_group_size - 1) / fog_group_size;
+
+    FogPass pass = FogPass::Inject;
+    vkCmdPushConstants(cmd_buffer, _fog_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), &pass);
+    vkCmdDispatch(cmd_buffer, groups_x, groups_y, settings.grid[2]);
+
+    // Integration reads the injected froxels through a buffer it may also
+    // write, so both accesses wait for the injection.
+    VkBufferMemoryBarrier injected{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _fog_froxels[current],
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &injected,
+        0, nullptr
+    );
+
+    pass = FogPass::Integrate;
+    vkCmdPushConstants(cmd_buffer, _fog_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pass), &pass);
+    vkCmdDispatch(cmd_buffer, groups_x, groups_y, 1);
+
+    VkBufferMemoryBarrier to_fragment{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _fog_integrated,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &to_fragment,
+        0, nullptr
+    );
+
+    // The next frame reprojects from this one.
+    _fog_previous = _fog_camera;
+    _fog_history = true;
+    ++_fog_frame;
+}
+
+auto Motorino::Engine::draw_fog(VkCommandBuffer cmd_buffer) -> void {
+    if (!_fog_ready) return;
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _fog_composite_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _fog_composite_pipeline.layout,
+        0,
+        1,
+        &_fog_composite_set,
+        0,
+        nullptr
+    );
+
+    const FogCompositeConstants constants{
+        .grid = { _fog_settings.grid[0], _fog_settings.grid[1], _fog_settings.grid[2] },
+        .width = _width,
+        .height = _height,
+        .visibility = _visibility_drawn ? 1u : 0u,
+    };
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _fog_composite_pipeline.layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
+}
@@ -0,0 +1,331 @@
+#include "nkgt/frame_encoder.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+static constexpr std::uint32_t rgb_to_yuv_spv[] = {
+#include "rgb_to_yuv.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType rgb_to_yuv_bindings[] = {
+    Motorino::DescriptorType::CombinedImageSampler,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+struct CaptureConstants {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t planar;
+};
+
+// Each invocation converts 8x2 pixels, each group 8x8 invocations.
+constexpr std::uint32_t capture_group_width = 64;
+constexpr std::uint32_t capture_group_height = 16;
+
+auto Motorino::Engine::start_capture(const CaptureSettings& settings) -> bool {
+    if (!_capture_supported) {
+        Logger::error("Swapchain images can't be sampled, frame capture is unavailable.\n");
+        return false;
+    }
+
+    if (_encoder.running()) {
+        Logger::error("Frame capture already running.\n");
+        return false;
+    }
+
+    const std::uint32_t width = _width;
+    const std::uint32_t height = _height;
+
+    if (width % 8 != 0 || height % 2 != 0) {
+        Logger::error("Frame capture needs a width multiple of 8 and an even height.\n");
+        return false;
+    }
+
+    bool result = create_compute_pipeline(
+        _device,
+        rgb_to_yuv_spv,
+        rgb_to_yuv_bindings,
+        sizeof(CaptureConstants),
+        _capture_pipeline
+    );
+
+    if (!result) {
+        destroy_capture();
+        return false;
+    }
+
+    // texelFetch ignores filtering, but the binding still needs a sampler.
+    constexpr VkSamplerCreateInfo sampler_info{
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    };
+
+    if (vkCreateSampler(_device, &sampler_info, nullptr, &_capture_sampler) != VK_SUCCESS) {
+        Logger::error("Failed to create capture sampler.\n");
+        destroy_capture();
+        return false;
+    }
+
+    const std::uint64_t frame_size = static_cast<std::uint64_t>(width) * height * 3 / 2;
+    const unsigned char* mappings[capture_slot_count];
+
+    for (std::uint32_t i = 0; i < capture_slot_count; ++i) {
+        CaptureSlot& slot = _capture_slots[i];
+
+        // The encoder reads every byte on the CPU, which is slow from
+        // uncached memory.
+        result = create_buffer(
+            frame_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            slot.buffer,
+            slot.memory
+        ) || create_buffer(
+            frame_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            slot.buffer,
+            slot.memory
+        );
+
+        if (!result) {
+            destroy_capture();
+            return false;
+        }
+
+        void* data;
+
+        if (vkMapMemory(_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map capture buffer.\n");
+            destroy_capture();
+            return false;
+        }
+
+        mappings[i] = static_cast<const unsigned char*>(data);
+
+        std::scoped_lock lock(_compute_mutex);
+
+        VkDescriptorSetAllocateInfo set_info{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = _descriptor_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &_capture_pipeline.set_layout,
+        };
+
+        if (vkAllocateDescriptorSets(_device, &set_info, &slot.set) != VK_SUCCESS) {
+            Logger::error("Failed to allocate capture descriptor set.\n");
+            destroy_capture();
+            return false;
+        }
+    }
+
+    if (!_encoder.start(settings, width, height, mappings)) {
+        destroy_capture();
+        return false;
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+
+    _capture_layout = settings.layout;
+    _capture_width = width;
+    _capture_height = height;
+    _capturing = true;
+
+    return true;
+}
+
+auto Motorino::Engine::stop_capture() -> void {
+    if (!_encoder.running()) return;
+
+    std::uint64_t last_frame;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _capturing = false;
+        last_frame = _frame_value.load();
+    }
+
+    // Frames hand their slot to the encoder from a waiter callback
+    // registered before this wait, so every captured frame is queued once
+    // it returns.
+    if (last_frame > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    _encoder.stop();
+    destroy_capture();
+}
+
+auto Motorino::Engine::destroy_capture() -> void {
+    for (CaptureSlot& slot : _capture_slots) {
+        if (slot.set != VK_NULL_HANDLE) {
+            std::scoped_lock lock(_compute_mutex);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &slot.set);
+        }
+
+        vkDestroyBuffer(_device, slot.buffer, nullptr);
+        vkFreeMemory(_device, slot.memory, nullptr);
+
+        slot = {};
+    }
+
+    vkDestroySampler(_device, _capture_sampler, nullptr);
+    _capture_sampler = VK_NULL_HANDLE;
+
+    destroy_compute_pipeline(_device, _capture_pipeline);
+}
+
+auto Motorino::Engine::record_capture(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t image_index
+) -> std::optional<std::uint32_t> {
+    if (!_capturing || _width != _capture_width || _height != _capture_height) {
+        return std::nullopt;
+    }
+
+    const auto slot_index = _encoder.acquire();
+    if (!slot_index) return std::nullopt;
+
+    const CaptureSlot& slot = _capture_slots[*slot_index];
+
+    // The slot was last read by a frame the encoder already wrote out, so
+    // its set is free to update.
+    VkDescriptorImageInfo image_info{
+        .sampler = _capture_sampler,
+        .imageView = _image_views[image_index],
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+
+    VkDescriptorBufferInfo buffer_info{
+        .buffer = slot.buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    const VkWriteDescriptorSet writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = slot.set,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &image_info,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = slot.set,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffer_info,
+        },
+    };
+
+    vkUpdateDescriptorSets(_device, 2, writes, 0, nullptr);
+
+    const VkImageSubresourceRange color_range{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    VkImageMemoryBarrier to_shader{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = _images[image_index],
+        .subresourceRange = color_range,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &to_shader
+    );
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _capture_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _capture_pipeline.layout,
+        0,
+        1,
+        &slot.set,
+        0,
+        nullptr
+    );
+
+    const CaptureConstants constants{
+        .width = _capture_width,
+        .height = _capture_height,
+        .planar = static_cast<std::uint32_t>(_capture_layout),
+    };
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _capture_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    vkCmdDispatch(
+        cmd_buffer,
+        (_capture_width + capture_group_width - 1) / capture_group_width,
+        (_capture_height + capture_group_height - 1) / capture_group_height,
+        1
+    );
+
+    VkImageMemoryBarrier to_present{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .dstAccessMask = 0,
+        .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = _images[image_index],
+        .subresourceRange = color_range,
+    };
+
+    VkBufferMemoryBarrier to_host{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = slot.buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        1, &to_host,
+        1, &to_present
+    );
+
+    return slot_index;
+}
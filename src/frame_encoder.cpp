@@ -0,0 +1,136 @@
+#include "nkgt/frame_encoder.hpp"
+#include "nkgt/logger.hpp"
+
+#include <fmt/format.h>
+
+Motorino::FrameEncoder::FrameEncoder()
+    : _width{ 0 },
+      _height{ 0 },
+      _slots{},
+      _busy{},
+      _submitted{ 0 },
+      _stop{ false },
+      _written{ 0 },
+      _dropped{ 0 },
+      _y4m{ false }
+{}
+
+Motorino::FrameEncoder::~FrameEncoder() {
+    stop();
+}
+
+auto Motorino::FrameEncoder::start(
+    const CaptureSettings& settings,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::span<const unsigned char* const> slots
+) -> bool {
+    if (running()) {
+        Logger::error("Frame capture already running.\n");
+        return false;
+    }
+
+    if (slots.size() != capture_slot_count) {
+        Logger::error("Frame capture needs {} slots.\n", capture_slot_count);
+        return false;
+    }
+
+    _y4m = settings.container == CaptureContainer::Y4M;
+
+    if (_y4m && settings.layout != YuvLayout::I420) {
+        Logger::error("Y4M capture needs the I420 layout.\n");
+        return false;
+    }
+
+    _file.open(settings.path, std::ios::binary | std::ios::trunc);
+
+    if (!_file) {
+        Logger::error("Failed to open capture file {}.\n", settings.path);
+        return false;
+    }
+
+    if (_y4m) {
+        const std::string header = fmt::format(
+            "YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+            width,
+            height,
+            settings.frame_rate
+        );
+
+        _file.write(header.data(), header.size());
+    }
+
+    _width = width;
+    _height = height;
+    _written = 0;
+    _dropped.store(0);
+    _stop.store(false);
+
+    for (std::uint32_t i = 0; i < capture_slot_count; ++i) {
+        _slots[i] = slots[i];
+        _busy[i].store(false);
+    }
+
+    _thread = std::thread(&FrameEncoder::encode, this);
+
+    Logger::info("Started capturing {}x{} frames to {}.\n", width, height, settings.path);
+    return true;
+}
+
+auto Motorino::FrameEncoder::stop() -> void {
+    if (!running()) return;
+
+    _stop.store(true, std::memory_order_release);
+    _submitted.fetch_add(1, std::memory_order_release);
+    _submitted.notify_one();
+
+    _thread.join();
+    _file.close();
+
+    Logger::info("Captured {} frames, dropped {}.\n", _written, _dropped.load());
+}
+
+auto Motorino::FrameEncoder::acquire() -> std::optional<std::uint32_t> {
+    for (std::uint32_t i = 0; i < capture_slot_count; ++i) {
+        bool expected = false;
+
+        if (_busy[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return i;
+        }
+    }
+
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+auto Motorino::FrameEncoder::submit(std::uint32_t slot) -> void {
+    // Never full, a slot is queued at most once.
+    _queue.push(slot);
+    _submitted.fetch_add(1, std::memory_order_release);
+    _submitted.notify_one();
+}
+
+auto Motorino::FrameEncoder::encode() -> void {
+    constexpr char frame_header[] = "FRAME\n";
+
+    for (;;) {
+        // Read before popping, so a submission in between wakes the wait.
+        const std::uint32_t seen = _submitted.load(std::memory_order_acquire);
+
+        if (const auto slot = _queue.pop()) {
+            if (_y4m) _file.write(frame_header, sizeof(frame_header) - 1);
+
+            _file.write(reinterpret_cast<const char*>(_slots[*slot]), static_cast<std::streamsize>(frame_size()));
+            _busy[*slot].store(false, std::memory_order_release);
+            ++_written;
+
+            continue;
+        }
+
+        if (_stop.load(std::memory_order_acquire)) break;
+
+        _submitted.wait(seen, std::memory_order_acquire);
+    }
+
+    if (!_file) Logger::error("Failed to write captured frames.\n");
+}
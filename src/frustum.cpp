@@ -0,0 +1,39 @@
+#include "nkgt/frustum.hpp"
+
+#include <cmath>
+
+auto Motorino::frustum_planes(
+    const float (&m)[16],
+    float (&planes)[6][4]
+) -> void {
+    const auto row = [&m](int r, int c) { return m[c * 4 + r]; };
+
+    for (int c = 0; c < 4; ++c) {
+        planes[0][c] = row(3, c) + row(0, c);
+        planes[1][c] = row(3, c) - row(0, c);
+        planes[2][c] = row(3, c) + row(1, c);
+        planes[3][c] = row(3, c) - row(1, c);
+        planes[4][c] = row(2, c);
+        planes[5][c] = row(3, c) - row(2, c);
+    }
+
+    for (auto& plane : planes) {
+        const float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length == 0.0f) continue;
+
+        for (float& value : plane) value /= length;
+    }
+}
+
+auto Motorino::sphere_in_frustum(
+    const float (&planes)[6][4],
+    const float (&center)[3],
+    float radius
+) -> bool {
+    for (const auto& plane : planes) {
+        const float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+        if (distance < -radius) return false;
+    }
+
+    return true;
+}
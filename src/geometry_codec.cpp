@@ -0,0 +1,166 @@
+#include "nkgt/geometry_codec.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<std::uint32_t>& words)
+        : _words{ words },
+          _bit{ 0 }
+    {}
+
+    auto write(std::uint32_t value, std::uint32_t bits) -> void {
+        if (bits == 0) return;
+
+        const std::size_t word = _bit / 32;
+        const std::uint32_t shift = _bit % 32;
+
+        if (_words.size() < word + 2) _words.resize(word + 2, 0);
+
+        _words[word] |= value << shift;
+
+        if (shift + bits > 32) {
+            _words[word + 1] |= value >> (32 - shift);
+        }
+
+        _bit += bits;
+    }
+
+    auto word_count() const -> std::size_t {
+        return (_bit + 31) / 32;
+    }
+
+private:
+    std::vector<std::uint32_t>& _words;
+    std::uint64_t _bit;
+};
+
+}
+
+auto Motorino::encode_geometry(
+    const Geometry& geometry,
+    std::span<const std::uint8_t> component_bits
+) -> std::optional<EncodedGeometry> {
+    const std::uint32_t component_count = static_cast<std::uint32_t>(component_bits.size());
+
+    if (component_count == 0 ||
+        component_count > max_encoded_components ||
+        geometry.vertex_stride != component_count * sizeof(float) ||
+        geometry.position_stride != 0) {
+        Logger::error("Geometry encoding needs interleaved vertices and one bit count per float of them.\n");
+        return std::nullopt;
+    }
+
+    if (std::any_of(component_bits.begin(), component_bits.end(), [](std::uint8_t bits) { return bits > 16; })) {
+        Logger::error("Geometry components are limited to 16 bits.\n");
+        return std::nullopt;
+    }
+
+    const std::uint32_t vertex_count = geometry.vertex_count;
+    const std::uint32_t index_count = geometry.index_count;
+
+    std::vector<float> vertices(static_cast<std::size_t>(vertex_count) * component_count);
+    std::memcpy(vertices.data(), geometry.data, vertices.size() * sizeof(float));
+
+    std::vector<std::uint16_t> indices(index_count);
+    std::memcpy(indices.data(), geometry.data + vertices.size() * sizeof(float), indices.size() * sizeof(std::uint16_t));
+
+    const std::uint32_t index_bits = std::max(1u, static_cast<std::uint32_t>(std::bit_width(vertex_count > 0 ? vertex_count - 1 : 0u)));
+
+    std::uint32_t vertex_bits = 0;
+    for (const auto bits : component_bits) vertex_bits += bits;
+
+    EncodedGeometry encoded{
+        .vertex_count = vertex_count,
+        .index_count = index_count,
+        .vertex_stride = geometry.vertex_stride,
+    };
+
+    auto& words = encoded.words;
+    words.resize(encoded_header_words + component_count * encoded_component_words, 0);
+
+    std::vector<float> minimum(component_count, std::numeric_limits<float>::max());
+    std::vector<float> maximum(component_count, std::numeric_limits<float>::lowest());
+
+    for (std::uint32_t v = 0; v < vertex_count; ++v) {
+        for (std::uint32_t c = 0; c < component_count; ++c) {
+            const float value = vertices[v * component_count + c];
+            minimum[c] = std::min(minimum[c], value);
+            maximum[c] = std::max(maximum[c], value);
+        }
+    }
+
+    std::vector<float> scale(component_count, 0.0f);
+    std::uint32_t bit_offset = 0;
+
+    for (std::uint32_t c = 0; c < component_count; ++c) {
+        if (vertex_count == 0) minimum[c] = maximum[c] = 0.0f;
+
+        const std::uint32_t steps = (1u << component_bits[c]) - 1;
+        scale[c] = steps > 0 ? (maximum[c] - minimum[c]) / static_cast<float>(steps) : 0.0f;
+
+        const std::size_t base = encoded_header_words + c * encoded_component_words;
+        words[base + 0] = component_bits[c];
+        words[base + 1] = bit_offset;
+        words[base + 2] = std::bit_cast<std::uint32_t>(minimum[c]);
+        words[base + 3] = std::bit_cast<std::uint32_t>(scale[c]);
+
+        bit_offset += component_bits[c];
+    }
+
+    std::vector<std::uint32_t> vertex_stream;
+    BitWriter vertex_writer(vertex_stream);
+
+    for (std::uint32_t v = 0; v < vertex_count; ++v) {
+        for (std::uint32_t c = 0; c < component_count; ++c) {
+            if (component_bits[c] == 0) continue;
+
+            const float value = vertices[v * component_count + c];
+            const std::uint32_t steps = (1u << component_bits[c]) - 1;
+            const float normalized = scale[c] > 0.0f ? (value - minimum[c]) / scale[c] : 0.0f;
+            const auto quantized = static_cast<std::uint32_t>(std::clamp(normalized + 0.5f, 0.0f, static_cast<float>(steps)));
+
+            vertex_writer.write(quantized, component_bits[c]);
+        }
+    }
+
+    std::vector<std::uint32_t> index_stream;
+    BitWriter index_writer(index_stream);
+
+    for (const auto index : indices) {
+        index_writer.write(index, index_bits);
+    }
+
+    words[0] = vertex_count;
+    words[1] = index_count;
+    words[2] = component_count;
+    words[3] = vertex_bits;
+    words[4] = index_bits;
+    words[5] = static_cast<std::uint32_t>(words.size());
+    words[6] = words[5] + static_cast<std::uint32_t>(vertex_writer.word_count());
+    words[7] = component_count;
+
+    vertex_stream.resize(vertex_writer.word_count());
+    index_stream.resize(index_writer.word_count());
+
+    words.insert(words.end(), vertex_stream.begin(), vertex_stream.end());
+    words.insert(words.end(), index_stream.begin(), index_stream.end());
+
+    // The decoder may read one word past the last value it extracts.
+    words.push_back(0);
+
+    Logger::info(
+        "Encoded geometry to {}B ({}B decoded).\n",
+        words.size() * sizeof(std::uint32_t),
+        encoded.decoded_size()
+    );
+
+    return encoded;
+}
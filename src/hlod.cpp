@@ -0,0 +1,401 @@
+#include "nkgt/hlod.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/triangle_mesh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+// Proxies are drawn with 16-bit indices.
+constexpr std::uint32_t max_proxy_vertices = 65535;
+
+// Bits per axis of a vertex clustering cell coordinate.
+constexpr std::uint32_t cell_bits = 21;
+
+// Median splits along the longest axis per level, 2^3 children at most.
+constexpr std::uint32_t split_rounds = 3;
+
+namespace {
+
+using Motorino::Vec3;
+using Motorino::operator+;
+using Motorino::operator*;
+
+// An object moved to world space, with the bounds clustering works on.
+struct WorldObject {
+    std::vector<Vec3> positions;
+    std::vector<Vec3> colors;
+    std::vector<std::uint16_t> indices;
+    Vec3 lower;
+    Vec3 upper;
+    Vec3 center;
+};
+
+auto transform_point(
+    const float (&m)[16],
+    const Vec3& p
+) -> Vec3 {
+    return {
+        m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+        m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+        m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14],
+    };
+}
+
+auto load_object(
+    const Motorino::HlodObject& object,
+    const Motorino::HlodSettings& settings,
+    WorldObject& out
+) -> bool {
+    Motorino::TriangleMesh mesh;
+
+    if (!Motorino::read_triangle_mesh(*object.geometry, settings.position_offset, settings.color_offset, "HLOD object", mesh)) {
+        return false;
+    }
+
+    out.positions = std::move(mesh.positions);
+    out.colors = std::move(mesh.colors);
+    out.indices = std::move(mesh.indices);
+
+    for (Vec3& position : out.positions) {
+        position = transform_point(object.transform, position);
+    }
+
+    Motorino::bounds(out.positions, out.lower, out.upper);
+    out.center = (out.lower + out.upper) * 0.5f;
+
+    return true;
+}
+
+// Splits objects into up to 2^split_rounds groups of about the same size,
+// halving every group larger than leaf_objects at the median of the object
+// centers along its longest axis.
+auto split_cluster(
+    const std::vector<WorldObject>& world,
+    std::vector<std::uint32_t> objects,
+    std::uint32_t leaf_objects
+) -> std::vector<std::vector<std::uint32_t>> {
+    std::vector<std::vector<std::uint32_t>> parts;
+    parts.push_back(std::move(objects));
+
+    for (std::uint32_t round = 0; round < split_rounds; ++round) {
+        std::vector<std::vector<std::uint32_t>> next;
+
+        for (auto& part : parts) {
+            if (part.size() <= leaf_objects) {
+                next.push_back(std::move(part));
+                continue;
+            }
+
+            Vec3 lower = world[part[0]].center;
+            Vec3 upper = lower;
+
+            for (const std::uint32_t object : part) {
+                for (int c = 0; c < 3; ++c) {
+                    lower[c] = std::min(lower[c], world[object].center[c]);
+                    upper[c] = std::max(upper[c], world[object].center[c]);
+                }
+            }
+
+            int axis = 0;
+            for (int c = 1; c < 3; ++c) {
+                if (upper[c] - lower[c] > upper[axis] - lower[axis]) axis = c;
+            }
+
+            const auto middle = part.begin() + part.size() / 2;
+            std::nth_element(part.begin(), middle, part.end(), [&](std::uint32_t a, std::uint32_t b) {
+                return world[a].center[axis] < world[b].center[axis];
+            });
+
+            next.emplace_back(part.begin(), middle);
+            next.emplace_back(middle, part.end());
+        }
+
+        parts = std::move(next);
+    }
+
+    return parts;
+}
+
+// Merges the objects and collapses every vertex into the average of the
+// cell of size cell it falls in, dropping triangles left degenerate or
+// duplicated. Returns false if more than max_proxy_vertices cells are used.
+auto build_proxy(
+    const std::vector<WorldObject>& world,
+    std::span<const std::uint32_t> objects,
+    const Vec3& origin,
+    float cell,
+    Motorino::HlodProxy& proxy
+) -> bool {
+    std::unordered_map<std::uint64_t, std::uint32_t> cells;
+    std::vector<Motorino::ProxyVertex> vertices;
+    std::vector<std::uint32_t> counts;
+    std::vector<std::vector<std::uint32_t>> remaps(objects.size());
+
+    const std::uint64_t cell_mask = (std::uint64_t{ 1 } << cell_bits) - 1;
+
+    for (std::size_t o = 0; o < objects.size(); ++o) {
+        const WorldObject& object = world[objects[o]];
+        std::vector<std::uint32_t>& remap = remaps[o];
+        remap.resize(object.positions.size());
+
+        for (std::size_t v = 0; v < object.positions.size(); ++v) {
+            const Vec3& position = object.positions[v];
+            std::uint64_t key = 0;
+
+            for (int c = 0; c < 3; ++c) {
+                const auto coordinate = static_cast<std::uint64_t>(std::max((position[c] - origin[c]) / cell, 0.0f));
+                key |= std::min(coordinate, cell_mask) << (c * cell_bits);
+            }
+
+            const auto [it, inserted] = cells.try_emplace(key, static_cast<std::uint32_t>(vertices.size()));
+
+            if (inserted) {
+                if (vertices.size() == max_proxy_vertices) return false;
+                vertices.push_back({});
+                counts.push_back(0);
+            }
+
+            Motorino::ProxyVertex& merged = vertices[it->second];
+
+            for (int c = 0; c < 3; ++c) {
+                merged.position[c] += position[c];
+                merged.color[c] += object.colors[v][c];
+            }
+
+            ++counts[it->second];
+            remap[v] = it->second;
+        }
+    }
+
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        const float scale = 1.0f / static_cast<float>(counts[i]);
+
+        for (int c = 0; c < 3; ++c) {
+            vertices[i].position[c] *= scale;
+            vertices[i].color[c] *= scale;
+        }
+    }
+
+    std::vector<std::uint16_t> indices;
+    std::unordered_set<std::uint64_t> triangles;
+
+    for (std::size_t o = 0; o < objects.size(); ++o) {
+        const WorldObject& object = world[objects[o]];
+        const std::vector<std::uint32_t>& remap = remaps[o];
+
+        for (std::size_t t = 0; t < object.indices.size(); t += 3) {
+            std::uint32_t corners[3] = {
+                remap[object.indices[t]],
+                remap[object.indices[t + 1]],
+                remap[object.indices[t + 2]],
+            };
+
+            if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) continue;
+
+            // Winding is kept, only the key is sorted.
+            std::uint32_t sorted[3] = { corners[0], corners[1], corners[2] };
+            std::sort(sorted, sorted + 3);
+
+            const std::uint64_t key = std::uint64_t{ sorted[0] } | std::uint64_t{ sorted[1] } << 16 | std::uint64_t{ sorted[2] } << 32;
+            if (!triangles.insert(key).second) continue;
+
+            for (const std::uint32_t corner : corners) {
+                indices.push_back(static_cast<std::uint16_t>(corner));
+            }
+        }
+    }
+
+    const std::uint64_t vertex_size = vertices.size() * sizeof(Motorino::ProxyVertex);
+
+    proxy.vertex_count = static_cast<std::uint32_t>(vertices.size());
+    proxy.index_count = static_cast<std::uint32_t>(indices.size());
+    proxy.data.resize(vertex_size + indices.size() * sizeof(std::uint16_t));
+    std::memcpy(proxy.data.data(), vertices.data(), vertex_size);
+    std::memcpy(proxy.data.data() + vertex_size, indices.data(), indices.size() * sizeof(std::uint16_t));
+
+    return true;
+}
+
+}
+
+auto Motorino::build_hlod(
+    std::span<const HlodObject> objects,
+    const HlodSettings& settings,
+    JobSystem& jobs
+) -> std::optional<HlodTree> {
+    if (objects.empty() || settings.leaf_objects == 0 || settings.proxy_detail <= 0.0f) {
+        Logger::error("HLOD needs objects, at least one object per leaf and a positive proxy detail.\n");
+        return std::nullopt;
+    }
+
+    std::vector<WorldObject> world(objects.size());
+    std::atomic<bool> loaded = true;
+
+    jobs.parallel_for(static_cast<std::uint32_t>(objects.size()), 16, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; ++i) {
+            if (!load_object(objects[i], settings, world[i])) loaded = false;
+        }
+    });
+
+    if (!loaded) return std::nullopt;
+
+    HlodTree tree;
+    // Objects under every node, kept to build the proxies afterwards.
+    std::vector<std::vector<std::uint32_t>> node_objects;
+
+    std::vector<std::uint32_t> all(objects.size());
+    for (std::uint32_t i = 0; i < all.size(); ++i) all[i] = i;
+
+    tree.nodes.push_back({});
+    node_objects.push_back(std::move(all));
+
+    // Breadth first, so the children of a node are contiguous.
+    for (std::size_t n = 0; n < tree.nodes.size(); ++n) {
+        const std::vector<std::uint32_t>& members = node_objects[n];
+
+        Vec3 lower = world[members[0]].lower;
+        Vec3 upper = world[members[0]].upper;
+
+        for (const std::uint32_t object : members) {
+            for (int c = 0; c < 3; ++c) {
+                lower[c] = std::min(lower[c], world[object].lower[c]);
+                upper[c] = std::max(upper[c], world[object].upper[c]);
+            }
+        }
+
+        HlodNode node{
+            .center = {
+                (lower[0] + upper[0]) * 0.5f,
+                (lower[1] + upper[1]) * 0.5f,
+                (lower[2] + upper[2]) * 0.5f,
+            },
+            .radius = 0.5f * distance(upper, lower),
+            .error = 0.0f,
+            .first_child = 0,
+            .child_count = 0,
+            .first_object = 0,
+            .object_count = 0,
+            .proxy = static_cast<std::uint32_t>(n),
+        };
+
+        auto parts = members.size() > settings.leaf_objects
+            ? split_cluster(world, members, settings.leaf_objects)
+            : std::vector<std::vector<std::uint32_t>>{};
+
+        if (parts.size() < 2) {
+            node.first_object = static_cast<std::uint32_t>(tree.objects.size());
+            node.object_count = static_cast<std::uint32_t>(members.size());
+            tree.objects.insert(tree.objects.end(), members.begin(), members.end());
+        }
+        else {
+            node.first_child = static_cast<std::uint32_t>(tree.nodes.size());
+            node.child_count = static_cast<std::uint32_t>(parts.size());
+
+            for (auto& part : parts) {
+                tree.nodes.push_back({});
+                node_objects.push_back(std::move(part));
+            }
+        }
+
+        tree.nodes[n] = node;
+    }
+
+    tree.proxies.resize(tree.nodes.size());
+    std::atomic<bool> built = true;
+
+    jobs.parallel_for(static_cast<std::uint32_t>(tree.nodes.size()), 1, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t n = begin; n < end; ++n) {
+            HlodNode& node = tree.nodes[n];
+            const Vec3 origin{
+                node.center[0] - node.radius,
+                node.center[1] - node.radius,
+                node.center[2] - node.radius,
+            };
+
+            // Cells stay addressable with cell_bits per axis.
+            const float diameter = std::max(node.radius * 2.0f, 1e-6f);
+            float cell = std::max(diameter * settings.proxy_detail, diameter / static_cast<float>(1u << (cell_bits - 1)));
+
+            // Coarser cells until the proxy fits 16-bit indices.
+            while (!build_proxy(world, node_objects[n], origin, cell, tree.proxies[n])) {
+                cell *= 2.0f;
+
+                if (cell > diameter * 2.0f) {
+                    built = false;
+                    break;
+                }
+            }
+
+            // A vertex moves at most the diagonal of its cell.
+            node.error = cell * std::sqrt(3.0f);
+        }
+    });
+
+    if (!built) {
+        Logger::error("HLOD proxy does not fit 16-bit indices.\n");
+        return std::nullopt;
+    }
+
+    // Children follow their parent, so walking backwards sees every child
+    // before its parent.
+    for (std::size_t n = tree.nodes.size(); n-- > 0;) {
+        HlodNode& node = tree.nodes[n];
+
+        for (std::uint32_t c = 0; c < node.child_count; ++c) {
+            node.error = std::max(node.error, tree.nodes[node.first_child + c].error);
+        }
+    }
+
+    std::uint64_t proxy_triangles = 0;
+    for (const HlodProxy& proxy : tree.proxies) proxy_triangles += proxy.index_count / 3;
+
+    Logger::info("Built {} HLOD clusters over {} objects, {} proxy triangles.\n", tree.nodes.size(), objects.size(), proxy_triangles);
+
+    return tree;
+}
+
+auto Motorino::select_hlod(
+    const HlodTree& tree,
+    const std::array<float, 3>& camera,
+    float pixels_per_radian,
+    float max_error,
+    std::vector<std::uint32_t>& objects,
+    std::vector<std::uint32_t>& proxies
+) -> void {
+    if (tree.nodes.empty()) return;
+
+    std::vector<std::uint32_t> stack{ 0 };
+
+    while (!stack.empty()) {
+        const HlodNode& node = tree.nodes[stack.back()];
+        stack.pop_back();
+
+        const float distance = Motorino::distance(camera, { node.center[0], node.center[1], node.center[2] }) - node.radius;
+
+        // Distance to the closest point of the cluster, so the projected
+        // error is an upper bound over the whole cluster.
+        if (distance > 0.0f && node.error * pixels_per_radian <= max_error * distance) {
+            proxies.push_back(node.proxy);
+            continue;
+        }
+
+        if (node.child_count == 0) {
+            objects.insert(
+                objects.end(),
+                tree.objects.begin() + node.first_object,
+                tree.objects.begin() + node.first_object + node.object_count
+            );
+            continue;
+        }
+
+        for (std::uint32_t c = 0; c < node.child_count; ++c) {
+            stack.push_back(node.first_child + c);
+        }
+    }
+}
@@ -0,0 +1,611 @@
+#include "nkgt/hash.hpp"
+#include "nkgt/ibl.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <fmt/format.h>
+
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+static constexpr std::uint32_t ibl_spv[] = {
+#include "ibl.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType ibl_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+// Bumped whenever the shader or the layout changes, so stale cache entries
+// are never loaded.
+constexpr std::uint64_t ibl_cache_version = 2;
+
+constexpr std::uint32_t ibl_group_size = 8;
+
+// Environment texels a group of the irradiance pass projects, the same as
+// texels_per_group in shaders/ibl.comp.
+constexpr std::uint32_t ibl_texels_per_group = 4096;
+
+namespace {
+
+enum class IblPass : std::uint32_t {
+    Irradiance = 0,
+    Brdf = 1,
+    Specular = 2,
+    IrradianceReduce = 3,
+};
+
+struct IblConstants {
+    IblPass pass;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t samples;
+    std::uint32_t size;
+    std::uint32_t offset;
+    float roughness;
+};
+
+}
+
+static auto groups(std::uint32_t size) -> std::uint32_t {
+    return (size + ibl_group_size - 1) / ibl_group_size;
+}
+
+auto Motorino::ibl_layout(
+    std::uint32_t cube_size,
+    std::uint32_t mip_count,
+    std::uint32_t lut_size
+) -> IblLayout {
+    IblLayout layout{
+        .irradiance = 0,
+        .brdf = sh_coefficient_count * 4 * sizeof(float),
+        .cube_size = cube_size,
+        .mip_count = mip_count,
+        .lut_size = lut_size,
+    };
+
+    layout.specular = layout.brdf + static_cast<std::uint64_t>(lut_size) * lut_size * sizeof(std::uint32_t);
+    layout.size = layout.specular;
+
+    for (std::uint32_t mip = 0; mip < mip_count; ++mip) {
+        const std::uint64_t face = cube_size >> mip;
+        layout.size += 6 * face * face * 2 * sizeof(std::uint32_t);
+    }
+
+    return layout;
+}
+
+auto Motorino::Engine::load_ibl(const IblSettings& settings) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    const std::uint64_t texel_count = static_cast<std::uint64_t>(settings.width) * settings.height;
+
+    if (texel_count == 0 || settings.environment.size() != texel_count * 4) {
+        Logger::error("IBL environment must hold RGBA floats for every texel.\n");
+        return failed;
+    }
+
+    if (!std::has_single_bit(settings.cube_size) || settings.mip_count == 0 ||
+        settings.mip_count > static_cast<std::uint32_t>(std::bit_width(settings.cube_size)) ||
+        settings.lut_size == 0 || settings.specular_samples == 0 || settings.lut_samples == 0) {
+        Logger::error("Invalid IBL cube size, mip count or sample counts.\n");
+        return failed;
+    }
+
+    const IblLayout layout = ibl_layout(settings.cube_size, settings.mip_count, settings.lut_size);
+
+    std::uint64_t key = Hash::integer(ibl_cache_version);
+    key = Hash::integer(settings.width, key);
+    key = Hash::integer(settings.height, key);
+    key = Hash::integer(settings.cube_size, key);
+    key = Hash::integer(settings.mip_count, key);
+    key = Hash::integer(settings.specular_samples, key);
+    key = Hash::integer(settings.lut_size, key);
+    key = Hash::integer(settings.lut_samples, key);
+    key = Hash::bytes(
+        { reinterpret_cast<const unsigned char*>(settings.environment.data()), settings.environment.size_bytes() },
+        key
+    );
+
+    const std::filesystem::path cache_directory = settings.cache_directory;
+    const auto cache_path = cache_directory / fmt::format("{:016x}.ibl", key);
+
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+
+    bool result = create_buffer(
+        layout.size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        buffer,
+        memory
+    );
+
+    if (!result) return failed;
+
+    const auto destroy_buffer = [=, this] {
+        vkDestroyBuffer(_device, buffer, nullptr);
+        vkFreeMemory(_device, memory, nullptr);
+    };
+
+    std::error_code error;
+
+    // A hit is a plain upload, the convolutions only run on the first start.
+    if (std::filesystem::file_size(cache_path, error) == layout.size && !error) {
+        std::ifstream file(cache_path, std::ios::binary);
+
+        const std::uint64_t transfer_value = !file ? 0 : submit_chunked_transfer(
+            buffer,
+            layout.size,
+            [&file](unsigned char* data, std::uint64_t, std::uint64_t size) {
+                return static_cast<bool>(file.read(reinterpret_cast<char*>(data), size));
+            }
+        );
+
+        if (transfer_value != 0) {
+            Logger::info("Loaded IBL from cache ({:016x}).\n", key);
+
+            _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+                replace_ibl(buffer, memory, layout);
+            });
+
+            return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+        }
+
+        Logger::warn("Failed to read IBL cache entry {}, baking again.\n", cache_path.string());
+    }
+
+    {
+        // Loads may run on several threads, the first bake creates the
+        // pipeline for all of them.
+        std::scoped_lock lock(_ibl_mutex);
+
+        if (_ibl_pipeline.pipeline == VK_NULL_HANDLE) {
+            result = create_compute_pipeline(
+                _device,
+                ibl_spv,
+                ibl_bindings,
+                sizeof(IblConstants),
+                _ibl_pipeline
+            );
+        }
+    }
+
+    if (!result) {
+        destroy_buffer();
+        return failed;
+    }
+
+    const std::uint64_t environment_size = texel_count * 4 * sizeof(float);
+
+    // The irradiance pass adds up its partial sums past the texels.
+    const auto irradiance_groups = static_cast<std::uint32_t>(
+        (texel_count + ibl_texels_per_group - 1) / ibl_texels_per_group
+    );
+    const std::uint64_t partial_size = static_cast<std::uint64_t>(irradiance_groups) * sh_coefficient_count * 4 * sizeof(float);
+
+    VkBuffer environment;
+    VkDeviceMemory environment_memory;
+    VkBuffer readback;
+    VkDeviceMemory readback_memory;
+
+    result = create_buffer(
+        environment_size + partial_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        environment,
+        environment_memory
+    );
+
+    if (!result) {
+        destroy_buffer();
+        return failed;
+    }
+
+    result = create_buffer(
+        layout.size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        readback,
+        readback_memory
+    );
+
+    const auto destroy_buffers = [=, this] {
+        vkDestroyBuffer(_device, environment, nullptr);
+        vkFreeMemory(_device, environment_memory, nullptr);
+        vkDestroyBuffer(_device, readback, nullptr);
+        vkFreeMemory(_device, readback_memory, nullptr);
+    };
+
+    if (!result) {
+        vkDestroyBuffer(_device, environment, nullptr);
+        vkFreeMemory(_device, environment_memory, nullptr);
+        destroy_buffer();
+        return failed;
+    }
+
+    const auto* environment_bytes = reinterpret_cast<const unsigned char*>(settings.environment.data());
+
+    const std::uint64_t transfer_value = submit_chunked_transfer(
+        environment,
+        environment_size,
+        [environment_bytes](unsigned char* data, std::uint64_t offset, std::uint64_t size) {
+            std::memcpy(data, environment_bytes + offset, size);
+            return true;
+        }
+    );
+
+    if (transfer_value == 0) {
+        destroy_buffers();
+        destroy_buffer();
+        return failed;
+    }
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_ibl_pipeline.set_layout,
+    };
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _compute_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    // The environment copy may still be running, so failures hand every
+    // buffer to the waiter instead of destroying them here.
+    const auto destroy_after_copy = [=, this] {
+        _waiter.add(_transfer_timeline, transfer_value, [=] {
+            destroy_buffers();
+            destroy_buffer();
+        });
+    };
+
+    VkDescriptorSet descriptor_set;
+    VkCommandBuffer cmd_buffer;
+    std::uint64_t compute_value;
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+
+        if (vkAllocateDescriptorSets(_device, &set_info, &descriptor_set) != VK_SUCCESS) {
+            Logger::error("Failed to allocate IBL descriptor set.\n");
+            destroy_after_copy();
+            return failed;
+        }
+
+        vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { environment, 0, environment_size + partial_size },
+            { buffer, 0, layout.size },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 0,
+            .descriptorCount = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+        VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkBeginCommandBuffer(cmd_buffer, &begin_info);
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _ibl_pipeline.pipeline);
+
+        vkCmdBindDescriptorSets(
+            cmd_buffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            _ibl_pipeline.layout,
+            0,
+            1,
+            &descriptor_set,
+            0,
+            nullptr
+        );
+
+        const auto dispatch = [&](const IblConstants& constants, std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+            vkCmdPushConstants(
+                cmd_buffer,
+                _ibl_pipeline.layout,
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                0,
+                sizeof(constants),
+                &constants
+            );
+
+            vkCmdDispatch(cmd_buffer, x, y, z);
+        };
+
+        const IblConstants base{
+            .width = settings.width,
+            .height = settings.height,
+        };
+
+        // The passes write disjoint ranges and only read the environment
+        // texels, so they run back to back without barriers until the
+        // partial irradiance sums are added up.
+        IblConstants constants = base;
+        constants.pass = IblPass::Irradiance;
+        dispatch(constants, irradiance_groups, 1, 1);
+
+        constants = base;
+        constants.pass = IblPass::Brdf;
+        constants.samples = settings.lut_samples;
+        constants.size = settings.lut_size;
+        constants.offset = static_cast<std::uint32_t>(layout.brdf / sizeof(std::uint32_t));
+        dispatch(constants, groups(settings.lut_size), groups(settings.lut_size), 1);
+
+        std::uint64_t offset = layout.specular;
+
+        for (std::uint32_t mip = 0; mip < settings.mip_count; ++mip) {
+            const std::uint32_t size = settings.cube_size >> mip;
+
+            constants = base;
+            constants.pass = IblPass::Specular;
+            constants.samples = settings.specular_samples;
+            constants.size = size;
+            constants.offset = static_cast<std::uint32_t>(offset / sizeof(std::uint32_t));
+            constants.roughness = settings.mip_count > 1 ? static_cast<float>(mip) / (settings.mip_count - 1) : 0.0f;
+            dispatch(constants, groups(size), groups(size), 6);
+
+            offset += 6ull * size * size * 2 * sizeof(std::uint32_t);
+        }
+
+        VkBufferMemoryBarrier partial_sums{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = environment,
+            .offset = environment_size,
+            .size = partial_size,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            0, nullptr,
+            1, &partial_sums,
+            0, nullptr
+        );
+
+        constants = base;
+        constants.pass = IblPass::IrradianceReduce;
+        constants.size = irradiance_groups;
+        constants.offset = static_cast<std::uint32_t>(layout.irradiance / sizeof(std::uint32_t));
+        dispatch(constants, 1, 1, 1);
+
+        VkBufferMemoryBarrier written{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            1, &written,
+            0, nullptr
+        );
+
+        VkBufferCopy region{
+            .size = layout.size,
+        };
+
+        vkCmdCopyBuffer(cmd_buffer, buffer, readback, 1, &region);
+
+        VkBufferMemoryBarrier to_host{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = readback,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            0, nullptr,
+            1, &to_host,
+            0, nullptr
+        );
+
+        vkEndCommandBuffer(cmd_buffer);
+
+        compute_value = ++_compute_value;
+
+        constexpr VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &transfer_value,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &compute_value,
+        };
+
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &_transfer_timeline,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &_compute_timeline,
+        };
+
+        std::scoped_lock queue_lock(_graphics_queue_mutex);
+
+        if (vkQueueSubmit(_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit IBL precomputation.\n");
+            vkFreeCommandBuffers(_device, _compute_command_pool, 1, &cmd_buffer);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &descriptor_set);
+            destroy_after_copy();
+            return failed;
+        }
+    }
+
+    Logger::info("Baking IBL ({:016x}).\n", key);
+
+    _waiter.add(_compute_timeline, compute_value, [=, this] {
+        {
+            std::scoped_lock lock(_compute_mutex);
+            vkFreeCommandBuffers(_device, _compute_command_pool, 1, &cmd_buffer);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &descriptor_set);
+        }
+
+        vkDestroyBuffer(_device, environment, nullptr);
+        vkFreeMemory(_device, environment_memory, nullptr);
+
+        replace_ibl(buffer, memory, layout);
+
+        // Writing the file would hold up every other timeline callback, so
+        // it goes to a worker. The engine drains the workers before the
+        // device goes away, so the readback never outlives it.
+        _jobs.submit([=, this] {
+            void* data;
+
+            if (vkMapMemory(_device, readback_memory, 0, VK_WHOLE_SIZE, 0, &data) == VK_SUCCESS) {
+                std::error_code error;
+                std::filesystem::create_directories(cache_directory, error);
+
+                // Written under a unique name and renamed, like the shader
+                // cache, so a crash never leaves a partial entry behind.
+                const auto thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+                const auto temp_path = cache_directory / fmt::format("{:016x}.{:x}.tmp", key, thread_id);
+
+                bool written;
+
+                {
+                    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+                    file.write(static_cast<const char*>(data), layout.size);
+                    file.close();
+                    written = !file.fail();
+                }
+
+                if (written) std::filesystem::rename(temp_path, cache_path, error);
+
+                if (!written || error) {
+                    Logger::warn("Failed to store IBL in the cache.\n");
+                    std::filesystem::remove(temp_path, error);
+                }
+
+                vkUnmapMemory(_device, readback_memory);
+            }
+
+            vkDestroyBuffer(_device, readback, nullptr);
+            vkFreeMemory(_device, readback_memory, nullptr);
+        });
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _compute_timeline, compute_value);
+}
+
+auto Motorino::Engine::ibl() -> IblMaps {
+    std::scoped_lock lock(_draw_mutex);
+    return { _ibl_buffer, _ibl_layout };
+}
+
+auto Motorino::Engine::replace_ibl(
+    VkBuffer buffer,
+    VkDeviceMemory memory,
+    const IblLayout& layout
+) -> void {
+    std::scoped_lock lock(_draw_mutex);
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_ibl_set_layout,
+    };
+
+    VkDescriptorSet set;
+    bool allocated;
+
+    {
+        std::scoped_lock sets_lock(_compute_mutex);
+        allocated = vkAllocateDescriptorSets(_device, &set_info, &set) == VK_SUCCESS;
+    }
+
+    if (!allocated) {
+        Logger::error("Failed to allocate IBL descriptor set, maps dropped.\n");
+        _retired_buffers.push_back({ buffer, memory, 0 });
+        return;
+    }
+
+    const VkDescriptorBufferInfo buffer_info{
+        .buffer = buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+    if (_ibl_buffer != VK_NULL_HANDLE) {
+        // Maps replaced before any frame bound them go right away.
+        const std::uint64_t frame_value = _ibl_set_used ? _frame_value.load() : 0;
+        _retired_buffers.push_back({ _ibl_buffer, _ibl_memory, frame_value });
+
+        if (_ibl_set_used) {
+            _waiter.add(_frame_timeline, frame_value, [this, old_set = _ibl_set] {
+                std::scoped_lock sets_lock(_compute_mutex);
+                vkFreeDescriptorSets(_device, _descriptor_pool, 1, &old_set);
+            });
+        }
+        else {
+            std::scoped_lock sets_lock(_compute_mutex);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &_ibl_set);
+        }
+    }
+
+    _ibl_set = set;
+    _ibl_set_used = false;
+    _ibl_buffer = buffer;
+    _ibl_memory = memory;
+    _ibl_layout = layout;
+}
@@ -0,0 +1,627 @@
+#include "nkgt/impostor.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/triangle_mesh.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+static constexpr std::uint32_t impostor_vert_spv[] = {
+#include "impostor.vert.spv.h"
+};
+
+static constexpr std::uint32_t impostor_frag_spv[] = {
+#include "impostor.frag.spv.h"
+};
+
+static constexpr Motorino::DescriptorType impostor_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t vertices_per_impostor = 6;
+
+namespace {
+
+using Motorino::Vec3;
+
+auto unorm8(float value) -> std::uint8_t {
+    return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Twice the signed area of a, b, p in screen space.
+auto edge(
+    const Vec3& a,
+    const Vec3& b,
+    float x,
+    float y
+) -> float {
+    return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+}
+
+struct ImpostorHeader {
+    std::uint32_t grid;
+    std::uint32_t cell_size;
+    float center[3];
+    float radius;
+};
+
+// Mirrors the push constants of shaders/impostor.vert.
+struct ImpostorConstants {
+    float view_projection[16];
+    float camera[3];
+    std::uint32_t grid;
+    float light[3];
+    std::uint32_t cell_size;
+};
+
+static_assert(sizeof(ImpostorConstants) == 96);
+
+}
+
+auto Motorino::hemi_octahedral_direction(
+    float u,
+    float v
+) -> std::array<float, 3> {
+    const float x = (u + v) * 0.5f;
+    const float z = (u - v) * 0.5f;
+    return normalize({ x, 1.0f - std::abs(x) - std::abs(z), z });
+}
+
+auto Motorino::hemi_octahedral_point(const std::array<float, 3>& direction) -> std::array<float, 2> {
+    const float y = std::max(direction[1], 0.0f);
+    const float sum = std::abs(direction[0]) + y + std::abs(direction[2]);
+    if (sum == 0.0f) return { 0.0f, 0.0f };
+
+    const float x = direction[0] / sum;
+    const float z = direction[2] / sum;
+    return { x + z, x - z };
+}
+
+auto Motorino::bake_impostor(
+    const Geometry& geometry,
+    const ImpostorSettings& settings,
+    JobSystem& jobs
+) -> std::optional<ImpostorAtlas> {
+    if (settings.grid == 0 || settings.grid > max_impostor_grid || settings.cell_size == 0) {
+        Logger::error("Impostor grid must be 1 to {} views per side.\n", max_impostor_grid);
+        return std::nullopt;
+    }
+
+    TriangleMesh mesh;
+    if (!read_triangle_mesh(geometry, settings.position_offset, settings.color_offset, "Impostor mesh", mesh)) return std::nullopt;
+
+    const std::vector<Vec3>& positions = mesh.positions;
+    const std::vector<Vec3>& colors = mesh.colors;
+    const std::vector<std::uint16_t>& indices = mesh.indices;
+
+    Vec3 lower;
+    Vec3 upper;
+    bounds(positions, lower, upper);
+
+    const Vec3 center{ (lower[0] + upper[0]) * 0.5f, (lower[1] + upper[1]) * 0.5f, (lower[2] + upper[2]) * 0.5f };
+    float radius = 0.0f;
+
+    for (const Vec3& position : positions) {
+        radius = std::max(radius, distance(position, center));
+    }
+
+    if (radius == 0.0f) {
+        Logger::error("Impostor mesh has no extent.\n");
+        return std::nullopt;
+    }
+
+    const std::uint64_t side = static_cast<std::uint64_t>(settings.grid) * settings.cell_size;
+    const std::uint64_t texels = side * side;
+
+    ImpostorAtlas atlas{
+        .grid = settings.grid,
+        .cell_size = settings.cell_size,
+        .center = { center[0], center[1], center[2] },
+        .radius = radius,
+        .albedo = std::vector<std::uint8_t>(texels * 4),
+        .normal = std::vector<std::uint8_t>(texels * 4),
+    };
+
+    const std::uint32_t cell_size = settings.cell_size;
+    const float scale = 0.5f * static_cast<float>(cell_size) / radius;
+
+    // Cells cover disjoint texels, so views render in parallel without locks.
+    jobs.parallel_for(settings.grid * settings.grid, 1, [&](std::uint32_t begin, std::uint32_t end) {
+        std::vector<Vec3> projected(positions.size());
+        std::vector<float> depth(static_cast<std::size_t>(cell_size) * cell_size);
+
+        for (std::uint32_t cell = begin; cell < end; ++cell) {
+            const std::uint32_t cell_x = cell % settings.grid;
+            const std::uint32_t cell_y = cell / settings.grid;
+
+            const Vec3 view = hemi_octahedral_direction(
+                (cell_x + 0.5f) / settings.grid * 2.0f - 1.0f,
+                (cell_y + 0.5f) / settings.grid * 2.0f - 1.0f
+            );
+            const Vec3 up_axis = view[1] > 0.999f ? Vec3{ 0.0f, 0.0f, -1.0f } : Vec3{ 0.0f, 1.0f, 0.0f };
+            const Vec3 right = normalize(cross(up_axis, view));
+            const Vec3 up = cross(view, right);
+
+            // Screen x and y in pixels of the cell, z towards the viewer in radii.
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                const Vec3 offset = positions[i] - center;
+                projected[i] = {
+                    static_cast<float>(cell_size) * 0.5f + dot(offset, right) * scale,
+                    static_cast<float>(cell_size) * 0.5f - dot(offset, up) * scale,
+                    dot(offset, view) / radius,
+                };
+            }
+
+            std::fill(depth.begin(), depth.end(), -std::numeric_limits<float>::infinity());
+
+            const std::uint64_t origin = static_cast<std::uint64_t>(cell_y) * cell_size * atlas.size() +
+                                         static_cast<std::uint64_t>(cell_x) * cell_size;
+
+            for (std::size_t t = 0; t < indices.size(); t += 3) {
+                const std::uint16_t i0 = indices[t];
+                const std::uint16_t i1 = indices[t + 1];
+                const std::uint16_t i2 = indices[t + 2];
+                const Vec3& a = projected[i0];
+                const Vec3& b = projected[i1];
+                const Vec3& c = projected[i2];
+
+                const float area = edge(a, b, c[0], c[1]);
+                if (std::abs(area) < 1e-6f) continue;
+
+                // Flat shaded and two sided, the normal always faces the view.
+                Vec3 normal = normalize(cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+                if (dot(normal, view) < 0.0f) normal = { -normal[0], -normal[1], -normal[2] };
+
+                const std::uint8_t encoded_normal[4] = {
+                    unorm8(normal[0] * 0.5f + 0.5f),
+                    unorm8(normal[1] * 0.5f + 0.5f),
+                    unorm8(normal[2] * 0.5f + 0.5f),
+                    255,
+                };
+
+                const auto first = [cell_size](float value) {
+                    return static_cast<std::uint32_t>(std::clamp(std::floor(value), 0.0f, static_cast<float>(cell_size - 1)));
+                };
+
+                const std::uint32_t x_begin = first(std::min({ a[0], b[0], c[0] }));
+                const std::uint32_t x_end = first(std::max({ a[0], b[0], c[0] }));
+                const std::uint32_t y_begin = first(std::min({ a[1], b[1], c[1] }));
+                const std::uint32_t y_end = first(std::max({ a[1], b[1], c[1] }));
+
+                for (std::uint32_t y = y_begin; y <= y_end; ++y) {
+                    for (std::uint32_t x = x_begin; x <= x_end; ++x) {
+                        const float sample_x = x + 0.5f;
+                        const float sample_y = y + 0.5f;
+
+                        const float w0 = edge(b, c, sample_x, sample_y) / area;
+                        const float w1 = edge(c, a, sample_x, sample_y) / area;
+                        const float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+                        const float z = w0 * a[2] + w1 * b[2] + w2 * c[2];
+                        float& nearest = depth[y * cell_size + x];
+                        if (z <= nearest) continue;
+                        nearest = z;
+
+                        const std::uint64_t texel = origin + static_cast<std::uint64_t>(y) * atlas.size() + x;
+
+                        for (int channel = 0; channel < 3; ++channel) {
+                            const float color = w0 * colors[i0][channel] + w1 * colors[i1][channel] + w2 * colors[i2][channel];
+                            atlas.albedo[texel * 4 + channel] = unorm8(color);
+                        }
+
+                        atlas.albedo[texel * 4 + 3] = 255;
+                        std::memcpy(&atlas.normal[texel * 4], encoded_normal, sizeof(encoded_normal));
+                    }
+                }
+            }
+        }
+    });
+
+    return atlas;
+}
+
+auto Motorino::impostor_frames(
+    std::uint32_t grid,
+    const std::array<float, 3>& direction
+) -> ImpostorFrames {
+    if (grid < 2) return { { 0, 0, 0 }, { 1.0f, 0.0f, 0.0f } };
+
+    const auto point = hemi_octahedral_point(normalize(direction));
+    const float last = static_cast<float>(grid - 1);
+
+    // Position among the cell centers, which sit at whole numbers.
+    const float fx = std::clamp((point[0] * 0.5f + 0.5f) * grid - 0.5f, 0.0f, last);
+    const float fy = std::clamp((point[1] * 0.5f + 0.5f) * grid - 0.5f, 0.0f, last);
+    const std::uint32_t x = std::min(static_cast<std::uint32_t>(fx), grid - 2);
+    const std::uint32_t y = std::min(static_cast<std::uint32_t>(fy), grid - 2);
+    const float dx = fx - x;
+    const float dy = fy - y;
+
+    const std::uint32_t corner = y * grid + x;
+
+    // Splits the square between four cell centers along its diagonal and
+    // blends the corners of the triangle holding the direction.
+    if (dx > dy) {
+        return { { corner, corner + 1, corner + grid + 1 }, { 1.0f - dx, dx - dy, dy } };
+    }
+
+    return { { corner, corner + grid, corner + grid + 1 }, { 1.0f - dy, dy - dx, dx } };
+}
+
+auto Motorino::select_impostors(
+    const ImpostorAtlas& atlas,
+    std::span<const std::array<float, 3>> positions,
+    const std::array<float, 3>& camera,
+    float switch_distance,
+    std::vector<std::uint32_t>& meshes,
+    std::vector<ImpostorInstance>& impostors
+) -> void {
+    const Vec3 center{ atlas.center[0], atlas.center[1], atlas.center[2] };
+    const float switch_squared = switch_distance * switch_distance;
+    const std::size_t first = impostors.size();
+
+    for (std::uint32_t i = 0; i < positions.size(); ++i) {
+        const Vec3 sphere{
+            positions[i][0] + center[0],
+            positions[i][1] + center[1],
+            positions[i][2] + center[2],
+        };
+        const Vec3 to_camera = camera - sphere;
+
+        if (dot(to_camera, to_camera) < switch_squared) {
+            meshes.push_back(i);
+            continue;
+        }
+
+        const ImpostorFrames frames = impostor_frames(atlas.grid, to_camera);
+
+        impostors.push_back({
+            .position = { sphere[0], sphere[1], sphere[2] },
+            .radius = atlas.radius,
+            .weights = { frames.weights[0], frames.weights[1], frames.weights[2] },
+            .cells = frames.cells[0] | frames.cells[1] << 10 | frames.cells[2] << 20,
+        });
+    }
+
+    const auto distance_squared = [&camera](const ImpostorInstance& instance) {
+        const Vec3 to_camera = camera - Vec3{ instance.position[0], instance.position[1], instance.position[2] };
+        return dot(to_camera, to_camera);
+    };
+
+    // Impostors are drawn without depth test, the nearest one last.
+    std::sort(impostors.begin() + first, impostors.end(), [&](const ImpostorInstance& a, const ImpostorInstance& b) {
+        return distance_squared(a) > distance_squared(b);
+    });
+}
+
+auto Motorino::ImpostorAtlas::serialize(std::vector<unsigned char>& out) const -> void {
+    const ImpostorHeader header{
+        .grid = grid,
+        .cell_size = cell_size,
+        .center = { center[0], center[1], center[2] },
+        .radius = radius,
+    };
+
+    const auto append = [&out](const void* data, std::uint64_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+
+    append(&header, sizeof(header));
+    append(albedo.data(), albedo.size());
+    append(normal.data(), normal.size());
+}
+
+auto Motorino::ImpostorAtlas::deserialize(std::span<const unsigned char> data) -> bool {
+    ImpostorHeader header;
+
+    if (data.size() < sizeof(header)) {
+        Logger::error("Corrupt serialized impostor.\n");
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    const std::uint64_t side = static_cast<std::uint64_t>(header.grid) * header.cell_size;
+    const std::uint64_t texels = side * side;
+
+    if (header.grid == 0 || header.grid > max_impostor_grid || sizeof(header) + texels * 8 != data.size()) {
+        Logger::error("Corrupt serialized impostor.\n");
+        return false;
+    }
+
+    grid = header.grid;
+    cell_size = header.cell_size;
+    std::memcpy(center, header.center, sizeof(center));
+    radius = header.radius;
+
+    const unsigned char* source = data.data() + sizeof(header);
+    albedo.assign(source, source + texels * 4);
+    normal.assign(source + texels * 4, source + texels * 8);
+
+    return true;
+}
+
+auto Motorino::Engine::create_impostors(
+    const ImpostorAtlas& atlas,
+    std::uint32_t max_instances
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (_impostor_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Impostors already created.\n");
+        return failed;
+    }
+
+    const std::uint64_t texels = static_cast<std::uint64_t>(atlas.size()) * atlas.size();
+
+    if (atlas.grid == 0 || atlas.grid > max_impostor_grid || texels == 0 ||
+        atlas.albedo.size() != texels * 4 || atlas.normal.size() != texels * 4) {
+        Logger::error("Invalid impostor atlas.\n");
+        return failed;
+    }
+
+    if (max_instances == 0) {
+        Logger::error("Impostors need room for at least one instance.\n");
+        return failed;
+    }
+
+    const DrawPipelineInfo pipeline_info{
+        .vertex_code = impostor_vert_spv,
+        .fragment_code = impostor_frag_spv,
+        .bindings = impostor_bindings,
+        .push_constant_size = sizeof(ImpostorConstants),
+        .blend = DrawBlend::Opaque,
+    };
+
+    const std::uint64_t atlas_size = texels * 8;
+    const std::uint64_t instance_size = static_cast<std::uint64_t>(max_instances) * sizeof(ImpostorInstance);
+
+    bool result = create_draw_pipeline(
+        _device,
+        _render_pass,
+        pipeline_info,
+        _impostor_pipeline
+    ) && create_buffer(
+        atlas_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _impostor_atlas,
+        _impostor_atlas_memory
+    );
+
+    for (std::uint32_t i = 0; result && i < max_frames_in_flight; ++i) {
+        result = create_buffer(
+            instance_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _impostor_instances[i],
+            _impostor_instances_memory[i]
+        );
+
+        void* data = nullptr;
+
+        if (result && vkMapMemory(_device, _impostor_instances_memory[i], 0, instance_size, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map impostor instance buffer.\n");
+            result = false;
+        }
+
+        if (result) _impostor_instance_data[i] = static_cast<ImpostorInstance*>(data);
+    }
+
+    if (!result) {
+        destroy_impostors();
+        return failed;
+    }
+
+    VkDescriptorSetLayout set_layouts[max_frames_in_flight];
+    std::fill(std::begin(set_layouts), std::end(set_layouts), _impostor_pipeline.set_layout);
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = max_frames_in_flight,
+        .pSetLayouts = set_layouts,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, _impostor_sets) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate impostor descriptor sets.\n");
+        std::fill(std::begin(_impostor_sets), std::end(_impostor_sets), VK_NULL_HANDLE);
+        destroy_impostors();
+        return failed;
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { .buffer = _impostor_instances[i], .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _impostor_atlas, .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _impostor_sets[i],
+            .dstBinding = 0,
+            .descriptorCount = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+
+    const auto staging = acquire_staging(atlas_size);
+
+    if (!staging) {
+        destroy_impostors();
+        return failed;
+    }
+
+    std::memcpy(staging->data, atlas.albedo.data(), atlas.albedo.size());
+    std::memcpy(staging->data + atlas.albedo.size(), atlas.normal.data(), atlas.normal.size());
+
+    const std::uint64_t transfer_value = submit_transfer(*staging, _impostor_atlas, atlas_size);
+
+    if (transfer_value == 0) {
+        destroy_impostors();
+        return failed;
+    }
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _impostor_grid = atlas.grid;
+        _impostor_cell_size = atlas.cell_size;
+        _impostor_capacity = max_instances;
+        _impostor_list.clear();
+        _impostor_upload = transfer_value;
+    }
+
+    // Frames only draw the impostors once the atlas is on the GPU.
+    _waiter.add(_transfer_timeline, transfer_value, [this, transfer_value] {
+        std::scoped_lock lock(_draw_mutex);
+        if (_impostor_upload == transfer_value) _impostor_ready = true;
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+}
+
+auto Motorino::Engine::set_impostors(std::span<const ImpostorInstance> instances) -> void {
+    std::scoped_lock lock(_draw_mutex);
+
+    if (instances.size() > _impostor_capacity) {
+        Logger::warn("Drawing {} of {} impostors.\n", _impostor_capacity, instances.size());
+        instances = instances.first(_impostor_capacity);
+    }
+
+    _impostor_list.assign(instances.begin(), instances.end());
+}
+
+auto Motorino::Engine::set_impostor_camera(const ImpostorCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _impostor_camera = camera;
+}
+
+auto Motorino::Engine::destroy_impostors() -> void {
+    std::uint64_t last_frame;
+    std::uint64_t upload;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _impostor_ready = false;
+        _impostor_list.clear();
+        _impostor_capacity = 0;
+        last_frame = _frame_value.load();
+        upload = std::exchange(_impostor_upload, 0);
+    }
+
+    // The upload still writes the atlas.
+    if (upload > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, upload).wait();
+    }
+
+    if (last_frame > 0 && _impostor_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_impostor_sets[0] != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, max_frames_in_flight, _impostor_sets);
+        std::fill(std::begin(_impostor_sets), std::end(_impostor_sets), VK_NULL_HANDLE);
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        vkDestroyBuffer(_device, _impostor_instances[i], nullptr);
+        vkFreeMemory(_device, _impostor_instances_memory[i], nullptr);
+
+        _impostor_instances[i] = VK_NULL_HANDLE;
+        _impostor_instances_memory[i] = VK_NULL_HANDLE;
+        _impostor_instance_data[i] = nullptr;
+    }
+
+    vkDestroyBuffer(_device, _impostor_atlas, nullptr);
+    vkFreeMemory(_device, _impostor_atlas_memory, nullptr);
+
+    _impostor_atlas = VK_NULL_HANDLE;
+    _impostor_atlas_memory = VK_NULL_HANDLE;
+
+    destroy_draw_pipeline(_device, _impostor_pipeline);
+}
+
+auto Motorino::Engine::draw_impostors(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t current_frame
+) -> void {
+    if (!_impostor_ready || _impostor_list.empty()) return;
+
+    // The frame last recorded with current_frame completed, nothing reads
+    // its instances anymore.
+    std::memcpy(
+        _impostor_instance_data[current_frame],
+        _impostor_list.data(),
+        _impostor_list.size() * sizeof(ImpostorInstance)
+    );
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _impostor_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _impostor_pipeline.layout,
+        0,
+        1,
+        &_impostor_sets[current_frame],
+        0,
+        nullptr
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    ImpostorConstants constants{
+        .view_projection = {},
+        .camera = {},
+        .grid = _impostor_grid,
+        .light = {},
+        .cell_size = _impostor_cell_size,
+    };
+
+    std::memcpy(constants.view_projection, _impostor_camera.view_projection, sizeof(constants.view_projection));
+    std::memcpy(constants.camera, _impostor_camera.position, sizeof(constants.camera));
+    std::memcpy(constants.light, _impostor_camera.light, sizeof(constants.light));
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _impostor_pipeline.layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    vkCmdDraw(cmd_buffer, vertices_per_impostor, static_cast<std::uint32_t>(_impostor_list.size()), 0, 0);
+}
@@ -0,0 +1,163 @@
+#include "nkgt/jobs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// Fire and forget coroutine owning the task it awaits. Destroys itself on
+// completion, so spawned tasks need no handle kept around.
+struct Detached {
+    struct promise_type {
+        auto get_return_object() noexcept -> Detached { return {}; }
+        auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+        auto final_suspend() noexcept -> std::suspend_never { return {}; }
+        auto return_void() noexcept -> void {}
+        auto unhandled_exception() noexcept -> void { std::terminate(); }
+    };
+};
+
+auto run_detached(
+    Motorino::JobSystem& jobs,
+    Motorino::Task<void> task
+) -> Detached {
+    co_await jobs.schedule();
+    co_await task;
+}
+
+}
+
+Motorino::JobSystem::JobSystem(std::uint32_t thread_count)
+    : _running{ 0 },
+      _stop{ false }
+{
+    if (thread_count == 0) {
+        const std::uint32_t hardware = std::thread::hardware_concurrency();
+        thread_count = hardware > 1 ? hardware - 1 : 1;
+    }
+
+    _threads.reserve(thread_count);
+
+    for (std::uint32_t i = 0; i < thread_count; ++i) {
+        _threads.emplace_back([this] { worker(); });
+    }
+}
+
+Motorino::JobSystem::~JobSystem() {
+    {
+        std::scoped_lock lock(_mutex);
+        _stop = true;
+    }
+
+    _condition.notify_all();
+
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+auto Motorino::JobSystem::submit(std::function<void()> job) -> void {
+    {
+        std::scoped_lock lock(_mutex);
+        _queue.push_back(std::move(job));
+    }
+
+    _condition.notify_one();
+}
+
+auto Motorino::JobSystem::spawn(Task<void> task) -> void {
+    run_detached(*this, std::move(task));
+}
+
+auto Motorino::JobSystem::parallel_for(
+    std::uint32_t count,
+    std::uint32_t batch_size,
+    const std::function<void(std::uint32_t, std::uint32_t)>& fn
+) -> void {
+    if (count == 0) return;
+
+    batch_size = std::max(batch_size, 1u);
+    const std::uint32_t batch_count = (count + batch_size - 1) / batch_size;
+
+    if (batch_count == 1) {
+        fn(0, count);
+        return;
+    }
+
+    // Helpers may only get to run after the caller already drained every
+    // batch, so the shared state outlives this call.
+    struct State {
+        std::atomic<std::uint32_t> next{ 0 };
+        std::atomic<std::uint32_t> done{ 0 };
+        std::uint32_t count;
+        std::uint32_t batch_size;
+        std::uint32_t batch_count;
+        const std::function<void(std::uint32_t, std::uint32_t)>* fn;
+    };
+
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->batch_size = batch_size;
+    state->batch_count = batch_count;
+    state->fn = &fn;
+
+    auto drain = [](State& s) {
+        for (;;) {
+            const std::uint32_t batch = s.next.fetch_add(1);
+            if (batch >= s.batch_count) return;
+
+            const std::uint32_t begin = batch * s.batch_size;
+            (*s.fn)(begin, std::min(begin + s.batch_size, s.count));
+
+            if (s.done.fetch_add(1) + 1 == s.batch_count) {
+                s.done.notify_all();
+            }
+        }
+    };
+
+    const std::uint32_t helpers = std::min(batch_count - 1, thread_count());
+
+    for (std::uint32_t i = 0; i < helpers; ++i) {
+        submit([state, drain] { drain(*state); });
+    }
+
+    drain(*state);
+
+    for (std::uint32_t done = state->done.load(); done != batch_count; done = state->done.load()) {
+        state->done.wait(done);
+    }
+}
+
+auto Motorino::JobSystem::wait_idle() -> bool {
+    std::unique_lock lock(_mutex);
+
+    if (_queue.empty() && _running == 0) return false;
+
+    _idle.wait(lock, [this] { return _queue.empty() && _running == 0; });
+    return true;
+}
+
+auto Motorino::JobSystem::worker() -> void {
+    for (;;) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock lock(_mutex);
+            _condition.wait(lock, [this] { return _stop || !_queue.empty(); });
+
+            if (_stop && _queue.empty()) return;
+
+            job = std::move(_queue.front());
+            _queue.pop_front();
+            ++_running;
+        }
+
+        job();
+
+        {
+            std::scoped_lock lock(_mutex);
+            if (--_running == 0 && _queue.empty()) _idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#include "nkgt/mapped_file.hpp"
+#include "nkgt/logger.hpp"
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+Motorino::MappedFile::MappedFile()
+    : _file{ INVALID_HANDLE_VALUE },
+      _mapping{ nullptr },
+      _data{ nullptr },
+      _size{ 0 }
+{}
+
+Motorino::MappedFile::~MappedFile() {
+    close();
+}
+
+auto Motorino::MappedFile::open(const char* path) -> bool {
+    close();
+
+    _file = CreateFile(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        0,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+        0
+    );
+
+    if (_file == INVALID_HANDLE_VALUE) {
+        Logger::error("Failed to open file. Path: {}\n", path);
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(_file, &file_size);
+    _size = static_cast<std::uint64_t>(file_size.QuadPart);
+
+    // Empty files cannot be mapped.
+    if (_size == 0) return true;
+
+    _mapping = CreateFileMapping(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (_mapping == nullptr) {
+        Logger::error("Failed to map file. Path: {}\n", path);
+        close();
+        return false;
+    }
+
+    _data = static_cast<const unsigned char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (_data == nullptr) {
+        Logger::error("Failed to map file view. Path: {}\n", path);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::MappedFile::close() -> void {
+    if (_data != nullptr) UnmapViewOfFile(_data);
+    if (_mapping != nullptr) CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+
+    _file = INVALID_HANDLE_VALUE;
+    _mapping = nullptr;
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,278 @@
+#include "nkgt/material.hpp"
+#include "nkgt/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// Ranges closer than this are copied as one, a few redundant bytes are
+// cheaper than another copy region.
+constexpr std::uint64_t dirty_merge_gap = 256;
+
+static auto aligned_size(std::uint32_t size) -> std::uint32_t {
+    return (size + Motorino::material_alignment - 1) / Motorino::material_alignment * Motorino::material_alignment;
+}
+
+Motorino::MaterialSystem::MaterialSystem(std::uint64_t capacity)
+    : _data(capacity),
+      _end{ 0 }
+{}
+
+auto Motorino::MaterialSystem::allocate(
+    std::uint64_t pipeline,
+    const void* parameters,
+    std::uint32_t size
+) -> Material {
+    const std::uint32_t block_size = aligned_size(size);
+
+    std::scoped_lock lock(_mutex);
+
+    std::uint64_t offset;
+    auto& free = _free[block_size];
+
+    if (!free.empty()) {
+        offset = free.back();
+        free.pop_back();
+    }
+    else {
+        if (_end + block_size > _data.size()) {
+            Logger::error("Material buffer full.\n");
+            return null_material;
+        }
+
+        offset = _end;
+        _end += block_size;
+    }
+
+    const Material material{ static_cast<std::uint32_t>(offset / material_alignment) };
+
+    std::memcpy(_data.data() + offset, parameters, size);
+    _dirty.push_back({ offset, size });
+    _records.emplace(material.index, Record{ pipeline, size });
+    _groups[pipeline].push_back(material);
+
+    return material;
+}
+
+auto Motorino::MaterialSystem::write(
+    Material material,
+    const void* parameters,
+    std::uint32_t size
+) -> bool {
+    std::scoped_lock lock(_mutex);
+
+    const auto it = _records.find(material.index);
+
+    if (it == _records.end() || it->second.size != size) {
+        Logger::error("Material {} updated with the wrong parameter type.\n", material.index);
+        return false;
+    }
+
+    const std::uint64_t offset = static_cast<std::uint64_t>(material.index) * material_alignment;
+
+    std::memcpy(_data.data() + offset, parameters, size);
+    _dirty.push_back({ offset, size });
+
+    return true;
+}
+
+auto Motorino::MaterialSystem::destroy(Material material) -> void {
+    std::scoped_lock lock(_mutex);
+
+    const auto it = _records.find(material.index);
+    if (it == _records.end()) return;
+
+    std::erase(_groups[it->second.pipeline], material);
+    _free[aligned_size(it->second.size)].push_back(material.index * material_alignment);
+    _records.erase(it);
+}
+
+auto Motorino::MaterialSystem::contains(Material material) const -> bool {
+    std::scoped_lock lock(_mutex);
+    return _records.contains(material.index);
+}
+
+auto Motorino::MaterialSystem::materials(std::uint64_t pipeline) const -> std::vector<Material> {
+    std::scoped_lock lock(_mutex);
+
+    const auto it = _groups.find(pipeline);
+    if (it == _groups.end()) return {};
+
+    return it->second;
+}
+
+auto Motorino::MaterialSystem::flush(
+    std::vector<MaterialRange>& ranges,
+    std::vector<unsigned char>& bytes
+) -> bool {
+    ranges.clear();
+    bytes.clear();
+
+    std::scoped_lock lock(_mutex);
+
+    if (_dirty.empty()) return false;
+
+    std::sort(_dirty.begin(), _dirty.end(), [](const MaterialRange& a, const MaterialRange& b) {
+        return a.offset < b.offset;
+    });
+
+    for (const MaterialRange& range : _dirty) {
+        if (!ranges.empty() && range.offset <= ranges.back().offset + ranges.back().size + dirty_merge_gap) {
+            MaterialRange& last = ranges.back();
+            last.size = std::max(last.offset + last.size, range.offset + range.size) - last.offset;
+        }
+        else {
+            ranges.push_back(range);
+        }
+    }
+
+    _dirty.clear();
+
+    for (const MaterialRange& range : ranges) {
+        bytes.insert(bytes.end(), _data.begin() + range.offset, _data.begin() + range.offset + range.size);
+    }
+
+    return true;
+}
+
+namespace {
+
+// Serialized layout: MaterialHeader, record_count SerializedMaterials,
+// free_count SerializedBlocks, then end bytes of parameter data.
+struct MaterialHeader {
+    std::uint64_t end;
+    std::uint32_t record_count;
+    std::uint32_t free_count;
+};
+
+struct SerializedMaterial {
+    std::uint64_t pipeline;
+    std::uint32_t index;
+    std::uint32_t size;
+};
+
+struct SerializedBlock {
+    std::uint32_t size;
+    std::uint32_t offset;
+};
+
+}
+
+auto Motorino::MaterialSystem::serialize(std::vector<unsigned char>& out) const -> void {
+    std::scoped_lock lock(_mutex);
+
+    std::vector<SerializedMaterial> records;
+    records.reserve(_records.size());
+
+    for (const auto& [index, record] : _records) {
+        records.push_back({ record.pipeline, index, record.size });
+    }
+
+    // Keeps groups in offset order after loading.
+    std::sort(records.begin(), records.end(), [](const SerializedMaterial& a, const SerializedMaterial& b) {
+        return a.index < b.index;
+    });
+
+    std::vector<SerializedBlock> blocks;
+
+    for (const auto& [size, offsets] : _free) {
+        for (const auto offset : offsets) {
+            blocks.push_back({ size, offset });
+        }
+    }
+
+    const MaterialHeader header{
+        .end = _end,
+        .record_count = static_cast<std::uint32_t>(records.size()),
+        .free_count = static_cast<std::uint32_t>(blocks.size()),
+    };
+
+    const auto append = [&out](const void* data, std::uint64_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+
+    append(&header, sizeof(header));
+    append(records.data(), records.size() * sizeof(SerializedMaterial));
+    append(blocks.data(), blocks.size() * sizeof(SerializedBlock));
+    append(_data.data(), _end);
+}
+
+auto Motorino::MaterialSystem::deserialize(std::span<const unsigned char> data) -> bool {
+    const auto fail = [] {
+        Logger::error("Corrupt serialized materials.\n");
+        return false;
+    };
+
+    MaterialHeader header;
+
+    if (data.size() < sizeof(header)) return fail();
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    // Every part is checked against what is left before it is read, so no
+    // count of a corrupt header reads or allocates past the data.
+    std::uint64_t remaining = data.size() - sizeof(header);
+
+    if (header.record_count > remaining / sizeof(SerializedMaterial)) return fail();
+
+    const std::uint64_t records_size = header.record_count * sizeof(SerializedMaterial);
+    remaining -= records_size;
+
+    if (header.free_count > remaining / sizeof(SerializedBlock)) return fail();
+
+    const std::uint64_t blocks_size = header.free_count * sizeof(SerializedBlock);
+    remaining -= blocks_size;
+
+    if (header.end > remaining || header.end > _data.size()) return fail();
+
+    std::vector<SerializedMaterial> records(header.record_count);
+    std::vector<SerializedBlock> blocks(header.free_count);
+
+    const unsigned char* source = data.data() + sizeof(header);
+    std::memcpy(records.data(), source, records_size);
+    std::memcpy(blocks.data(), source + records_size, blocks_size);
+
+    // Materials and free blocks must lie in the parameter data.
+    for (const SerializedMaterial& record : records) {
+        if (static_cast<std::uint64_t>(record.index) * material_alignment + record.size > header.end) return fail();
+    }
+
+    for (const SerializedBlock& block : blocks) {
+        if (static_cast<std::uint64_t>(block.offset) + block.size > header.end) return fail();
+    }
+
+    std::scoped_lock lock(_mutex);
+
+    _records.clear();
+    _free.clear();
+    _groups.clear();
+    _dirty.clear();
+
+    for (const SerializedMaterial& record : records) {
+        _records.emplace(record.index, Record{ record.pipeline, record.size });
+        _groups[record.pipeline].push_back({ record.index });
+    }
+
+    for (const SerializedBlock& block : blocks) {
+        _free[block.size].push_back(block.offset);
+    }
+
+    _end = header.end;
+    std::memcpy(_data.data(), source + records_size + blocks_size, _end);
+
+    if (_end > 0) _dirty.push_back({ 0, _end });
+
+    return true;
+}
+
+auto Motorino::MaterialSystem::swap(MaterialSystem& other) -> void {
+    std::scoped_lock lock(_mutex, other._mutex);
+
+    std::swap(_data, other._data);
+    std::swap(_end, other._end);
+    std::swap(_records, other._records);
+    std::swap(_free, other._free);
+    std::swap(_groups, other._groups);
+    std::swap(_dirty, other._dirty);
+}
@@ -0,0 +1,590 @@
+#include "nkgt/hash.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/mesh_processing.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#define MOTORINO_MESH_SSE
+#endif
+
+// Vertices or triangles per job.
+constexpr std::uint32_t mesh_batch_size = 4096;
+
+namespace {
+
+// Three floats and a zero, one SSE register wide where SSE is there. Every
+// kernel works on whole vectors instead of component loops.
+struct Float4 {
+#ifdef MOTORINO_MESH_SSE
+    __m128 value;
+#else
+    float value[4];
+#endif
+
+    static auto load(const unsigned char* data) -> Float4 {
+        float f[4] = {};
+        std::memcpy(f, data, 3 * sizeof(float));
+#ifdef MOTORINO_MESH_SSE
+        return { _mm_loadu_ps(f) };
+#else
+        return { { f[0], f[1], f[2], 0.0f } };
+#endif
+    }
+
+    auto store(unsigned char* data) const -> void {
+        float f[4];
+#ifdef MOTORINO_MESH_SSE
+        _mm_storeu_ps(f, value);
+#else
+        std::memcpy(f, value, sizeof(f));
+#endif
+        std::memcpy(data, f, 3 * sizeof(float));
+    }
+
+    static auto make(
+        float x,
+        float y,
+        float z
+    ) -> Float4 {
+#ifdef MOTORINO_MESH_SSE
+        return { _mm_set_ps(0.0f, z, y, x) };
+#else
+        return { { x, y, z, 0.0f } };
+#endif
+    }
+
+    static auto splat(float s) -> Float4 {
+#ifdef MOTORINO_MESH_SSE
+        return { _mm_set_ps(0.0f, s, s, s) };
+#else
+        return { { s, s, s, 0.0f } };
+#endif
+    }
+
+    auto get(float (&out)[3]) const -> void {
+        float f[4];
+#ifdef MOTORINO_MESH_SSE
+        _mm_storeu_ps(f, value);
+#else
+        std::memcpy(f, value, sizeof(f));
+#endif
+        std::memcpy(out, f, sizeof(out));
+    }
+};
+
+#ifdef MOTORINO_MESH_SSE
+
+auto operator+(Float4 a, Float4 b) -> Float4 { return { _mm_add_ps(a.value, b.value) }; }
+auto operator-(Float4 a, Float4 b) -> Float4 { return { _mm_sub_ps(a.value, b.value) }; }
+auto operator*(Float4 a, float s) -> Float4 { return { _mm_mul_ps(a.value, _mm_set1_ps(s)) }; }
+auto min(Float4 a, Float4 b) -> Float4 { return { _mm_min_ps(a.value, b.value) }; }
+auto max(Float4 a, Float4 b) -> Float4 { return { _mm_max_ps(a.value, b.value) }; }
+
+auto dot(Float4 a, Float4 b) -> float {
+    const __m128 product = _mm_mul_ps(a.value, b.value);
+    const __m128 swapped = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+    const __m128 pairs = _mm_add_ps(product, swapped);
+    const __m128 high = _mm_movehl_ps(pairs, pairs);
+    return _mm_cvtss_f32(_mm_add_ss(pairs, high));
+}
+
+auto cross(Float4 a, Float4 b) -> Float4 {
+    const __m128 a_yzx = _mm_shuffle_ps(a.value, a.value, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_yzx = _mm_shuffle_ps(b.value, b.value, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a.value, b_yzx), _mm_mul_ps(a_yzx, b.value));
+    return { _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)) };
+}
+
+#else
+
+auto operator+(Float4 a, Float4 b) -> Float4 {
+    return { { a.value[0] + b.value[0], a.value[1] + b.value[1], a.value[2] + b.value[2], 0.0f } };
+}
+
+auto operator-(Float4 a, Float4 b) -> Float4 {
+    return { { a.value[0] - b.value[0], a.value[1] - b.value[1], a.value[2] - b.value[2], 0.0f } };
+}
+
+auto operator*(Float4 a, float s) -> Float4 {
+    return { { a.value[0] * s, a.value[1] * s, a.value[2] * s, 0.0f } };
+}
+
+auto min(Float4 a, Float4 b) -> Float4 {
+    return { { std::min(a.value[0], b.value[0]), std::min(a.value[1], b.value[1]), std::min(a.value[2], b.value[2]), 0.0f } };
+}
+
+auto max(Float4 a, Float4 b) -> Float4 {
+    return { { std::max(a.value[0], b.value[0]), std::max(a.value[1], b.value[1]), std::max(a.value[2], b.value[2]), 0.0f } };
+}
+
+auto dot(Float4 a, Float4 b) -> float {
+    return a.value[0] * b.value[0] + a.value[1] * b.value[1] + a.value[2] * b.value[2];
+}
+
+auto cross(Float4 a, Float4 b) -> Float4 {
+    return { {
+        a.value[1] * b.value[2] - a.value[2] * b.value[1],
+        a.value[2] * b.value[0] - a.value[0] * b.value[2],
+        a.value[0] * b.value[1] - a.value[1] * b.value[0],
+        0.0f,
+    } };
+}
+
+#endif
+
+auto normalize(Float4 v, Float4 fallback) -> Float4 {
+    const float length_squared = dot(v, v);
+    if (!(length_squared > 1e-24f)) return fallback;
+    return v * (1.0f / std::sqrt(length_squared));
+}
+
+// Some unit vector perpendicular to n (Duff et al. 2017).
+auto perpendicular(Float4 n) -> Float4 {
+    float v[3];
+    n.get(v);
+
+    const float s = v[2] >= 0.0f ? 1.0f : -1.0f;
+    const float a = -1.0f / (s + v[2]);
+    const float b = v[0] * v[1] * a;
+    return Float4::make(1.0f + s * v[0] * v[0] * a, s * b, -s * v[0]);
+}
+
+// The parts of a geometry every kernel needs, checked once.
+struct MeshView {
+    std::uint32_t vertex_count;
+    std::uint32_t stride;
+    unsigned char* vertices;
+    std::span<std::uint16_t> indices;
+};
+
+// Corners of every vertex: corners[offsets[v]] to corners[offsets[v + 1]]
+// are the index positions referring to v.
+struct Adjacency {
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> corners;
+};
+
+}
+
+static auto fits(
+    std::uint32_t offset,
+    std::uint32_t size,
+    std::uint32_t stride
+) -> bool {
+    return offset != UINT32_MAX && static_cast<std::uint64_t>(offset) + size <= stride;
+}
+
+static auto mesh_view(
+    const Motorino::Geometry& geometry,
+    std::uint32_t position_offset
+) -> std::optional<MeshView> {
+    if (geometry.vertex_count == 0 || geometry.index_count % 3 != 0) {
+        Motorino::Logger::error("Mesh processing needs an indexed triangle list.\n");
+        return std::nullopt;
+    }
+
+    if (geometry.position_stride != 0) {
+        Motorino::Logger::error("Mesh processing needs interleaved vertices, split them last.\n");
+        return std::nullopt;
+    }
+
+    if (!fits(position_offset, 3 * sizeof(float), geometry.vertex_stride)) {
+        Motorino::Logger::error("Mesh position lies outside the vertex.\n");
+        return std::nullopt;
+    }
+
+    // Indices follow the vertices without padding.
+    const std::uint64_t vertices_size = static_cast<std::uint64_t>(geometry.vertex_count) * geometry.vertex_stride;
+    auto* indices = reinterpret_cast<std::uint16_t*>(geometry.data + vertices_size);
+
+    const MeshView view{
+        .vertex_count = geometry.vertex_count,
+        .stride = geometry.vertex_stride,
+        .vertices = geometry.data,
+        .indices = { indices, geometry.index_count },
+    };
+
+    if (std::any_of(view.indices.begin(), view.indices.end(), [&](std::uint16_t i) { return i >= view.vertex_count; })) {
+        Motorino::Logger::error("Mesh indices out of range.\n");
+        return std::nullopt;
+    }
+
+    return view;
+}
+
+static auto load_attribute(
+    const MeshView& view,
+    std::uint32_t offset,
+    Motorino::JobSystem& jobs
+) -> std::vector<Float4> {
+    std::vector<Float4> values(view.vertex_count);
+
+    jobs.parallel_for(view.vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t v = begin; v < end; ++v) {
+            values[v] = Float4::load(view.vertices + static_cast<std::uint64_t>(v) * view.stride + offset);
+        }
+    });
+
+    return values;
+}
+
+// Counting sort of the corners by vertex. Normals and tangents then gather
+// per vertex in parallel instead of scattering per triangle, which would
+// need atomics.
+static auto build_adjacency(const MeshView& view) -> Adjacency {
+    Adjacency adjacency{
+        .offsets = std::vector<std::uint32_t>(view.vertex_count + 1, 0),
+        .corners = std::vector<std::uint32_t>(view.indices.size()),
+    };
+
+    for (const std::uint16_t index : view.indices) ++adjacency.offsets[index + 1];
+
+    for (std::uint32_t v = 0; v < view.vertex_count; ++v) {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+
+    std::vector<std::uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+
+    for (std::uint32_t corner = 0; corner < view.indices.size(); ++corner) {
+        adjacency.corners[cursor[view.indices[corner]]++] = corner;
+    }
+
+    return adjacency;
+}
+
+auto Motorino::compute_normals(
+    Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> bool {
+    const auto view = mesh_view(geometry, attributes.position_offset);
+    if (!view) return false;
+
+    if (!fits(attributes.normal_offset, 3 * sizeof(float), view->stride)) {
+        Logger::error("Mesh normal lies outside the vertex.\n");
+        return false;
+    }
+
+    const std::vector<Float4> positions = load_attribute(*view, attributes.position_offset, jobs);
+    const auto triangle_count = static_cast<std::uint32_t>(view->indices.size() / 3);
+
+    // Twice the area long, which weights the sum below by area.
+    std::vector<Float4> faces(triangle_count);
+
+    jobs.parallel_for(triangle_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t t = begin; t < end; ++t) {
+            const Float4 p0 = positions[view->indices[t * 3]];
+            const Float4 p1 = positions[view->indices[t * 3 + 1]];
+            const Float4 p2 = positions[view->indices[t * 3 + 2]];
+            faces[t] = cross(p1 - p0, p2 - p0);
+        }
+    });
+
+    const Adjacency adjacency = build_adjacency(*view);
+    const Float4 up = Float4::make(0.0f, 1.0f, 0.0f);
+
+    jobs.parallel_for(view->vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t v = begin; v < end; ++v) {
+            Float4 sum = Float4::splat(0.0f);
+
+            for (std::uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i) {
+                sum = sum + faces[adjacency.corners[i] / 3];
+            }
+
+            normalize(sum, up).store(view->vertices + static_cast<std::uint64_t>(v) * view->stride + attributes.normal_offset);
+        }
+    });
+
+    return true;
+}
+
+auto Motorino::compute_tangents(
+    Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> bool {
+    const auto view = mesh_view(geometry, attributes.position_offset);
+    if (!view) return false;
+
+    if (!fits(attributes.normal_offset, 3 * sizeof(float), view->stride) ||
+        !fits(attributes.uv_offset, 2 * sizeof(float), view->stride) ||
+        !fits(attributes.tangent_offset, 4 * sizeof(float), view->stride)) {
+        Logger::error("Mesh tangents need a normal, a uv and a tangent inside the vertex.\n");
+        return false;
+    }
+
+    const std::vector<Float4> positions = load_attribute(*view, attributes.position_offset, jobs);
+    std::vector<Float4> normals = load_attribute(*view, attributes.normal_offset, jobs);
+    std::vector<std::array<float, 2>> uvs(view->vertex_count);
+
+    jobs.parallel_for(view->vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        const Float4 up = Float4::make(0.0f, 1.0f, 0.0f);
+
+        for (std::uint32_t v = begin; v < end; ++v) {
+            const unsigned char* vertex = view->vertices + static_cast<std::uint64_t>(v) * view->stride;
+            std::memcpy(uvs[v].data(), vertex + attributes.uv_offset, sizeof(uvs[v]));
+            normals[v] = normalize(normals[v], up);
+        }
+    });
+
+    const auto triangle_count = static_cast<std::uint32_t>(view->indices.size() / 3);
+
+    struct TriangleTangent {
+        // Unit direction of increasing u, zero where the uvs are degenerate.
+        Float4 tangent;
+        // 1 where the uvs keep the winding of the triangle, -1 where they
+        // mirror it.
+        float orientation;
+    };
+
+    std::vector<TriangleTangent> triangles(triangle_count);
+
+    jobs.parallel_for(triangle_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t t = begin; t < end; ++t) {
+            const std::uint16_t i0 = view->indices[t * 3];
+            const std::uint16_t i1 = view->indices[t * 3 + 1];
+            const std::uint16_t i2 = view->indices[t * 3 + 2];
+
+            const Float4 e1 = positions[i1] - positions[i0];
+            const Float4 e2 = positions[i2] - positions[i0];
+            const float du1 = uvs[i1][0] - uvs[i0][0];
+            const float dv1 = uvs[i1][1] - uvs[i0][1];
+            const float du2 = uvs[i2][0] - uvs[i0][0];
+            const float dv2 = uvs[i2][1] - uvs[i0][1];
+
+            const float area = du1 * dv2 - du2 * dv1;
+            const float orientation = area > 0.0f ? 1.0f : -1.0f;
+
+            triangles[t] = {
+                .tangent = std::abs(area) > 1e-20f
+                    ? normalize((e1 * dv2 - e2 * dv1) * orientation, Float4::splat(0.0f))
+                    : Float4::splat(0.0f),
+                .orientation = orientation,
+            };
+        }
+    });
+
+    const Adjacency adjacency = build_adjacency(*view);
+
+    jobs.parallel_for(view->vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t v = begin; v < end; ++v) {
+            const Float4 n = normals[v];
+            Float4 sum = Float4::splat(0.0f);
+            float orientation = 0.0f;
+
+            for (std::uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i) {
+                const std::uint32_t corner = adjacency.corners[i];
+                const std::uint32_t t = corner / 3;
+                const TriangleTangent& triangle = triangles[t];
+
+                if (dot(triangle.tangent, triangle.tangent) == 0.0f) continue;
+
+                // Both the tangent and the edges leaving the corner are
+                // projected onto the plane of the vertex normal.
+                const Float4 tangent = normalize(triangle.tangent - n * dot(n, triangle.tangent), Float4::splat(0.0f));
+
+                const std::uint32_t first = t * 3;
+                const Float4 p = positions[v];
+                const Float4 next = positions[view->indices[first + (corner - first + 1) % 3]] - p;
+                const Float4 previous = positions[view->indices[first + (corner - first + 2) % 3]] - p;
+
+                const Float4 a = normalize(next - n * dot(n, next), Float4::splat(0.0f));
+                const Float4 b = normalize(previous - n * dot(n, previous), Float4::splat(0.0f));
+                const float angle = std::acos(std::clamp(dot(a, b), -1.0f, 1.0f));
+
+                sum = sum + tangent * angle;
+                orientation += triangle.orientation * angle;
+            }
+
+            unsigned char* vertex = view->vertices + static_cast<std::uint64_t>(v) * view->stride;
+            normalize(sum, perpendicular(n)).store(vertex + attributes.tangent_offset);
+
+            const float handedness = orientation < 0.0f ? -1.0f : 1.0f;
+            std::memcpy(vertex + attributes.tangent_offset + 3 * sizeof(float), &handedness, sizeof(float));
+        }
+    });
+
+    return true;
+}
+
+auto Motorino::compute_bounds(
+    const Geometry& geometry,
+    const MeshAttributes& attributes,
+    JobSystem& jobs
+) -> std::optional<MeshBounds> {
+    if (geometry.vertex_count == 0 || geometry.position_stride != 0 ||
+        !fits(attributes.position_offset, 3 * sizeof(float), geometry.vertex_stride)) {
+        Logger::error("Mesh bounds need interleaved vertices with a position inside them.\n");
+        return std::nullopt;
+    }
+
+    const MeshView view{
+        .vertex_count = geometry.vertex_count,
+        .stride = geometry.vertex_stride,
+        .vertices = geometry.data,
+        .indices = {},
+    };
+
+    const std::vector<Float4> positions = load_attribute(view, attributes.position_offset, jobs);
+    const std::uint32_t batch_count = (view.vertex_count + mesh_batch_size - 1) / mesh_batch_size;
+
+    // Every batch reduces on its own, the batches are merged after.
+    std::vector<Float4> lowers(batch_count, Float4::splat(std::numeric_limits<float>::max()));
+    std::vector<Float4> uppers(batch_count, Float4::splat(std::numeric_limits<float>::lowest()));
+
+    jobs.parallel_for(view.vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        Float4 lower = positions[begin];
+        Float4 upper = positions[begin];
+
+        for (std::uint32_t v = begin + 1; v < end; ++v) {
+            lower = min(lower, positions[v]);
+            upper = max(upper, positions[v]);
+        }
+
+        lowers[begin / mesh_batch_size] = lower;
+        uppers[begin / mesh_batch_size] = upper;
+    });
+
+    Float4 lower = lowers[0];
+    Float4 upper = uppers[0];
+
+    for (std::uint32_t i = 1; i < batch_count; ++i) {
+        lower = min(lower, lowers[i]);
+        upper = max(upper, uppers[i]);
+    }
+
+    const Float4 center = (lower + upper) * 0.5f;
+    std::vector<float> radii(batch_count, 0.0f);
+
+    jobs.parallel_for(view.vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        float radius_squared = 0.0f;
+
+        for (std::uint32_t v = begin; v < end; ++v) {
+            const Float4 offset = positions[v] - center;
+            radius_squared = std::max(radius_squared, dot(offset, offset));
+        }
+
+        radii[begin / mesh_batch_size] = radius_squared;
+    });
+
+    MeshBounds bounds;
+    lower.get(bounds.lower);
+    upper.get(bounds.upper);
+    center.get(bounds.center);
+    bounds.radius = std::sqrt(*std::max_element(radii.begin(), radii.end()));
+
+    return bounds;
+}
+
+auto Motorino::deduplicate_vertices(
+    Geometry& geometry,
+    JobSystem& jobs
+) -> std::optional<std::vector<std::uint32_t>> {
+    const auto view = mesh_view(geometry, 0);
+    if (!view) return std::nullopt;
+
+    const auto vertex_at = [&](std::uint32_t v) -> unsigned char* {
+        return view->vertices + static_cast<std::uint64_t>(v) * view->stride;
+    };
+
+    std::vector<std::uint64_t> hashes(view->vertex_count);
+
+    jobs.parallel_for(view->vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t v = begin; v < end; ++v) {
+            hashes[v] = Hash::bytes({ vertex_at(v), view->stride });
+        }
+    });
+
+    // From hashes, or the next key along on the rare collision of two
+    // different vertices, to the slot of the kept vertex.
+    std::unordered_map<std::uint64_t, std::uint32_t, Hash::Identity> kept_at;
+    kept_at.reserve(view->vertex_count);
+
+    std::vector<std::uint32_t> remap(view->vertex_count);
+    std::uint32_t kept = 0;
+
+    for (std::uint32_t v = 0; v < view->vertex_count; ++v) {
+        std::uint64_t key = hashes[v];
+        auto it = kept_at.find(key);
+
+        while (it != kept_at.end() && std::memcmp(vertex_at(it->second), vertex_at(v), view->stride) != 0) {
+            it = kept_at.find(++key);
+        }
+
+        if (it != kept_at.end()) {
+            remap[v] = it->second;
+            continue;
+        }
+
+        kept_at.emplace(key, kept);
+        remap[v] = kept;
+
+        // Kept vertices only ever move down, over ones already read.
+        if (kept != v) std::memcpy(vertex_at(kept), vertex_at(v), view->stride);
+        ++kept;
+    }
+
+    std::uint16_t* indices = reinterpret_cast<std::uint16_t*>(vertex_at(kept));
+    std::memmove(indices, view->indices.data(), view->indices.size_bytes());
+
+    jobs.parallel_for(static_cast<std::uint32_t>(view->indices.size()), mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; ++i) {
+            indices[i] = static_cast<std::uint16_t>(remap[indices[i]]);
+        }
+    });
+
+    geometry.vertex_count = kept;
+    return remap;
+}
+
+auto Motorino::split_vertex_streams(
+    Geometry& geometry,
+    std::uint32_t position_offset,
+    std::uint32_t position_size,
+    JobSystem& jobs
+) -> bool {
+    const std::uint32_t stride = geometry.vertex_stride;
+
+    if (geometry.position_stride != 0 || position_size == 0 || position_size >= stride ||
+        !fits(position_offset, position_size, stride)) {
+        Logger::error("Vertex streams need interleaved vertices with a position inside them and attributes left.\n");
+        return false;
+    }
+
+    const std::uint32_t attribute_stride = stride - position_size;
+    const std::uint32_t tail = stride - position_offset - position_size;
+
+    // Both streams together take the space of the interleaved vertices, the
+    // indices stay where they are.
+    const std::vector<unsigned char> interleaved(
+        geometry.data,
+        geometry.data + static_cast<std::uint64_t>(geometry.vertex_count) * stride
+    );
+
+    unsigned char* positions = geometry.data;
+    unsigned char* attributes = geometry.data + static_cast<std::uint64_t>(geometry.vertex_count) * position_size;
+
+    jobs.parallel_for(geometry.vertex_count, mesh_batch_size, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t v = begin; v < end; ++v) {
+            const unsigned char* vertex = interleaved.data() + static_cast<std::uint64_t>(v) * stride;
+            unsigned char* attribute = attributes + static_cast<std::uint64_t>(v) * attribute_stride;
+
+            std::memcpy(positions + static_cast<std::uint64_t>(v) * position_size, vertex + position_offset, position_size);
+            std::memcpy(attribute, vertex, position_offset);
+            std::memcpy(attribute + position_offset, vertex + position_offset + position_size, tail);
+        }
+    });
+
+    geometry.position_stride = position_size;
+    return true;
+}
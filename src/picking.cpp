@@ -0,0 +1,184 @@
+#include "nkgt/logger.hpp"
+#include "nkgt/picking.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <utility>
+
+// Every slot holds a full region, whatever part of it lies on screen.
+constexpr std::uint64_t pick_slot_size = Motorino::pick_region_size * Motorino::pick_region_size * sizeof(std::uint32_t);
+
+auto Motorino::Engine::pick(
+    std::uint32_t x,
+    std::uint32_t y,
+    PickCallback callback
+) -> bool {
+    std::scoped_lock lock(_draw_mutex);
+
+    if (_pick_buffer == VK_NULL_HANDLE) {
+        // Read on the CPU one id at a time, cached memory when there is some.
+        bool result = create_buffer(
+            pick_slot_count * pick_slot_size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            _pick_buffer,
+            _pick_memory
+        ) || create_buffer(
+            pick_slot_count * pick_slot_size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _pick_buffer,
+            _pick_memory
+        );
+
+        if (!result) return false;
+
+        void* data;
+
+        if (vkMapMemory(_device, _pick_memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map pick buffer.\n");
+            vkDestroyBuffer(_device, _pick_buffer, nullptr);
+            vkFreeMemory(_device, _pick_memory, nullptr);
+            _pick_buffer = VK_NULL_HANDLE;
+            _pick_memory = VK_NULL_HANDLE;
+            return false;
+        }
+
+        _pick_data = static_cast<const std::uint32_t*>(data);
+    }
+
+    const auto slot = std::find_if(
+        std::begin(_pick_slots),
+        std::end(_pick_slots),
+        [](const PickSlot& candidate) { return candidate.state == PickState::Free; }
+    );
+
+    if (slot == std::end(_pick_slots)) return false;
+
+    slot->state = PickState::Queued;
+    slot->x = x;
+    slot->y = y;
+    slot->callback = std::move(callback);
+
+    return true;
+}
+
+auto Motorino::Engine::record_picks(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t image_index
+) -> void {
+    // A minimized window has no pixel to read, the picks wait for one.
+    if (_width == 0 || _height == 0) return;
+
+    bool copied = false;
+
+    for (std::uint32_t i = 0; i < pick_slot_count; ++i) {
+        PickSlot& slot = _pick_slots[i];
+        if (slot.state != PickState::Queued) continue;
+
+        // The window may have shrunk since the pick was requested.
+        const std::uint32_t width = std::min(pick_region_size, _width);
+        const std::uint32_t height = std::min(pick_region_size, _height);
+        const std::uint32_t x = std::min(slot.x, _width - 1);
+        const std::uint32_t y = std::min(slot.y, _height - 1);
+
+        slot.origin[0] = std::min(x - std::min(x, pick_region_size / 2), _width - width);
+        slot.origin[1] = std::min(y - std::min(y, pick_region_size / 2), _height - height);
+        slot.extent[0] = width;
+        slot.extent[1] = height;
+        slot.state = PickState::Recorded;
+
+        VkBufferImageCopy region{
+            .bufferOffset = i * pick_slot_size,
+            .bufferRowLength = pick_region_size,
+            .bufferImageHeight = pick_region_size,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+            .imageOffset = { static_cast<std::int32_t>(slot.origin[0]), static_cast<std::int32_t>(slot.origin[1]), 0 },
+            .imageExtent = { width, height, 1 },
+        };
+
+        // The render pass leaves the attachment in TRANSFER_SRC_OPTIMAL, its
+        // outgoing dependency makes the ID writes visible to this copy.
+        vkCmdCopyImageToBuffer(
+            cmd_buffer,
+            _id_images[image_index],
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            _pick_buffer,
+            1,
+            &region
+        );
+
+        _picks_recorded.push_back(i);
+        copied = true;
+    }
+
+    if (!copied) return;
+
+    VkBufferMemoryBarrier to_host{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _pick_buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        1, &to_host,
+        0, nullptr
+    );
+}
+
+auto Motorino::Engine::resolve_pick(std::uint32_t slot_index) -> void {
+    PickCallback callback;
+    PickResult result{};
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+
+        PickSlot& slot = _pick_slots[slot_index];
+        const std::uint32_t* ids = _pick_data + slot_index * pick_region_size * pick_region_size;
+
+        result.x = slot.x;
+        result.y = slot.y;
+
+        std::uint64_t best = UINT64_MAX;
+
+        for (std::uint32_t y = 0; y < slot.extent[1]; ++y) {
+            for (std::uint32_t x = 0; x < slot.extent[0]; ++x) {
+                const std::uint32_t id = ids[y * pick_region_size + x];
+                if (id == 0) continue;
+
+                const std::int64_t dx = static_cast<std::int64_t>(slot.origin[0] + x) - slot.x;
+                const std::int64_t dy = static_cast<std::int64_t>(slot.origin[1] + y) - slot.y;
+                const std::uint64_t distance = dx * dx + dy * dy;
+
+                if (distance < best) {
+                    best = distance;
+                    result = { id, slot.origin[0] + x, slot.origin[1] + y };
+                }
+            }
+        }
+
+        callback = std::move(slot.callback);
+        slot.callback = nullptr;
+        slot.state = PickState::Free;
+    }
+
+    // Outside the lock, the callback may well pick again.
+    if (callback) callback(result);
+}
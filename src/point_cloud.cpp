@@ -0,0 +1,593 @@
+#include "nkgt/frustum.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/point_cloud.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+static constexpr std::uint32_t point_cloud_spv[] = {
+#include "point_cloud.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType point_cloud_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t point_group_size = 256;
+
+// Groups sharing one batch at most, larger batches loop over their points.
+constexpr std::uint32_t max_point_groups = 64;
+
+constexpr float pi = 3.14159265358979f;
+
+namespace {
+
+struct PointCloudConstants {
+    float view_projection[16];
+    std::uint32_t width;
+    std::uint32_t height;
+};
+
+static_assert(sizeof(Motorino::PointCloudPoint) == 16);
+
+// The draw list is written with vkCmdUpdateBuffer.
+static_assert(Motorino::max_point_batches * 2 * sizeof(std::uint32_t) <= 65536);
+
+}
+
+static auto hash(std::uint32_t x) -> std::uint32_t {
+    const std::uint32_t state = x * 747796405u + 2891336453u;
+    const std::uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Any prefix of a shuffled batch is an even sample of it, which is what
+// drawing fewer points of distant batches relies on.
+static auto shuffle(
+    std::vector<std::uint32_t>& order,
+    std::uint32_t count,
+    std::uint32_t seed
+) -> void {
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0u);
+
+    std::uint32_t state = hash(seed);
+
+    for (std::uint32_t i = count; i > 1; --i) {
+        state = hash(state);
+        std::swap(order[i - 1], order[state % i]);
+    }
+}
+
+auto Motorino::Engine::create_point_cloud(const PointCloudSettings& settings) -> bool {
+    if (!_point_cloud_supported) {
+        Logger::error("Device lacks 64-bit buffer atomics, point clouds are unavailable.\n");
+        return false;
+    }
+
+    if (_point_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Point cloud already created.\n");
+        return false;
+    }
+
+    // The shader indexes points with 32 bits, through one binding.
+    const std::uint64_t max_capacity = std::min<std::uint64_t>(
+        UINT32_MAX,
+        _max_storage_buffer_range / sizeof(PointCloudPoint)
+    );
+
+    if (settings.capacity == 0 || settings.capacity > max_capacity) {
+        Logger::error("Point cloud capacity must be between 1 and {} points.\n", max_capacity);
+        return false;
+    }
+
+    bool result = create_compute_pipeline(
+        _device,
+        point_cloud_spv,
+        point_cloud_bindings,
+        sizeof(PointCloudConstants),
+        _point_pipeline
+    );
+
+    if (!result) {
+        destroy_point_cloud();
+        return false;
+    }
+
+    result = create_buffer(
+        settings.capacity * sizeof(PointCloudPoint),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _points,
+        _points_memory
+    ) && create_buffer(
+        max_point_batches * sizeof(PointDraw),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _point_draws,
+        _point_draws_memory
+    );
+
+    if (!result) {
+        destroy_point_cloud();
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_point_pipeline.set_layout,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, &_point_set) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate point cloud descriptor set.\n");
+        _point_set = VK_NULL_HANDLE;
+        destroy_point_cloud();
+        return false;
+    }
+
+    if (!resize_point_cloud()) {
+        destroy_point_cloud();
+        return false;
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+    _point_settings = settings;
+    _point_batches.clear();
+    _point_free.assign(1, { 0, static_cast<std::uint32_t>(settings.capacity) });
+    _point_ready = true;
+
+    return true;
+}
+
+auto Motorino::Engine::add_point_batch(std::span<const PointCloudPoint> points) -> TimelineAwaitable {
+    PointBatchId batch;
+    return add_point_batch(points, batch);
+}
+
+auto Motorino::Engine::add_point_batch(
+    std::span<const PointCloudPoint> points,
+    PointBatchId& id
+) -> TimelineAwaitable {
+    id = null_point_batch;
+
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (points.empty() || points.size() > max_point_batch_size) {
+        Logger::error("Point batches hold 1 to {} points.\n", max_point_batch_size);
+        return failed;
+    }
+
+    const std::uint32_t count = static_cast<std::uint32_t>(points.size());
+    std::uint32_t first;
+    std::uint64_t generation;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+
+        if (!_point_ready || !reserve_points(count, first)) {
+            Logger::error("No point cloud or no free range of {} points left.\n", count);
+            return failed;
+        }
+
+        generation = _point_generation;
+    }
+
+    // Gives the range back when nothing was submitted to write it.
+    const auto release = [this, first, count, generation] {
+        std::scoped_lock lock(_draw_mutex);
+        if (_point_generation == generation) release_points(first, count);
+    };
+
+    PointBatch batch{
+        .center = {},
+        .radius = 0.0f,
+        .first = first,
+        .count = count,
+        .id = 0,
+        .uploaded = false,
+        .upload = 0,
+    };
+
+    float lower[3] = { points[0].position[0], points[0].position[1], points[0].position[2] };
+    float upper[3] = { lower[0], lower[1], lower[2] };
+
+    for (const auto& point : points) {
+        for (std::uint32_t i = 0; i < 3; ++i) {
+            lower[i] = std::min(lower[i], point.position[i]);
+            upper[i] = std::max(upper[i], point.position[i]);
+        }
+    }
+
+    for (std::uint32_t i = 0; i < 3; ++i) batch.center[i] = (lower[i] + upper[i]) * 0.5f;
+
+    float radius_squared = 0.0f;
+
+    for (const auto& point : points) {
+        const float dx = point.position[0] - batch.center[0];
+        const float dy = point.position[1] - batch.center[1];
+        const float dz = point.position[2] - batch.center[2];
+        radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+    }
+
+    batch.radius = std::sqrt(radius_squared);
+
+    const std::uint64_t size = points.size_bytes();
+    const auto staging = acquire_staging(size);
+
+    if (!staging) {
+        release();
+        return failed;
+    }
+
+    std::vector<std::uint32_t> order;
+    shuffle(order, count, batch.first);
+
+    auto* out = reinterpret_cast<PointCloudPoint*>(staging->data);
+
+    for (std::uint32_t i = 0; i < count; ++i) {
+        out[i] = points[order[i]];
+    }
+
+    const std::uint64_t transfer_value = submit_transfer(
+        *staging,
+        _points,
+        size,
+        first * sizeof(PointCloudPoint)
+    );
+
+    if (transfer_value == 0) {
+        release();
+        return failed;
+    }
+
+    batch.upload = transfer_value;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+
+        // Destroyed meanwhile, which waited for the upload.
+        if (_point_generation != generation) return failed;
+
+        batch.id = _point_next_batch++;
+        _point_batches.push_back(batch);
+        _point_upload = std::max(_point_upload, transfer_value);
+    }
+
+    // Frames only draw the batch once its points are on the GPU. Ids are
+    // never reused, so a batch removed meanwhile is simply not found.
+    _waiter.add(_transfer_timeline, transfer_value, [this, batch_id = batch.id] {
+        std::scoped_lock lock(_draw_mutex);
+        const auto it = std::ranges::find(_point_batches, batch_id, &PointBatch::id);
+        if (it != _point_batches.end()) it->uploaded = true;
+    });
+
+    id = { batch.id };
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+}
+
+auto Motorino::Engine::remove_point_batch(PointBatchId id) -> bool {
+    PointBatch batch;
+    std::uint64_t frame_value;
+    std::uint64_t generation;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+
+        const auto it = std::ranges::find(_point_batches, id.index, &PointBatch::id);
+
+        if (it == _point_batches.end()) {
+            Logger::error("No point batch {} to remove.\n", id.index);
+            return false;
+        }
+
+        batch = *it;
+        _point_batches.erase(it);
+        frame_value = _frame_value.load();
+        generation = _point_generation;
+
+        if (batch.uploaded && frame_value == 0) {
+            release_points(batch.first, batch.count);
+            return true;
+        }
+    }
+
+    const auto release = [this, batch, generation] {
+        std::scoped_lock lock(_draw_mutex);
+        if (_point_generation == generation) release_points(batch.first, batch.count);
+    };
+
+    // Frames recorded so far may draw an uploaded batch. One still uploading
+    // was never drawn, but the transfer writes its range until it completes.
+    if (batch.uploaded) {
+        _waiter.add(_frame_timeline, frame_value, release);
+    } else {
+        _waiter.add(_transfer_timeline, batch.upload, release);
+    }
+
+    return true;
+}
+
+auto Motorino::Engine::set_point_cloud_camera(const PointCloudCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _point_camera = camera;
+}
+
+auto Motorino::Engine::destroy_point_cloud() -> void {
+    std::uint64_t last_frame;
+    std::uint64_t upload;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _point_ready = false;
+        _point_batches.clear();
+        _point_free.clear();
+        ++_point_generation;
+        last_frame = _frame_value.load();
+        upload = std::exchange(_point_upload, 0);
+    }
+
+    // Uploads still write the point buffer and their callbacks add batches.
+    if (upload > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, upload).wait();
+
+        std::scoped_lock lock(_draw_mutex);
+        _point_batches.clear();
+    }
+
+    if (last_frame > 0 && _point_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_point_set != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 1, &_point_set);
+        _point_set = VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(_device, _points, nullptr);
+    vkFreeMemory(_device, _points_memory, nullptr);
+    vkDestroyBuffer(_device, _point_draws, nullptr);
+    vkFreeMemory(_device, _point_draws_memory, nullptr);
+
+    _points = VK_NULL_HANDLE;
+    _points_memory = VK_NULL_HANDLE;
+    _point_draws = VK_NULL_HANDLE;
+    _point_draws_memory = VK_NULL_HANDLE;
+
+    destroy_compute_pipeline(_device, _point_pipeline);
+}
+
+auto Motorino::Engine::resize_point_cloud() -> bool {
+    if (_point_set == VK_NULL_HANDLE) return true;
+
+    if (_visibility_frame == VK_NULL_HANDLE) {
+        std::scoped_lock lock(_draw_mutex);
+        _point_ready = false;
+        return false;
+    }
+
+    const VkDescriptorBufferInfo buffer_infos[] = {
+        { .buffer = _points, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _point_draws, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _visibility_frame, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _point_set,
+        .dstBinding = 0,
+        .descriptorCount = 3,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = buffer_infos,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return true;
+}
+
+auto Motorino::Engine::reserve_points(
+    std::uint32_t count,
+    std::uint32_t& first
+) -> bool {
+    const auto it = std::ranges::find_if(_point_free, [count](const PointRange& range) {
+        return range.count >= count;
+    });
+
+    if (it == _point_free.end()) return false;
+
+    first = it->first;
+    it->first += count;
+    it->count -= count;
+
+    if (it->count == 0) _point_free.erase(it);
+
+    return true;
+}
+
+auto Motorino::Engine::release_points(
+    std::uint32_t first,
+    std::uint32_t count
+) -> void {
+    const auto next = std::ranges::lower_bound(_point_free, first, {}, &PointRange::first);
+
+    // Merges with the neighbours, so ranges of removed batches add up to
+    // room for larger ones.
+    const bool joins_next = next != _point_free.end() && first + count == next->first;
+    const bool joins_previous = next != _point_free.begin() && std::prev(next)->first + std::prev(next)->count == first;
+
+    if (joins_previous && joins_next) {
+        std::prev(next)->count += count + next->count;
+        _point_free.erase(next);
+    } else if (joins_previous) {
+        std::prev(next)->count += count;
+    } else if (joins_next) {
+        next->first = first;
+        next->count += count;
+    } else {
+        _point_free.insert(next, { first, count });
+    }
+}
+
+auto Motorino::Engine::record_point_cloud(VkCommandBuffer cmd_buffer) -> void {
+    _point_draw_list.clear();
+
+    if (!_point_ready || _point_batches.empty()) return;
+
+    const PointCloudCamera& camera = _point_camera;
+
+    float planes[6][4];
+    frustum_planes(camera.view_projection, planes);
+
+    std::uint64_t total = 0;
+
+    for (const PointBatch& batch : _point_batches) {
+        if (!batch.uploaded) continue;
+        if (!sphere_in_frustum(planes, batch.center, batch.radius)) continue;
+
+        const float dx = batch.center[0] - camera.position[0];
+        const float dy = batch.center[1] - camera.position[1];
+        const float dz = batch.center[2] - camera.position[2];
+        const float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - batch.radius;
+
+        // Points for the area the bounding sphere covers on screen, all of
+        // them once the camera is inside it.
+        std::uint32_t count = batch.count;
+
+        if (distance > 0.0f) {
+            const float pixels = camera.pixels_per_radian * batch.radius / distance;
+            const float wanted = std::ceil(pi * pixels * pixels * _point_settings.points_per_pixel);
+            count = static_cast<std::uint32_t>(std::min(wanted, static_cast<float>(batch.count)));
+        }
+
+        if (count == 0) continue;
+
+        _point_draw_list.push_back({ batch.first, count });
+        total += count;
+
+        if (_point_draw_list.size() == max_point_batches) break;
+    }
+
+    if (_point_draw_list.empty()) return;
+
+    // Over budget every batch gives up the same share, so detail drops
+    // evenly instead of far batches vanishing first.
+    if (total > _point_settings.point_budget) {
+        const double scale = static_cast<double>(_point_settings.point_budget) / total;
+
+        for (auto& draw : _point_draw_list) {
+            draw.count = std::max(1u, static_cast<std::uint32_t>(draw.count * scale));
+        }
+    }
+
+    std::uint32_t max_count = 0;
+    for (const auto& draw : _point_draw_list) max_count = std::max(max_count, draw.count);
+
+    // Frames before may still read the draw list.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        0, nullptr
+    );
+
+    vkCmdUpdateBuffer(
+        cmd_buffer,
+        _point_draws,
+        0,
+        _point_draw_list.size() * sizeof(PointDraw),
+        _point_draw_list.data()
+    );
+
+    VkMemoryBarrier to_compute{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &to_compute,
+        0, nullptr,
+        0, nullptr
+    );
+
+    begin_visibility(cmd_buffer);
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _point_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _point_pipeline.layout,
+        0,
+        1,
+        &_point_set,
+        0,
+        nullptr
+    );
+
+    PointCloudConstants constants{
+        .view_projection = {},
+        .width = _width,
+        .height = _height,
+    };
+
+    std::memcpy(constants.view_projection, camera.view_projection, sizeof(constants.view_projection));
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _point_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    const std::uint32_t groups = std::min(max_point_groups, (max_count + point_group_size - 1) / point_group_size);
+    vkCmdDispatch(cmd_buffer, groups, static_cast<std::uint32_t>(_point_draw_list.size()), 1);
+
+    VkBufferMemoryBarrier to_fragment{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _visibility_frame,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &to_fragment,
+        0, nullptr
+    );
+}
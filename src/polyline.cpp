@@ -0,0 +1,421 @@
+#include "nkgt/frustum.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/polyline.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+static constexpr std::uint32_t polyline_vert_spv[] = {
+#include "polyline.vert.spv.h"
+};
+
+static constexpr std::uint32_t polyline_frag_spv[] = {
+#include "polyline.frag.spv.h"
+};
+
+// Vertices, then the segment words of the same buffer.
+static constexpr Motorino::DescriptorType polyline_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+// Segment words keep the index of their first vertex below these flags.
+constexpr std::uint32_t segment_starts = 1u << 30;
+constexpr std::uint32_t segment_ends = 1u << 31;
+
+constexpr std::uint32_t vertices_per_segment = 6;
+
+// Draws address segments by gl_VertexIndex, which is signed. Vertex indices
+// stay below the segment flags as well, a vertex taking four times the
+// bytes of a word.
+constexpr std::uint64_t max_polyline_capacity = INT32_MAX / vertices_per_segment * sizeof(std::uint32_t);
+
+namespace {
+
+struct PolylineConstants {
+    float view_projection[16];
+    float viewport[2];
+    float half_width;
+    float miter_limit;
+    std::uint32_t style;
+};
+
+static_assert(sizeof(Motorino::PolylineVertex) == 16);
+
+}
+
+auto Motorino::Engine::create_polylines(const PolylineSettings& settings) -> bool {
+    if (_polyline_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Polylines already created.\n");
+        return false;
+    }
+
+    // Both bindings see the whole buffer.
+    const std::uint64_t max_capacity = std::min<std::uint64_t>(max_polyline_capacity, _max_storage_buffer_range);
+
+    if (settings.capacity < 16 || settings.capacity > max_capacity) {
+        Logger::error("Polyline capacity must be between 16 and {} bytes.\n", max_capacity);
+        return false;
+    }
+
+    bool result = create_draw_pipeline(
+        _device,
+        _render_pass,
+        {
+            .vertex_code = polyline_vert_spv,
+            .fragment_code = polyline_frag_spv,
+            .bindings = polyline_bindings,
+            .push_constant_size = sizeof(PolylineConstants),
+            .blend = DrawBlend::Alpha,
+        },
+        _polyline_pipeline
+    ) && create_buffer(
+        settings.capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _polylines,
+        _polylines_memory
+    );
+
+    if (!result) {
+        destroy_polylines();
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_polyline_pipeline.set_layout,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, &_polyline_set) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate polyline descriptor set.\n");
+        _polyline_set = VK_NULL_HANDLE;
+        destroy_polylines();
+        return false;
+    }
+
+    // The same buffer seen as vertices and as segment words.
+    const VkDescriptorBufferInfo buffer_infos[] = {
+        { .buffer = _polylines, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _polylines, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _polyline_set,
+        .dstBinding = 0,
+        .descriptorCount = 2,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = buffer_infos,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+    std::scoped_lock lock(_draw_mutex);
+    _polyline_settings = settings;
+    _polyline_chunks.clear();
+    _polyline_styles.clear();
+    _polyline_reserved = 0;
+    _polyline_ready = true;
+
+    return true;
+}
+
+auto Motorino::Engine::add_polylines(
+    std::span<const PolylineVertex> vertices,
+    std::span<const std::uint32_t> counts,
+    const PolylineStyle& style
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (!(style.width > 0.0f) || !(style.miter_limit >= 1.0f) ||
+        style.join > LineJoin::Round || style.cap > LineCap::Round) {
+        Logger::error("Invalid polyline style.\n");
+        return failed;
+    }
+
+    std::uint64_t total = 0;
+
+    for (const std::uint32_t count : counts) {
+        if (count < 2) {
+            Logger::error("Polylines need at least two vertices.\n");
+            return failed;
+        }
+
+        total += count;
+    }
+
+    if (counts.empty() || total != vertices.size()) {
+        Logger::error("Polyline counts add up to {} vertices, {} given.\n", total, vertices.size());
+        return failed;
+    }
+
+    const std::uint64_t segment_count = vertices.size() - counts.size();
+    const std::uint64_t segments_offset = vertices.size_bytes();
+    const std::uint64_t size = (segments_offset + segment_count * sizeof(std::uint32_t) + 15) & ~std::uint64_t{15};
+
+    std::uint64_t first;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+
+        if (!_polyline_ready || _polyline_reserved + size > _polyline_settings.capacity) {
+            Logger::error("No polylines or not enough room left for {} bytes.\n", size);
+            return failed;
+        }
+
+        first = _polyline_reserved;
+        _polyline_reserved += size;
+    }
+
+    const auto staging = acquire_staging(size);
+
+    // The reserved range stays unused, batches are never freed one by one.
+    if (!staging) return failed;
+
+    std::memcpy(staging->data, vertices.data(), segments_offset);
+
+    auto* segments = reinterpret_cast<std::uint32_t*>(staging->data + segments_offset);
+    const std::uint32_t first_vertex = static_cast<std::uint32_t>(first / sizeof(PolylineVertex));
+
+    std::uint32_t vertex = 0;
+    std::uint32_t segment = 0;
+
+    for (const std::uint32_t count : counts) {
+        for (std::uint32_t i = 0; i + 1 < count; ++i) {
+            std::uint32_t word = first_vertex + vertex + i;
+            if (i == 0) word |= segment_starts;
+            if (i + 2 == count) word |= segment_ends;
+            segments[segment++] = word;
+        }
+
+        vertex += count;
+    }
+
+    // Chunks take consecutive segments, their bounds cover both endpoints.
+    std::vector<PolylineChunk> chunks;
+    chunks.reserve((segment_count + polyline_chunk_size - 1) / polyline_chunk_size);
+
+    const std::uint64_t first_segment = (first + segments_offset) / sizeof(std::uint32_t);
+
+    for (std::uint64_t begin = 0; begin < segment_count; begin += polyline_chunk_size) {
+        const std::uint64_t end = std::min<std::uint64_t>(begin + polyline_chunk_size, segment_count);
+
+        PolylineChunk chunk{
+            .center = {},
+            .radius = 0.0f,
+            .first = first_segment + begin,
+            .count = static_cast<std::uint32_t>(end - begin),
+            .style = 0,
+        };
+
+        const auto endpoint = [&](std::uint64_t index, std::uint32_t side) -> const float* {
+            const std::uint32_t word = segments[index] & (segment_starts - 1);
+            return vertices[word - first_vertex + side].position;
+        };
+
+        const float* start = endpoint(begin, 0);
+        float lower[3] = { start[0], start[1], start[2] };
+        float upper[3] = { start[0], start[1], start[2] };
+
+        for (std::uint64_t s = begin; s < end; ++s) {
+            for (std::uint32_t side = 0; side < 2; ++side) {
+                const float* p = endpoint(s, side);
+
+                for (std::uint32_t i = 0; i < 3; ++i) {
+                    lower[i] = std::min(lower[i], p[i]);
+                    upper[i] = std::max(upper[i], p[i]);
+                }
+            }
+        }
+
+        for (std::uint32_t i = 0; i < 3; ++i) chunk.center[i] = (lower[i] + upper[i]) * 0.5f;
+
+        float radius_squared = 0.0f;
+
+        for (std::uint64_t s = begin; s < end; ++s) {
+            for (std::uint32_t side = 0; side < 2; ++side) {
+                const float* p = endpoint(s, side);
+                const float dx = p[0] - chunk.center[0];
+                const float dy = p[1] - chunk.center[1];
+                const float dz = p[2] - chunk.center[2];
+                radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+            }
+        }
+
+        chunk.radius = std::sqrt(radius_squared);
+        chunks.push_back(chunk);
+    }
+
+    const std::uint64_t transfer_value = submit_transfer(*staging, _polylines, size, first);
+    if (transfer_value == 0) return failed;
+
+    // Frames only draw the batch once it is on the GPU.
+    _waiter.add(_transfer_timeline, transfer_value, [this, chunks = std::move(chunks), style]() mutable {
+        std::scoped_lock lock(_draw_mutex);
+        if (!_polyline_ready) return;
+
+        const std::uint32_t style_index = static_cast<std::uint32_t>(_polyline_styles.size());
+        _polyline_styles.push_back(style);
+
+        for (auto& chunk : chunks) chunk.style = style_index;
+        _polyline_chunks.insert(_polyline_chunks.end(), chunks.begin(), chunks.end());
+    });
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _polyline_upload = std::max(_polyline_upload, transfer_value);
+    }
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+}
+
+auto Motorino::Engine::set_polyline_camera(const PolylineCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _polyline_camera = camera;
+}
+
+auto Motorino::Engine::destroy_polylines() -> void {
+    std::uint64_t last_frame;
+    std::uint64_t upload;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _polyline_ready = false;
+        _polyline_chunks.clear();
+        _polyline_styles.clear();
+        last_frame = _frame_value.load();
+        upload = std::exchange(_polyline_upload, 0);
+    }
+
+    // Uploads still write the buffer.
+    if (upload > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, upload).wait();
+    }
+
+    if (last_frame > 0 && _polyline_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_polyline_set != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 1, &_polyline_set);
+        _polyline_set = VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(_device, _polylines, nullptr);
+    vkFreeMemory(_device, _polylines_memory, nullptr);
+
+    _polylines = VK_NULL_HANDLE;
+    _polylines_memory = VK_NULL_HANDLE;
+
+    destroy_draw_pipeline(_device, _polyline_pipeline);
+}
+
+auto Motorino::Engine::draw_polylines(VkCommandBuffer cmd_buffer) -> void {
+    if (!_polyline_ready || _polyline_chunks.empty()) return;
+
+    float planes[6][4];
+    frustum_planes(_polyline_camera.view_projection, planes);
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _polyline_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _polyline_pipeline.layout,
+        0,
+        1,
+        &_polyline_set,
+        0,
+        nullptr
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    PolylineConstants constants{
+        .view_projection = {},
+        .viewport = { static_cast<float>(_width), static_cast<float>(_height) },
+        .half_width = 0.0f,
+        .miter_limit = 0.0f,
+        .style = 0,
+    };
+
+    std::memcpy(constants.view_projection, _polyline_camera.view_projection, sizeof(constants.view_projection));
+
+    std::uint32_t bound_style = UINT32_MAX;
+    std::uint64_t run_first = 0;
+    std::uint64_t run_count = 0;
+
+    // Visible chunks following each other in the buffer are drawn at once.
+    const auto flush = [&] {
+        if (run_count == 0) return;
+
+        vkCmdDraw(
+            cmd_buffer,
+            static_cast<std::uint32_t>(run_count * vertices_per_segment),
+            1,
+            static_cast<std::uint32_t>(run_first * vertices_per_segment),
+            0
+        );
+
+        run_count = 0;
+    };
+
+    for (const PolylineChunk& chunk : _polyline_chunks) {
+        if (!sphere_in_frustum(planes, chunk.center, chunk.radius)) continue;
+
+        if (chunk.style != bound_style) {
+            flush();
+
+            const PolylineStyle& style = _polyline_styles[chunk.style];
+            constants.half_width = style.width * 0.5f;
+            constants.miter_limit = style.miter_limit;
+            constants.style = static_cast<std::uint32_t>(style.join) | (static_cast<std::uint32_t>(style.cap) << 1);
+
+            vkCmdPushConstants(
+                cmd_buffer,
+                _polyline_pipeline.layout,
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                0,
+                sizeof(constants),
+                &constants
+            );
+
+            bound_style = chunk.style;
+        }
+
+        if (run_count > 0 && run_first + run_count != chunk.first) flush();
+        if (run_count == 0) run_first = chunk.first;
+        run_count += chunk.count;
+    }
+
+    flush();
+}
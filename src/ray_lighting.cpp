@@ -0,0 +1,483 @@
+#include "nkgt/bvh.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/ray_lighting.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+static constexpr std::uint32_t ray_lighting_spv[] = {
+#include "ray_lighting.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType ray_lighting_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t ray_group_size = 64;
+
+// Nodes, triangles and receivers share one buffer, each range starting at
+// the largest minStorageBufferOffsetAlignment a device may ask for.
+constexpr std::uint64_t ray_scene_alignment = 256;
+
+// One vec4 per receiver.
+constexpr std::uint64_t ray_result_size = 4 * sizeof(float);
+
+namespace {
+
+// Where a part of the scene buffer lies and what it holds.
+struct SceneSection {
+    std::uint64_t offset;
+    const void* data;
+    std::uint64_t size;
+};
+
+// Mirrors the Constants block of shaders/ray_lighting.comp.
+struct RayConstants {
+    float sun_direction[3];
+    float sun_angle;
+    std::uint32_t first;
+    std::uint32_t count;
+    std::uint32_t receiver_count;
+    std::uint32_t frame;
+    float ao_radius;
+    std::uint32_t ao_rays;
+    float max_history;
+    float bias;
+};
+
+static_assert(sizeof(Motorino::BvhNode) == 32);
+static_assert(sizeof(Motorino::BvhTriangle) == 48);
+static_assert(sizeof(Motorino::RayReceiver) == 32);
+static_assert(sizeof(RayConstants) == 48);
+
+}
+
+static auto align_scene(std::uint64_t offset) -> std::uint64_t {
+    return (offset + ray_scene_alignment - 1) & ~(ray_scene_alignment - 1);
+}
+
+auto Motorino::Engine::create_ray_lighting(const RayLightingSettings& settings) -> bool {
+    if (_ray_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Ray lighting already created.\n");
+        return false;
+    }
+
+    if (settings.receivers_per_frame == 0 || settings.max_history == 0) {
+        Logger::error("Ray lighting must trace and keep at least one receiver and frame.\n");
+        return false;
+    }
+
+    bool result = create_compute_pipeline(
+        _device,
+        ray_lighting_spv,
+        ray_lighting_bindings,
+        sizeof(RayConstants),
+        _ray_pipeline
+    );
+
+    if (!result) {
+        destroy_ray_lighting();
+        return false;
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+    _ray_settings = settings;
+    _ray_frame = 0;
+    _ray_ready = true;
+
+    return true;
+}
+
+auto Motorino::Engine::set_ray_scene(
+    const Bvh& bvh,
+    std::span<const RayReceiver> receivers
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (bvh.triangles.empty() || receivers.empty()) {
+        Logger::error("Ray scene needs a BVH with triangles and at least one receiver.\n");
+        return failed;
+    }
+
+    if (_ray_pipeline.pipeline == VK_NULL_HANDLE) {
+        Logger::error("Ray lighting not created.\n");
+        return failed;
+    }
+
+    const std::uint64_t nodes_size = bvh.nodes.size() * sizeof(BvhNode);
+    const std::uint64_t triangles_size = bvh.triangles.size() * sizeof(BvhTriangle);
+    const std::uint64_t receivers_size = receivers.size_bytes();
+
+    const std::uint64_t triangles_offset = align_scene(nodes_size);
+    const std::uint64_t receivers_offset = align_scene(triangles_offset + triangles_size);
+    const std::uint64_t scene_size = receivers_offset + receivers_size;
+    const std::uint64_t results_size = receivers.size() * ray_result_size;
+
+    VkBuffer scene;
+    VkDeviceMemory scene_memory;
+    VkBuffer results;
+    VkDeviceMemory results_memory;
+
+    bool result = create_buffer(
+        scene_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        scene,
+        scene_memory
+    );
+
+    if (!result) return failed;
+
+    result = create_buffer(
+        results_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        results,
+        results_memory
+    );
+
+    const auto destroy_buffers = [=, this] {
+        vkDestroyBuffer(_device, scene, nullptr);
+        vkFreeMemory(_device, scene_memory, nullptr);
+
+        if (result) {
+            vkDestroyBuffer(_device, results, nullptr);
+            vkFreeMemory(_device, results_memory, nullptr);
+        }
+    };
+
+    if (!result) {
+        destroy_buffers();
+        return failed;
+    }
+
+    const SceneSection sections[] = {
+        { 0, bvh.nodes.data(), nodes_size },
+        { triangles_offset, bvh.triangles.data(), triangles_size },
+        { receivers_offset, receivers.data(), receivers_size },
+    };
+
+    // Large scenes don't fit the staging ring at once, the pieces copy the
+    // parts of the sections they cover. Nothing reads the padding.
+    const std::uint64_t transfer_value = submit_chunked_transfer(
+        scene,
+        scene_size,
+        [&sections](unsigned char* data, std::uint64_t offset, std::uint64_t size) {
+            for (const SceneSection& section : sections) {
+                const std::uint64_t begin = std::max(offset, section.offset);
+                const std::uint64_t end = std::min(offset + size, section.offset + section.size);
+
+                if (begin >= end) continue;
+
+                std::memcpy(
+                    data + (begin - offset),
+                    static_cast<const unsigned char*>(section.data) + (begin - section.offset),
+                    end - begin
+                );
+            }
+
+            return true;
+        }
+    );
+
+    if (transfer_value == 0) {
+        destroy_buffers();
+        return failed;
+    }
+
+    const auto receiver_count = static_cast<std::uint32_t>(receivers.size());
+
+    // Frames keep tracing the previous scene until this one is on the GPU.
+    // Its sets are only allocated then, so scenes uploading at once don't
+    // hold any.
+    _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+        std::scoped_lock lock(_draw_mutex);
+
+        const auto retire = [this](
+            VkBuffer retired_scene,
+            VkDeviceMemory retired_scene_memory,
+            VkBuffer retired_results,
+            VkDeviceMemory retired_results_memory,
+            std::uint64_t frame_value
+        ) {
+            _retired_buffers.push_back({ retired_scene, retired_scene_memory, frame_value });
+            _retired_buffers.push_back({ retired_results, retired_results_memory, frame_value });
+        };
+
+        // Destroyed meanwhile, no frame ever saw the new scene.
+        if (!_ray_ready) {
+            retire(scene, scene_memory, results, results_memory, 0);
+            return;
+        }
+
+        const VkDescriptorSetLayout set_layouts[] = {
+            _ray_pipeline.set_layout,
+            _ray_shading_set_layout,
+        };
+
+        VkDescriptorSetAllocateInfo set_info{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = _descriptor_pool,
+            .descriptorSetCount = 2,
+            .pSetLayouts = set_layouts,
+        };
+
+        VkDescriptorSet sets[2];
+        bool allocated;
+
+        {
+            std::scoped_lock sets_lock(_compute_mutex);
+            allocated = vkAllocateDescriptorSets(_device, &set_info, sets) == VK_SUCCESS;
+        }
+
+        if (!allocated) {
+            Logger::error("Failed to allocate ray lighting descriptor sets, scene dropped.\n");
+            retire(scene, scene_memory, results, results_memory, 0);
+            return;
+        }
+
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { .buffer = scene, .offset = 0, .range = nodes_size },
+            { .buffer = scene, .offset = triangles_offset, .range = triangles_size },
+            { .buffer = scene, .offset = receivers_offset, .range = receivers_size },
+            { .buffer = results, .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        const VkWriteDescriptorSet writes[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = sets[0],
+                .dstBinding = 0,
+                .descriptorCount = 4,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = buffer_infos,
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = sets[1],
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &buffer_infos[3],
+            },
+        };
+
+        vkUpdateDescriptorSets(_device, 2, writes, 0, nullptr);
+
+        if (_ray_set != VK_NULL_HANDLE) {
+            const VkDescriptorSet old_sets[] = { _ray_set, _ray_shading_set };
+
+            // A scene replaced before any frame used it goes right away, so
+            // only scenes of frames in flight hold sets.
+            if (_ray_set_used) {
+                const std::uint64_t frame_value = _frame_value.load();
+                retire(_ray_scene, _ray_scene_memory, _ray_results, _ray_results_memory, frame_value);
+
+                _waiter.add(_frame_timeline, frame_value, [this, old_set = old_sets[0], old_shading_set = old_sets[1]] {
+                    const VkDescriptorSet freed[] = { old_set, old_shading_set };
+                    std::scoped_lock sets_lock(_compute_mutex);
+                    vkFreeDescriptorSets(_device, _descriptor_pool, 2, freed);
+                });
+            }
+            else {
+                retire(_ray_scene, _ray_scene_memory, _ray_results, _ray_results_memory, 0);
+
+                std::scoped_lock sets_lock(_compute_mutex);
+                vkFreeDescriptorSets(_device, _descriptor_pool, 2, old_sets);
+            }
+        }
+
+        _ray_set = sets[0];
+        _ray_shading_set = sets[1];
+        _ray_set_used = false;
+        _ray_scene = scene;
+        _ray_scene_memory = scene_memory;
+        _ray_results = results;
+        _ray_results_memory = results_memory;
+        _ray_receiver_count = receiver_count;
+        _ray_cursor = 0;
+        _ray_reset = true;
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+}
+
+auto Motorino::Engine::set_ray_sun(const float (&direction)[3]) -> void {
+    const float length = std::sqrt(
+        direction[0] * direction[0] +
+        direction[1] * direction[1] +
+        direction[2] * direction[2]
+    );
+
+    if (!(length > 0.0f)) return;
+
+    std::scoped_lock lock(_draw_mutex);
+
+    for (std::uint32_t i = 0; i < 3; ++i) _ray_sun[i] = direction[i] / length;
+}
+
+auto Motorino::Engine::ray_lighting() -> RayLighting {
+    std::scoped_lock lock(_draw_mutex);
+    return { _ray_results, _ray_receiver_count };
+}
+
+auto Motorino::Engine::destroy_ray_lighting() -> void {
+    std::uint64_t last_frame;
+    VkDescriptorSet set;
+    VkDescriptorSet shading_set;
+    VkBuffer scene;
+    VkDeviceMemory scene_memory;
+    VkBuffer results;
+    VkDeviceMemory results_memory;
+
+    // Scenes still uploading retire themselves once they find the module
+    // gone.
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _ray_ready = false;
+        last_frame = _frame_value.load();
+        set = std::exchange(_ray_set, VK_NULL_HANDLE);
+        shading_set = std::exchange(_ray_shading_set, VK_NULL_HANDLE);
+        scene = std::exchange(_ray_scene, VK_NULL_HANDLE);
+        scene_memory = std::exchange(_ray_scene_memory, VK_NULL_HANDLE);
+        results = std::exchange(_ray_results, VK_NULL_HANDLE);
+        results_memory = std::exchange(_ray_results_memory, VK_NULL_HANDLE);
+        _ray_receiver_count = 0;
+    }
+
+    if (last_frame > 0 && set != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (set != VK_NULL_HANDLE) {
+        const VkDescriptorSet sets[] = { set, shading_set };
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 2, sets);
+    }
+
+    vkDestroyBuffer(_device, scene, nullptr);
+    vkFreeMemory(_device, scene_memory, nullptr);
+    vkDestroyBuffer(_device, results, nullptr);
+    vkFreeMemory(_device, results_memory, nullptr);
+
+    destroy_compute_pipeline(_device, _ray_pipeline);
+}
+
+auto Motorino::Engine::record_ray_lighting(VkCommandBuffer cmd_buffer) -> void {
+    if (!_ray_ready || _ray_set == VK_NULL_HANDLE) return;
+
+    const RayLightingSettings& settings = _ray_settings;
+    _ray_set_used = true;
+
+    // Earlier frames may still read the results this one accumulates into.
+    VkMemoryBarrier readers{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &readers,
+        0, nullptr,
+        0, nullptr
+    );
+
+    // A new scene starts without history.
+    if (_ray_reset) {
+        vkCmdFillBuffer(cmd_buffer, _ray_results, 0, VK_WHOLE_SIZE, 0);
+
+        VkBufferMemoryBarrier cleared{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = _ray_results,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            0, nullptr,
+            1, &cleared,
+            0, nullptr
+        );
+
+        _ray_reset = false;
+    }
+
+    // Receivers are traced round robin, so every frame costs the same and
+    // each receiver gets a sample every receiver_count / count frames.
+    const std::uint32_t count = std::min(settings.receivers_per_frame, _ray_receiver_count);
+
+    RayConstants constants{
+        .sun_direction = { _ray_sun[0], _ray_sun[1], _ray_sun[2] },
+        .sun_angle = std::max(settings.sun_angle, 0.0f),
+        .first = _ray_cursor,
+        .count = count,
+        .receiver_count = _ray_receiver_count,
+        .frame = _ray_frame,
+        .ao_radius = settings.ao_radius,
+        .ao_rays = settings.ao_rays,
+        .max_history = static_cast<float>(settings.max_history),
+        .bias = settings.bias,
+    };
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _ray_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _ray_pipeline.layout,
+        0,
+        1,
+        &_ray_set,
+        0,
+        nullptr
+    );
+
+    vkCmdPushConstants(cmd_buffer, _ray_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cmd_buffer, (count + ray_group_size - 1) / ray_group_size, 1, 1);
+
+    VkBufferMemoryBarrier traced{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _ray_results,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    // The next frame's dispatch reads what this one wrote, as may the
+    // geometry drawn in between.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &traced,
+        0, nullptr
+    );
+
+    _ray_cursor = static_cast<std::uint32_t>((static_cast<std::uint64_t>(_ray_cursor) + count) % _ray_receiver_count);
+    ++_ray_frame;
+}
@@ -0,0 +1,1220 @@
+#include "nkgt/render_server.hpp"
+#include "nkgt/device_memory.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+
+constexpr VkFormat session_format = VK_FORMAT_R8G8B8A8_SRGB;
+constexpr std::uint32_t session_pixel_size = 4;
+
+Motorino::RenderSession::RenderSession(
+    RenderServer& server,
+    std::uint32_t width,
+    std::uint32_t height,
+    bool retain_frames
+) : _server{ server },
+    _width{ width },
+    _height{ height },
+    _command_pool{ VK_NULL_HANDLE },
+    _command_buffers{},
+    _images{},
+    _image_memory{},
+    _image_views{},
+    _framebuffers{},
+    _readback_buffers{},
+    _readback_memory{},
+    _readback_data{},
+    _timeline{ VK_NULL_HANDLE },
+    _requested{ 0 },
+    _submitted{ 0 },
+    _retain_frames{ retain_frames },
+    _released{ 0 },
+    _failing{ false },
+    _state{ 0, null_mesh, null_material }
+{}
+
+Motorino::RenderSession::~RenderSession() {
+    const VkDevice device = _server._device;
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        vkDestroyFramebuffer(device, _framebuffers[i], nullptr);
+        vkDestroyImageView(device, _image_views[i], nullptr);
+        vkDestroyImage(device, _images[i], nullptr);
+        vkFreeMemory(device, _image_memory[i], nullptr);
+        vkDestroyBuffer(device, _readback_buffers[i], nullptr);
+        vkFreeMemory(device, _readback_memory[i], nullptr);
+    }
+
+    vkDestroyCommandPool(device, _command_pool, nullptr);
+    vkDestroySemaphore(device, _timeline, nullptr);
+}
+
+auto Motorino::RenderSession::init() -> bool {
+    const VkDevice device = _server._device;
+
+    VkCommandPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = _server._queue_family,
+    };
+
+    if (vkCreateCommandPool(device, &pool_info, nullptr, &_command_pool) != VK_SUCCESS) {
+        Logger::error("Failed to create session command pool.\n");
+        return false;
+    }
+
+    VkCommandBufferAllocateInfo command_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = max_frames_in_flight,
+    };
+
+    if (vkAllocateCommandBuffers(device, &command_info, _command_buffers) != VK_SUCCESS) {
+        Logger::error("Failed to allocate session command buffers.\n");
+        return false;
+    }
+
+    const std::uint64_t frame_size = static_cast<std::uint64_t>(_width) * _height * session_pixel_size;
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        VkImageCreateInfo image_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = session_format,
+            .extent = { _width, _height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+
+        if (vkCreateImage(device, &image_info, nullptr, &_images[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create session image.\n");
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, _images[i], &requirements);
+
+        bool result = allocate_memory(
+            device,
+            _server._physical_device,
+            requirements.size,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            _image_memory[i]
+        );
+
+        if (!result) return false;
+
+        vkBindImageMemory(device, _images[i], _image_memory[i], 0);
+
+        VkImageViewCreateInfo view_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = _images[i],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = session_format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+
+        if (vkCreateImageView(device, &view_info, nullptr, &_image_views[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create session image view.\n");
+            return false;
+        }
+
+        VkFramebufferCreateInfo framebuffer_info{
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .renderPass = _server._render_pass,
+            .attachmentCount = 1,
+            .pAttachments = &_image_views[i],
+            .width = _width,
+            .height = _height,
+            .layers = 1,
+        };
+
+        if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &_framebuffers[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create session framebuffer.\n");
+            return false;
+        }
+
+        // Every frame is read in full on the CPU, which is slow from
+        // uncached memory.
+        result = create_buffer(
+            device,
+            _server._physical_device,
+            {},
+            frame_size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            _readback_buffers[i],
+            _readback_memory[i]
+        ) || create_buffer(
+            device,
+            _server._physical_device,
+            {},
+            frame_size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _readback_buffers[i],
+            _readback_memory[i]
+        );
+
+        if (!result) return false;
+
+        void* data;
+
+        if (vkMapMemory(device, _readback_memory[i], 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map session readback buffer.\n");
+            return false;
+        }
+
+        _readback_data[i] = static_cast<const unsigned char*>(data);
+    }
+
+    VkSemaphoreTypeCreateInfo timeline_type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+
+    VkSemaphoreCreateInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &timeline_type_info,
+    };
+
+    if (vkCreateSemaphore(device, &timeline_info, nullptr, &_timeline) != VK_SUCCESS) {
+        Logger::error("Failed to create session timeline semaphore.\n");
+        return false;
+    }
+
+    return true;
+}
+
+auto Motorino::RenderSession::set_pipeline(std::uint64_t key) -> void {
+    std::scoped_lock lock(_state_mutex);
+    _state.pipeline_key = key;
+}
+
+auto Motorino::RenderSession::set_mesh(Mesh mesh) -> void {
+    std::scoped_lock lock(_state_mutex);
+    _state.mesh = mesh;
+}
+
+auto Motorino::RenderSession::set_material(Material material) -> void {
+    std::scoped_lock lock(_state_mutex);
+    _state.material = material;
+}
+
+auto Motorino::RenderSession::request_frame() -> TimelineAwaitable {
+    std::uint64_t frame;
+    return request_frame(frame);
+}
+
+auto Motorino::RenderSession::request_frame(std::uint64_t& frame) -> TimelineAwaitable {
+    {
+        std::scoped_lock lock(_state_mutex);
+        _queued.push_back(_state);
+        frame = _requested.fetch_add(1) + 1;
+    }
+
+    _server.wake();
+
+    return TimelineAwaitable(&_server._waiter, &_server._jobs, _timeline, frame);
+}
+
+auto Motorino::RenderSession::pixels() const -> std::span<const unsigned char> {
+    std::uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(_server._device, _timeline, &completed);
+
+    return pixels(completed);
+}
+
+auto Motorino::RenderSession::pixels(std::uint64_t frame) const -> std::span<const unsigned char> {
+    if (frame == 0 || failed(frame)) return {};
+
+    return {
+        _readback_data[(frame - 1) % max_frames_in_flight],
+        static_cast<std::size_t>(_width) * _height * session_pixel_size
+    };
+}
+
+auto Motorino::RenderSession::failed(std::uint64_t frame) const -> bool {
+    std::scoped_lock lock(_failed_mutex);
+
+    return std::any_of(_failed.begin(), _failed.end(), [frame](const FailedFrames& run) {
+        return frame >= run.first && frame <= run.last;
+    });
+}
+
+auto Motorino::RenderSession::release(std::uint64_t frame) -> void {
+    {
+        std::scoped_lock lock(_release_mutex);
+
+        if (frame <= _released.load()) return;
+
+        _release_pending.push_back(frame);
+
+        // Writers finish out of order, a slot only comes back once the
+        // frames before it are done with theirs too.
+        std::uint64_t released = _released.load();
+
+        for (;;) {
+            const auto next = std::find(_release_pending.begin(), _release_pending.end(), released + 1);
+            if (next == _release_pending.end()) break;
+
+            _release_pending.erase(next);
+            ++released;
+        }
+
+        _released = released;
+    }
+
+    _server.wake();
+}
+
+auto Motorino::RenderSession::ready() const -> bool {
+    if (_failing.load() || _requested.load() <= _submitted) return false;
+
+    // Frame n renders into the slot of frame n - max_frames_in_flight.
+    std::uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(_server._device, _timeline, &completed);
+
+    if (_retain_frames) completed = std::min(completed, _released.load());
+
+    return completed + max_frames_in_flight > _submitted;
+}
+
+auto Motorino::RenderSession::record() -> bool {
+    const std::uint32_t slot = _submitted % max_frames_in_flight;
+    const VkCommandBuffer cmd_buffer = _command_buffers[slot];
+
+    FrameState state;
+
+    {
+        std::scoped_lock lock(_state_mutex);
+        state = _queued.front();
+    }
+
+    const VkPipeline pipeline = _server.find_pipeline(state.pipeline_key);
+    const auto geometry = _server.find_mesh(state.mesh);
+
+    vkResetCommandBuffer(cmd_buffer, 0);
+
+    constexpr VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    if (vkBeginCommandBuffer(cmd_buffer, &begin_info) != VK_SUCCESS) {
+        Logger::error("Failed to begin recording session command buffer.\n");
+        return false;
+    }
+
+    // Uploads and material copies are submitted ahead of the frames on the
+    // same queue.
+    constexpr VkMemoryBarrier copies_done{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        1, &copies_done,
+        0, nullptr,
+        0, nullptr
+    );
+
+    VkClearValue clear_value = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+    VkRenderPassBeginInfo pass_info{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = _server._render_pass,
+        .framebuffer = _framebuffers[slot],
+        .renderArea = {.offset = {0,0}, .extent = {_width, _height}},
+        .clearValueCount = 1,
+        .pClearValues = &clear_value
+    };
+
+    vkCmdBeginRenderPass(cmd_buffer, &pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    if (pipeline != VK_NULL_HANDLE && geometry) {
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        vkCmdBindDescriptorSets(
+            cmd_buffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            _server._pipeline_layout,
+            0,
+            1,
+            &_server._material_set,
+            0,
+            nullptr
+        );
+
+        vkCmdPushConstants(
+            cmd_buffer,
+            _server._pipeline_layout,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof(Material),
+            &state.material
+        );
+
+        const VkBuffer buffers[] = { geometry->buffer, geometry->buffer };
+        const VkDeviceSize offsets[] = { 0, static_cast<VkDeviceSize>(geometry->vertex_count) * geometry->position_stride };
+        vkCmdBindVertexBuffers(cmd_buffer, 0, geometry->position_stride != 0 ? 2 : 1, buffers, offsets);
+
+        vkCmdBindIndexBuffer(
+            cmd_buffer,
+            geometry->buffer,
+            static_cast<VkDeviceSize>(geometry->vertex_count) * geometry->vertex_stride,
+            VK_INDEX_TYPE_UINT16
+        );
+
+        VkViewport viewport{
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(_width),
+            .height = static_cast<float>(_height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+        VkRect2D scissor{
+            .offset = {0, 0},
+            .extent = {_width, _height}
+        };
+        vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+        vkCmdDrawIndexed(cmd_buffer, geometry->index_count, 1, 0, 0, 0);
+    }
+
+    vkCmdEndRenderPass(cmd_buffer);
+
+    // The render pass leaves the image in TRANSFER_SRC_OPTIMAL.
+    constexpr VkMemoryBarrier rendered{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &rendered,
+        0, nullptr,
+        0, nullptr
+    );
+
+    VkBufferImageCopy region{
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { _width, _height, 1 },
+    };
+
+    vkCmdCopyImageToBuffer(
+        cmd_buffer,
+        _images[slot],
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        _readback_buffers[slot],
+        1,
+        &region
+    );
+
+    constexpr VkMemoryBarrier read_back{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &read_back,
+        0, nullptr,
+        0, nullptr
+    );
+
+    if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+        Logger::error("Failed to finish recording session command buffer.\n");
+        return false;
+    }
+
+    std::scoped_lock lock(_state_mutex);
+    _queued.pop_front();
+
+    return true;
+}
+
+auto Motorino::RenderSession::fail_pending() -> void {
+    std::uint64_t last;
+
+    {
+        std::scoped_lock lock(_state_mutex);
+        last = _requested.load();
+        _queued.clear();
+    }
+
+    const std::uint64_t first = _submitted + 1;
+    if (last < first) return;
+
+    {
+        std::scoped_lock lock(_failed_mutex);
+        _failed.push_back({ first, last });
+    }
+
+    Logger::error("Render session dropped frames {} to {}.\n", first, last);
+
+    _submitted = last;
+    _failing = true;
+
+    // Signaling the failed frames only after the ones before keeps the
+    // timeline from being signaled past values still pending on the GPU.
+    _server._waiter.add(_timeline, first - 1, [this, last] {
+        const VkSemaphoreSignalInfo signal_info{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+            .semaphore = _timeline,
+            .value = last,
+        };
+
+        vkSignalSemaphore(_server._device, &signal_info);
+
+        _failing = false;
+        _server.wake();
+    });
+}
+
+Motorino::RenderServer::RenderServer()
+    : _instance{ VK_NULL_HANDLE },
+      _physical_device{ VK_NULL_HANDLE },
+      _device{ VK_NULL_HANDLE },
+      _queue_family{ 0 },
+      _queue{ VK_NULL_HANDLE },
+      _render_pass{ VK_NULL_HANDLE },
+      _material_set_layout{ VK_NULL_HANDLE },
+      _pipeline_layout{ VK_NULL_HANDLE },
+      _descriptor_pool{ VK_NULL_HANDLE },
+      _material_set{ VK_NULL_HANDLE },
+      _material_buffer{ VK_NULL_HANDLE },
+      _material_buffer_memory{ VK_NULL_HANDLE },
+      _copy_pool{ VK_NULL_HANDLE },
+      _copy_timeline{ VK_NULL_HANDLE },
+      _copy_value{ 0 },
+      _next_session{ 0 },
+      _work{ false },
+      _stop{ false },
+      _shader_compiler{ _jobs, "shader_cache" }
+{}
+
+Motorino::RenderServer::~RenderServer() {
+    {
+        std::scoped_lock lock(_schedule_mutex);
+        _stop = true;
+    }
+
+    _schedule_condition.notify_one();
+    if (_scheduler.joinable()) _scheduler.join();
+
+    if (_device == VK_NULL_HANDLE) {
+        vkDestroyInstance(_instance, nullptr);
+        return;
+    }
+
+    vkDeviceWaitIdle(_device);
+    _waiter.stop();
+
+    _sessions.clear();
+
+    for (const MeshRecord& mesh : _meshes) {
+        vkDestroyBuffer(_device, mesh.buffer, nullptr);
+        vkFreeMemory(_device, mesh.memory, nullptr);
+    }
+
+    for (const auto& [key, pipeline] : _pipelines) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+    }
+
+    vkDestroyBuffer(_device, _material_buffer, nullptr);
+    vkFreeMemory(_device, _material_buffer_memory, nullptr);
+    vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
+    vkDestroyPipelineLayout(_device, _pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _material_set_layout, nullptr);
+    vkDestroyRenderPass(_device, _render_pass, nullptr);
+    vkDestroyCommandPool(_device, _copy_pool, nullptr);
+    vkDestroySemaphore(_device, _copy_timeline, nullptr);
+
+    vkDestroyDevice(_device, nullptr);
+    vkDestroyInstance(_instance, nullptr);
+}
+
+auto Motorino::RenderServer::init() -> bool {
+    VkApplicationInfo app_info{
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "Motorino render server",
+        .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+        .pEngineName = "Motorino",
+        .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+        .apiVersion = VK_API_VERSION_1_3,
+    };
+
+    VkInstanceCreateInfo instance_info{
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &app_info,
+    };
+
+#ifndef NDEBUG
+    const char* validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
+
+    instance_info.enabledLayerCount = 1;
+    instance_info.ppEnabledLayerNames = validation_layers;
+#endif
+
+    if (vkCreateInstance(&instance_info, nullptr, &_instance) != VK_SUCCESS) {
+        Logger::error("Error while creating Vulkan instance\n");
+        return false;
+    }
+
+    std::uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(_instance, &device_count, nullptr);
+
+    std::vector<VkPhysicalDevice> available_devices(device_count);
+    vkEnumeratePhysicalDevices(_instance, &device_count, available_devices.data());
+
+    // Headless, so the first device with a graphics queue will do.
+    for (const VkPhysicalDevice candidate : available_devices) {
+        std::uint32_t family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &family_count, nullptr);
+
+        std::vector<VkQueueFamilyProperties> families(family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &family_count, families.data());
+
+        for (std::uint32_t i = 0; i < family_count; ++i) {
+            if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                _physical_device = candidate;
+                _queue_family = i;
+                break;
+            }
+        }
+
+        if (_physical_device != VK_NULL_HANDLE) break;
+    }
+
+    if (_physical_device == VK_NULL_HANDLE) {
+        Logger::error("No Vulkan device with a graphics queue available.\n");
+        return false;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physical_device, &properties);
+
+    Logger::info("Selected device: {}.\n", properties.deviceName);
+
+    float priorities = 1.f;
+    VkDeviceQueueCreateInfo queue_info{
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = _queue_family,
+        .queueCount = 1,
+        .pQueuePriorities = &priorities,
+    };
+
+    VkPhysicalDeviceFeatures device_features{};
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .timelineSemaphore = VK_TRUE,
+    };
+
+    VkDeviceCreateInfo device_info{
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &vulkan12_features,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = &queue_info,
+        .pEnabledFeatures = &device_features,
+    };
+
+    if (vkCreateDevice(_physical_device, &device_info, nullptr, &_device) != VK_SUCCESS) {
+        Logger::error("Failed to create Vulkan logical device.\n");
+        return false;
+    }
+
+    vkGetDeviceQueue(_device, _queue_family, 0, &_queue);
+
+    Logger::info("Created headless Vulkan device.\n");
+
+    // Same attachment as the swapchain pass, so pipelines of both stay
+    // compatible, but left ready for the readback copy.
+    constexpr VkAttachmentDescription color_attachment{
+        .format = session_format,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+    };
+
+    constexpr VkAttachmentReference color_attachment_ref{
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    };
+
+    VkSubpassDescription subpass{
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &color_attachment_ref
+    };
+
+    // Waits for the readback of the previous frame in the same slot.
+    constexpr VkSubpassDependency dependency{
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        .dstSubpass = 0,
+        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    };
+
+    VkRenderPassCreateInfo render_pass_info{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = 1,
+        .pAttachments = &color_attachment,
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = 1,
+        .pDependencies = &dependency
+    };
+
+    if (vkCreateRenderPass(_device, &render_pass_info, nullptr, &_render_pass) != VK_SUCCESS) {
+        Logger::error("Failed to create Vulkan render pass.\n");
+        return false;
+    }
+
+    constexpr VkDescriptorSetLayoutBinding material_binding{
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &material_binding,
+    };
+
+    if (vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_material_set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create material descriptor set layout.\n");
+        return false;
+    }
+
+    constexpr VkPushConstantRange material_push_constant{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(Material),
+    };
+
+    VkPipelineLayoutCreateInfo layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &_material_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &material_push_constant,
+    };
+
+    if (vkCreatePipelineLayout(_device, &layout_info, nullptr, &_pipeline_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create Vulkan pipeline layout.\n");
+        return false;
+    }
+
+    constexpr VkDescriptorPoolSize pool_size{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 };
+
+    VkDescriptorPoolCreateInfo descriptor_pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &pool_size,
+    };
+
+    if (vkCreateDescriptorPool(_device, &descriptor_pool_info, nullptr, &_descriptor_pool) != VK_SUCCESS) {
+        Logger::error("Failed to create descriptor pool.\n");
+        return false;
+    }
+
+    bool result = create_buffer(
+        _device,
+        _physical_device,
+        {},
+        _materials.capacity(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _material_buffer,
+        _material_buffer_memory
+    );
+
+    if (!result) return false;
+
+    VkDescriptorSetAllocateInfo material_set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_material_set_layout,
+    };
+
+    if (vkAllocateDescriptorSets(_device, &material_set_info, &_material_set) != VK_SUCCESS) {
+        Logger::error("Failed to allocate material descriptor set.\n");
+        return false;
+    }
+
+    VkDescriptorBufferInfo material_buffer_info{
+        .buffer = _material_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet material_write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _material_set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &material_buffer_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &material_write, 0, nullptr);
+
+    VkCommandPoolCreateInfo pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = _queue_family,
+    };
+
+    if (vkCreateCommandPool(_device, &pool_info, nullptr, &_copy_pool) != VK_SUCCESS) {
+        Logger::error("Failed to create command pool.\n");
+        return false;
+    }
+
+    VkSemaphoreTypeCreateInfo timeline_type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+
+    VkSemaphoreCreateInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &timeline_type_info,
+    };
+
+    if (vkCreateSemaphore(_device, &timeline_info, nullptr, &_copy_timeline) != VK_SUCCESS) {
+        Logger::error("Failed to create copy timeline semaphore.\n");
+        return false;
+    }
+
+    if (!_waiter.start(_device)) return false;
+
+    _scheduler = std::thread(&RenderServer::schedule, this);
+
+    Logger::info("Started render server.\n");
+    return true;
+}
+
+auto Motorino::RenderServer::create_session(
+    std::uint32_t width,
+    std::uint32_t height,
+    bool retain_frames
+) -> RenderSession* {
+    auto session = std::make_unique<RenderSession>(*this, width, height, retain_frames);
+    if (!session->init()) return nullptr;
+
+    Logger::info("Created {}x{} render session.\n", width, height);
+
+    std::scoped_lock lock(_session_mutex);
+    return _sessions.emplace_back(std::move(session)).get();
+}
+
+auto Motorino::RenderServer::destroy_session(RenderSession* session) -> void {
+    // Rounds hold the lock, so nothing is submitted for the session anymore.
+    std::scoped_lock lock(_session_mutex);
+
+    const VkSemaphoreWaitInfo wait_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &session->_timeline,
+        .pValues = &session->_submitted,
+    };
+
+    vkWaitSemaphores(_device, &wait_info, UINT64_MAX);
+
+    // Frames requested but never rendered complete without pixels, and the
+    // waiter has to be done with the semaphore before it is destroyed.
+    const std::uint64_t requested = session->_requested.load();
+
+    if (requested > session->_submitted) {
+        const VkSemaphoreSignalInfo signal_info{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+            .semaphore = session->_timeline,
+            .value = requested,
+        };
+
+        vkSignalSemaphore(_device, &signal_info);
+    }
+
+    if (requested > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, session->_timeline, requested).wait();
+    }
+
+    std::erase_if(_sessions, [session](const auto& owned) { return owned.get() == session; });
+    _next_session = 0;
+}
+
+auto Motorino::RenderServer::create_pipeline(const PipelineState& state) -> bool {
+    const std::uint64_t key = state.hash();
+
+    if (find_pipeline(key) != VK_NULL_HANDLE) return true;
+
+    VkPipeline pipeline = create_graphics_pipeline(
+        _device,
+        _shader_compiler,
+        state,
+        _pipeline_layout,
+        _render_pass,
+        false
+    );
+
+    if (pipeline == VK_NULL_HANDLE) return false;
+
+    std::scoped_lock lock(_pipeline_mutex);
+
+    if (!_pipelines.try_emplace(key, pipeline).second) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+    }
+
+    return true;
+}
+
+auto Motorino::RenderServer::find_pipeline(std::uint64_t key) -> VkPipeline {
+    std::scoped_lock lock(_pipeline_mutex);
+
+    const auto it = _pipelines.find(key);
+    return it != _pipelines.end() ? it->second : VK_NULL_HANDLE;
+}
+
+auto Motorino::RenderServer::upload(const Geometry& geometry) -> Mesh {
+    const std::uint64_t size = static_cast<std::uint64_t>(geometry.vertex_count) * geometry.vertex_stride +
+                               geometry.index_count * sizeof(std::uint16_t);
+
+    MeshRecord record{
+        .vertex_count = geometry.vertex_count,
+        .index_count = geometry.index_count,
+        .vertex_stride = geometry.vertex_stride,
+        .position_stride = geometry.position_stride,
+    };
+
+    bool result = create_buffer(
+        _device,
+        _physical_device,
+        {},
+        size,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        record.buffer,
+        record.memory
+    );
+
+    if (!result) return null_mesh;
+
+    const MaterialRange range{ 0, size };
+
+    if (!submit_copy(record.buffer, { &range, 1 }, { geometry.data, size })) {
+        vkDestroyBuffer(_device, record.buffer, nullptr);
+        vkFreeMemory(_device, record.memory, nullptr);
+        return null_mesh;
+    }
+
+    std::scoped_lock lock(_mesh_mutex);
+
+    _meshes.push_back(record);
+    return { static_cast<std::uint32_t>(_meshes.size() - 1) };
+}
+
+auto Motorino::RenderServer::find_mesh(Mesh mesh) -> std::optional<MeshRecord> {
+    std::scoped_lock lock(_mesh_mutex);
+
+    if (mesh.index >= _meshes.size()) return std::nullopt;
+    return _meshes[mesh.index];
+}
+
+auto Motorino::RenderServer::submit_copy(
+    VkBuffer destination,
+    std::span<const MaterialRange> ranges,
+    std::span<const unsigned char> bytes
+) -> bool {
+    VkBuffer staging;
+    VkDeviceMemory staging_memory;
+
+    bool result = create_buffer(
+        _device,
+        _physical_device,
+        {},
+        bytes.size(),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        staging,
+        staging_memory
+    );
+
+    if (!result) return false;
+
+    void* data;
+    vkMapMemory(_device, staging_memory, 0, bytes.size(), 0, &data);
+    std::memcpy(data, bytes.data(), bytes.size());
+    vkUnmapMemory(_device, staging_memory);
+
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(ranges.size());
+
+    std::uint64_t source_offset = 0;
+
+    for (const MaterialRange& range : ranges) {
+        regions.push_back({ source_offset, range.offset, range.size });
+        source_offset += range.size;
+    }
+
+    const auto release = [this, staging, staging_memory] {
+        vkDestroyBuffer(_device, staging, nullptr);
+        vkFreeMemory(_device, staging_memory, nullptr);
+    };
+
+    // The copy pool is only used with the queue lock held.
+    std::unique_lock lock(_queue_mutex);
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _copy_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer cmd_buffer;
+
+    if (vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer) != VK_SUCCESS) {
+        Logger::error("Failed to allocate copy command buffer.\n");
+        release();
+        return false;
+    }
+
+    constexpr VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    vkBeginCommandBuffer(cmd_buffer, &begin_info);
+
+    // Frames submitted earlier may still read the ranges overwritten.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        0, nullptr
+    );
+
+    vkCmdCopyBuffer(cmd_buffer, staging, destination, static_cast<std::uint32_t>(regions.size()), regions.data());
+    vkEndCommandBuffer(cmd_buffer);
+
+    const std::uint64_t value = ++_copy_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value,
+    };
+
+    VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmd_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &_copy_timeline,
+    };
+
+    if (vkQueueSubmit(_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        Logger::error("Failed to submit copy.\n");
+        vkFreeCommandBuffers(_device, _copy_pool, 1, &cmd_buffer);
+        --_copy_value;
+        release();
+        return false;
+    }
+
+    lock.unlock();
+
+    _waiter.add(_copy_timeline, value, [this, cmd_buffer, release] {
+        release();
+
+        std::scoped_lock lock(_queue_mutex);
+        vkFreeCommandBuffers(_device, _copy_pool, 1, &cmd_buffer);
+    });
+
+    return true;
+}
+
+auto Motorino::RenderServer::render() -> std::uint32_t {
+    std::scoped_lock lock(_session_mutex);
+
+    std::vector<RenderSession*> batch;
+    const std::size_t count = _sessions.size();
+
+    for (std::size_t i = 0; i < count && batch.size() < max_sessions_per_round; ++i) {
+        RenderSession* session = _sessions[(_next_session + i) % count].get();
+
+        if (session->ready()) batch.push_back(session);
+    }
+
+    if (batch.empty()) return 0;
+
+    // The next round starts behind the last session served, so sessions
+    // past the limit are not always the ones left out.
+    if (batch.size() == max_sessions_per_round) {
+        const auto last = std::find_if(_sessions.begin(), _sessions.end(), [&](const auto& owned) {
+            return owned.get() == batch.back();
+        });
+
+        _next_session = (static_cast<std::size_t>(last - _sessions.begin()) + 1) % count;
+    }
+
+    if (_materials.flush(_material_ranges, _material_bytes)) {
+        submit_copy(_material_buffer, _material_ranges, _material_bytes);
+    }
+
+    std::vector<unsigned char> recorded(batch.size(), 0);
+
+    _jobs.parallel_for(static_cast<std::uint32_t>(batch.size()), 1, [&](std::uint32_t begin, std::uint32_t end) {
+        for (std::uint32_t i = begin; i < end; ++i) {
+            recorded[i] = batch[i]->record();
+        }
+    });
+
+    std::size_t kept = 0;
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (recorded[i]) {
+            batch[kept++] = batch[i];
+        }
+        else {
+            batch[i]->fail_pending();
+        }
+    }
+
+    batch.resize(kept);
+    if (batch.empty()) return 0;
+
+    std::vector<std::uint64_t> values(batch.size());
+    std::vector<VkTimelineSemaphoreSubmitInfo> timeline_infos(batch.size());
+    std::vector<VkSubmitInfo> submit_infos(batch.size());
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        RenderSession* session = batch[i];
+        values[i] = session->_submitted + 1;
+
+        timeline_infos[i] = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &values[i],
+        };
+
+        submit_infos[i] = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_infos[i],
+            .commandBufferCount = 1,
+            .pCommandBuffers = &session->_command_buffers[session->_submitted % max_frames_in_flight],
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &session->_timeline,
+        };
+    }
+
+    bool failed = false;
+
+    {
+        std::scoped_lock queue_lock(_queue_mutex);
+
+        if (vkQueueSubmit(_queue, static_cast<std::uint32_t>(submit_infos.size()), submit_infos.data(), VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit render round.\n");
+            failed = true;
+        }
+    }
+
+    if (failed) {
+        for (RenderSession* session : batch) {
+            session->fail_pending();
+        }
+
+        return 0;
+    }
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->_submitted = values[i];
+
+        // A session waiting for a free slot becomes ready once this frame
+        // completes.
+        _waiter.add(batch[i]->_timeline, values[i], [this] { wake(); });
+    }
+
+    return static_cast<std::uint32_t>(batch.size());
+}
+
+auto Motorino::RenderServer::wake() -> void {
+    {
+        std::scoped_lock lock(_schedule_mutex);
+        _work = true;
+    }
+
+    _schedule_condition.notify_one();
+}
+
+auto Motorino::RenderServer::schedule() -> void {
+    for (;;) {
+        {
+            std::unique_lock lock(_schedule_mutex);
+            _schedule_condition.wait(lock, [this] { return _work || _stop; });
+
+            if (_stop) return;
+            _work = false;
+        }
+
+        // Sessions with more frames queued go again right away.
+        if (render() > 0) wake();
+    }
+}
@@ -1,4 +1,5 @@
 #include "nkgt/renderer.hpp"
+#include "nkgt/device_memory.hpp"
 #include "nkgt/logger.hpp"
 
 #define WIN32_LEAN_AND_MEAN
@@ -76,6 +77,121 @@ static inline void DestroyDebugUtilsMessengerEXT(
 }
 #endif
 
+// The vertex layout types are declared without Vulkan headers and handed to
+// Vulkan as is, so their layout has to match the native descriptions.
+static_assert(sizeof(Motorino::VertexBinding) == sizeof(VkVertexInputBindingDescription));
+static_assert(offsetof(Motorino::VertexBinding, stride) == offsetof(VkVertexInputBindingDescription, stride));
+static_assert(offsetof(Motorino::VertexBinding, input_rate) == offsetof(VkVertexInputBindingDescription, inputRate));
+static_assert(sizeof(Motorino::VertexAttribute) == sizeof(VkVertexInputAttributeDescription));
+static_assert(offsetof(Motorino::VertexAttribute, format) == offsetof(VkVertexInputAttributeDescription, format));
+static_assert(offsetof(Motorino::VertexAttribute, offset) == offsetof(VkVertexInputAttributeDescription, offset));
+static_assert(static_cast<VkFormat>(Motorino::VertexFormat::R8G8B8A8_UNORM) == VK_FORMAT_R8G8B8A8_UNORM);
+static_assert(static_cast<VkFormat>(Motorino::VertexFormat::R16G16_SFLOAT) == VK_FORMAT_R16G16_SFLOAT);
+static_assert(static_cast<VkFormat>(Motorino::VertexFormat::R16G16B16A16_SFLOAT) == VK_FORMAT_R16G16B16A16_SFLOAT);
+static_assert(static_cast<VkFormat>(Motorino::VertexFormat::R32_SFLOAT) == VK_FORMAT_R32_SFLOAT);
+static_assert(static_cast<VkFormat>(Motorino::VertexFormat::R32G32B32A32_SFLOAT) == VK_FORMAT_R32G32B32A32_SFLOAT);
+static_assert(Motorino::vertex_attributes<Motorino::Vertex>[1].offset == offsetof(Motorino::Vertex, color));
+static_assert(Motorino::vertex_attributes<Motorino::VertexAttributes, 1, 1>[0].location == 1);
+static_assert(static_cast<VkPrimitiveTopology>(Motorino::PrimitiveTopology::TriangleStrip) == VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP);
+static_assert(static_cast<VkPolygonMode>(Motorino::PolygonMode::Point) == VK_POLYGON_MODE_POINT);
+static_assert(static_cast<VkCullModeFlagBits>(Motorino::CullMode::FrontAndBack) == VK_CULL_MODE_FRONT_AND_BACK);
+static_assert(static_cast<VkFrontFace>(Motorino::FrontFace::Clockwise) == VK_FRONT_FACE_CLOCKWISE);
+
+// Engine compute shaders, compiled to SPIR-V words at build time.
+static constexpr std::uint32_t decode_geometry_spv[] = {
+#include "decode_geometry.comp.spv.h"
+};
+
+static constexpr Motorino::DescriptorType decode_geometry_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t decode_group_size = 64;
+constexpr std::uint32_t max_decode_sets = 64;
+constexpr VkFormat id_format = VK_FORMAT_R32_UINT;
+
+namespace {
+
+// Sets and storage buffer descriptors a feature holds in the shared
+// descriptor pool at most.
+struct PoolShare {
+    std::uint32_t sets;
+    std::uint32_t storage_buffers;
+};
+
+}
+
+// Every decode in flight, an index and a vertex buffer each.
+constexpr PoolShare decode_pool_share{ max_decode_sets, max_decode_sets * 2 };
+constexpr PoolShare material_pool_share{ 1, 1 };
+// Each capture slot also samples its swapchain image.
+constexpr PoolShare capture_pool_share{ capture_slot_count, capture_slot_count };
+// The instance generation and the instance draw.
+constexpr PoolShare scatter_pool_share{ 2, 3 + 2 };
+constexpr PoolShare point_cloud_pool_share{ 1, 3 };
+constexpr PoolShare visibility_pool_share{ 1, 1 };
+// The two froxel sets and the composite.
+constexpr PoolShare fog_pool_share{ 3, 2 * 4 + 3 };
+constexpr PoolShare ibl_bake_pool_share{ 1, 2 };
+// One per frame in flight still shading, the current one and one being
+// swapped in.
+constexpr PoolShare ibl_pool_share{ max_frames_in_flight + 2, max_frames_in_flight + 2 };
+constexpr PoolShare polyline_pool_share{ 1, 2 };
+constexpr PoolShare volume_pool_share{ max_frames_in_flight, max_frames_in_flight * 5 };
+// As many scenes as IBL sets, each a trace and a shading set.
+constexpr PoolShare ray_pool_share{ (max_frames_in_flight + 2) * 2, (max_frames_in_flight + 2) * (4 + 1) };
+// A selection set per frame in flight and the rasterization set.
+constexpr PoolShare cluster_pool_share{ max_frames_in_flight + 1, (max_frames_in_flight + 1) * 5 };
+constexpr PoolShare impostor_pool_share{ max_frames_in_flight, max_frames_in_flight * 2 };
+
+constexpr PoolShare pool_shares[] = {
+    decode_pool_share,
+    material_pool_share,
+    capture_pool_share,
+    scatter_pool_share,
+    point_cloud_pool_share,
+    visibility_pool_share,
+    fog_pool_share,
+    ibl_bake_pool_share,
+    ibl_pool_share,
+    polyline_pool_share,
+    volume_pool_share,
+    ray_pool_share,
+    cluster_pool_share,
+    impostor_pool_share,
+};
+
+constexpr PoolShare pool_size = [] {
+    PoolShare total{ 0, 0 };
+
+    for (const PoolShare& share : pool_shares) {
+        total.sets += share.sets;
+        total.storage_buffers += share.storage_buffers;
+    }
+
+    return total;
+}();
+
+// Whether geometry with the given strides can be drawn by a pipeline whose
+// binding 0 has binding_stride and whose attribute stream at binding 1 has
+// attribute_stride, 0 for a pipeline without one. Split geometry feeds a
+// split pipeline or a depth only one reading positions alone, interleaved
+// geometry only an interleaved pipeline.
+static auto vertex_input_matches(
+    std::uint32_t binding_stride,
+    std::uint32_t attribute_stride,
+    std::uint32_t vertex_stride,
+    std::uint32_t position_stride
+) -> bool {
+    if (position_stride == 0) {
+        return attribute_stride == 0 && binding_stride == vertex_stride;
+    }
+
+    return binding_stride == position_stride &&
+           (attribute_stride == 0 || attribute_stride == vertex_stride - position_stride);
+}
+
 static auto is_complete(Motorino::queue_indices indices) -> bool {
     return indices.graphics.has_value() &&
            indices.present.has_value() &&
@@ -125,29 +241,6 @@ static void resize_callback(GLFWwindow* window, int width, int height) {
     engine->recreate_swapchain();
 }
 
-static inline auto find_memory_type(
-    VkPhysicalDevice physical_device,
-    std::uint32_t filter,
-    VkMemoryPropertyFlags properties,
-    std::uint32_t& memory_index
-) -> bool {
-    VkPhysicalDeviceMemoryProperties mem_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
-
-    for (std::uint32_t i = 0; i < mem_properties.memoryTypeCount; ++i) {
-        bool correct_type = filter & (1 << i);
-        bool has_property = (mem_properties.memoryTypes[i].propertyFlags & properties) == properties;
-
-        if (correct_type && has_property)
-        {
-            memory_index = i;
-            return true;
-        }
-    }
-
-    return false;
-}
-
 static inline auto create_command_buffer(
     VkDevice device,
     VkCommandPool pool,
@@ -179,6 +272,7 @@ Motorino::Engine::Engine(
     _instance{ VK_NULL_HANDLE },
     _surface{ VK_NULL_HANDLE },
     _physical_device{ VK_NULL_HANDLE },
+    _max_storage_buffer_range{ 0 },
     _device{ VK_NULL_HANDLE },
     _graphics_queue{ VK_NULL_HANDLE },
     _present_queue{ VK_NULL_HANDLE },
@@ -187,16 +281,199 @@ Motorino::Engine::Engine(
     _render_pass{ VK_NULL_HANDLE },
     _graphics_command_pool{ VK_NULL_HANDLE },
     _transfer_command_pool{ VK_NULL_HANDLE },
+    _compute_command_pool{ VK_NULL_HANDLE },
+    _descriptor_pool{ VK_NULL_HANDLE },
+    _material_set_layout{ VK_NULL_HANDLE },
+    _material_set{ VK_NULL_HANDLE },
+    _ray_shading_set_layout{ VK_NULL_HANDLE },
+    _ibl_set_layout{ VK_NULL_HANDLE },
     _pipeline_layout{ VK_NULL_HANDLE },
     _graphics_command_buffers{},
     _pipeline{ VK_NULL_HANDLE },
+    _pipeline_binding_stride{ 0 },
+    _pipeline_attribute_stride{ 0 },
     _image_available_semaphores{},
     _render_finished_semaphores{},
     _inflight_fences{},
+    _current_frame{ 0 },
+    _frame_timeline{ VK_NULL_HANDLE },
+    _transfer_timeline{ VK_NULL_HANDLE },
+    _frame_value{ 0 },
+    _transfer_value{ 0 },
+    _compute_timeline{ VK_NULL_HANDLE },
+    _compute_value{ 0 },
+    _decode_pipeline{},
+    _shader_compiler{ _jobs, "shader_cache" },
     _index_count{ 0 },
     _vertex_count{ 0 },
+    _vertex_stride{ sizeof(Vertex) },
+    _position_stride{ 0 },
+    _material{ null_material },
+    _material_buffer{ VK_NULL_HANDLE },
+    _material_buffer_memory{ VK_NULL_HANDLE },
+    _material_upload{ 0 },
     _vertex_buffer{ VK_NULL_HANDLE },
-    _vertex_buffer_memory{ VK_NULL_HANDLE }
+    _vertex_buffer_memory{ VK_NULL_HANDLE },
+    _vertex_readback{ 0 },
+    _capture_supported{ false },
+    _capture_slots{},
+    _capture_pipeline{},
+    _capture_sampler{ VK_NULL_HANDLE },
+    _capture_layout{ YuvLayout::I420 },
+    _capture_width{ 0 },
+    _capture_height{ 0 },
+    _capturing{ false },
+    _pick_slots{},
+    _pick_buffer{ VK_NULL_HANDLE },
+    _pick_memory{ VK_NULL_HANDLE },
+    _pick_data{ nullptr },
+    _scatter_pipeline{},
+    _scatter_set{ VK_NULL_HANDLE },
+    _scatter_data{ VK_NULL_HANDLE },
+    _scatter_data_memory{ VK_NULL_HANDLE },
+    _scatter_instances{ VK_NULL_HANDLE },
+    _scatter_instances_memory{ VK_NULL_HANDLE },
+    _scatter_commands{ VK_NULL_HANDLE },
+    _scatter_commands_memory{ VK_NULL_HANDLE },
+    _scatter_draw_pipeline{},
+    _scatter_draw_set{ VK_NULL_HANDLE },
+    _scatter_mesh{ VK_NULL_HANDLE },
+    _scatter_mesh_memory{ VK_NULL_HANDLE },
+    _scatter_index_offset{ 0 },
+    _scatter_commands_reset{},
+    _scatter_tiles{},
+    _scatter_layer_count{ 0 },
+    _scatter_upload{ 0 },
+    _scatter_camera{},
+    _scatter_ready{ false },
+    _scatter_dirty{ false },
+    _point_cloud_supported{ false },
+    _visibility_resolve_pipeline{},
+    _visibility_set{ VK_NULL_HANDLE },
+    _visibility_frame{ VK_NULL_HANDLE },
+    _visibility_frame_memory{ VK_NULL_HANDLE },
+    _visibility_drawn{ false },
+    _point_pipeline{},
+    _point_set{ VK_NULL_HANDLE },
+    _points{ VK_NULL_HANDLE },
+    _points_memory{ VK_NULL_HANDLE },
+    _point_draws{ VK_NULL_HANDLE },
+    _point_draws_memory{ VK_NULL_HANDLE },
+    _point_settings{},
+    _point_camera{},
+    _point_next_batch{ 0 },
+    _point_generation{ 0 },
+    _point_upload{ 0 },
+    _point_ready{ false },
+    _fog_pipeline{},
+    _fog_sets{},
+    _fog_composite_pipeline{},
+    _fog_composite_set{ VK_NULL_HANDLE },
+    _fog_data{ VK_NULL_HANDLE },
+    _fog_data_memory{ VK_NULL_HANDLE },
+    _fog_froxels{},
+    _fog_froxels_memory{},
+    _fog_integrated{ VK_NULL_HANDLE },
+    _fog_integrated_memory{ VK_NULL_HANDLE },
+    _fog_settings{},
+    _fog_camera{},
+    _fog_previous{},
+    _fog_lights{},
+    _fog_light_count{ 0 },
+    _fog_frame{ 0 },
+    _fog_history{ false },
+    _fog_ready{ false },
+    _ibl_pipeline{},
+    _ibl_buffer{ VK_NULL_HANDLE },
+    _ibl_memory{ VK_NULL_HANDLE },
+    _ibl_layout{},
+    _ibl_set{ VK_NULL_HANDLE },
+    _ibl_set_used{ false },
+    _impostor_pipeline{},
+    _impostor_sets{},
+    _impostor_atlas{ VK_NULL_HANDLE },
+    _impostor_atlas_memory{ VK_NULL_HANDLE },
+    _impostor_instances{},
+    _impostor_instances_memory{},
+    _impostor_instance_data{},
+    _impostor_camera{},
+    _impostor_grid{ 0 },
+    _impostor_cell_size{ 0 },
+    _impostor_capacity{ 0 },
+    _impostor_upload{ 0 },
+    _impostor_ready{ false },
+    _polyline_pipeline{},
+    _polyline_set{ VK_NULL_HANDLE },
+    _polylines{ VK_NULL_HANDLE },
+    _polylines_memory{ VK_NULL_HANDLE },
+    _polyline_settings{},
+    _polyline_camera{},
+    _polyline_reserved{ 0 },
+    _polyline_upload{ 0 },
+    _polyline_ready{ false },
+    _volume_supported{ false },
+    _volume_pipeline{},
+    _volume_sets{},
+    _volume_pool{ VK_NULL_HANDLE },
+    _volume_pool_memory{ VK_NULL_HANDLE },
+    _volume_bricks{ VK_NULL_HANDLE },
+    _volume_bricks_memory{ VK_NULL_HANDLE },
+    _volume_transfer{ VK_NULL_HANDLE },
+    _volume_transfer_memory{ VK_NULL_HANDLE },
+    _volume_requests{ VK_NULL_HANDLE },
+    _volume_requests_memory{ VK_NULL_HANDLE },
+    _volume_used{},
+    _volume_used_memory{},
+    _volume_used_lists{},
+    _volume_settings{},
+    _volume_camera{},
+    _volume_colors{},
+    _volume_streams{ 0 },
+    _volume_generation{ 0 },
+    _volume_colors_dirty{ false },
+    _volume_reset{ false },
+    _volume_ready{ false },
+    _ray_pipeline{},
+    _ray_set{ VK_NULL_HANDLE },
+    _ray_shading_set{ VK_NULL_HANDLE },
+    _ray_scene{ VK_NULL_HANDLE },
+    _ray_scene_memory{ VK_NULL_HANDLE },
+    _ray_results{ VK_NULL_HANDLE },
+    _ray_results_memory{ VK_NULL_HANDLE },
+    _ray_settings{},
+    _ray_sun{ 0.0f, -1.0f, 0.0f },
+    _ray_receiver_count{ 0 },
+    _ray_cursor{ 0 },
+    _ray_frame{ 0 },
+    _ray_set_used{ false },
+    _ray_reset{ false },
+    _ray_ready{ false },
+    _cluster_select_pipeline{},
+    _cluster_raster_pipeline{},
+    _cluster_sets{},
+    _cluster_tables{ VK_NULL_HANDLE },
+    _cluster_tables_memory{ VK_NULL_HANDLE },
+    _cluster_page_slots{ VK_NULL_HANDLE },
+    _cluster_page_slots_memory{ VK_NULL_HANDLE },
+    _cluster_pool{ VK_NULL_HANDLE },
+    _cluster_pool_memory{ VK_NULL_HANDLE },
+    _cluster_draws{ VK_NULL_HANDLE },
+    _cluster_draws_memory{ VK_NULL_HANDLE },
+    _cluster_large{ VK_NULL_HANDLE },
+    _cluster_large_memory{ VK_NULL_HANDLE },
+    _cluster_requests{},
+    _cluster_requests_memory{},
+    _cluster_request_bits{},
+    _cluster_settings{},
+    _cluster_camera{},
+    _cluster_page_offset{ 0 },
+    _cluster_count{ 0 },
+    _cluster_root_pages{ 0 },
+    _cluster_streams{ 0 },
+    _cluster_generation{ 0 },
+    _cluster_upload{ 0 },
+    _cluster_reset{ false },
+    _cluster_ready{ false }
 #ifndef NDEBUG
     , _dbg_messenger{ VK_NULL_HANDLE }
 #endif
@@ -295,6 +572,8 @@ auto Motorino::Engine::init_vulkan() -> bool {
 
     Logger::info("Selected device: {}.\n", properties.deviceName);
 
+    _max_storage_buffer_range = properties.limits.maxStorageBufferRange;
+
     _indices = find_queue_indices(_physical_device, _surface);
 
     if (!is_complete(_indices)) {
@@ -338,12 +617,40 @@ auto Motorino::Engine::init_vulkan() -> bool {
         *_indices.transfer
     );
 
-    VkPhysicalDeviceFeatures device_features{};
+    VkPhysicalDeviceVulkan12Features supported12{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    };
+
+    VkPhysicalDeviceFeatures2 supported{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &supported12,
+    };
+
+    vkGetPhysicalDeviceFeatures2(_physical_device, &supported);
+
+    // Point clouds are rasterized with 64-bit atomics, everything else works
+    // without them.
+    _point_cloud_supported = supported.features.shaderInt64 && supported12.shaderBufferInt64Atomics;
+
+    // Volumes flag the bricks rays need from their fragment shader.
+    _volume_supported = supported.features.fragmentStoresAndAtomics;
+
+    VkPhysicalDeviceFeatures device_features{
+        .fragmentStoresAndAtomics = _volume_supported ? VK_TRUE : VK_FALSE,
+        .shaderInt64 = _point_cloud_supported ? VK_TRUE : VK_FALSE,
+    };
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .shaderBufferInt64Atomics = _point_cloud_supported ? VK_TRUE : VK_FALSE,
+        .timelineSemaphore = VK_TRUE,
+    };
     
     const char* device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
     VkDeviceCreateInfo device_info{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &vulkan12_features,
         .queueCreateInfoCount = queue_count,
         .pQueueCreateInfos = queue_infos,
         .enabledExtensionCount = 1,
@@ -376,34 +683,67 @@ auto Motorino::Engine::init_vulkan() -> bool {
         .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
     };
 
-    constexpr VkAttachmentReference color_attachment_ref{
-        .attachment = 0,
-        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    // Pipelines with PipelineState::object_id write the id of what they
+    // draw here, picks copy it out after the pass.
+    constexpr VkAttachmentDescription id_attachment{
+        .format = id_format,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+    };
+
+    const VkAttachmentDescription attachments[] = { color_attachment, id_attachment };
+
+    constexpr VkAttachmentReference color_attachment_refs[] = {
+        {
+            .attachment = 0,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        },
+        {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        },
     };
 
     VkSubpassDescription subpass{
         .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &color_attachment_ref
+        .colorAttachmentCount = 2,
+        .pColorAttachments = color_attachment_refs
     };
 
-    constexpr VkSubpassDependency dependency{
-        .srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    // Picks of an earlier frame may still copy from the ID attachment, and
+    // the picks of this frame copy from it after the pass.
+    constexpr VkSubpassDependency dependencies[] = {
+        {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+        },
+        {
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+        },
     };
 
     VkRenderPassCreateInfo render_pass_info{
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &color_attachment,
+        .attachmentCount = 2,
+        .pAttachments = attachments,
         .subpassCount = 1,
         .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency
+        .dependencyCount = 2,
+        .pDependencies = dependencies
     };
 
     if (vkCreateRenderPass(_device, &render_pass_info, nullptr, &_render_pass) != VK_SUCCESS) {
@@ -413,6 +753,81 @@ auto Motorino::Engine::init_vulkan() -> bool {
 
     Logger::info("Created Vulkan render pass.\n");
 
+    constexpr VkDescriptorSetLayoutBinding material_binding{
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &material_binding,
+    };
+
+    if (vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_material_set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create material descriptor set layout.\n");
+        return false;
+    }
+
+    // The ray lighting results, one vec4 per receiver.
+    constexpr VkDescriptorSetLayoutBinding ray_shading_binding{
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    set_layout_info.pBindings = &ray_shading_binding;
+
+    if (vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_ray_shading_set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create ray lighting descriptor set layout.\n");
+        return false;
+    }
+
+    // The IBL buffer, laid out as IblLayout describes.
+    constexpr VkDescriptorSetLayoutBinding ibl_binding{
+        .binding = 0,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    set_layout_info.pBindings = &ibl_binding;
+
+    if (vkCreateDescriptorSetLayout(_device, &set_layout_info, nullptr, &_ibl_set_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create IBL descriptor set layout.\n");
+        return false;
+    }
+
+    const VkDescriptorSetLayout pipeline_set_layouts[] = {
+        _material_set_layout,
+        _ray_shading_set_layout,
+        _ibl_set_layout,
+    };
+
+    constexpr VkPushConstantRange material_push_constant{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(Material),
+    };
+
+    VkPipelineLayoutCreateInfo layout_info{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 3,
+        .pSetLayouts = pipeline_set_layouts,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &material_push_constant,
+    };
+
+    if (vkCreatePipelineLayout(_device, &layout_info, nullptr, &_pipeline_layout) != VK_SUCCESS) {
+        Logger::error("Failed to create Vulkan pipeline layout.\n");
+        return false;
+    }
+
+    Logger::info("Created Vulkan pipeline layout.\n");
+
     if (!create_framebuffers()) return false;
 
     VkCommandPoolCreateInfo pool_info{
@@ -438,6 +853,15 @@ auto Motorino::Engine::init_vulkan() -> bool {
 
     Logger::info("Created transfer command pool.\n");
 
+    pool_info.queueFamilyIndex = _indices.graphics.value();
+
+    if (vkCreateCommandPool(_device, &pool_info, nullptr, &_compute_command_pool) != VK_SUCCESS) {
+        Logger::error("Failed to create command pool.\n");
+        return false;
+    }
+
+    Logger::info("Created compute command pool.\n");
+
     if (!create_command_buffer(_device, _graphics_command_pool, _graphics_command_buffers)) {
         return false;
     }
@@ -468,17 +892,187 @@ auto Motorino::Engine::init_vulkan() -> bool {
         }
     }
 
+    VkSemaphoreTypeCreateInfo timeline_type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+
+    VkSemaphoreCreateInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &timeline_type_info,
+    };
+
+    if (vkCreateSemaphore(_device, &timeline_info, nullptr, &_frame_timeline) != VK_SUCCESS) {
+        Logger::error("Failed to create frame timeline semaphore.\n");
+        return false;
+    }
+
+    if (vkCreateSemaphore(_device, &timeline_info, nullptr, &_transfer_timeline) != VK_SUCCESS) {
+        Logger::error("Failed to create transfer timeline semaphore.\n");
+        return false;
+    }
+
+    if (vkCreateSemaphore(_device, &timeline_info, nullptr, &_compute_timeline) != VK_SUCCESS) {
+        Logger::error("Failed to create compute timeline semaphore.\n");
+        return false;
+    }
+
     Logger::info("Created synchronization primitives.\n");
 
+    if (!_waiter.start(_device)) return false;
+
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_memory;
+
+    bool result = create_buffer(
+        staging_ring_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        staging_buffer,
+        staging_memory
+    );
+
+    if (!result) return false;
+
+    if (!_staging_ring.init(_device, staging_buffer, staging_memory, staging_ring_size, _transfer_timeline)) {
+        return false;
+    }
+
+    const VkDescriptorPoolSize pool_sizes[] = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, pool_size.storage_buffers },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, capture_slot_count },
+    };
+
+    VkDescriptorPoolCreateInfo descriptor_pool_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = pool_size.sets,
+        .poolSizeCount = 2,
+        .pPoolSizes = pool_sizes,
+    };
+
+    if (vkCreateDescriptorPool(_device, &descriptor_pool_info, nullptr, &_descriptor_pool) != VK_SUCCESS) {
+        Logger::error("Failed to create descriptor pool.\n");
+        return false;
+    }
+
+    result = create_compute_pipeline(
+        _device,
+        decode_geometry_spv,
+        decode_geometry_bindings,
+        0,
+        _decode_pipeline
+    );
+
+    if (!result) return false;
+
+    Logger::info("Created geometry decode pipeline.\n");
+
+    result = create_buffer(
+        _materials.capacity(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _material_buffer,
+        _material_buffer_memory
+    );
+
+    if (!result) return false;
+
+    VkDescriptorSetAllocateInfo material_set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_material_set_layout,
+    };
+
+    if (vkAllocateDescriptorSets(_device, &material_set_info, &_material_set) != VK_SUCCESS) {
+        Logger::error("Failed to allocate material descriptor set.\n");
+        return false;
+    }
+
+    VkDescriptorBufferInfo material_buffer_info{
+        .buffer = _material_buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet material_write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _material_set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &material_buffer_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &material_write, 0, nullptr);
+
+    Logger::info("Created material buffer.\n");
+
+    // Points and clusters share the visibility frame, so it needs the same
+    // 64-bit atomics.
+    if (_point_cloud_supported && !create_visibility()) return false;
+
     return true;
 }
 
 Motorino::Engine::~Engine() {
+    stop_capture();
+
+    // No frame is drawn anymore, so awaiters of later frames, like a
+    // next_frame() nobody draws, are dropped rather than waited for.
+    // Transfer and compute values are only taken when submitted, so none of
+    // their awaiters wait past the last submission.
+    vkDeviceWaitIdle(_device);
+    _waiter.seal(_frame_timeline, _frame_value.load());
+
+    // Uploads resumed by the waiter, page and brick streams and cache writes
+    // run on the workers and still touch buffers and submit work. Whatever
+    // they submit from here on is waited for by the features below.
+    _waiter.wait_idle();
+    _jobs.wait_idle();
+
+    destroy_scatter();
+    destroy_point_cloud();
+    destroy_fog();
+    destroy_impostors();
+    destroy_polylines();
+    destroy_volume();
+    destroy_ray_lighting();
+    destroy_cluster_mesh();
+    destroy_visibility();
+
+    // The features wait for their last frames through the waiter, stopped
+    // only now that nothing is left to wait for.
+    vkDeviceWaitIdle(_device);
+    _waiter.stop();
+
     cleanup_swapchain();
 
     vkDestroyBuffer(_device, _vertex_buffer, nullptr);
     vkFreeMemory(_device, _vertex_buffer_memory, nullptr);
 
+    for (const auto& retired : _retired_buffers) {
+        vkDestroyBuffer(_device, retired.buffer, nullptr);
+        vkFreeMemory(_device, retired.memory, nullptr);
+    }
+
+    _staging_ring.destroy();
+
+    vkDestroyBuffer(_device, _material_buffer, nullptr);
+    vkFreeMemory(_device, _material_buffer_memory, nullptr);
+
+    vkDestroyBuffer(_device, _pick_buffer, nullptr);
+    vkFreeMemory(_device, _pick_memory, nullptr);
+
+    vkDestroyBuffer(_device, _ibl_buffer, nullptr);
+    vkFreeMemory(_device, _ibl_memory, nullptr);
+
+    vkDestroySemaphore(_device, _frame_timeline, nullptr);
+    vkDestroySemaphore(_device, _transfer_timeline, nullptr);
+    vkDestroySemaphore(_device, _compute_timeline, nullptr);
+
     for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
         vkDestroySemaphore(_device, _image_available_semaphores[i], nullptr);
         vkDestroySemaphore(_device, _render_finished_semaphores[i], nullptr);
@@ -487,9 +1081,20 @@ Motorino::Engine::~Engine() {
 
     vkDestroyCommandPool(_device, _graphics_command_pool, nullptr);
     vkDestroyCommandPool(_device, _transfer_command_pool, nullptr);
+    vkDestroyCommandPool(_device, _compute_command_pool, nullptr);
+
+    destroy_compute_pipeline(_device, _decode_pipeline);
+    destroy_compute_pipeline(_device, _ibl_pipeline);
+    vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
+
+    for (const auto& [key, pipeline] : _pipelines) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+    }
 
-    vkDestroyPipeline(_device, _pipeline, nullptr);
     vkDestroyPipelineLayout(_device, _pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _material_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _ray_shading_set_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _ibl_set_layout, nullptr);
     vkDestroyRenderPass(_device, _render_pass, nullptr);
 
     vkDestroyDevice(_device, nullptr);
@@ -503,85 +1108,117 @@ Motorino::Engine::~Engine() {
 }
 
 auto Motorino::Engine::create_pipeline(
-    std::span<ShaderInfo> shaders
+    const PipelineState& state
+) -> bool {
+    return create_pipeline(state, state.hash());
+}
+
+auto Motorino::Engine::create_pipeline(
+    const PipelineState& state,
+    std::uint64_t key
 ) -> bool {
-    if (shaders.empty()) {
+    VkPipeline pipeline = build_pipeline(state, key);
+    if (pipeline == VK_NULL_HANDLE) return false;
+
+    const std::uint32_t binding_stride = state.vertex_input.binding.stride;
+    const std::uint32_t attribute_stride = state.attribute_input.attributes.empty() ? 0 : state.attribute_input.binding.stride;
+
+    std::scoped_lock lock(_draw_mutex);
+
+    // Switching layouts means switching the pipeline first, then uploading
+    // geometry it reads.
+    if (_vertex_buffer != VK_NULL_HANDLE &&
+        !vertex_input_matches(binding_stride, attribute_stride, _vertex_stride, _position_stride)) {
+        Logger::warn("Pipeline vertex input doesn't match the loaded geometry, nothing is drawn until matching geometry is uploaded.\n");
+    }
+
+    _pipeline = pipeline;
+    _pipeline_binding_stride = binding_stride;
+    _pipeline_attribute_stride = attribute_stride;
+
+    return true;
+}
+
+auto Motorino::Engine::compile_pipeline(
+    PipelineState state
+) -> Task<bool> {
+    co_await _jobs.schedule();
+    co_return build_pipeline(state, state.hash()) != VK_NULL_HANDLE;
+}
+
+auto Motorino::create_graphics_pipeline(
+    VkDevice device,
+    ShaderCompiler& shader_compiler,
+    const PipelineState& state,
+    VkPipelineLayout layout,
+    VkRenderPass render_pass,
+    bool id_attachment
+) -> VkPipeline {
+    if (state.shader_count == 0) {
         Logger::error("No shaders specified. Skipping.\n");
-        return false;
+        return VK_NULL_HANDLE;
     }
 
-    char buffer[2048];
-    std::vector<VkShaderModule> shader_modules(shaders.size());
-    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
-    shader_stages.reserve(shaders.size());
+    const auto code = shader_compiler.load_all({ state.shaders.data(), state.shader_count });
 
-    for(std::size_t i = 0; i < shaders.size(); ++i) {
-        HANDLE file = CreateFile(
-            shaders[i].path,
-            GENERIC_READ,
-            0,
-            0,
-            OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
-            0
-        );
+    std::vector<VkShaderModule> shader_modules;
+    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+    shader_modules.reserve(state.shader_count);
+    shader_stages.reserve(state.shader_count);
 
-        if (file == INVALID_HANDLE_VALUE) {
-            Logger::error("Failed to open shader file. Skipping. Path: {}", shaders[i].path);
-            continue;
-        }
+    for (std::size_t i = 0; i < state.shader_count; ++i) {
+        const ShaderInfo& shader = state.shaders[i];
 
-        unsigned long code_size = 0;
-        if (ReadFile(file, buffer, 2048, &code_size, 0) == 0) {
-            Logger::error("Failed to read shader file. Skipping. Path: {}", shaders[i].path);
+        if (!code[i]) {
+            Logger::error("Failed to load shader. Skipping. Path: {}\n", shader.path);
             continue;
         }
 
-        Logger::info("Read {}B from {}.\n", code_size, shaders[i].path);
-
         VkShaderModuleCreateInfo module_info{
             .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = code_size,
-            .pCode = reinterpret_cast<const std::uint32_t*>(buffer)
+            .codeSize = code[i]->size() * sizeof(std::uint32_t),
+            .pCode = code[i]->data()
         };
 
-        if (vkCreateShaderModule(_device, &module_info, nullptr, &shader_modules[i]) != VK_SUCCESS) {
-            Logger::error("Failed to create shader module for shader: {}\n", shaders[i].path);
-            return false;
+        VkShaderModule shader_module;
+
+        if (vkCreateShaderModule(device, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+            Logger::error("Failed to create shader module for shader: {}\n", shader.path);
+
+            for (auto mod : shader_modules) {
+                vkDestroyShaderModule(device, mod, nullptr);
+            }
+
+            return VK_NULL_HANDLE;
         }
 
+        shader_modules.push_back(shader_module);
         shader_stages.push_back({
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = static_cast<VkShaderStageFlagBits>(shaders[i].type),
-            .module = shader_modules[i],
+            .stage = static_cast<VkShaderStageFlagBits>(shader.type),
+            .module = shader_module,
             .pName = "main"
         });
-
-        CloseHandle(file);
     }
 
-    constexpr VkVertexInputBindingDescription binding_desc{
-        .binding = 0,
-        .stride = sizeof(Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-    };
+    // Split geometry adds the attribute stream as a second binding.
+    const bool split = !state.attribute_input.attributes.empty();
+    const VertexBinding bindings[] = { state.vertex_input.binding, state.attribute_input.binding };
 
-    constexpr VkVertexInputAttributeDescription attribute_desc[] = {
-        { 0, 0, VK_FORMAT_R32G32_SFLOAT,    offsetof(Vertex, pos) },
-        { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) }
-    };
+    std::vector<VertexAttribute> attributes(state.vertex_input.attributes.begin(), state.vertex_input.attributes.end());
+    attributes.insert(attributes.end(), state.attribute_input.attributes.begin(), state.attribute_input.attributes.end());
 
     VkPipelineVertexInputStateCreateInfo vertex_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &binding_desc,
-        .vertexAttributeDescriptionCount = 2,
-        .pVertexAttributeDescriptions = attribute_desc
+        .vertexBindingDescriptionCount = split ? 2u : 1u,
+        .pVertexBindingDescriptions = reinterpret_cast<const VkVertexInputBindingDescription*>(bindings),
+        .vertexAttributeDescriptionCount = static_cast<std::uint32_t>(attributes.size()),
+        .pVertexAttributeDescriptions = reinterpret_cast<const VkVertexInputAttributeDescription*>(attributes.data())
     };
 
-    constexpr VkPipelineInputAssemblyStateCreateInfo assembly_info{
+    VkPipelineInputAssemblyStateCreateInfo assembly_info{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .topology = static_cast<VkPrimitiveTopology>(state.topology),
         .primitiveRestartEnable = VK_FALSE
     };
 
@@ -602,13 +1239,13 @@ auto Motorino::Engine::create_pipeline(
         .scissorCount = 1
     };
 
-    constexpr VkPipelineRasterizationStateCreateInfo rasterizer{
+    VkPipelineRasterizationStateCreateInfo rasterizer{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
-        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .polygonMode = static_cast<VkPolygonMode>(state.polygon_mode),
+        .cullMode = static_cast<VkCullModeFlags>(state.cull_mode),
+        .frontFace = static_cast<VkFrontFace>(state.front_face),
         .depthBiasEnable = VK_FALSE,
         .lineWidth = 1.0f,
     };
@@ -619,7 +1256,7 @@ auto Motorino::Engine::create_pipeline(
         .sampleShadingEnable = VK_FALSE,
     };
 
-    constexpr VkPipelineColorBlendAttachmentState color_blend_attachment{
+    VkPipelineColorBlendAttachmentState color_blend_attachment{
         .blendEnable = VK_FALSE,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
                           VK_COLOR_COMPONENT_G_BIT |
@@ -627,27 +1264,38 @@ auto Motorino::Engine::create_pipeline(
                           VK_COLOR_COMPONENT_A_BIT,
     };
 
+    if (state.blend != BlendMode::Opaque) {
+        color_blend_attachment.blendEnable = VK_TRUE;
+        color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        color_blend_attachment.dstColorBlendFactor = state.blend == BlendMode::Alpha ?
+                                                     VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA :
+                                                     VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
+
+    // Integer attachments can't blend. Pipelines without an object id leave
+    // the cleared value, so they can't be picked.
+    const VkPipelineColorBlendAttachmentState blend_attachments[] = {
+        color_blend_attachment,
+        {
+            .blendEnable = VK_FALSE,
+            .colorWriteMask = state.object_id ? VK_COLOR_COMPONENT_R_BIT : 0u,
+        },
+    };
+
     VkPipelineColorBlendStateCreateInfo color_blend_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
         .logicOpEnable = VK_FALSE,
-        .attachmentCount = 1,
-        .pAttachments = &color_blend_attachment,
-    };
-
-    constexpr VkPipelineLayoutCreateInfo layout_info{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .attachmentCount = id_attachment ? 2u : 1u,
+        .pAttachments = blend_attachments,
     };
 
-    if (vkCreatePipelineLayout(_device, &layout_info, nullptr, &_pipeline_layout) != VK_SUCCESS) {
-        Logger::error("Failed to create Vulkan pipeline layout.\n");
-        return false;
-    }
-
-    Logger::info("Created Vulkan pipeline layout.\n");
-
     VkGraphicsPipelineCreateInfo pipeline_info{
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 2,
+        .stageCount = static_cast<std::uint32_t>(shader_stages.size()),
         .pStages = shader_stages.data(),
         .pVertexInputState = &vertex_info,
         .pInputAssemblyState = &assembly_info,
@@ -656,63 +1304,211 @@ auto Motorino::Engine::create_pipeline(
         .pMultisampleState = &multisampling,
         .pColorBlendState = &color_blend_state,
         .pDynamicState = &dynamic_state,
-        .layout = _pipeline_layout,
-        .renderPass = _render_pass,
+        .layout = layout,
+        .renderPass = render_pass,
         .subpass = 0,
     };
 
-    if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_pipeline) != VK_SUCCESS) {
+    VkPipeline pipeline;
+    const auto result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+
+    for (auto mod : shader_modules) {
+        vkDestroyShaderModule(device, mod, nullptr);
+    }
+
+    if (result != VK_SUCCESS) {
         Logger::error("Failed to create Vulkan pipeline.\n");
-        return false;
+        return VK_NULL_HANDLE;
     }
 
-    Logger::info("Created Vulkan pipeline.\n");
+    return pipeline;
+}
+
+auto Motorino::Engine::build_pipeline(
+    const PipelineState& state,
+    std::uint64_t key
+) -> VkPipeline {
+    {
+        std::scoped_lock lock(_pipeline_mutex);
 
-    for (auto mod : shader_modules) {
-        vkDestroyShaderModule(_device, mod, nullptr);
+        if (const auto it = _pipelines.find(key); it != _pipelines.end()) {
+            return it->second;
+        }
     }
 
+    VkPipeline pipeline = create_graphics_pipeline(
+        _device,
+        _shader_compiler,
+        state,
+        _pipeline_layout,
+        _render_pass,
+        true
+    );
+
+    if (pipeline == VK_NULL_HANDLE) return VK_NULL_HANDLE;
 
-    return true;
+    std::scoped_lock lock(_pipeline_mutex);
+
+    // Another thread may have built the same state in the meantime.
+    const auto [it, inserted] = _pipelines.try_emplace(key, pipeline);
+
+    if (!inserted) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+        return it->second;
+    }
+
+    Logger::info("Created Vulkan pipeline {:016x}.\n", key);
+    return pipeline;
 }
 
 auto Motorino::Engine::submit_vertex_data(
     const Geometry* geometry
 ) -> bool {
-    _index_count = geometry->index_count;
-    _vertex_count = geometry->vertex_count;
+    return upload(geometry).wait();
+}
 
-    const std::uint64_t size = geometry->vertex_count * sizeof(Vertex) +
-                               geometry->index_count  * sizeof(std::uint16_t);
+auto Motorino::Engine::upload(
+    const Geometry* geometry
+) -> TimelineAwaitable {
+    const std::uint64_t size = static_cast<VkDeviceSize>(geometry->vertex_count) * geometry->vertex_stride +
+                               static_cast<VkDeviceSize>(geometry->index_count) * sizeof(std::uint16_t);
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
+    const auto staging = acquire_staging(size);
+    if (!staging) return TimelineAwaitable(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
 
-    bool result = create_buffer(
+    std::memcpy(staging->data, geometry->data, size);
+
+    return submit_geometry(
+        *staging,
         size,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        staging_buffer,
-        staging_buffer_memory
+        geometry->vertex_count,
+        geometry->index_count,
+        geometry->vertex_stride,
+        geometry->position_stride
     );
+}
 
-    if (!result) return false;
+auto Motorino::Engine::upload(
+    const AssetPack& pack,
+    std::string_view name
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
 
-    void* data;
-    vkMapMemory(_device, staging_buffer_memory, 0, size, 0, &data);
-    std::memcpy(data, geometry->data, size);
-    vkUnmapMemory(_device, staging_buffer_memory);
+    const PackEntry* entry = pack.find(name);
 
-    result = create_buffer(
-        size,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        _vertex_buffer,
-        _vertex_buffer_memory
-    );
+    if (entry == nullptr || (entry->type != AssetType::Mesh && entry->type != AssetType::EncodedMesh)) {
+        Logger::error("No mesh named {} in asset pack.\n", name);
+        return failed;
+    }
 
-    if (!result) return false;
+    const auto staging = acquire_staging(entry->size);
+    if (!staging) return failed;
 
+    // Chunks are decompressed by the workers straight into mapped staging
+    // memory, there is no intermediate copy.
+    if (!pack.decompress(*entry, { staging->data, entry->size }, _jobs)) {
+        release_staging(*staging, 0);
+        return failed;
+    }
+
+    if (entry->type == AssetType::EncodedMesh) {
+        return submit_encoded_geometry(
+            *staging,
+            entry->size,
+            entry->vertex_count,
+            entry->index_count,
+            entry->vertex_stride
+        );
+    }
+
+    return submit_geometry(
+        *staging,
+        entry->size,
+        entry->vertex_count,
+        entry->index_count,
+        entry->vertex_stride,
+        0
+    );
+}
+
+auto Motorino::Engine::upload(
+    const EncodedGeometry& geometry
+) -> TimelineAwaitable {
+    const std::uint64_t size = geometry.words.size() * sizeof(std::uint32_t);
+
+    const auto staging = acquire_staging(size);
+    if (!staging) return TimelineAwaitable(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    std::memcpy(staging->data, geometry.words.data(), size);
+
+    return submit_encoded_geometry(
+        *staging,
+        size,
+        geometry.vertex_count,
+        geometry.index_count,
+        geometry.vertex_stride
+    );
+}
+
+auto Motorino::Engine::acquire_staging(
+    std::uint64_t size
+) -> std::optional<StagingBlock> {
+    if (const auto allocation = _staging_ring.allocate(size)) {
+        return StagingBlock{
+            .buffer = _staging_ring.buffer(),
+            .memory = VK_NULL_HANDLE,
+            .offset = allocation->offset,
+            .data = allocation->data,
+            .allocation = *allocation,
+        };
+    }
+
+    // Too large for the ring, or the ring is held by uploads still being
+    // written, fall back to a dedicated buffer.
+    StagingBlock block{ .offset = 0 };
+
+    bool result = create_buffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        block.buffer,
+        block.memory
+    );
+
+    if (!result) return std::nullopt;
+
+    void* data;
+    if (vkMapMemory(_device, block.memory, 0, size, 0, &data) != VK_SUCCESS) {
+        Logger::error("Failed to map staging buffer.\n");
+        vkDestroyBuffer(_device, block.buffer, nullptr);
+        vkFreeMemory(_device, block.memory, nullptr);
+        return std::nullopt;
+    }
+
+    block.data = static_cast<unsigned char*>(data);
+    return block;
+}
+
+auto Motorino::Engine::release_staging(
+    const StagingBlock& block,
+    std::uint64_t transfer_value
+) -> void {
+    if (block.memory == VK_NULL_HANDLE) {
+        _staging_ring.release(block.allocation, transfer_value);
+        return;
+    }
+
+    // Dedicated buffers are only released once the transfer completed.
+    vkDestroyBuffer(_device, block.buffer, nullptr);
+    vkFreeMemory(_device, block.memory, nullptr);
+}
+
+auto Motorino::Engine::submit_transfer(
+    const StagingBlock& staging,
+    VkBuffer destination,
+    std::uint64_t size,
+    std::uint64_t destination_offset
+) -> std::uint64_t {
     VkCommandBufferAllocateInfo alloc_info{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = _transfer_command_pool,
@@ -721,38 +1517,588 @@ auto Motorino::Engine::submit_vertex_data(
     };
 
     VkCommandBuffer cmd_buffer;
-    vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+    std::uint64_t transfer_value;
 
-    VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    {
+        // The transfer pool and queue are used from whichever thread uploads.
+        std::scoped_lock lock(_transfer_mutex);
+        vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+
+        VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkBeginCommandBuffer(cmd_buffer, &begin_info);
+
+        VkBufferCopy copy_region{
+            .srcOffset = staging.offset,
+            .dstOffset = destination_offset,
+            .size = size
+        };
+
+        vkCmdCopyBuffer(cmd_buffer, staging.buffer, destination, 1, &copy_region);
+        vkEndCommandBuffer(cmd_buffer);
+
+        transfer_value = ++_transfer_value;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &transfer_value,
+        };
+
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &_transfer_timeline,
+        };
+
+        if (vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit vertex data upload.\n");
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+            release_staging(staging, 0);
+            return 0;
+        }
+    }
+
+    const bool dedicated_staging = staging.memory != VK_NULL_HANDLE;
+
+    if (!dedicated_staging) {
+        release_staging(staging, transfer_value);
+    }
+
+    _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+        {
+            std::scoped_lock lock(_transfer_mutex);
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+        }
+
+        if (dedicated_staging) {
+            release_staging(staging, transfer_value);
+        }
+    });
+
+    return transfer_value;
+}
+
+auto Motorino::Engine::submit_chunked_transfer(
+    VkBuffer destination,
+    std::uint64_t size,
+    const std::function<bool(unsigned char* data, std::uint64_t offset, std::uint64_t size)>& fill
+) -> std::uint64_t {
+    std::uint64_t transfer_value = 0;
+
+    const auto fail = [&] {
+        // Transfers signal in submission order, the last piece submitted
+        // covers the ones before.
+        if (transfer_value != 0) {
+            TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value).wait();
+        }
+
+        return std::uint64_t{ 0 };
     };
 
-    vkBeginCommandBuffer(cmd_buffer, &begin_info);
+    for (std::uint64_t offset = 0; offset < size; offset += staging_chunk_size) {
+        const std::uint64_t piece = std::min(size - offset, staging_chunk_size);
+
+        const auto staging = acquire_staging(piece);
+        if (!staging) return fail();
+
+        if (!fill(staging->data, offset, piece)) {
+            release_staging(*staging, 0);
+            return fail();
+        }
+
+        const std::uint64_t value = submit_transfer(*staging, destination, piece, offset);
+        if (value == 0) return fail();
 
-    VkBufferCopy copy_region{
-        .size = size
+        transfer_value = value;
+    }
+
+    return transfer_value;
+}
+
+auto Motorino::Engine::submit_geometry(
+    const StagingBlock& staging,
+    std::uint64_t size,
+    std::uint32_t vertex_count,
+    std::uint32_t index_count,
+    std::uint32_t vertex_stride,
+    std::uint32_t position_stride
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (position_stride != 0 && position_stride >= vertex_stride) {
+        Logger::error("Position stream must leave room for the attributes in the vertex.\n");
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    if (!fits_pipeline(vertex_stride, position_stride)) {
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    // The indices are read right after the vertices, so both must lie in
+    // the buffer.
+    const std::uint64_t geometry_size = static_cast<VkDeviceSize>(vertex_count) * vertex_stride +
+                                        static_cast<VkDeviceSize>(index_count) * sizeof(std::uint16_t);
+
+    if (geometry_size > size) {
+        Logger::error("Geometry needs {} bytes, its buffer holds {}.\n", geometry_size, size);
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    VkBuffer vertex_buffer;
+    VkDeviceMemory vertex_buffer_memory;
+
+    bool result = create_buffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        vertex_buffer,
+        vertex_buffer_memory
+    );
+
+    if (!result) {
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    const std::uint64_t transfer_value = submit_transfer(staging, vertex_buffer, size);
+
+    if (transfer_value == 0) {
+        vkDestroyBuffer(_device, vertex_buffer, nullptr);
+        vkFreeMemory(_device, vertex_buffer_memory, nullptr);
+        return failed;
+    }
+
+    const auto dropped = std::make_shared<std::atomic<bool>>(false);
+
+    // Registered before anything can await the upload, so the new geometry
+    // is in place, or dropped, by the time an awaiting coroutine resumes.
+    _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+        if (!replace_geometry(vertex_buffer, vertex_buffer_memory, vertex_count, index_count, vertex_stride, position_stride)) {
+            dropped->store(true);
+        }
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value, dropped);
+}
+
+auto Motorino::Engine::submit_encoded_geometry(
+    const StagingBlock& staging,
+    std::uint64_t size,
+    std::uint32_t vertex_count,
+    std::uint32_t index_count,
+    std::uint32_t vertex_stride
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    // Decoded vertices are always interleaved.
+    if (!fits_pipeline(vertex_stride, 0)) {
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    const std::uint64_t decoded_size = (static_cast<std::uint64_t>(vertex_count) * vertex_stride +
+                                        index_count * sizeof(std::uint16_t) + 3) / 4 * 4;
+
+    VkBuffer encoded_buffer;
+    VkDeviceMemory encoded_buffer_memory;
+
+    bool result = create_buffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        encoded_buffer,
+        encoded_buffer_memory
+    );
+
+    if (!result) {
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    VkBuffer vertex_buffer;
+    VkDeviceMemory vertex_buffer_memory;
+
+    result = create_buffer(
+        decoded_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        vertex_buffer,
+        vertex_buffer_memory
+    );
+
+    if (!result) {
+        vkDestroyBuffer(_device, encoded_buffer, nullptr);
+        vkFreeMemory(_device, encoded_buffer_memory, nullptr);
+        release_staging(staging, 0);
+        return failed;
+    }
+
+    const auto destroy_buffers = [=, this] {
+        vkDestroyBuffer(_device, encoded_buffer, nullptr);
+        vkFreeMemory(_device, encoded_buffer_memory, nullptr);
+        vkDestroyBuffer(_device, vertex_buffer, nullptr);
+        vkFreeMemory(_device, vertex_buffer_memory, nullptr);
     };
 
-    vkCmdCopyBuffer(cmd_buffer, staging_buffer, _vertex_buffer, 1, &copy_region);
-    vkEndCommandBuffer(cmd_buffer);
+    const std::uint64_t transfer_value = submit_transfer(staging, encoded_buffer, size);
 
-    VkSubmitInfo submit_info{
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmd_buffer
+    if (transfer_value == 0) {
+        destroy_buffers();
+        return failed;
+    }
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_decode_pipeline.set_layout,
+    };
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _compute_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
     };
 
-    vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(_transfer_queue);
+    VkDescriptorSet descriptor_set;
+    VkCommandBuffer cmd_buffer;
+    std::uint64_t compute_value;
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+
+        // The copy may still be running, so failures hand the buffers to
+        // the waiter instead of destroying them here.
+        if (vkAllocateDescriptorSets(_device, &set_info, &descriptor_set) != VK_SUCCESS) {
+            Logger::error("Too many geometry decodes in flight.\n");
+            _waiter.add(_transfer_timeline, transfer_value, destroy_buffers);
+            return failed;
+        }
+
+        vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { encoded_buffer, 0, size },
+            { vertex_buffer, 0, decoded_size },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 0,
+            .descriptorCount = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+        VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkBeginCommandBuffer(cmd_buffer, &begin_info);
+        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _decode_pipeline.pipeline);
+
+        vkCmdBindDescriptorSets(
+            cmd_buffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            _decode_pipeline.layout,
+            0,
+            1,
+            &descriptor_set,
+            0,
+            nullptr
+        );
 
-    vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
-    vkDestroyBuffer(_device, staging_buffer, nullptr);
-    vkFreeMemory(_device, staging_buffer_memory, nullptr);
+        // Every invocation decodes one vertex and one pair of indices.
+        const std::uint32_t invocations = std::max(vertex_count, (index_count + 1) / 2);
+        vkCmdDispatch(cmd_buffer, (invocations + decode_group_size - 1) / decode_group_size, 1, 1);
+
+        VkBufferMemoryBarrier barrier{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = vertex_buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            0,
+            0,
+            nullptr,
+            1,
+            &barrier,
+            0,
+            nullptr
+        );
+
+        vkEndCommandBuffer(cmd_buffer);
+
+        compute_value = ++_compute_value;
+
+        constexpr VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &transfer_value,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &compute_value,
+        };
+
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &_transfer_timeline,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &_compute_timeline,
+        };
+
+        std::scoped_lock queue_lock(_graphics_queue_mutex);
+
+        if (vkQueueSubmit(_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit geometry decode.\n");
+            vkFreeCommandBuffers(_device, _compute_command_pool, 1, &cmd_buffer);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &descriptor_set);
+            _waiter.add(_transfer_timeline, transfer_value, destroy_buffers);
+            return failed;
+        }
+    }
+
+    const auto dropped = std::make_shared<std::atomic<bool>>(false);
+
+    _waiter.add(_compute_timeline, compute_value, [=, this] {
+        {
+            std::scoped_lock lock(_compute_mutex);
+            vkFreeCommandBuffers(_device, _compute_command_pool, 1, &cmd_buffer);
+            vkFreeDescriptorSets(_device, _descriptor_pool, 1, &descriptor_set);
+        }
+
+        vkDestroyBuffer(_device, encoded_buffer, nullptr);
+        vkFreeMemory(_device, encoded_buffer_memory, nullptr);
+
+        if (!replace_geometry(vertex_buffer, vertex_buffer_memory, vertex_count, index_count, vertex_stride, 0)) {
+            dropped->store(true);
+        }
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _compute_timeline, compute_value, dropped);
+}
+
+auto Motorino::Engine::replace_geometry(
+    VkBuffer buffer,
+    VkDeviceMemory memory,
+    std::uint32_t vertex_count,
+    std::uint32_t index_count,
+    std::uint32_t vertex_stride,
+    std::uint32_t position_stride
+) -> bool {
+    std::scoped_lock lock(_draw_mutex);
+
+    // The pipeline may have changed while the geometry was in transfer.
+    if (_pipeline != VK_NULL_HANDLE &&
+        !vertex_input_matches(_pipeline_binding_stride, _pipeline_attribute_stride, vertex_stride, position_stride)) {
+        Logger::error("Geometry vertex layout doesn't match the pipeline vertex input, geometry dropped.\n");
+        _retired_buffers.push_back({ buffer, memory, 0, 0 });
+        return false;
+    }
+
+    if (_vertex_buffer != VK_NULL_HANDLE) {
+        _retired_buffers.push_back({ _vertex_buffer, _vertex_buffer_memory, _frame_value.load(), _vertex_readback });
+    }
+
+    _vertex_readback = 0;
+
+    _vertex_buffer = buffer;
+    _vertex_buffer_memory = memory;
+    _vertex_count = vertex_count;
+    _index_count = index_count;
+    _vertex_stride = vertex_stride;
+    _position_stride = position_stride;
+
+    return true;
+}
+
+auto Motorino::Engine::fits_pipeline(
+    std::uint32_t vertex_stride,
+    std::uint32_t position_stride
+) -> bool {
+    std::scoped_lock lock(_draw_mutex);
+
+    if (_pipeline != VK_NULL_HANDLE &&
+        !vertex_input_matches(_pipeline_binding_stride, _pipeline_attribute_stride, vertex_stride, position_stride)) {
+        Logger::error("Geometry vertex layout doesn't match the pipeline vertex input, split vertices need a split or position only pipeline.\n");
+        return false;
+    }
 
     return true;
 }
 
+auto Motorino::Engine::next_frame() -> TimelineAwaitable {
+    return TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, _frame_value.load() + 1);
+}
+
+auto Motorino::Engine::release_retired_buffers() -> void {
+    std::uint64_t completed = 0;
+    std::uint64_t transferred = 0;
+    vkGetSemaphoreCounterValue(_device, _frame_timeline, &completed);
+    vkGetSemaphoreCounterValue(_device, _transfer_timeline, &transferred);
+
+    std::scoped_lock lock(_draw_mutex);
+
+    std::erase_if(_retired_buffers, [&](const RetiredBuffer& retired) {
+        if (retired.frame_value > completed || retired.transfer_value > transferred) return false;
+
+        vkDestroyBuffer(_device, retired.buffer, nullptr);
+        vkFreeMemory(_device, retired.memory, nullptr);
+        return true;
+    });
+}
+
+auto Motorino::Engine::set_material(Material material) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _material = material;
+}
+
+auto Motorino::Engine::flush_materials(
+    std::uint64_t frame_value
+) -> std::uint64_t {
+    if (!_materials.flush(_material_ranges, _material_bytes)) return 0;
+
+    const auto staging = acquire_staging(_material_bytes.size());
+
+    if (!staging) {
+        Logger::error("Failed to stage material updates.\n");
+        return 0;
+    }
+
+    std::memcpy(staging->data, _material_bytes.data(), _material_bytes.size());
+
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(_material_ranges.size());
+
+    std::uint64_t packed = 0;
+
+    for (const MaterialRange& range : _material_ranges) {
+        regions.push_back({
+            .srcOffset = staging->offset + packed,
+            .dstOffset = range.offset,
+            .size = range.size,
+        });
+
+        packed += range.size;
+    }
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _transfer_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer cmd_buffer;
+    std::uint64_t transfer_value;
+
+    {
+        std::scoped_lock lock(_transfer_mutex);
+        vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+
+        VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkBeginCommandBuffer(cmd_buffer, &begin_info);
+
+        vkCmdCopyBuffer(
+            cmd_buffer,
+            staging->buffer,
+            _material_buffer,
+            static_cast<std::uint32_t>(regions.size()),
+            regions.data()
+        );
+
+        vkEndCommandBuffer(cmd_buffer);
+
+        transfer_value = ++_transfer_value;
+
+        // Every frame submitted before this one may still read the old
+        // parameters.
+        const std::uint64_t previous_frame = frame_value - 1;
+        constexpr VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &previous_frame,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &transfer_value,
+        };
+
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &_frame_timeline,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &_transfer_timeline,
+        };
+
+        if (vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit material updates.\n");
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+            release_staging(*staging, 0);
+            return 0;
+        }
+    }
+
+    const StagingBlock block = *staging;
+    const bool dedicated_staging = block.memory != VK_NULL_HANDLE;
+
+    if (!dedicated_staging) {
+        release_staging(block, transfer_value);
+    }
+
+    _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+        {
+            std::scoped_lock lock(_transfer_mutex);
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+        }
+
+        if (dedicated_staging) {
+            release_staging(block, transfer_value);
+        }
+    });
+
+    return transfer_value;
+}
+
 auto Motorino::Engine::run() -> void {
     while (!glfwWindowShouldClose(_handle)) {
         glfwPollEvents();
@@ -791,6 +2137,13 @@ auto Motorino::Engine::create_swapchain() -> bool {
         *_indices.present
     };
 
+    // Frame capture samples the presented image from a compute shader.
+    _capture_supported = (surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT) != 0;
+
+    const VkImageUsageFlags image_usage = _capture_supported ?
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT :
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
     VkSwapchainCreateInfoKHR swapchain_info{
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = _surface,
@@ -799,7 +2152,7 @@ auto Motorino::Engine::create_swapchain() -> bool {
         .imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
         .imageExtent = surface_capabilities.currentExtent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = image_usage,
         .preTransform = surface_capabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = VK_PRESENT_MODE_MAILBOX_KHR,
@@ -868,12 +2221,78 @@ auto Motorino::Engine::create_image_views() -> bool {
 auto Motorino::Engine::create_framebuffers() -> bool {
     _framebuffers.resize(_images.size());
 
+    _id_images.resize(_images.size(), VK_NULL_HANDLE);
+    _id_image_memory.resize(_images.size(), VK_NULL_HANDLE);
+    _id_image_views.resize(_images.size(), VK_NULL_HANDLE);
+
     for (std::size_t i = 0; i < _image_views.size(); ++i) {
+        VkImageCreateInfo image_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = id_format,
+            .extent = { _width, _height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+
+        if (vkCreateImage(_device, &image_info, nullptr, &_id_images[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create object ID image.\n");
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(_device, _id_images[i], &requirements);
+
+        VkMemoryAllocateInfo allocate_info{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = requirements.size,
+        };
+
+        bool result = Motorino::find_memory_type(
+            _physical_device,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            allocate_info.memoryTypeIndex
+        );
+
+        if (!result || vkAllocateMemory(_device, &allocate_info, nullptr, &_id_image_memory[i]) != VK_SUCCESS) {
+            Logger::error("Failed to allocate object ID image memory.\n");
+            return false;
+        }
+
+        vkBindImageMemory(_device, _id_images[i], _id_image_memory[i], 0);
+
+        VkImageViewCreateInfo view_info{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = _id_images[i],
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = id_format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+
+        if (vkCreateImageView(_device, &view_info, nullptr, &_id_image_views[i]) != VK_SUCCESS) {
+            Logger::error("Failed to create object ID image view.\n");
+            return false;
+        }
+
+        const VkImageView attachments[] = { _image_views[i], _id_image_views[i] };
+
         VkFramebufferCreateInfo framebuffer_info{
             .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
             .renderPass = _render_pass,
-            .attachmentCount = 1,
-            .pAttachments = &_image_views[i],
+            .attachmentCount = 2,
+            .pAttachments = attachments,
             .width = _width,
             .height = _height,
             .layers = 1
@@ -898,6 +2317,16 @@ auto Motorino::Engine::cleanup_swapchain() -> void {
         vkDestroyImageView(_device, view, nullptr);
     }
 
+    for (std::size_t i = 0; i < _id_images.size(); ++i) {
+        vkDestroyImageView(_device, _id_image_views[i], nullptr);
+        vkDestroyImage(_device, _id_images[i], nullptr);
+        vkFreeMemory(_device, _id_image_memory[i], nullptr);
+    }
+
+    _id_images.clear();
+    _id_image_memory.clear();
+    _id_image_views.clear();
+
     vkDestroySwapchainKHR(_device, _swapchain, nullptr);
 }
 
@@ -918,6 +2347,10 @@ auto Motorino::Engine::recreate_swapchain() -> bool {
     create_swapchain();
     create_image_views();
     create_framebuffers();
+    resize_visibility();
+    resize_point_cloud();
+    resize_fog();
+    resize_cluster_mesh();
 
     return true;
 }
@@ -930,20 +2363,33 @@ auto Motorino::Engine::record_command_buffer(
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
     };
 
+    _capture_slot = std::nullopt;
+
     if (vkBeginCommandBuffer(_graphics_command_buffers[current_frame], &begin_info) != VK_SUCCESS) {
         Logger::error("Failed to begin recording command buffer.\n");
         return;
     }
 
-    VkClearValue clear_value = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+    _visibility_drawn = false;
+
+    record_scatter(_graphics_command_buffers[current_frame]);
+    record_point_cloud(_graphics_command_buffers[current_frame]);
+    record_fog(_graphics_command_buffers[current_frame]);
+    record_volume(_graphics_command_buffers[current_frame], current_frame);
+    record_ray_lighting(_graphics_command_buffers[current_frame]);
+    record_cluster_mesh(_graphics_command_buffers[current_frame], current_frame);
+
+    VkClearValue clear_values[2] = {};
+    clear_values[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+    clear_values[1].color.uint32[0] = 0;
 
     VkRenderPassBeginInfo pass_info{
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
         .renderPass = _render_pass,
         .framebuffer = _framebuffers[image_index],
         .renderArea = {.offset = {0,0}, .extent = {_width, _height}},
-        .clearValueCount = 1,
-        .pClearValues = &clear_value
+        .clearValueCount = 2,
+        .pClearValues = clear_values
     };
 
     vkCmdBeginRenderPass(
@@ -952,47 +2398,126 @@ auto Motorino::Engine::record_command_buffer(
         VK_SUBPASS_CONTENTS_INLINE
     );
 
-    vkCmdBindPipeline(
-        _graphics_command_buffers[current_frame],
-        VK_PIPELINE_BIND_POINT_GRAPHICS,
-        _pipeline
-    );
+    draw_visibility(_graphics_command_buffers[current_frame]);
+    draw_fog(_graphics_command_buffers[current_frame]);
+    draw_scatter(_graphics_command_buffers[current_frame]);
+    draw_impostors(_graphics_command_buffers[current_frame], current_frame);
+
+    // Pipelines and geometry may still be in flight when loading
+    // asynchronously, and a new pipeline may wait for geometry it reads.
+    const bool drawable = _pipeline != VK_NULL_HANDLE &&
+                          _vertex_buffer != VK_NULL_HANDLE &&
+                          vertex_input_matches(_pipeline_binding_stride, _pipeline_attribute_stride, _vertex_stride, _position_stride);
+
+    if (drawable) {
+        vkCmdBindPipeline(
+            _graphics_command_buffers[current_frame],
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            _pipeline
+        );
 
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(
-        _graphics_command_buffers[current_frame],
-        0,
-        1,
-        &_vertex_buffer,
-        offsets
-    );
+        vkCmdBindDescriptorSets(
+            _graphics_command_buffers[current_frame],
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            _pipeline_layout,
+            0,
+            1,
+            &_material_set,
+            0,
+            nullptr
+        );
 
-    vkCmdBindIndexBuffer(
-        _graphics_command_buffers[current_frame],
-        _vertex_buffer,
-        _vertex_count * sizeof(Vertex),
-        VK_INDEX_TYPE_UINT16
-    );
+        // Ray lighting results of the current scene, for pipelines that
+        // shade with them.
+        if (_ray_ready && _ray_shading_set != VK_NULL_HANDLE) {
+            vkCmdBindDescriptorSets(
+                _graphics_command_buffers[current_frame],
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                _pipeline_layout,
+                1,
+                1,
+                &_ray_shading_set,
+                0,
+                nullptr
+            );
+
+            _ray_set_used = true;
+        }
 
-    VkViewport viewport{
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = static_cast<float>(_width),
-        .height = static_cast<float>(_height),
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f,
-    };
-    vkCmdSetViewport(_graphics_command_buffers[current_frame], 0, 1, &viewport);
+        // IBL maps of the last load, for pipelines that shade with them.
+        if (_ibl_set != VK_NULL_HANDLE) {
+            vkCmdBindDescriptorSets(
+                _graphics_command_buffers[current_frame],
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                _pipeline_layout,
+                2,
+                1,
+                &_ibl_set,
+                0,
+                nullptr
+            );
+
+            _ibl_set_used = true;
+        }
 
-    VkRect2D scissor{
-        .offset = {0, 0},
-        .extent = {_width, _height}
-    };
-    vkCmdSetScissor(_graphics_command_buffers[current_frame], 0, 1, &scissor);
+        vkCmdPushConstants(
+            _graphics_command_buffers[current_frame],
+            _pipeline_layout,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof(Material),
+            &_material
+        );
+
+        // Split pipelines read the attribute stream of the split geometry
+        // as well, depth only ones the positions alone.
+        const VkBuffer buffers[] = { _vertex_buffer, _vertex_buffer };
+        const VkDeviceSize offsets[] = { 0, static_cast<VkDeviceSize>(_vertex_count) * _position_stride };
+
+        vkCmdBindVertexBuffers(
+            _graphics_command_buffers[current_frame],
+            0,
+            _pipeline_attribute_stride != 0 ? 2 : 1,
+            buffers,
+            offsets
+        );
+
+        vkCmdBindIndexBuffer(
+            _graphics_command_buffers[current_frame],
+            _vertex_buffer,
+            static_cast<VkDeviceSize>(_vertex_count) * _vertex_stride,
+            VK_INDEX_TYPE_UINT16
+        );
+
+        VkViewport viewport{
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(_width),
+            .height = static_cast<float>(_height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f,
+        };
+        vkCmdSetViewport(_graphics_command_buffers[current_frame], 0, 1, &viewport);
+
+        VkRect2D scissor{
+            .offset = {0, 0},
+            .extent = {_width, _height}
+        };
+        vkCmdSetScissor(_graphics_command_buffers[current_frame], 0, 1, &scissor);
+
+        vkCmdDrawIndexed(_graphics_command_buffers[current_frame], _index_count, 1, 0, 0, 0);
+    }
+
+    draw_volume(_graphics_command_buffers[current_frame], current_frame);
+    draw_polylines(_graphics_command_buffers[current_frame]);
 
-    vkCmdDrawIndexed(_graphics_command_buffers[current_frame], _index_count, 1, 0, 0, 0);
     vkCmdEndRenderPass(_graphics_command_buffers[current_frame]);
 
+    finish_volume(_graphics_command_buffers[current_frame], current_frame);
+
+    _capture_slot = record_capture(_graphics_command_buffers[current_frame], image_index);
+    record_picks(_graphics_command_buffers[current_frame], image_index);
+
     if (vkEndCommandBuffer(_graphics_command_buffers[current_frame]) != VK_SUCCESS) {
         Logger::error("Failed to finish recording command buffer.\n");
         return;
@@ -1000,12 +2525,10 @@ auto Motorino::Engine::record_command_buffer(
 }
 
 auto Motorino::Engine::draw_frame() -> void {
-    static std::uint32_t current_frame = 0;
-
     vkWaitForFences(
         _device,
         1,
-        &_inflight_fences[current_frame],
+        &_inflight_fences[_current_frame],
         VK_TRUE,
         UINT64_MAX
     );
@@ -1015,36 +2538,92 @@ auto Motorino::Engine::draw_frame() -> void {
         _device,
         _swapchain,
         UINT64_MAX,
-        _image_available_semaphores[current_frame],
+        _image_available_semaphores[_current_frame],
         VK_NULL_HANDLE,
         &image_index
     );
 
-    vkResetFences(_device, 1, &_inflight_fences[current_frame]);
-    vkResetCommandBuffer(_graphics_command_buffers[current_frame], 0);
-    record_command_buffer(current_frame, image_index);
+    release_retired_buffers();
+
+    vkResetFences(_device, 1, &_inflight_fences[_current_frame]);
+    vkResetCommandBuffer(_graphics_command_buffers[_current_frame], 0);
+
+    std::uint64_t frame_value;
+
+    {
+        // Reserving the frame value while recording lets uploads retire the
+        // buffers this frame reads against the right value.
+        std::scoped_lock lock(_draw_mutex);
+        frame_value = _frame_value.fetch_add(1) + 1;
+        record_command_buffer(_current_frame, image_index);
+
+        // Registered before stop_capture can wait for this frame.
+        if (_capture_slot) {
+            _waiter.add(_frame_timeline, frame_value, [this, slot = *_capture_slot] {
+                _encoder.submit(slot);
+            });
+        }
+
+        for (const std::uint32_t slot : _picks_recorded) {
+            _waiter.add(_frame_timeline, frame_value, [this, slot] {
+                resolve_pick(slot);
+            });
+        }
+
+        _picks_recorded.clear();
+    }
+
+    const std::uint64_t material_value = std::max(flush_materials(frame_value), _material_upload.load());
 
     constexpr VkPipelineStageFlags wait_stages[] = {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+    };
+
+    const VkSemaphore wait_semaphores[] = {
+        _image_available_semaphores[_current_frame],
+        _transfer_timeline
+    };
+
+    const std::uint64_t wait_values[] = { 0, material_value };
+    const std::uint32_t wait_count = material_value != 0 ? 2 : 1;
+
+    const VkSemaphore signal_semaphores[] = {
+        _render_finished_semaphores[_current_frame],
+        _frame_timeline
+    };
+
+    // The binary semaphore ignores its value.
+    const std::uint64_t signal_values[] = { 0, frame_value };
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = wait_count,
+        .pWaitSemaphoreValues = wait_values,
+        .signalSemaphoreValueCount = 2,
+        .pSignalSemaphoreValues = signal_values,
     };
 
     VkSubmitInfo submit_info{
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &_image_available_semaphores[current_frame],
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = wait_count,
+        .pWaitSemaphores = wait_semaphores,
         .pWaitDstStageMask = wait_stages,
         .commandBufferCount = 1,
-        .pCommandBuffers = &_graphics_command_buffers[current_frame],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &_render_finished_semaphores[current_frame]
+        .pCommandBuffers = &_graphics_command_buffers[_current_frame],
+        .signalSemaphoreCount = 2,
+        .pSignalSemaphores = signal_semaphores
     };
 
-    vkQueueSubmit(_graphics_queue, 1, &submit_info, _inflight_fences[current_frame]);
+    std::scoped_lock lock(_graphics_queue_mutex);
+
+    vkQueueSubmit(_graphics_queue, 1, &submit_info, _inflight_fences[_current_frame]);
 
     VkPresentInfoKHR present_info{
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &_render_finished_semaphores[current_frame],
+        .pWaitSemaphores = &_render_finished_semaphores[_current_frame],
         .swapchainCount = 1,
         .pSwapchains = &_swapchain,
         .pImageIndices = &image_index
@@ -1052,7 +2631,7 @@ auto Motorino::Engine::draw_frame() -> void {
 
     vkQueuePresentKHR(_present_queue, &present_info);
 
-    current_frame = (current_frame + 1) % max_frames_in_flight;
+    _current_frame = (_current_frame + 1) % max_frames_in_flight;
 }
 
 auto Motorino::Engine::create_buffer(
@@ -1061,51 +2640,19 @@ auto Motorino::Engine::create_buffer(
     std::uint32_t properties,
     VkBuffer& buffer,
     VkDeviceMemory& buffer_memory
-) -> bool{
-    std::uint32_t indices[] = { *_indices.graphics, *_indices.transfer };
-
-    VkBufferCreateInfo buffer_info{
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = size,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_CONCURRENT,
-        .queueFamilyIndexCount = 2,
-        .pQueueFamilyIndices = indices
-    };
-
-    if (vkCreateBuffer(_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
-        Logger::error("Failed to create buffer.\n");
-        return false;
-    }
-
-    Logger::info("Created buffer.\n");
-
-    VkMemoryRequirements mem_requirements;
-    vkGetBufferMemoryRequirements(_device, buffer, &mem_requirements);
+) -> bool {
+    // Written by the transfer queue and read by the graphics queue.
+    const std::uint32_t families[] = { *_indices.graphics, *_indices.transfer };
+    const std::span<const std::uint32_t> sharing(families, families[0] == families[1] ? 1 : 2);
 
-    std::uint32_t memory_index;
-    const auto result = find_memory_type(
+    return Motorino::create_buffer(
+        _device,
         _physical_device,
-        mem_requirements.memoryTypeBits,
+        sharing,
+        size,
+        usage,
         properties,
-        memory_index
+        buffer,
+        buffer_memory
     );
-
-    if (!result) return false;
-
-    VkMemoryAllocateInfo allocate_info{
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = mem_requirements.size,
-        .memoryTypeIndex = memory_index
-    };
-
-    if (vkAllocateMemory(_device, &allocate_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-        Logger::error("Failed to allocate buffer memory.\n");
-        return false;
-    }
-
-    vkBindBufferMemory(_device, buffer, buffer_memory, 0);
-    Logger::info("Allocated buffer memory.\n");
-
-    return true;
 }
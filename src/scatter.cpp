@@ -0,0 +1,591 @@
+#include "nkgt/frustum.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/scatter.hpp"
+#include "nkgt/triangle_mesh.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr std::uint32_t scatter_spv[] = {
+#include "scatter.comp.spv.h"
+};
+
+static constexpr std::uint32_t scatter_draw_vert_spv[] = {
+#include "scatter_draw.vert.spv.h"
+};
+
+static constexpr std::uint32_t scatter_draw_frag_spv[] = {
+#include "scatter_draw.frag.spv.h"
+};
+
+static constexpr Motorino::DescriptorType scatter_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+static constexpr Motorino::DescriptorType scatter_draw_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+namespace {
+
+// Mirrors the Data block of shaders/scatter.comp, followed by the texels.
+struct ScatterLayerData {
+    std::uint32_t candidates;
+    std::uint32_t first;
+    std::uint32_t capacity;
+    float radius;
+    float min_scale;
+    float max_scale;
+    float max_distance;
+    std::uint32_t padding;
+};
+
+struct ScatterData {
+    float origin[2];
+    float size[2];
+    float height_min;
+    float height_scale;
+    std::uint32_t tiles[2];
+    std::uint32_t map_width;
+    std::uint32_t map_height;
+    std::uint32_t layer_count;
+    std::uint32_t seed;
+    ScatterLayerData layers[Motorino::max_scatter_layers];
+};
+
+static_assert(sizeof(ScatterData) == 176);
+static_assert(sizeof(Motorino::ScatterCommand) == sizeof(VkDrawIndexedIndirectCommand));
+
+struct ScatterConstants {
+    float planes[6][4];
+    float position[3];
+    float padding;
+};
+
+// Mirrors the Vertices block of shaders/scatter_draw.vert.
+struct ScatterVertex {
+    float position[3];
+    std::uint32_t color;
+};
+
+static_assert(sizeof(ScatterVertex) == 16);
+
+auto unorm8(float value) -> std::uint32_t {
+    return static_cast<std::uint32_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Every index of the layer's range, offset by vertex_offset, names a vertex
+// of the mesh.
+auto layer_in_mesh(
+    const Motorino::ScatterLayer& layer,
+    const Motorino::TriangleMesh& mesh
+) -> bool {
+    if (static_cast<std::uint64_t>(layer.first_index) + layer.index_count > mesh.indices.size()) return false;
+
+    const auto vertex_count = static_cast<std::int64_t>(mesh.positions.size());
+
+    for (std::uint32_t i = 0; i < layer.index_count; ++i) {
+        const std::int64_t vertex = static_cast<std::int64_t>(mesh.indices[layer.first_index + i]) + layer.vertex_offset;
+        if (vertex < 0 || vertex >= vertex_count) return false;
+    }
+
+    return true;
+}
+
+}
+
+auto Motorino::Engine::create_scatter(const ScatterSettings& settings) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    if (_scatter_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Scatter pass already created.\n");
+        return failed;
+    }
+
+    const std::uint64_t texel_count = static_cast<std::uint64_t>(settings.map_width) * settings.map_height;
+
+    if (texel_count == 0 || settings.density.size() != texel_count || settings.heights.size() != texel_count) {
+        Logger::error("Scatter density and height maps must hold one value per texel.\n");
+        return failed;
+    }
+
+    if (settings.layer_count == 0 || settings.layer_count > max_scatter_layers ||
+        settings.tiles[0] == 0 || settings.tiles[1] == 0) {
+        Logger::error("Scatter needs 1 to {} layers over at least one tile.\n", max_scatter_layers);
+        return failed;
+    }
+
+    if (settings.mesh == nullptr) {
+        Logger::error("Scatter needs a mesh to draw its layers with.\n");
+        return failed;
+    }
+
+    TriangleMesh mesh;
+    if (!read_triangle_mesh(*settings.mesh, settings.position_offset, settings.color_offset, "Scatter mesh", mesh)) return failed;
+
+    ScatterData data{
+        .origin = { settings.origin[0], settings.origin[1] },
+        .size = { settings.size[0], settings.size[1] },
+        .height_min = settings.height_min,
+        .height_scale = settings.height_max - settings.height_min,
+        .tiles = { settings.tiles[0], settings.tiles[1] },
+        .map_width = settings.map_width,
+        .map_height = settings.map_height,
+        .layer_count = settings.layer_count,
+        .seed = settings.seed,
+        .layers = {},
+    };
+
+    std::uint32_t instance_count = 0;
+
+    for (std::uint32_t i = 0; i < settings.layer_count; ++i) {
+        const ScatterLayer& layer = settings.layers[i];
+
+        if (!layer_in_mesh(layer, mesh)) {
+            Logger::error("Indices of scatter layer {} lie outside the mesh.\n", i);
+            return failed;
+        }
+
+        data.layers[i] = {
+            .candidates = (layer.candidates_per_tile + scatter_group_size - 1) / scatter_group_size * scatter_group_size,
+            .first = instance_count,
+            .capacity = layer.capacity,
+            .radius = layer.radius,
+            .min_scale = layer.min_scale,
+            .max_scale = layer.max_scale,
+            .max_distance = layer.max_distance,
+            .padding = 0,
+        };
+
+        // Only instanceCount is written by the pass, the rest stays as
+        // uploaded here at every reset.
+        _scatter_commands_reset[i] = {
+            .index_count = layer.index_count,
+            .instance_count = 0,
+            .first_index = layer.first_index,
+            .vertex_offset = layer.vertex_offset,
+            .first_instance = instance_count,
+        };
+
+        instance_count += layer.capacity;
+    }
+
+    if (instance_count == 0) {
+        Logger::error("Scatter layers have no capacity.\n");
+        return failed;
+    }
+
+    bool result = create_compute_pipeline(
+        _device,
+        scatter_spv,
+        scatter_bindings,
+        sizeof(ScatterConstants),
+        _scatter_pipeline
+    ) && create_draw_pipeline(
+        _device,
+        _render_pass,
+        {
+            .vertex_code = scatter_draw_vert_spv,
+            .fragment_code = scatter_draw_frag_spv,
+            .bindings = scatter_draw_bindings,
+            .push_constant_size = sizeof(ScatterCamera::view_projection),
+        },
+        _scatter_draw_pipeline
+    );
+
+    if (!result) {
+        destroy_scatter();
+        return failed;
+    }
+
+    const std::uint64_t data_size = sizeof(ScatterData) + texel_count * 2 * sizeof(std::uint32_t);
+    const std::uint64_t commands_size = settings.layer_count * sizeof(ScatterCommand);
+    const std::uint64_t vertex_size = mesh.positions.size() * sizeof(ScatterVertex);
+    const std::uint64_t mesh_size = (vertex_size + mesh.indices.size() * sizeof(std::uint16_t) + 3) / 4 * 4;
+
+    result = create_buffer(
+        data_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _scatter_data,
+        _scatter_data_memory
+    ) && create_buffer(
+        static_cast<std::uint64_t>(instance_count) * sizeof(ScatterInstance),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _scatter_instances,
+        _scatter_instances_memory
+    ) && create_buffer(
+        commands_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _scatter_commands,
+        _scatter_commands_memory
+    ) && create_buffer(
+        mesh_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _scatter_mesh,
+        _scatter_mesh_memory
+    );
+
+    if (!result) {
+        destroy_scatter();
+        return failed;
+    }
+
+    const VkDescriptorSetLayout set_layouts[] = {
+        _scatter_pipeline.set_layout,
+        _scatter_draw_pipeline.set_layout,
+    };
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 2,
+        .pSetLayouts = set_layouts,
+    };
+
+    VkDescriptorSet sets[2];
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, sets) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate scatter descriptor sets.\n");
+        destroy_scatter();
+        return failed;
+    }
+
+    _scatter_set = sets[0];
+    _scatter_draw_set = sets[1];
+
+    const VkDescriptorBufferInfo buffer_infos[] = {
+        { .buffer = _scatter_data, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _scatter_instances, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _scatter_commands, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _scatter_instances, .offset = 0, .range = VK_WHOLE_SIZE },
+        { .buffer = _scatter_mesh, .offset = 0, .range = vertex_size },
+    };
+
+    VkWriteDescriptorSet writes[5];
+
+    for (std::uint32_t i = 0; i < 5; ++i) {
+        writes[i] = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = i < 3 ? _scatter_set : _scatter_draw_set,
+            .dstBinding = i < 3 ? i : i - 3,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &buffer_infos[i],
+        };
+    }
+
+    vkUpdateDescriptorSets(_device, 5, writes, 0, nullptr);
+
+    const auto staging = acquire_staging(data_size);
+
+    if (!staging) {
+        destroy_scatter();
+        return failed;
+    }
+
+    unsigned char* out = staging->data;
+    std::memcpy(out, &data, sizeof(data));
+    out += sizeof(data);
+    std::memcpy(out, settings.density.data(), texel_count * sizeof(std::uint32_t));
+    out += texel_count * sizeof(std::uint32_t);
+    std::memcpy(out, settings.heights.data(), texel_count * sizeof(float));
+
+    std::uint64_t transfer_value = submit_transfer(*staging, _scatter_data, data_size);
+
+    if (transfer_value == 0) {
+        destroy_scatter();
+        return failed;
+    }
+
+    // Set before the mesh goes up, so a failure below waits for the maps.
+    _scatter_upload = transfer_value;
+
+    const auto mesh_staging = acquire_staging(mesh_size);
+
+    if (!mesh_staging) {
+        destroy_scatter();
+        return failed;
+    }
+
+    auto* vertex = reinterpret_cast<ScatterVertex*>(mesh_staging->data);
+
+    for (std::size_t i = 0; i < mesh.positions.size(); ++i) {
+        const Vec3& color = mesh.colors[i];
+
+        vertex[i] = {
+            .position = { mesh.positions[i][0], mesh.positions[i][1], mesh.positions[i][2] },
+            .color = unorm8(color[0]) | unorm8(color[1]) << 8 | unorm8(color[2]) << 16 | 255u << 24,
+        };
+    }
+
+    std::memcpy(mesh_staging->data + vertex_size, mesh.indices.data(), mesh.indices.size() * sizeof(std::uint16_t));
+
+    // Transfers on the one queue signal in order, the mesh being up means
+    // the maps are as well.
+    transfer_value = submit_transfer(*mesh_staging, _scatter_mesh, mesh_size);
+
+    if (transfer_value == 0) {
+        destroy_scatter();
+        return failed;
+    }
+
+    _scatter_upload = transfer_value;
+    _scatter_index_offset = vertex_size;
+    _scatter_tiles[0] = settings.tiles[0];
+    _scatter_tiles[1] = settings.tiles[1];
+    _scatter_layer_count = settings.layer_count;
+
+    // Frames only start scattering once the maps are on the GPU.
+    _waiter.add(_transfer_timeline, transfer_value, [this] {
+        std::scoped_lock lock(_draw_mutex);
+        _scatter_ready = true;
+        _scatter_dirty = true;
+    });
+
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+}
+
+auto Motorino::Engine::set_scatter_camera(const ScatterCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+
+    if (std::memcmp(&camera, &_scatter_camera, sizeof(camera)) == 0) return;
+
+    _scatter_camera = camera;
+    _scatter_dirty = true;
+}
+
+auto Motorino::Engine::destroy_scatter() -> void {
+    std::uint64_t last_frame;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        _scatter_ready = false;
+        last_frame = _frame_value.load();
+    }
+
+    // The upload writes the data buffer and its callback flags the pass
+    // ready, both must be done before anything goes away.
+    if (_scatter_upload > 0) {
+        TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, _scatter_upload).wait();
+
+        std::scoped_lock lock(_draw_mutex);
+        _scatter_ready = false;
+    }
+
+    if (last_frame > 0 && _scatter_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_scatter_set != VK_NULL_HANDLE) {
+        const VkDescriptorSet sets[] = { _scatter_set, _scatter_draw_set };
+
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 2, sets);
+        _scatter_set = VK_NULL_HANDLE;
+        _scatter_draw_set = VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(_device, _scatter_data, nullptr);
+    vkFreeMemory(_device, _scatter_data_memory, nullptr);
+    vkDestroyBuffer(_device, _scatter_instances, nullptr);
+    vkFreeMemory(_device, _scatter_instances_memory, nullptr);
+    vkDestroyBuffer(_device, _scatter_commands, nullptr);
+    vkFreeMemory(_device, _scatter_commands_memory, nullptr);
+    vkDestroyBuffer(_device, _scatter_mesh, nullptr);
+    vkFreeMemory(_device, _scatter_mesh_memory, nullptr);
+
+    _scatter_data = VK_NULL_HANDLE;
+    _scatter_data_memory = VK_NULL_HANDLE;
+    _scatter_instances = VK_NULL_HANDLE;
+    _scatter_instances_memory = VK_NULL_HANDLE;
+    _scatter_commands = VK_NULL_HANDLE;
+    _scatter_commands_memory = VK_NULL_HANDLE;
+    _scatter_mesh = VK_NULL_HANDLE;
+    _scatter_mesh_memory = VK_NULL_HANDLE;
+    _scatter_index_offset = 0;
+    _scatter_upload = 0;
+    _scatter_layer_count = 0;
+
+    destroy_compute_pipeline(_device, _scatter_pipeline);
+    destroy_draw_pipeline(_device, _scatter_draw_pipeline);
+}
+
+auto Motorino::Engine::record_scatter(VkCommandBuffer cmd_buffer) -> void {
+    if (!_scatter_ready || !_scatter_dirty) return;
+
+    _scatter_dirty = false;
+
+    // Earlier frames on this queue may still draw the previous instances.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        0, nullptr
+    );
+
+    vkCmdUpdateBuffer(
+        cmd_buffer,
+        _scatter_commands,
+        0,
+        _scatter_layer_count * sizeof(ScatterCommand),
+        _scatter_commands_reset
+    );
+
+    VkBufferMemoryBarrier to_compute{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _scatter_commands,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &to_compute,
+        0, nullptr
+    );
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _scatter_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        _scatter_pipeline.layout,
+        0,
+        1,
+        &_scatter_set,
+        0,
+        nullptr
+    );
+
+    ScatterConstants constants{
+        .position = {
+            _scatter_camera.position[0],
+            _scatter_camera.position[1],
+            _scatter_camera.position[2],
+        },
+        .padding = 0.0f,
+    };
+
+    frustum_planes(_scatter_camera.view_projection, constants.planes);
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _scatter_pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    vkCmdDispatch(cmd_buffer, _scatter_tiles[0], _scatter_tiles[1], _scatter_layer_count);
+
+    const VkBufferMemoryBarrier to_draw[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = _scatter_instances,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = _scatter_commands,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
+        },
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        0,
+        0, nullptr,
+        2, to_draw,
+        0, nullptr
+    );
+}
+
+auto Motorino::Engine::draw_scatter(VkCommandBuffer cmd_buffer) -> void {
+    // Ready frames dispatched the pass in record_scatter at least once, so
+    // the commands hold the counts of the last camera.
+    if (!_scatter_ready) return;
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _scatter_draw_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _scatter_draw_pipeline.layout,
+        0,
+        1,
+        &_scatter_draw_set,
+        0,
+        nullptr
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _scatter_draw_pipeline.layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(_scatter_camera.view_projection),
+        _scatter_camera.view_projection
+    );
+
+    vkCmdBindIndexBuffer(cmd_buffer, _scatter_mesh, _scatter_index_offset, VK_INDEX_TYPE_UINT16);
+
+    // One draw per layer, the device is created without multiDrawIndirect.
+    for (std::uint32_t i = 0; i < _scatter_layer_count; ++i) {
+        vkCmdDrawIndexedIndirect(cmd_buffer, _scatter_commands, i * sizeof(ScatterCommand), 1, sizeof(ScatterCommand));
+    }
+}
@@ -0,0 +1,336 @@
+#include "nkgt/shader_compiler.hpp"
+#include "nkgt/hash.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+
+#ifdef MOTORINO_RUNTIME_SHADERS
+#include <shaderc/shaderc.h>
+#endif
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+
+static auto read_file(
+    const std::filesystem::path& path
+) -> std::optional<std::string> {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return std::nullopt;
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return std::move(contents).str();
+}
+
+static auto to_spirv(
+    const std::string& bytes
+) -> std::optional<Motorino::SpirV> {
+    if (bytes.empty() || bytes.size() % sizeof(std::uint32_t) != 0) {
+        return std::nullopt;
+    }
+
+    Motorino::SpirV code(bytes.size() / sizeof(std::uint32_t));
+    std::memcpy(code.data(), bytes.data(), bytes.size());
+    return code;
+}
+
+static auto is_binary(
+    const std::filesystem::path& path
+) -> bool {
+    return path.extension() == ".spv";
+}
+
+// Returns the name between the quotes or angle brackets of an include
+// directive, or an empty view if line is not one.
+static auto include_name(
+    std::string_view line
+) -> std::string_view {
+    const auto first = line.find_first_not_of(" \t");
+    if (first == std::string_view::npos) return {};
+
+    line.remove_prefix(first);
+    if (!line.starts_with("#include")) return {};
+
+    const auto open = line.find_first_of("\"<");
+    if (open == std::string_view::npos) return {};
+
+    const auto close = line.find_first_of("\">", open + 1);
+    if (close == std::string_view::npos) return {};
+
+    return line.substr(open + 1, close - open - 1);
+}
+
+// Includes resolve relative to the including file, which matches what the
+// shaderc include callbacks below do.
+static auto hash_sources(
+    const std::filesystem::path& path,
+    const std::string& source,
+    std::uint64_t seed,
+    std::unordered_set<std::string>& visited
+) -> std::uint64_t {
+    seed = Motorino::Hash::string(source, seed);
+
+    std::istringstream lines(source);
+    std::string line;
+
+    while (std::getline(lines, line)) {
+        const auto name = include_name(line);
+        if (name.empty()) continue;
+
+        const auto include_path = (path.parent_path() / name).lexically_normal();
+        if (!visited.insert(include_path.string()).second) continue;
+
+        seed = Motorino::Hash::string(include_path.generic_string(), seed);
+
+        if (const auto include = read_file(include_path)) {
+            seed = hash_sources(include_path, *include, seed, visited);
+        }
+    }
+
+    return seed;
+}
+
+#ifdef MOTORINO_RUNTIME_SHADERS
+struct IncludeResult {
+    std::string name;
+    std::string content;
+    shaderc_include_result result;
+};
+
+static auto resolve_include(
+    void*,
+    const char* requested_source,
+    int,
+    const char* requesting_source,
+    std::size_t
+) -> shaderc_include_result* {
+    auto* include = new IncludeResult;
+    const auto path = std::filesystem::path(requesting_source).parent_path() / requested_source;
+
+    if (auto content = read_file(path)) {
+        include->name = path.lexically_normal().string();
+        include->content = std::move(*content);
+    }
+    else {
+        // An empty name tells shaderc the include failed; content is the error.
+        include->content = "Failed to open " + path.string();
+    }
+
+    include->result = {
+        .source_name = include->name.data(),
+        .source_name_length = include->name.size(),
+        .content = include->content.data(),
+        .content_length = include->content.size(),
+        .user_data = include,
+    };
+
+    return &include->result;
+}
+
+static auto release_include(
+    void*,
+    shaderc_include_result* result
+) -> void {
+    delete static_cast<IncludeResult*>(result->user_data);
+}
+
+static auto shader_kind(Motorino::ShaderStage stage) -> shaderc_shader_kind {
+    switch (stage) {
+    case Motorino::ShaderStage::Vertex:   return shaderc_vertex_shader;
+    case Motorino::ShaderStage::Fragment: return shaderc_fragment_shader;
+    }
+
+    return shaderc_glsl_infer_from_source;
+}
+#endif
+
+Motorino::ShaderCompiler::ShaderCompiler(
+    JobSystem& jobs,
+    std::filesystem::path cache_directory
+) : _jobs{ jobs },
+    _cache_directory{ std::move(cache_directory) },
+    _compiler_version{ 0 },
+    _compiler{ nullptr }
+{
+#ifdef MOTORINO_RUNTIME_SHADERS
+    _compiler = shaderc_compiler_initialize();
+
+    // shaderc_get_spv_version only gives the SPIR-V version it emits, a
+    // compiler update producing different code keeps it. The build passes
+    // the shaderc version and commit string instead.
+    _compiler_version = Hash::string(MOTORINO_SHADERC_VERSION);
+
+    std::error_code error;
+    std::filesystem::create_directories(_cache_directory, error);
+
+    if (error) {
+        Logger::warn("Failed to create shader cache directory {}.\n", _cache_directory.string());
+    }
+#endif
+}
+
+Motorino::ShaderCompiler::~ShaderCompiler() {
+#ifdef MOTORINO_RUNTIME_SHADERS
+    shaderc_compiler_release(_compiler);
+#endif
+}
+
+auto Motorino::ShaderCompiler::load(
+    const ShaderInfo& shader
+) -> std::optional<SpirV> {
+    const std::filesystem::path path(shader.path);
+    const auto contents = read_file(path);
+
+    if (!contents) {
+        Logger::error("Failed to read shader file. Path: {}\n", shader.path);
+        return std::nullopt;
+    }
+
+    if (is_binary(path)) {
+        auto code = to_spirv(*contents);
+
+        if (!code) {
+            Logger::error("Invalid SPIR-V binary. Path: {}\n", shader.path);
+        }
+
+        Logger::info("Read {}B from {}.\n", contents->size(), shader.path);
+        return code;
+    }
+
+    std::uint64_t key = Hash::integer(_compiler_version);
+    key = Hash::integer(static_cast<std::uint64_t>(shader.type), key);
+    key = Hash::string(path.extension().string(), key);
+
+    for (const auto& define : shader.defines) {
+        key = Hash::string(define.name, key);
+        key = Hash::string(define.value, key);
+    }
+
+    std::unordered_set<std::string> visited;
+    key = hash_sources(path, *contents, key, visited);
+
+    const auto cache_path = _cache_directory / fmt::format("{:016x}.spv", key);
+
+    if (const auto cached = read_file(cache_path)) {
+        if (auto code = to_spirv(*cached)) {
+            Logger::info("Loaded {} from shader cache ({:016x}).\n", shader.path, key);
+            return code;
+        }
+    }
+
+    auto code = compile(shader, path, key);
+    if (!code) return std::nullopt;
+
+    // Written under a unique name and renamed, so concurrent compiles of the
+    // same permutation never leave a partially written file behind.
+    const auto thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    const auto temp_path = _cache_directory / fmt::format("{:016x}.{:x}.tmp", key, thread_id);
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(code->data()), code->size() * sizeof(std::uint32_t));
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+
+    if (error) {
+        Logger::warn("Failed to store {} in the shader cache.\n", shader.path);
+        std::filesystem::remove(temp_path, error);
+    }
+
+    return code;
+}
+
+auto Motorino::ShaderCompiler::load_all(
+    std::span<const ShaderInfo> shaders
+) -> std::vector<std::optional<SpirV>> {
+    std::vector<std::optional<SpirV>> results(shaders.size());
+
+    _jobs.parallel_for(
+        static_cast<std::uint32_t>(shaders.size()),
+        1,
+        [&](std::uint32_t begin, std::uint32_t end) {
+            for (std::uint32_t i = begin; i < end; ++i) {
+                results[i] = load(shaders[i]);
+            }
+        }
+    );
+
+    return results;
+}
+
+auto Motorino::ShaderCompiler::load_async(
+    ShaderInfo shader
+) -> Task<std::optional<SpirV>> {
+    co_await _jobs.schedule();
+    co_return load(shader);
+}
+
+auto Motorino::ShaderCompiler::compile(
+    const ShaderInfo& shader,
+    const std::filesystem::path& source_path,
+    std::uint64_t key
+) -> std::optional<SpirV> {
+#ifdef MOTORINO_RUNTIME_SHADERS
+    const auto source = read_file(source_path);
+    if (!source) return std::nullopt;
+
+    shaderc_compile_options_t options = shaderc_compile_options_initialize();
+
+    shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+    shaderc_compile_options_set_optimization_level(options, shaderc_optimization_level_performance);
+    shaderc_compile_options_set_include_callbacks(options, resolve_include, release_include, nullptr);
+
+    if (source_path.extension() == ".hlsl") {
+        shaderc_compile_options_set_source_language(options, shaderc_source_language_hlsl);
+    }
+
+    for (const auto& define : shader.defines) {
+        shaderc_compile_options_add_macro_definition(
+            options,
+            define.name,
+            std::strlen(define.name),
+            define.value,
+            std::strlen(define.value)
+        );
+    }
+
+    const auto name = source_path.string();
+
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(
+        _compiler,
+        source->data(),
+        source->size(),
+        shader_kind(shader.type),
+        name.c_str(),
+        "main",
+        options
+    );
+
+    std::optional<SpirV> code;
+
+    if (shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success) {
+        code = to_spirv(std::string(shaderc_result_get_bytes(result), shaderc_result_get_length(result)));
+        Logger::info("Compiled {} ({:016x}).\n", shader.path, key);
+    }
+    else {
+        Logger::error("Failed to compile {}:\n{}", shader.path, shaderc_result_get_error_message(result));
+    }
+
+    shaderc_result_release(result);
+    shaderc_compile_options_release(options);
+
+    return code;
+#else
+    static_cast<void>(source_path);
+    static_cast<void>(key);
+
+    Logger::error("Runtime shader compilation is disabled. Skipping {}.\n", shader.path);
+    return std::nullopt;
+#endif
+}
@@ -0,0 +1,506 @@
+#include "nkgt/snapshot.hpp"
+#include "nkgt/ecs.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/mapped_file.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+static_assert(sizeof(Motorino::SnapshotHeader) == 16);
+static_assert(sizeof(Motorino::SnapshotEntry) == 24);
+static_assert(sizeof(Motorino::SnapshotGeometry) == 32);
+
+// Checks everything replace_geometry and the draw trust, so a broken file
+// can't make a draw read past the buffer or push a material that isn't
+// there.
+static auto validate_snapshot_geometry(
+    const Motorino::SnapshotGeometry& geometry,
+    std::span<const unsigned char> section,
+    const Motorino::MaterialSystem& materials
+) -> bool {
+    using namespace Motorino;
+
+    if (geometry.material != null_material && !materials.contains(geometry.material)) return false;
+
+    if (geometry.size == 0) return true;
+
+    if (section.size() < sizeof(geometry) || geometry.size > section.size() - sizeof(geometry)) return false;
+
+    if (geometry.vertex_stride == 0 || geometry.vertex_stride % 4 != 0) return false;
+
+    if (geometry.position_stride != 0 && geometry.position_stride >= geometry.vertex_stride) return false;
+
+    const std::uint64_t used =
+        static_cast<std::uint64_t>(geometry.vertex_count) * geometry.vertex_stride +
+        static_cast<std::uint64_t>(geometry.index_count) * sizeof(std::uint16_t);
+
+    return used <= geometry.size;
+}
+
+auto Motorino::Engine::save_snapshot(
+    const char* path,
+    const World* world
+) -> bool {
+    SnapshotGeometry geometry_header;
+    std::optional<Readback> vertices;
+
+    {
+        // Only the state and the copy out of the vertex buffer are taken
+        // under the lock. Retiring the buffer waits for the copy, so the
+        // wait and the file I/O below don't hold up frames or uploads.
+        std::scoped_lock lock(_draw_mutex);
+
+        geometry_header = {
+            .vertex_count = _vertex_count,
+            .index_count = _index_count,
+            .vertex_stride = _vertex_stride,
+            .position_stride = _position_stride,
+            .material = _material,
+            .reserved = 0,
+            .size = static_cast<std::uint64_t>(_vertex_count) * _vertex_stride +
+                    _index_count * sizeof(std::uint16_t),
+        };
+
+        if (_vertex_buffer != VK_NULL_HANDLE && geometry_header.size > 0) {
+            vertices = submit_readback(_vertex_buffer, geometry_header.size);
+            if (!vertices) return false;
+
+            _vertex_readback = vertices->transfer_value;
+        }
+    }
+
+    std::vector<unsigned char> geometry(sizeof(geometry_header));
+    std::memcpy(geometry.data(), &geometry_header, sizeof(geometry_header));
+
+    if (vertices) {
+        std::vector<unsigned char> data;
+        if (!finish_readback(*vertices, data)) return false;
+
+        geometry.insert(geometry.end(), data.begin(), data.end());
+    }
+
+    std::vector<unsigned char> materials;
+    _materials.serialize(materials);
+
+    std::vector<unsigned char> entities;
+    if (world != nullptr) world->serialize(entities);
+
+    struct Section {
+        SnapshotSection type;
+        const std::vector<unsigned char>* data;
+    };
+
+    std::vector<Section> sections = {
+        { SnapshotSection::Geometry, &geometry },
+        { SnapshotSection::Materials, &materials },
+    };
+
+    if (world != nullptr) sections.push_back({ SnapshotSection::World, &entities });
+
+    const auto align = [](std::uint64_t offset) {
+        return (offset + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+    };
+
+    const SnapshotHeader header{
+        .magic = snapshot_magic,
+        .version = snapshot_version,
+        .section_count = static_cast<std::uint32_t>(sections.size()),
+    };
+
+    std::vector<SnapshotEntry> entries;
+    std::uint64_t offset = align(sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotEntry));
+
+    for (const Section& section : sections) {
+        entries.push_back({ .type = section.type, .offset = offset, .size = section.data->size() });
+        offset = align(offset + section.data->size());
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    if (!file) {
+        Logger::error("Failed to create snapshot. Path: {}\n", path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SnapshotEntry));
+
+    const char padding[snapshot_alignment] = {};
+    std::uint64_t written = sizeof(header) + entries.size() * sizeof(SnapshotEntry);
+
+    for (std::size_t i = 0; i < sections.size(); ++i) {
+        file.write(padding, entries[i].offset - written);
+        file.write(reinterpret_cast<const char*>(sections[i].data->data()), sections[i].data->size());
+        written = entries[i].offset + sections[i].data->size();
+    }
+
+    if (!file) {
+        Logger::error("Failed to write snapshot. Path: {}\n", path);
+        return false;
+    }
+
+    Logger::info("Wrote snapshot {} ({}B).\n", path, offset);
+    return true;
+}
+
+auto Motorino::Engine::load_snapshot(
+    const char* path,
+    World* world
+) -> TimelineAwaitable {
+    const TimelineAwaitable failed(&_waiter, &_jobs, VK_NULL_HANDLE, 0);
+
+    MappedFile file;
+    if (!file.open(path)) return failed;
+
+    const auto data = file.data();
+
+    SnapshotHeader header;
+
+    if (data.size() < sizeof(header)) {
+        Logger::error("Snapshot too small. Path: {}\n", path);
+        return failed;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.magic != snapshot_magic ||
+        header.version != snapshot_version ||
+        sizeof(header) + header.section_count * sizeof(SnapshotEntry) > data.size()) {
+        Logger::error("Unsupported snapshot format. Path: {}\n", path);
+        return failed;
+    }
+
+    std::span<const unsigned char> sections[3];
+
+    for (std::uint32_t i = 0; i < header.section_count; ++i) {
+        SnapshotEntry entry;
+        std::memcpy(&entry, data.data() + sizeof(header) + i * sizeof(SnapshotEntry), sizeof(entry));
+
+        const auto type = static_cast<std::uint32_t>(entry.type);
+
+        if (type >= std::size(sections) || entry.offset > data.size() || entry.size > data.size() - entry.offset) {
+            Logger::error("Corrupt snapshot section table. Path: {}\n", path);
+            return failed;
+        }
+
+        sections[type] = data.subspan(entry.offset, entry.size);
+    }
+
+    const auto geometry_section = sections[static_cast<std::uint32_t>(SnapshotSection::Geometry)];
+    const auto material_section = sections[static_cast<std::uint32_t>(SnapshotSection::Materials)];
+    const auto world_section = sections[static_cast<std::uint32_t>(SnapshotSection::World)];
+
+    SnapshotGeometry geometry{};
+
+    if (geometry_section.size() >= sizeof(geometry)) {
+        std::memcpy(&geometry, geometry_section.data(), sizeof(geometry));
+    }
+
+    // Sections are loaded aside and only swapped in once the upload was
+    // submitted, a failure leaves the world and materials as they were.
+    const bool load_world = world != nullptr && !world_section.empty();
+    const bool load_materials = !material_section.empty();
+
+    World loaded_world;
+    MaterialSystem loaded_materials(_materials.capacity());
+
+    if (load_world && !loaded_world.deserialize(world_section)) {
+        return failed;
+    }
+
+    std::vector<MaterialRange> material_ranges;
+    std::vector<unsigned char> material_bytes;
+
+    if (load_materials) {
+        if (!loaded_materials.deserialize(material_section)) return failed;
+        loaded_materials.flush(material_ranges, material_bytes);
+    }
+
+    // The geometry names a material of the snapshot if it has them, of the
+    // engine otherwise.
+    if (!validate_snapshot_geometry(geometry, geometry_section, load_materials ? loaded_materials : _materials)) {
+        Logger::error("Corrupt snapshot geometry. Path: {}\n", path);
+        return failed;
+    }
+
+    const auto commit = [&] {
+        if (load_world) world->swap(loaded_world);
+        if (load_materials) _materials.swap(loaded_materials);
+    };
+
+    const std::uint64_t staging_size = geometry.size + material_bytes.size();
+
+    if (staging_size == 0) {
+        Logger::info("Loaded empty snapshot {}.\n", path);
+        commit();
+        set_material(geometry.material);
+        return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, 0);
+    }
+
+    const auto staging = acquire_staging(staging_size);
+    if (!staging) return failed;
+
+    std::memcpy(staging->data, geometry_section.data() + sizeof(geometry), geometry.size);
+    std::memcpy(staging->data + geometry.size, material_bytes.data(), material_bytes.size());
+
+    VkBuffer vertex_buffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertex_buffer_memory = VK_NULL_HANDLE;
+
+    if (geometry.size > 0) {
+        bool result = create_buffer(
+            geometry.size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            vertex_buffer,
+            vertex_buffer_memory
+        );
+
+        if (!result) {
+            release_staging(*staging, 0);
+            return failed;
+        }
+    }
+
+    std::vector<VkBufferCopy> material_regions;
+    std::uint64_t packed = geometry.size;
+
+    for (const MaterialRange& range : material_ranges) {
+        material_regions.push_back({
+            .srcOffset = staging->offset + packed,
+            .dstOffset = range.offset,
+            .size = range.size,
+        });
+
+        packed += range.size;
+    }
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _transfer_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer cmd_buffer;
+    std::uint64_t transfer_value;
+
+    {
+        std::scoped_lock lock(_transfer_mutex);
+        vkAllocateCommandBuffers(_device, &alloc_info, &cmd_buffer);
+
+        VkCommandBufferBeginInfo begin_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+
+        vkBeginCommandBuffer(cmd_buffer, &begin_info);
+
+        if (vertex_buffer != VK_NULL_HANDLE) {
+            VkBufferCopy geometry_region{
+                .srcOffset = staging->offset,
+                .size = geometry.size,
+            };
+
+            vkCmdCopyBuffer(cmd_buffer, staging->buffer, vertex_buffer, 1, &geometry_region);
+        }
+
+        if (!material_regions.empty()) {
+            vkCmdCopyBuffer(
+                cmd_buffer,
+                staging->buffer,
+                _material_buffer,
+                static_cast<std::uint32_t>(material_regions.size()),
+                material_regions.data()
+            );
+        }
+
+        vkEndCommandBuffer(cmd_buffer);
+
+        transfer_value = ++_transfer_value;
+
+        // Frames already submitted may still read the old materials.
+        const std::uint64_t last_frame = _frame_value.load();
+        constexpr VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info{
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &last_frame,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &transfer_value,
+        };
+
+        VkSubmitInfo submit_info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &_frame_timeline,
+            .pWaitDstStageMask = &wait_stage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmd_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &_transfer_timeline,
+        };
+
+        if (vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            Logger::error("Failed to submit snapshot upload.\n");
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+            release_staging(*staging, 0);
+            vkDestroyBuffer(_device, vertex_buffer, nullptr);
+            vkFreeMemory(_device, vertex_buffer_memory, nullptr);
+            return failed;
+        }
+
+        if (!material_regions.empty()) _material_upload = transfer_value;
+    }
+
+    commit();
+
+    const StagingBlock block = *staging;
+    const bool dedicated_staging = block.memory != VK_NULL_HANDLE;
+
+    if (!dedicated_staging) {
+        release_staging(block, transfer_value);
+    }
+
+    const auto dropped = std::make_shared<std::atomic<bool>>(false);
+
+    _waiter.add(_transfer_timeline, transfer_value, [=, this] {
+        {
+            std::scoped_lock lock(_transfer_mutex);
+            vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &cmd_buffer);
+        }
+
+        if (dedicated_staging) {
+            release_staging(block, transfer_value);
+        }
+
+        if (vertex_buffer != VK_NULL_HANDLE) {
+            const bool replaced = replace_geometry(
+                vertex_buffer,
+                vertex_buffer_memory,
+                geometry.vertex_count,
+                geometry.index_count,
+                geometry.vertex_stride,
+                geometry.position_stride
+            );
+
+            if (!replaced) dropped->store(true);
+        }
+
+        set_material(geometry.material);
+    });
+
+    Logger::info("Loaded snapshot {} ({}B to upload).\n", path, staging_size);
+    return TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value, dropped);
+}
+
+auto Motorino::Engine::submit_readback(
+    VkBuffer buffer,
+    std::uint64_t size
+) -> std::optional<Readback> {
+    Readback readback{ .size = size };
+
+    bool result = create_buffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        readback.buffer,
+        readback.memory
+    );
+
+    if (!result) return std::nullopt;
+
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = _transfer_command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+
+    std::scoped_lock lock(_transfer_mutex);
+    vkAllocateCommandBuffers(_device, &alloc_info, &readback.cmd_buffer);
+
+    VkCommandBufferBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    vkBeginCommandBuffer(readback.cmd_buffer, &begin_info);
+
+    VkBufferCopy region{
+        .size = size,
+    };
+
+    vkCmdCopyBuffer(readback.cmd_buffer, buffer, readback.buffer, 1, &region);
+    vkEndCommandBuffer(readback.cmd_buffer);
+
+    readback.transfer_value = ++_transfer_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &readback.transfer_value,
+    };
+
+    VkSubmitInfo submit_info{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &readback.cmd_buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &_transfer_timeline,
+    };
+
+    if (vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+        Logger::error("Failed to submit buffer readback.\n");
+        vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &readback.cmd_buffer);
+        vkDestroyBuffer(_device, readback.buffer, nullptr);
+        vkFreeMemory(_device, readback.memory, nullptr);
+        return std::nullopt;
+    }
+
+    return readback;
+}
+
+auto Motorino::Engine::finish_readback(
+    const Readback& readback,
+    std::vector<unsigned char>& out
+) -> bool {
+    VkSemaphoreWaitInfo wait_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &_transfer_timeline,
+        .pValues = &readback.transfer_value,
+    };
+
+    vkWaitSemaphores(_device, &wait_info, UINT64_MAX);
+
+    {
+        std::scoped_lock lock(_transfer_mutex);
+        vkFreeCommandBuffers(_device, _transfer_command_pool, 1, &readback.cmd_buffer);
+    }
+
+    const auto destroy_readback = [&] {
+        vkDestroyBuffer(_device, readback.buffer, nullptr);
+        vkFreeMemory(_device, readback.memory, nullptr);
+    };
+
+    void* data;
+    if (vkMapMemory(_device, readback.memory, 0, readback.size, 0, &data) != VK_SUCCESS) {
+        Logger::error("Failed to map readback buffer.\n");
+        destroy_readback();
+        return false;
+    }
+
+    out.assign(static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + readback.size);
+    vkUnmapMemory(_device, readback.memory);
+    destroy_readback();
+
+    return true;
+}
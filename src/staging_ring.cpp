@@ -0,0 +1,157 @@
+#include "nkgt/staging_ring.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+Motorino::StagingRing::StagingRing()
+    : _device{ VK_NULL_HANDLE },
+      _buffer{ VK_NULL_HANDLE },
+      _memory{ VK_NULL_HANDLE },
+      _timeline{ VK_NULL_HANDLE },
+      _data{ nullptr },
+      _size{ 0 },
+      _head{ 0 },
+      _first_id{ 0 }
+{}
+
+auto Motorino::StagingRing::init(
+    VkDevice device,
+    VkBuffer buffer,
+    VkDeviceMemory memory,
+    std::uint64_t size,
+    VkSemaphore timeline
+) -> bool {
+    _device = device;
+    _buffer = buffer;
+    _memory = memory;
+    _size = size;
+    _timeline = timeline;
+
+    void* data;
+    if (vkMapMemory(_device, _memory, 0, _size, 0, &data) != VK_SUCCESS) {
+        Logger::error("Failed to map staging ring.\n");
+        return false;
+    }
+
+    _data = static_cast<unsigned char*>(data);
+
+    Logger::info("Created {}MiB staging ring.\n", _size >> 20);
+    return true;
+}
+
+auto Motorino::StagingRing::destroy() -> void {
+    if (_memory != VK_NULL_HANDLE) {
+        vkUnmapMemory(_device, _memory);
+    }
+
+    vkDestroyBuffer(_device, _buffer, nullptr);
+    vkFreeMemory(_device, _memory, nullptr);
+
+    _buffer = VK_NULL_HANDLE;
+    _memory = VK_NULL_HANDLE;
+    _data = nullptr;
+}
+
+auto Motorino::StagingRing::allocate(
+    std::uint64_t size,
+    std::uint64_t alignment
+) -> std::optional<StagingAllocation> {
+    if (size == 0 || size + alignment > _size) return std::nullopt;
+
+    for (;;) {
+        std::uint64_t wait_value;
+
+        {
+            std::scoped_lock lock(_mutex);
+            reclaim();
+
+            if (auto allocation = try_allocate(size, alignment)) {
+                return allocation;
+            }
+
+            // Space only frees up in order, so the oldest block is the one to
+            // wait for. One still being written has no value to wait on yet.
+            if (_blocks.empty() || !_blocks.front().released) {
+                Logger::warn("Staging ring full of allocations still being written.\n");
+                return std::nullopt;
+            }
+
+            wait_value = _blocks.front().value;
+        }
+
+        VkSemaphoreWaitInfo wait_info{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &_timeline,
+            .pValues = &wait_value,
+        };
+
+        vkWaitSemaphores(_device, &wait_info, UINT64_MAX);
+    }
+}
+
+auto Motorino::StagingRing::release(
+    const StagingAllocation& allocation,
+    std::uint64_t value
+) -> void {
+    std::scoped_lock lock(_mutex);
+
+    Block& block = _blocks[allocation.id - _first_id];
+    block.value = value;
+    block.released = true;
+}
+
+// Must be called with _mutex held.
+auto Motorino::StagingRing::try_allocate(
+    std::uint64_t size,
+    std::uint64_t alignment
+) -> std::optional<StagingAllocation> {
+    const auto align = [alignment](std::uint64_t offset) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+
+    std::uint64_t begin;
+
+    if (_blocks.empty()) {
+        begin = 0;
+    }
+    else {
+        const std::uint64_t tail = _blocks.front().begin;
+        const bool wrapped = _blocks.back().begin < tail;
+        begin = align(_head);
+
+        if (!wrapped) {
+            // Free space is [head, size) followed by [0, tail).
+            if (begin + size > _size) {
+                begin = 0;
+                if (size > tail) return std::nullopt;
+            }
+        }
+        else if (begin + size > tail) {
+            return std::nullopt;
+        }
+    }
+
+    _blocks.push_back({ begin, begin + size, 0, false });
+    _head = begin + size;
+
+    return StagingAllocation{
+        .data = _data + begin,
+        .offset = begin,
+        .size = size,
+        .id = _first_id + _blocks.size() - 1,
+    };
+}
+
+// Must be called with _mutex held.
+auto Motorino::StagingRing::reclaim() -> void {
+    if (_blocks.empty()) return;
+
+    std::uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(_device, _timeline, &completed);
+
+    while (!_blocks.empty() && _blocks.front().released && _blocks.front().value <= completed) {
+        _blocks.pop_front();
+        ++_first_id;
+    }
+}
@@ -0,0 +1,243 @@
+#include "nkgt/timeline.hpp"
+#include "nkgt/jobs.hpp"
+#include "nkgt/logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <semaphore>
+#include <utility>
+
+Motorino::TimelineWaiter::TimelineWaiter()
+    : _device{ VK_NULL_HANDLE },
+      _wake_semaphore{ VK_NULL_HANDLE },
+      _wake_value{ 0 },
+      _running{ false },
+      _stop{ false }
+{}
+
+Motorino::TimelineWaiter::~TimelineWaiter() {
+    stop();
+}
+
+auto Motorino::TimelineWaiter::start(VkDevice device) -> bool {
+    _device = device;
+
+    VkSemaphoreTypeCreateInfo type_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+
+    VkSemaphoreCreateInfo semaphore_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+    };
+
+    if (vkCreateSemaphore(_device, &semaphore_info, nullptr, &_wake_semaphore) != VK_SUCCESS) {
+        Logger::error("Failed to create timeline wake semaphore.\n");
+        return false;
+    }
+
+    _stop = false;
+    _thread = std::thread([this] { watch(); });
+
+    Logger::info("Started timeline waiter.\n");
+    return true;
+}
+
+auto Motorino::TimelineWaiter::stop() -> void {
+    if (!_thread.joinable()) return;
+
+    {
+        std::scoped_lock lock(_mutex);
+        _stop = true;
+        wake();
+    }
+
+    _condition.notify_one();
+    _thread.join();
+
+    vkDestroySemaphore(_device, _wake_semaphore, nullptr);
+    _wake_semaphore = VK_NULL_HANDLE;
+}
+
+auto Motorino::TimelineWaiter::add(
+    VkSemaphore semaphore,
+    std::uint64_t value,
+    std::function<void()> callback
+) -> bool {
+    {
+        std::scoped_lock lock(_mutex);
+
+        for (const auto& seal : _seals) {
+            if (seal.semaphore == semaphore && value > seal.last_value) return false;
+        }
+
+        _entries.push_back({ semaphore, value, std::move(callback) });
+        wake();
+    }
+
+    _condition.notify_one();
+    return true;
+}
+
+auto Motorino::TimelineWaiter::seal(
+    VkSemaphore semaphore,
+    std::uint64_t last_value
+) -> void {
+    std::scoped_lock lock(_mutex);
+
+    _seals.push_back({ semaphore, last_value });
+
+    std::erase_if(_entries, [&](const Entry& entry) {
+        return entry.semaphore == semaphore && entry.value > last_value;
+    });
+
+    if (_entries.empty() && !_running) _idle.notify_all();
+}
+
+auto Motorino::TimelineWaiter::reached(
+    VkSemaphore semaphore,
+    std::uint64_t value
+) const -> bool {
+    std::uint64_t current = 0;
+    vkGetSemaphoreCounterValue(_device, semaphore, &current);
+    return current >= value;
+}
+
+auto Motorino::TimelineWaiter::wait_idle() -> bool {
+    std::unique_lock lock(_mutex);
+
+    if (_entries.empty() && !_running) return false;
+
+    _idle.wait(lock, [this] { return _entries.empty() && !_running; });
+    return true;
+}
+
+// Must be called with _mutex held.
+auto Motorino::TimelineWaiter::wake() -> void {
+    VkSemaphoreSignalInfo signal_info{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+        .semaphore = _wake_semaphore,
+        .value = ++_wake_value,
+    };
+
+    vkSignalSemaphore(_device, &signal_info);
+}
+
+auto Motorino::TimelineWaiter::watch() -> void {
+    std::vector<VkSemaphore> semaphores;
+    std::vector<std::uint64_t> values;
+    std::vector<std::function<void()>> ready;
+
+    for (;;) {
+        {
+            std::unique_lock lock(_mutex);
+            _condition.wait(lock, [this] { return _stop || !_entries.empty(); });
+
+            if (_stop) return;
+
+            // The wake semaphore is part of the wait so new entries or stop()
+            // interrupt it without polling.
+            semaphores.assign(1, _wake_semaphore);
+            values.assign(1, _wake_value + 1);
+
+            for (const auto& entry : _entries) {
+                semaphores.push_back(entry.semaphore);
+                values.push_back(entry.value);
+            }
+        }
+
+        VkSemaphoreWaitInfo wait_info{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .flags = VK_SEMAPHORE_WAIT_ANY_BIT,
+            .semaphoreCount = static_cast<std::uint32_t>(semaphores.size()),
+            .pSemaphores = semaphores.data(),
+            .pValues = values.data(),
+        };
+
+        if (vkWaitSemaphores(_device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+            Logger::error("Failed to wait on timeline semaphores.\n");
+        }
+
+        {
+            std::scoped_lock lock(_mutex);
+
+            // Entries are kept in registration order so that callbacks for the
+            // same value run in the order they were added.
+            std::erase_if(_entries, [&](Entry& entry) {
+                if (!reached(entry.semaphore, entry.value)) return false;
+
+                ready.push_back(std::move(entry.callback));
+                return true;
+            });
+
+            _running = !ready.empty();
+        }
+
+        for (auto& callback : ready) {
+            callback();
+        }
+
+        ready.clear();
+
+        {
+            std::scoped_lock lock(_mutex);
+            _running = false;
+            if (_entries.empty()) _idle.notify_all();
+        }
+    }
+}
+
+Motorino::TimelineAwaitable::TimelineAwaitable(
+    TimelineWaiter* waiter,
+    JobSystem* jobs,
+    VkSemaphore semaphore,
+    std::uint64_t value
+) : _waiter{ waiter },
+    _jobs{ jobs },
+    _semaphore{ semaphore },
+    _value{ value }
+{}
+
+Motorino::TimelineAwaitable::TimelineAwaitable(
+    TimelineWaiter* waiter,
+    JobSystem* jobs,
+    VkSemaphore semaphore,
+    std::uint64_t value,
+    std::shared_ptr<const std::atomic<bool>> failed
+) : _waiter{ waiter },
+    _jobs{ jobs },
+    _semaphore{ semaphore },
+    _value{ value },
+    _failed{ std::move(failed) }
+{}
+
+auto Motorino::TimelineAwaitable::await_ready() const -> bool {
+    return _semaphore == VK_NULL_HANDLE;
+}
+
+auto Motorino::TimelineAwaitable::await_suspend(std::coroutine_handle<> handle) -> bool {
+    JobSystem* jobs = _jobs;
+
+    const bool added = _waiter->add(_semaphore, _value, [jobs, handle] {
+        jobs->submit([handle] { handle.resume(); });
+    });
+
+    // Resumes right away, failed.
+    if (!added) _semaphore = VK_NULL_HANDLE;
+
+    return added;
+}
+
+auto Motorino::TimelineAwaitable::wait() -> bool {
+    if (_semaphore == VK_NULL_HANDLE) return false;
+
+    // Waiting through the waiter rather than on the semaphore itself also
+    // waits for completion callbacks registered before this one.
+    std::binary_semaphore done{ 0 };
+    if (!_waiter->add(_semaphore, _value, [&done] { done.release(); })) return false;
+    done.acquire();
+
+    return !(_failed && _failed->load());
+}
@@ -0,0 +1,55 @@
+#include "nkgt/triangle_mesh.hpp"
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+auto Motorino::read_triangle_mesh(
+    const Geometry& geometry,
+    std::uint32_t position_offset,
+    std::uint32_t color_offset,
+    std::string_view user,
+    TriangleMesh& mesh
+) -> bool {
+    const bool has_color = color_offset != UINT32_MAX;
+
+    if (geometry.position_stride != 0) {
+        Logger::error("{} needs interleaved vertices.\n", user);
+        return false;
+    }
+
+    if (position_offset + sizeof(Vec3) > geometry.vertex_stride ||
+        (has_color && color_offset + sizeof(Vec3) > geometry.vertex_stride)) {
+        Logger::error("{} vertex attributes lie outside the vertex.\n", user);
+        return false;
+    }
+
+    if (geometry.vertex_count == 0 || geometry.index_count % 3 != 0) {
+        Logger::error("{} needs an indexed triangle list.\n", user);
+        return false;
+    }
+
+    mesh.positions.resize(geometry.vertex_count);
+    mesh.colors.assign(geometry.vertex_count, Vec3{ 1.0f, 1.0f, 1.0f });
+
+    for (std::uint32_t i = 0; i < geometry.vertex_count; ++i) {
+        const unsigned char* vertex = geometry.data + static_cast<std::uint64_t>(i) * geometry.vertex_stride;
+        std::memcpy(mesh.positions[i].data(), vertex + position_offset, sizeof(Vec3));
+        if (has_color) std::memcpy(mesh.colors[i].data(), vertex + color_offset, sizeof(Vec3));
+    }
+
+    mesh.indices.resize(geometry.index_count);
+    std::memcpy(
+        mesh.indices.data(),
+        geometry.data + static_cast<std::uint64_t>(geometry.vertex_count) * geometry.vertex_stride,
+        mesh.indices.size() * sizeof(std::uint16_t)
+    );
+
+    if (std::any_of(mesh.indices.begin(), mesh.indices.end(), [&](std::uint16_t index) { return index >= geometry.vertex_count; })) {
+        Logger::error("{} indices out of range.\n", user);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,217 @@
+#include "nkgt/logger.hpp"
+#include "nkgt/renderer.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+static constexpr std::uint32_t fullscreen_vert_spv[] = {
+#include "fullscreen.vert.spv.h"
+};
+
+static constexpr std::uint32_t visibility_resolve_frag_spv[] = {
+#include "visibility_resolve.frag.spv.h"
+};
+
+static constexpr Motorino::DescriptorType visibility_resolve_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+auto Motorino::Engine::create_visibility() -> bool {
+    bool result = create_draw_pipeline(
+        _device,
+        _render_pass,
+        {
+            .vertex_code = fullscreen_vert_spv,
+            .fragment_code = visibility_resolve_frag_spv,
+            .bindings = visibility_resolve_bindings,
+            .push_constant_size = sizeof(std::uint32_t),
+        },
+        _visibility_resolve_pipeline
+    );
+
+    if (!result) return false;
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_visibility_resolve_pipeline.set_layout,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, &_visibility_set) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate visibility descriptor set.\n");
+        _visibility_set = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return resize_visibility();
+}
+
+auto Motorino::Engine::resize_visibility() -> bool {
+    if (_visibility_set == VK_NULL_HANDLE) return true;
+
+    vkDestroyBuffer(_device, _visibility_frame, nullptr);
+    vkFreeMemory(_device, _visibility_frame_memory, nullptr);
+
+    _visibility_frame = VK_NULL_HANDLE;
+    _visibility_frame_memory = VK_NULL_HANDLE;
+
+    const bool result = create_buffer(
+        static_cast<std::uint64_t>(_width) * _height * sizeof(std::uint64_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _visibility_frame,
+        _visibility_frame_memory
+    );
+
+    if (!result) {
+        _visibility_frame = VK_NULL_HANDLE;
+        _visibility_frame_memory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    const VkDescriptorBufferInfo frame_info{
+        .buffer = _visibility_frame,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _visibility_set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &frame_info,
+    };
+
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return true;
+}
+
+auto Motorino::Engine::destroy_visibility() -> void {
+    if (_visibility_set != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, 1, &_visibility_set);
+        _visibility_set = VK_NULL_HANDLE;
+    }
+
+    vkDestroyBuffer(_device, _visibility_frame, nullptr);
+    vkFreeMemory(_device, _visibility_frame_memory, nullptr);
+
+    _visibility_frame = VK_NULL_HANDLE;
+    _visibility_frame_memory = VK_NULL_HANDLE;
+
+    destroy_draw_pipeline(_device, _visibility_resolve_pipeline);
+}
+
+auto Motorino::Engine::begin_visibility(VkCommandBuffer cmd_buffer) -> void {
+    if (_visibility_drawn) {
+        // Depth tests against what the pass before kept.
+        VkMemoryBarrier rasterized{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &rasterized,
+            0, nullptr,
+            0, nullptr
+        );
+
+        return;
+    }
+
+    // Frames before may still resolve the frame or fog by its depth.
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        0, nullptr
+    );
+
+    vkCmdFillBuffer(cmd_buffer, _visibility_frame, 0, VK_WHOLE_SIZE, 0xffffffffu);
+
+    VkBufferMemoryBarrier cleared{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _visibility_frame,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        1, &cleared,
+        0, nullptr
+    );
+
+    _visibility_drawn = true;
+}
+
+auto Motorino::Engine::draw_visibility(VkCommandBuffer cmd_buffer) -> void {
+    // Unset when neither points nor clusters were rasterized this frame.
+    if (!_visibility_drawn) return;
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _visibility_resolve_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _visibility_resolve_pipeline.layout,
+        0,
+        1,
+        &_visibility_set,
+        0,
+        nullptr
+    );
+
+    const std::uint32_t width = _width;
+    vkCmdPushConstants(
+        cmd_buffer,
+        _visibility_resolve_pipeline.layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(width),
+        &width
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
+}
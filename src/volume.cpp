@@ -0,0 +1,695 @@
+#include "nkgt/logger.hpp"
+#include "nkgt/matrix.hpp"
+#include "nkgt/renderer.hpp"
+#include "nkgt/volume.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static constexpr std::uint32_t fullscreen_vert_spv[] = {
+#include "fullscreen.vert.spv.h"
+};
+
+static constexpr std::uint32_t volume_frag_spv[] = {
+#include "volume.frag.spv.h"
+};
+
+static constexpr Motorino::DescriptorType volume_bindings[] = {
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+    Motorino::DescriptorType::StorageBuffer,
+};
+
+constexpr std::uint32_t not_resident = UINT32_MAX;
+
+constexpr std::uint64_t brick_bytes =
+    static_cast<std::uint64_t>(Motorino::volume_brick_stride) *
+    Motorino::volume_brick_stride *
+    Motorino::volume_brick_stride;
+
+// Bricks being loaded at once. Requests past it wait for later frames.
+constexpr std::uint32_t max_volume_streams = 32;
+
+// Bricks missing from the pool listed per frame, see the Used block of
+// shaders/volume.frag. The ones past it are listed again by later frames.
+constexpr std::uint32_t max_volume_misses = 256;
+
+// Counts of the Used block ahead of the lists.
+constexpr std::uint32_t volume_used_header = 2 + max_volume_misses;
+
+namespace {
+
+struct VolumeConstants {
+    float inverse_view_projection[16];
+    float origin[3];
+    float step;
+    float voxel_size[3];
+    float width;
+    std::uint32_t size[3];
+    float height;
+};
+
+// Mirrors the Transfer block of shaders/volume.frag.
+struct VolumeTransfer {
+    std::uint32_t colors[Motorino::volume_transfer_size];
+    std::uint32_t visible[Motorino::volume_transfer_size + 1];
+};
+
+static_assert(brick_bytes % sizeof(std::uint32_t) == 0);
+
+// The transfer function is written with vkCmdUpdateBuffer.
+static_assert(sizeof(VolumeTransfer) <= 65536);
+
+}
+
+static auto brick_grid(const Motorino::VolumeSettings& settings, std::uint32_t axis) -> std::uint32_t {
+    return (settings.size[axis] + Motorino::volume_brick_size - 1) / Motorino::volume_brick_size;
+}
+
+// Value range as shaders/volume.frag reads it, 255 - min then max, so the
+// all ones entry the table is cleared to is the full range.
+static auto encode_range(std::uint8_t low, std::uint8_t high) -> std::uint32_t {
+    return (255u - low) | (static_cast<std::uint32_t>(high) << 8);
+}
+
+auto Motorino::Engine::create_volume(
+    const VolumeSettings& settings,
+    VolumeLoader loader
+) -> bool {
+    if (!_volume_supported) {
+        Logger::error("Device lacks fragment shader storage writes, volumes are unavailable.\n");
+        return false;
+    }
+
+    if (_volume_pipeline.pipeline != VK_NULL_HANDLE) {
+        Logger::error("Volume already created.\n");
+        return false;
+    }
+
+    if (settings.size[0] == 0 || settings.size[1] == 0 || settings.size[2] == 0 || !loader) {
+        Logger::error("Volumes need a size and a loader.\n");
+        return false;
+    }
+
+    const std::uint64_t brick_count =
+        static_cast<std::uint64_t>(brick_grid(settings, 0)) *
+        brick_grid(settings, 1) *
+        brick_grid(settings, 2);
+
+    if (brick_count > max_volume_bricks) {
+        Logger::error("Volume of {} bricks, at most {} are supported.\n", brick_count, max_volume_bricks);
+        return false;
+    }
+
+    if (settings.pool_bricks == 0 || settings.pool_bricks * brick_bytes > UINT32_MAX) {
+        Logger::error("Volume pools hold 1 to {} bricks.\n", UINT32_MAX / brick_bytes);
+        return false;
+    }
+
+    if (!(settings.step > 0.0f)) {
+        Logger::error("Volume step must be positive.\n");
+        return false;
+    }
+
+    const std::uint64_t request_size = (brick_count + 31) / 32 * sizeof(std::uint32_t);
+
+    // Every resident brick fits, the pool holding each once.
+    const std::uint64_t used_size = (volume_used_header + settings.pool_bricks) * sizeof(std::uint32_t);
+
+    bool result = create_draw_pipeline(
+        _device,
+        _render_pass,
+        {
+            .vertex_code = fullscreen_vert_spv,
+            .fragment_code = volume_frag_spv,
+            .bindings = volume_bindings,
+            .push_constant_size = sizeof(VolumeConstants),
+            .blend = DrawBlend::Premultiplied,
+        },
+        _volume_pipeline
+    ) && create_buffer(
+        request_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _volume_requests,
+        _volume_requests_memory
+    ) && create_buffer(
+        settings.pool_bricks * brick_bytes,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _volume_pool,
+        _volume_pool_memory
+    ) && create_buffer(
+        brick_count * sizeof(VolumeBrick),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _volume_bricks,
+        _volume_bricks_memory
+    ) && create_buffer(
+        sizeof(VolumeTransfer),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _volume_transfer,
+        _volume_transfer_memory
+    );
+
+    for (std::uint32_t i = 0; result && i < max_frames_in_flight; ++i) {
+        result = create_buffer(
+            used_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            _volume_used[i],
+            _volume_used_memory[i]
+        );
+
+        void* data = nullptr;
+
+        if (result && vkMapMemory(_device, _volume_used_memory[i], 0, used_size, 0, &data) != VK_SUCCESS) {
+            Logger::error("Failed to map volume request buffer.\n");
+            result = false;
+        }
+
+        if (result) {
+            _volume_used_lists[i] = static_cast<std::uint32_t*>(data);
+            std::memset(data, 0, used_size);
+        }
+    }
+
+    if (!result) {
+        destroy_volume();
+        return false;
+    }
+
+    VkDescriptorSetLayout set_layouts[max_frames_in_flight];
+    std::fill(std::begin(set_layouts), std::end(set_layouts), _volume_pipeline.set_layout);
+
+    VkDescriptorSetAllocateInfo set_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptor_pool,
+        .descriptorSetCount = max_frames_in_flight,
+        .pSetLayouts = set_layouts,
+    };
+
+    {
+        std::scoped_lock lock(_compute_mutex);
+        result = vkAllocateDescriptorSets(_device, &set_info, _volume_sets) == VK_SUCCESS;
+    }
+
+    if (!result) {
+        Logger::error("Failed to allocate volume descriptor sets.\n");
+        std::fill(std::begin(_volume_sets), std::end(_volume_sets), VK_NULL_HANDLE);
+        destroy_volume();
+        return false;
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        const VkDescriptorBufferInfo buffer_infos[] = {
+            { .buffer = _volume_pool, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _volume_bricks, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _volume_transfer, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _volume_requests, .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = _volume_used[i], .offset = 0, .range = VK_WHOLE_SIZE },
+        };
+
+        VkWriteDescriptorSet write{
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = _volume_sets[i],
+            .dstBinding = 0,
+            .descriptorCount = 5,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = buffer_infos,
+        };
+
+        vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+    _volume_settings = settings;
+    _volume_loader = std::move(loader);
+    _volume_brick_table.assign(brick_count, { not_resident, encode_range(0, 255) });
+    _volume_loading.assign(brick_count, false);
+    _volume_slots.assign(settings.pool_bricks, { not_resident, 0 });
+    _volume_free_slots.resize(settings.pool_bricks);
+    _volume_dirty.clear();
+
+    // Popped from the back, so slots fill from the start of the pool.
+    for (std::uint32_t i = 0; i < settings.pool_bricks; ++i) {
+        _volume_free_slots[i] = settings.pool_bricks - 1 - i;
+    }
+
+    std::fill(std::begin(_volume_colors), std::end(_volume_colors), 0u);
+    _volume_colors_dirty = true;
+    _volume_reset = true;
+    _volume_ready = true;
+
+    return true;
+}
+
+auto Motorino::Engine::set_volume_transfer_function(
+    std::span<const std::uint32_t, volume_transfer_size> colors
+) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    std::copy(colors.begin(), colors.end(), _volume_colors);
+    _volume_colors_dirty = true;
+}
+
+auto Motorino::Engine::set_volume_camera(const VolumeCamera& camera) -> void {
+    std::scoped_lock lock(_draw_mutex);
+    _volume_camera = camera;
+}
+
+auto Motorino::Engine::destroy_volume() -> void {
+    std::uint64_t last_frame;
+
+    {
+        // Bricks being loaded still write the pool, their results are
+        // dropped once the generation changed.
+        std::unique_lock lock(_draw_mutex);
+        _volume_ready = false;
+        ++_volume_generation;
+        _volume_idle.wait(lock, [this] { return _volume_streams == 0; });
+
+        _volume_brick_table.clear();
+        _volume_loading.clear();
+        _volume_slots.clear();
+        _volume_free_slots.clear();
+        _volume_dirty.clear();
+        _volume_loader = nullptr;
+        last_frame = _frame_value.load();
+    }
+
+    if (last_frame > 0 && _volume_pipeline.pipeline != VK_NULL_HANDLE) {
+        TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, last_frame).wait();
+    }
+
+    if (_volume_sets[0] != VK_NULL_HANDLE) {
+        std::scoped_lock lock(_compute_mutex);
+        vkFreeDescriptorSets(_device, _descriptor_pool, max_frames_in_flight, _volume_sets);
+        std::fill(std::begin(_volume_sets), std::end(_volume_sets), VK_NULL_HANDLE);
+    }
+
+    for (std::uint32_t i = 0; i < max_frames_in_flight; ++i) {
+        vkDestroyBuffer(_device, _volume_used[i], nullptr);
+        vkFreeMemory(_device, _volume_used_memory[i], nullptr);
+
+        _volume_used[i] = VK_NULL_HANDLE;
+        _volume_used_memory[i] = VK_NULL_HANDLE;
+        _volume_used_lists[i] = nullptr;
+    }
+
+    vkDestroyBuffer(_device, _volume_requests, nullptr);
+    vkFreeMemory(_device, _volume_requests_memory, nullptr);
+
+    vkDestroyBuffer(_device, _volume_pool, nullptr);
+    vkFreeMemory(_device, _volume_pool_memory, nullptr);
+    vkDestroyBuffer(_device, _volume_bricks, nullptr);
+    vkFreeMemory(_device, _volume_bricks_memory, nullptr);
+    vkDestroyBuffer(_device, _volume_transfer, nullptr);
+    vkFreeMemory(_device, _volume_transfer_memory, nullptr);
+
+    _volume_requests = VK_NULL_HANDLE;
+    _volume_requests_memory = VK_NULL_HANDLE;
+    _volume_pool = VK_NULL_HANDLE;
+    _volume_pool_memory = VK_NULL_HANDLE;
+    _volume_bricks = VK_NULL_HANDLE;
+    _volume_bricks_memory = VK_NULL_HANDLE;
+    _volume_transfer = VK_NULL_HANDLE;
+    _volume_transfer_memory = VK_NULL_HANDLE;
+
+    destroy_draw_pipeline(_device, _volume_pipeline);
+}
+
+auto Motorino::Engine::stream_brick(
+    std::uint32_t brick,
+    std::uint32_t slot,
+    std::uint64_t free_after,
+    std::uint64_t generation
+) -> Task<void> {
+    // Evicted slots are only written once the frames sampling them are done.
+    if (free_after > 0) {
+        co_await TimelineAwaitable(&_waiter, &_jobs, _frame_timeline, free_after);
+    }
+
+    VolumeLoader loader;
+    VolumeSettings settings;
+    bool current;
+
+    {
+        std::scoped_lock lock(_draw_mutex);
+        current = generation == _volume_generation;
+
+        if (current) {
+            loader = _volume_loader;
+            settings = _volume_settings;
+        }
+    }
+
+    std::uint32_t range = 0;
+    std::uint64_t transfer_value = 0;
+
+    if (current) {
+        const std::uint32_t grid_x = brick_grid(settings, 0);
+        const std::uint32_t grid_y = brick_grid(settings, 1);
+        const std::uint32_t coordinates[3] = {
+            brick % grid_x,
+            brick / grid_x % grid_y,
+            brick / (grid_x * grid_y),
+        };
+
+        // The brick and its apron, clamped to the volume. Voxels of the
+        // apron outside of it repeat the border.
+        std::uint32_t origin[3];
+        std::uint32_t extent[3];
+
+        for (std::uint32_t i = 0; i < 3; ++i) {
+            const std::int64_t start = static_cast<std::int64_t>(coordinates[i]) * volume_brick_size - 1;
+            const std::int64_t end = std::min<std::int64_t>(start + volume_brick_stride, settings.size[i]);
+            origin[i] = static_cast<std::uint32_t>(std::max<std::int64_t>(start, 0));
+            extent[i] = static_cast<std::uint32_t>(end - origin[i]);
+        }
+
+        std::vector<std::uint8_t> box(static_cast<std::size_t>(extent[0]) * extent[1] * extent[2]);
+
+        if (!loader(origin, extent, box)) {
+            Logger::warn("Failed to load volume brick {}, left empty.\n", brick);
+            std::fill(box.begin(), box.end(), std::uint8_t{ 0 });
+        }
+
+        if (const auto staging = acquire_staging(brick_bytes)) {
+            std::uint8_t low = 255;
+            std::uint8_t high = 0;
+
+            const auto source = [&](std::uint32_t axis, std::uint32_t i) -> std::uint32_t {
+                const std::int64_t voxel = static_cast<std::int64_t>(coordinates[axis]) * volume_brick_size - 1 + i;
+                const std::int64_t clamped = std::clamp<std::int64_t>(voxel, origin[axis], origin[axis] + extent[axis] - 1);
+                return static_cast<std::uint32_t>(clamped - origin[axis]);
+            };
+
+            std::uint8_t* out = staging->data;
+
+            for (std::uint32_t z = 0; z < volume_brick_stride; ++z) {
+                const std::size_t plane = static_cast<std::size_t>(source(2, z)) * extent[1];
+
+                for (std::uint32_t y = 0; y < volume_brick_stride; ++y) {
+                    const std::uint8_t* row = box.data() + (plane + source(1, y)) * extent[0];
+
+                    for (std::uint32_t x = 0; x < volume_brick_stride; ++x) {
+                        const std::uint8_t value = row[source(0, x)];
+                        low = std::min(low, value);
+                        high = std::max(high, value);
+                        *out++ = value;
+                    }
+                }
+            }
+
+            range = encode_range(low, high);
+            transfer_value = submit_transfer(*staging, _volume_pool, brick_bytes, slot * brick_bytes);
+        }
+    }
+
+    // Published once on the GPU, the next frame uploads the table entry.
+    if (transfer_value != 0) {
+        co_await TimelineAwaitable(&_waiter, &_jobs, _transfer_timeline, transfer_value);
+    }
+
+    std::scoped_lock lock(_draw_mutex);
+
+    if (generation == _volume_generation) {
+        _volume_loading[brick] = false;
+
+        if (transfer_value != 0) {
+            _volume_brick_table[brick] = { slot, range };
+            _volume_slots[slot].last_used = _frame_value.load();
+            _volume_dirty.push_back(brick);
+        }
+        else {
+            _volume_slots[slot].brick = not_resident;
+            _volume_free_slots.push_back(slot);
+        }
+    }
+
+    --_volume_streams;
+    _volume_idle.notify_all();
+}
+
+auto Motorino::Engine::record_volume(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t current_frame
+) -> void {
+    if (!_volume_ready) return;
+
+    // The frame value reserved for the frame being recorded.
+    const std::uint64_t frame = _frame_value.load();
+
+    // The frame last recorded with current_frame completed, so its lists
+    // are final. Resident bricks it asked for are in use, the others are
+    // streamed in. Residency may have changed since the frame was recorded,
+    // so both lists are checked against the table.
+    std::vector<std::uint32_t> wanted;
+    std::uint32_t* used = _volume_used_lists[current_frame];
+
+    const std::uint32_t missing = std::min(used[0], max_volume_misses);
+    const std::uint32_t resident = std::min(used[1], _volume_settings.pool_bricks);
+
+    const auto request = [&](std::uint32_t brick) {
+        const VolumeBrick& entry = _volume_brick_table[brick];
+
+        if (entry.slot != not_resident) {
+            _volume_slots[entry.slot].last_used = frame;
+        }
+        else if (!_volume_loading[brick]) {
+            wanted.push_back(brick);
+        }
+    };
+
+    for (std::uint32_t i = 0; i < resident; ++i) request(used[volume_used_header + i]);
+    for (std::uint32_t i = 0; i < missing; ++i) request(used[2 + i]);
+
+    used[0] = 0;
+    used[1] = 0;
+
+    for (const std::uint32_t brick : wanted) {
+        if (_volume_streams == max_volume_streams) break;
+
+        std::uint32_t slot = not_resident;
+        std::uint64_t free_after = 0;
+
+        if (!_volume_free_slots.empty()) {
+            slot = _volume_free_slots.back();
+            _volume_free_slots.pop_back();
+        }
+        else {
+            // The least recently used resident brick, as long as the frame
+            // read back didn't need it.
+            std::uint64_t oldest = frame;
+
+            for (std::uint32_t i = 0; i < _volume_slots.size(); ++i) {
+                const VolumeSlot& candidate = _volume_slots[i];
+
+                if (candidate.brick == not_resident || candidate.last_used >= oldest) continue;
+                if (_volume_brick_table[candidate.brick].slot != i) continue;
+
+                slot = i;
+                oldest = candidate.last_used;
+            }
+
+            // Every brick is in use, the pool is too small for the view.
+            if (slot == not_resident) break;
+
+            const std::uint32_t evicted = _volume_slots[slot].brick;
+            _volume_brick_table[evicted].slot = not_resident;
+            _volume_dirty.push_back(evicted);
+
+            // This frame no longer samples the slot, earlier ones may.
+            free_after = frame;
+        }
+
+        _volume_slots[slot] = { brick, frame };
+        _volume_loading[brick] = true;
+        ++_volume_streams;
+
+        _jobs.spawn(stream_brick(brick, slot, free_after, _volume_generation));
+    }
+
+    // Frames before may still read the table and the transfer function, and
+    // set request bits.
+    VkMemoryBarrier from_fragment{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1, &from_fragment,
+        0, nullptr,
+        0, nullptr
+    );
+
+    vkCmdFillBuffer(cmd_buffer, _volume_requests, 0, VK_WHOLE_SIZE, 0);
+
+    if (_volume_reset) {
+        vkCmdFillBuffer(cmd_buffer, _volume_bricks, 0, VK_WHOLE_SIZE, 0xffffffffu);
+        _volume_reset = false;
+
+        VkMemoryBarrier fill_barrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+
+        vkCmdPipelineBarrier(
+            cmd_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            1, &fill_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+    }
+
+    if (_volume_colors_dirty) {
+        VolumeTransfer transfer{};
+        std::copy(std::begin(_volume_colors), std::end(_volume_colors), transfer.colors);
+
+        // Empty space skipping checks a brick's value range against these
+        // counts in constant time.
+        for (std::uint32_t i = 0; i < volume_transfer_size; ++i) {
+            transfer.visible[i + 1] = transfer.visible[i] + ((_volume_colors[i] >> 24) != 0 ? 1 : 0);
+        }
+
+        vkCmdUpdateBuffer(cmd_buffer, _volume_transfer, 0, sizeof(transfer), &transfer);
+        _volume_colors_dirty = false;
+    }
+
+    std::sort(_volume_dirty.begin(), _volume_dirty.end());
+    _volume_dirty.erase(std::unique(_volume_dirty.begin(), _volume_dirty.end()), _volume_dirty.end());
+
+    for (const std::uint32_t brick : _volume_dirty) {
+        vkCmdUpdateBuffer(
+            cmd_buffer,
+            _volume_bricks,
+            brick * sizeof(VolumeBrick),
+            sizeof(VolumeBrick),
+            &_volume_brick_table[brick]
+        );
+    }
+
+    _volume_dirty.clear();
+
+    VkMemoryBarrier to_fragment{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        1, &to_fragment,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+auto Motorino::Engine::draw_volume(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t current_frame
+) -> void {
+    if (!_volume_ready) return;
+
+    VolumeConstants constants{
+        .inverse_view_projection = {},
+        .origin = {},
+        .step = _volume_settings.step,
+        .voxel_size = {},
+        .width = static_cast<float>(_width),
+        .size = {},
+        .height = static_cast<float>(_height),
+    };
+
+    if (!invert(_volume_camera.view_projection, constants.inverse_view_projection)) return;
+
+    std::memcpy(constants.origin, _volume_settings.origin, sizeof(constants.origin));
+    std::memcpy(constants.voxel_size, _volume_settings.voxel_size, sizeof(constants.voxel_size));
+    std::memcpy(constants.size, _volume_settings.size, sizeof(constants.size));
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _volume_pipeline.pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd_buffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        _volume_pipeline.layout,
+        0,
+        1,
+        &_volume_sets[current_frame],
+        0,
+        nullptr
+    );
+
+    vkCmdPushConstants(
+        cmd_buffer,
+        _volume_pipeline.layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(constants),
+        &constants
+    );
+
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(_width),
+        .height = static_cast<float>(_height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = {_width, _height}
+    };
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
+}
+
+auto Motorino::Engine::finish_volume(
+    VkCommandBuffer cmd_buffer,
+    std::uint32_t current_frame
+) -> void {
+    if (!_volume_ready) return;
+
+    VkBufferMemoryBarrier to_host{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = _volume_used[current_frame],
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(
+        cmd_buffer,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        1, &to_host,
+        0, nullptr
+    );
+}